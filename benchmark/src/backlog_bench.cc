@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+
+#include "benchmark.h"
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/manager.h"
+#undef protected
+#undef private
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+const int BACKLOG_HOURS = 3 * 365 * 24;
+const int BACKLOG_SELECTED = 20;
+const int BACKLOG_ROUNDS = 10;
+
+string hourlyName(time_t t)
+{/*{{{*/
+    char buf[64];
+    struct tm lt;
+    localtime_r(&t, &lt);
+    strftime(buf, sizeof(buf), "access_log.%Y%m%d%H", &lt);
+    return buf;
+}/*}}}*/
+
+} // namespace
+
+/* Time to find the backlog files of an hourly path pattern in a 
+ * directory holding three years of logs, by globbing every matching 
+ * file as before, and from the cached directory listing. */
+BENCHMARK(BacklogPaths3Years)
+{/*{{{*/
+    const char *name = "BacklogPaths3Years";
+
+    char dir[] = "/tmp/logkafka_bench.backlogXXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        fprintf(stderr, "Fail to create temp dir\n");
+        return;
+    }
+    string d = dir;
+
+    time_t now = time(NULL) / 3600 * 3600;
+    for (int i = BACKLOG_HOURS; i > 0; --i) {
+        std::ofstream((d + "/" + hourlyName(now - i * 3600)).c_str());
+    }
+
+    string path_pattern = d + "/access_log.%Y%m%d%H";
+    string last_path = d + "/" + hourlyName(now - BACKLOG_SELECTED * 3600);
+    string expanded_path = d + "/" + hourlyName(now);
+
+    Config config;
+    Manager *manager = new Manager(&config);
+
+    size_t selected = 0;
+    uint64_t start = Benchmark::nowUs();
+    for (int i = 0; i < BACKLOG_ROUNDS; ++i) {
+        vector<string> globed;
+        manager->getPathPatternGlobed(path_pattern, globed);
+        selected = 0;
+        for (vector<string>::const_iterator iter = globed.begin();
+                iter != globed.end(); ++iter) {
+            if (*iter > last_path && *iter < expanded_path) ++selected;
+        }
+    }
+    Benchmark::report(name, "glob",
+            (Benchmark::nowUs() - start) / 1000.0 / BACKLOG_ROUNDS, "ms");
+    Benchmark::report(name, "glob_selected", selected, "paths");
+
+    start = Benchmark::nowUs();
+    vector<string> paths;
+    manager->getBacklogPaths(path_pattern, last_path, expanded_path, paths);
+    Benchmark::report(name, "index_cold",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+
+    /* as if the directory settled since it was listed */
+    manager->m_dir_cache.m_listings[d].unsettled = false;
+    start = Benchmark::nowUs();
+    for (int i = 0; i < BACKLOG_ROUNDS; ++i) {
+        paths.clear();
+        manager->getBacklogPaths(path_pattern, last_path, expanded_path, paths);
+    }
+    Benchmark::report(name, "index_cached",
+            (double)(Benchmark::nowUs() - start) / BACKLOG_ROUNDS, "us");
+    Benchmark::report(name, "index_selected", paths.size(), "paths");
+
+    delete manager;
+
+    string cmd = "rm -rf " + d;
+    if (0 != system(cmd.c_str())) {
+        fprintf(stderr, "Fail to remove %s\n", d.c_str());
+    }
+}/*}}}*/
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "easylogging/easylogging++.h"
+
+_INITIALIZE_EASYLOGGINGPP
+
+namespace benchmark {
+
+vector<BenchmarkCase> &Benchmark::cases()
+{/*{{{*/
+    /* constructed on first use, benchmarks register themselves
+     * during static initialization */
+    static vector<BenchmarkCase> s_cases;
+    return s_cases;
+}/*}}}*/
+
+bool Benchmark::add(const char *name, BenchmarkFunc func)
+{/*{{{*/
+    BenchmarkCase bc = {name, func};
+    cases().push_back(bc);
+    return true;
+}/*}}}*/
+
+int Benchmark::run(const char *filter)
+{/*{{{*/
+    int count = 0;
+    vector<BenchmarkCase> &bcs = cases();
+    for (vector<BenchmarkCase>::const_iterator iter = bcs.begin();
+            iter != bcs.end(); ++iter) {
+        if (NULL != filter && NULL == strstr(iter->name, filter)) {
+            continue;
+        }
+
+        printf("[ RUN      ] %s\n", iter->name);
+        fflush(stdout);
+        uint64_t start = nowUs();
+        iter->func();
+        printf("[     DONE ] %s (%.3f s)\n", iter->name,
+                (nowUs() - start) / 1000000.0);
+        fflush(stdout);
+        ++count;
+    }
+
+    return count;
+}/*}}}*/
+
+uint64_t Benchmark::nowUs()
+{/*{{{*/
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}/*}}}*/
+
+void Benchmark::report(const char *name, const char *metric,
+        double value, const char *unit)
+{/*{{{*/
+    printf("%s/%s: %.3f %s\n", name, metric, value, unit);
+    fflush(stdout);
+}/*}}}*/
+
+} // namespace benchmark
+
+int main(int argc, char *argv[])
+{/*{{{*/
+    const char *filter = NULL;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (0 == strcmp(argv[i], "-h")) {
+            printf("Usage: %s [-v] [filter]\n", argv[0]);
+            return 0;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    /* logging would dominate the measurements */
+    if (!verbose) {
+        easyloggingpp::Loggers::disableAll();
+    }
+
+    if (0 == benchmark::Benchmark::run(filter)) {
+        fprintf(stderr, "No benchmark matches %s\n",
+                NULL != filter ? filter : "");
+        return 1;
+    }
+
+    return 0;
+}/*}}}*/
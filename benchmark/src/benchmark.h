@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BENCHMARK_BENCHMARK_H_
+#define BENCHMARK_BENCHMARK_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace benchmark {
+
+typedef void (*BenchmarkFunc)();
+
+struct BenchmarkCase
+{
+    const char *name;
+    BenchmarkFunc func;
+};
+
+class Benchmark
+{
+    public:
+        static bool add(const char *name, BenchmarkFunc func);
+
+        /* run all benchmarks whose name contains filter */
+        static int run(const char *filter);
+
+        static uint64_t nowUs();
+        static void report(const char *name, const char *metric,
+                double value, const char *unit);
+
+    private:
+        static vector<BenchmarkCase> &cases();
+};
+
+} // namespace benchmark
+
+/* BENCHMARK(name) { ... } defines and registers a benchmark */
+#define BENCHMARK(name) \
+    static void benchmark_##name(); \
+    static bool benchmark_##name##_added \
+        = ::benchmark::Benchmark::add(#name, benchmark_##name); \
+    static void benchmark_##name()
+
+#endif // BENCHMARK_BENCHMARK_H_
@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "mock_kafka_broker.h"
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/filter_stage.h"
+#include "logkafka/pipeline.h"
+#include "logkafka/producer.h"
+#include "logkafka/zookeeper.h"
+#undef protected
+#undef private
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+const int FILTER_ROUNDS = 2000;
+const int PRODUCE_LINES = 200000;
+const long PRODUCE_MAX_QUEUED = 50000;
+
+/* access log where most lines are load balancer health checks */
+vector<string> makeBatch()
+{/*{{{*/
+    vector<string> lines;
+    for (unsigned long i = 0; i < DEFAULT_BATCHSIZE; ++i) {
+        string path = (i % 10 < 7)? "/health": "/item/" + int2Str(rand());
+        string status = (i % 10 == 9)? "503": "200";
+        lines.push_back("10.0.0." + int2Str(i % 256) 
+            + " - - [01/Jan/2015:00:00:00 +0800] \"GET " + path 
+            + " HTTP/1.1\" " + status + " " + int2Str(rand() % 10000)
+            + " \"-\" \"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\"");
+    }
+    return lines;
+}/*}}}*/
+
+StageConf filterConf(const char *exclude, const char *exclude_regex)
+{/*{{{*/
+    StageConf conf;
+    conf.stage = "filter";
+    if (NULL != exclude) conf.exclude.push_back(exclude);
+    if (NULL != exclude_regex) conf.exclude_regex.push_back(exclude_regex);
+    return conf;
+}/*}}}*/
+
+void runFilter(const char *name, const StageConf &conf, 
+        const vector<string> &batch)
+{/*{{{*/
+    FilterStage filter;
+    if (!filter.init(conf)) {
+        fprintf(stderr, "Fail to init filter %s\n", name);
+        return;
+    }
+
+    uint64_t start = Benchmark::nowUs();
+    size_t kept = 0;
+    for (int i = 0; i < FILTER_ROUNDS; ++i) {
+        for (size_t j = 0; j < batch.size(); ++j) {
+            if (filter.keep(batch[j])) ++kept;
+        }
+    }
+    double ns = (Benchmark::nowUs() - start) * 1000.0;
+    double lines = (double)FILTER_ROUNDS * batch.size();
+
+    Benchmark::report(name, "ns_per_line", ns / lines, "ns");
+    Benchmark::report(name, "kept", 100.0 * kept / lines, "%");
+}/*}}}*/
+
+/* std::string::find, which scans for the first byte of the literal */
+void runFind(const char *name, const string &literal,
+        const vector<string> &batch)
+{/*{{{*/
+    uint64_t start = Benchmark::nowUs();
+    size_t kept = 0;
+    for (int i = 0; i < FILTER_ROUNDS; ++i) {
+        for (size_t j = 0; j < batch.size(); ++j) {
+            if (string::npos == batch[j].find(literal)) ++kept;
+        }
+    }
+    double ns = (Benchmark::nowUs() - start) * 1000.0;
+    double lines = (double)FILTER_ROUNDS * batch.size();
+
+    Benchmark::report(name, "ns_per_line", ns / lines, "ns");
+    Benchmark::report(name, "kept", 100.0 * kept / lines, "%");
+}/*}}}*/
+
+/* seconds to filter, if a pipeline is given, and send PRODUCE_LINES 
+ * lines until every kept one is acknowledged */
+double produce(MockKafkaBroker &broker, const vector<string> &batch, 
+        Pipeline *pipeline)
+{/*{{{*/
+    Zookeeper zookeeper;
+    zookeeper.m_broker_urls = broker.getBrokerUrls();
+    zookeeper.m_broker_urls_version = 1;
+
+    Producer producer;
+    if (!producer.init(zookeeper, "none", 1000000, 3)) {
+        fprintf(stderr, "Fail to init producer\n");
+        return 0;
+    }
+
+    uint64_t start = Benchmark::nowUs();
+    for (int i = 0; i < PRODUCE_LINES; i += batch.size()) {
+        while (producer.m_queue_depth > PRODUCE_MAX_QUEUED) {
+            rd_kafka_poll(producer.m_rk, 1);
+            producer.updateQueueDepth();
+        }
+        /* the tailer hands over a fresh batch each time */
+        vector<string> lines(batch);
+        if (NULL != pipeline) pipeline->process(lines);
+        if (lines.empty()) continue;
+        producer.send(lines, broker.getBrokerUrls(), "bench", "", 
+                1, -1, 30000);
+    }
+    producer.close();
+
+    return (Benchmark::nowUs() - start) / 1000000.0;
+}/*}}}*/
+
+} // namespace
+
+/* FilterStage::keep over access log lines, 70% of them health checks,
+ * excluded by a literal, by several literals, by a regex, and by a 
+ * plain std::string::find for comparison; then the time to send the 
+ * same lines to an in-process mock broker with and without dropping 
+ * health checks first, to weigh the cost of the filter against the 
+ * produce cost it saves. */
+BENCHMARK(FilterStage)
+{/*{{{*/
+    srand(1);
+    vector<string> batch = makeBatch();
+
+    runFilter("FilterStage/literal", filterConf("/health ", NULL), 
+            batch);
+    StageConf literals = filterConf("/health ", NULL);
+    literals.exclude.push_back("/ping ");
+    literals.exclude.push_back("/ready ");
+    literals.exclude.push_back("kube-probe/");
+    runFilter("FilterStage/literals4", literals, batch);
+    runFilter("FilterStage/regex", 
+            filterConf(NULL, "/(health|ping|ready) "), batch);
+    runFind("FilterStage/string_find", "/health ", batch);
+
+    MockKafkaBroker broker;
+    if (!broker.start(0, 4)) {
+        fprintf(stderr, "Fail to start mock kafka broker\n");
+        return;
+    }
+
+    double unfiltered = produce(broker, batch, NULL);
+    Pipeline pipeline;
+    if (!pipeline.init(vector<StageConf>(1, 
+                    filterConf("/health ", NULL)))) {
+        fprintf(stderr, "Fail to init pipeline\n");
+        broker.stop();
+        return;
+    }
+    double filtered = produce(broker, batch, &pipeline);
+    broker.stop();
+
+    Benchmark::report("FilterStage/produce_unfiltered", "lines_per_s", 
+            unfiltered > 0? PRODUCE_LINES / unfiltered: 0, "lines/s");
+    Benchmark::report("FilterStage/produce_filtered", "lines_per_s", 
+            filtered > 0? PRODUCE_LINES / filtered: 0, "lines/s");
+    Benchmark::report("FilterStage/produce_filtered", "dropped", 
+            pipeline.getDropped(0), "lines");
+}/*}}}*/
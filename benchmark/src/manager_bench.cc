@@ -0,0 +1,481 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+#include <uv.h>
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#include "mock_kafka_broker.h"
+#define protected public
+#define private public
+#include "logkafka/manager.h"
+#undef protected
+#undef private
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+const int RECONCILE_PATTERNS = 10000;
+const int RECONCILE_ROUNDS = 100;
+
+/* Defaults of ManagerScale, overridden by environment:
+ *   LOGKAFKA_BENCH_SCALE_TASKS  numbers of tasks, one run for each
+ *   LOGKAFKA_BENCH_IDLE_SECONDS seconds of idle loop for cpu usage */
+const char *DEFAULT_SCALE_TASKS = "1000,10000,50000";
+const long DEFAULT_IDLE_SECONDS = 5;
+const int SCALE_REFRESH_ROUNDS = 10;
+/* fds of the loop, logging, producer and broker besides watchers */
+const long SCALE_RESERVED_FDS = 256;
+
+string taskConfigJson(const string &dir, int patterns, int changed, 
+        const char *sep)
+{/*{{{*/
+    stringstream ss;
+    ss << "{";
+    for (int i = 0; i < patterns; ++i) {
+        if (i > 0) ss << "," << sep;
+        ss << "\"" << dir << "/app" << i << ".log\":" << sep << "{"
+           << "\"valid\":true,"
+           << "\"log_path\":\"" << dir << "/app" << i << ".log\","
+           << "\"follow_last\":true,"
+           << "\"batchsize\":" << (i < changed ? 500 : 200) << ","
+           << "\"topic\":\"topic" << i % 16 << "\","
+           << "\"key\":\"\","
+           << "\"partition\":-1,"
+           << "\"compression_codec\":\"none\","
+           << "\"required_acks\":1,"
+           << "\"message_timeout_ms\":0}";
+    }
+    ss << "}";
+
+    return ss.str();
+}/*}}}*/
+
+void initConfig(Config &config)
+{/*{{{*/
+    config.pos_path = "";
+    config.refresh_interval = DEFAULT_REFRESH_INTERVAL;
+    config.line_max_bytes = DEFAULT_LINE_MAX_BYTES;
+    config.stat_silent_max_ms = DEFAULT_STAT_SILENT_MAX_MS;
+    config.pos_compact_interval = DEFAULT_POS_COMPACT_INTERVAL;
+    config.config_apply_delay = DEFAULT_CONFIG_APPLY_DELAY;
+    config.glob_max_open_files = DEFAULT_GLOB_MAX_OPEN_FILES;
+    config.loop_probe_interval = DEFAULT_LOOP_PROBE_INTERVAL;
+    config.slow_callback_ms = DEFAULT_SLOW_CALLBACK_MS;
+    config.message_send_max_retries = DEFAULT_MESSAGE_SEND_MAX_RETRIES;
+}/*}}}*/
+
+/* Log config held in memory, changed by the benchmark itself */
+class MemoryConfigSource: public ConfigSource
+{
+    public:
+        MemoryConfigSource(const string &broker_urls)
+            : m_broker_urls(broker_urls), m_log_config_version(-1) {};
+
+        void setLogConfig(const string &config)
+        {/*{{{*/
+            m_log_config = config;
+            ++m_log_config_version;
+        }/*}}}*/
+
+        string getLogConfig(int64_t *version = NULL)
+        {/*{{{*/
+            if (NULL != version) *version = m_log_config_version;
+            return m_log_config;
+        }/*}}}*/
+        int64_t getLogConfigVersion() { return m_log_config_version; };
+        void setConfigChangeCallback(ConfigChangeFunc func, void *arg) {};
+
+        string getBrokerUrls(int64_t *version = NULL)
+        {/*{{{*/
+            if (NULL != version) *version = 0;
+            return m_broker_urls;
+        }/*}}}*/
+        int64_t getBrokerUrlsVersion() { return 0; };
+        void setBrokersChangeCallback(ConfigChangeFunc func, void *arg) {};
+
+        bool setLogState(const char *buf, int buflen, long shard,
+                StateCompletionFunc completion, const void *data)
+        {/*{{{*/
+            if (NULL != completion) completion(0, data);
+            return true;
+        }/*}}}*/
+        bool deleteLogState(long shard, 
+                StateCompletionFunc completion, const void *data)
+        {/*{{{*/
+            if (NULL != completion) completion(0, data);
+            return true;
+        }/*}}}*/
+        unsigned long getClientEpoch() { return 1; };
+
+        void close() {};
+
+    private:
+        string m_broker_urls;
+        string m_log_config;
+        int64_t m_log_config_version;
+};
+
+long envLong(const char *name, long default_value)
+{/*{{{*/
+    const char *value = getenv(name);
+    return (NULL != value && '\0' != *value)? atol(value): default_value;
+}/*}}}*/
+
+int64_t processCpuUs()
+{/*{{{*/
+    /* of all threads, stat polling runs in the threadpool */
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (int64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 
+        + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}/*}}}*/
+
+/* resident and virtual bytes of the process */
+void memoryBytes(int64_t &rss, int64_t &vsz)
+{/*{{{*/
+    rss = vsz = 0;
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (NULL == file) return;
+    if (2 == fscanf(file, "%ld %ld", &pages, &resident)) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        rss = (int64_t)resident * page_size;
+        vsz = (int64_t)pages * page_size;
+    }
+    fclose(file);
+}/*}}}*/
+
+long openFds()
+{/*{{{*/
+    DIR *dir = opendir("/proc/self/fd");
+    if (NULL == dir) return -1;
+
+    long count = 0;
+    struct dirent *entry;
+    while (NULL != (entry = readdir(dir))) {
+        if ('.' != entry->d_name[0]) ++count;
+    }
+    closedir(dir);
+
+    /* the one of the listing itself */
+    return count - 1;
+}/*}}}*/
+
+/* soft limit is raised to hard limit, returns the limit */
+long raiseFdLimit()
+{/*{{{*/
+    struct rlimit rl;
+    if (0 != getrlimit(RLIMIT_NOFILE, &rl)) return -1;
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    return (RLIM_INFINITY == rl.rlim_cur)? LONG_MAX: (long)rl.rlim_cur;
+}/*}}}*/
+
+bool createFiles(const string &dir, int count)
+{/*{{{*/
+    for (int i = 0; i < count; ++i) {
+        string path = dir + "/app" + int2Str(i) + ".log";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Fail to create %s\n", path.c_str());
+            return false;
+        }
+        ::close(fd);
+    }
+
+    return true;
+}/*}}}*/
+
+void removeFiles(const string &dir)
+{/*{{{*/
+    string cmd = "rm -rf " + dir;
+    if (0 != system(cmd.c_str())) {
+        fprintf(stderr, "Fail to remove %s\n", dir.c_str());
+    }
+}/*}}}*/
+
+void stopLoop(uv_timer_t *handle)
+{/*{{{*/
+    uv_stop(handle->loop);
+}/*}}}*/
+
+/* one run of ManagerScale with the given number of tasks */
+void runScale(MockKafkaBroker &broker, int tasks, long fd_limit)
+{/*{{{*/
+    string name = "ManagerScale" + int2Str(tasks);
+
+    if (tasks + SCALE_RESERVED_FDS > fd_limit) {
+        fprintf(stderr, "Skip %s, which needs %ld fds while the limit is "
+                "%ld\n", name.c_str(), tasks + SCALE_RESERVED_FDS, fd_limit);
+        return;
+    }
+
+    char dir[] = "/tmp/logkafka_bench.scaleXXXXXX";
+    if (NULL == mkdtemp(dir) || !createFiles(dir, tasks)) {
+        fprintf(stderr, "Fail to create files of %s\n", name.c_str());
+        removeFiles(dir);
+        return;
+    }
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+
+    Config config;
+    initConfig(config);
+    config.pos_path = string(dir) + "/pos";
+    Manager *manager = new Manager(&config);
+    manager->m_loop = &loop;
+    manager->initKafkaConf();
+    OutputKafka::setKafkaConf(manager->m_kafka_conf);
+    MemoryConfigSource *config_source = 
+        new MemoryConfigSource(broker.getBrokerUrls());
+    config_source->setLogConfig(taskConfigJson(dir, tasks, 0, ""));
+    manager->m_config_source = config_source;
+
+    int64_t rss_before, vsz_before, rss_after, vsz_after;
+    memoryBytes(rss_before, vsz_before);
+    long fds_before = openFds();
+
+    /* tasks and watchers set up from the first config, files are 
+     * opened once the loop runs */
+    uint64_t start = Benchmark::nowUs();
+    if (!manager->start()) {
+        fprintf(stderr, "Fail to start manager of %s\n", name.c_str());
+    }
+    uv_run(&loop, UV_RUN_NOWAIT);
+    Benchmark::report(name.c_str(), "start",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+
+    memoryBytes(rss_after, vsz_after);
+    long fds_after = openFds();
+    size_t watchers = manager->m_tails.size();
+    Benchmark::report(name.c_str(), "watchers", watchers, "watchers");
+    Benchmark::report(name.c_str(), "pending", 
+            manager->m_pending_patterns.size(), "tasks");
+    Benchmark::report(name.c_str(), "rss_per_task",
+            (double)(rss_after - rss_before) / tasks, "bytes");
+    Benchmark::report(name.c_str(), "vsz_per_task",
+            (double)(vsz_after - vsz_before) / tasks, "bytes");
+    Benchmark::report(name.c_str(), "fds_per_task",
+            (double)(fds_after - fds_before) / tasks, "fds");
+
+    /* refreshes with nothing changed */
+    start = Benchmark::nowUs();
+    for (int i = 0; i < SCALE_REFRESH_ROUNDS; ++i) {
+        Manager::refreshWatchers(manager);
+    }
+    Benchmark::report(name.c_str(), "refresh_unchanged",
+            (Benchmark::nowUs() - start) / 1000.0 / SCALE_REFRESH_ROUNDS, 
+            "ms");
+
+    /* 1% of tasks changed, their watchers are updated */
+    config_source->setLogConfig(taskConfigJson(dir, tasks, tasks / 100, ""));
+    start = Benchmark::nowUs();
+    Manager::refreshWatchers(manager);
+    Benchmark::report(name.c_str(), "refresh_changed_1pct",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+
+    /* stat polling and timers of every watcher, nothing written */
+    long idle_seconds = envLong("LOGKAFKA_BENCH_IDLE_SECONDS", 
+            DEFAULT_IDLE_SECONDS);
+    uv_timer_t idle_timer;
+    uv_timer_init(&loop, &idle_timer);
+    uv_update_time(&loop);
+    uv_timer_start(&idle_timer, stopLoop, idle_seconds * 1000, 0);
+    int64_t cpu_start = processCpuUs();
+    start = Benchmark::nowUs();
+    uv_run(&loop, UV_RUN_DEFAULT);
+    Benchmark::report(name.c_str(), "idle_cpu",
+            100.0 * (processCpuUs() - cpu_start) 
+            / (Benchmark::nowUs() - start), "%");
+    uv_close((uv_handle_t *)&idle_timer, NULL);
+
+    start = Benchmark::nowUs();
+    manager->stop();
+    uv_run(&loop, UV_RUN_DEFAULT);
+    delete manager;
+    uv_run(&loop, UV_RUN_DEFAULT);
+    Benchmark::report(name.c_str(), "stop",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+
+    uv_loop_close(&loop);
+    removeFiles(dir);
+}/*}}}*/
+
+} // namespace
+
+/* Time to reconcile 10k path patterns with the task confs and tasks
+ * held by Manager: the first load, refreshes that change nothing,
+ * and a refresh changing 1% of the patterns. "full" forgets all
+ * hashes before reconciling, which costs as much as rebuilding every
+ * task conf from scratch. */
+BENCHMARK(ManagerReconcile10k)
+{/*{{{*/
+    const char *name = "ManagerReconcile10k";
+
+    Config config;
+    initConfig(config);
+    Manager *manager = new Manager(&config);
+    Zookeeper *zookeeper = new Zookeeper();
+    manager->m_config_source = zookeeper;
+
+    string json = taskConfigJson("/data/logs", RECONCILE_PATTERNS, 0, "");
+    string json_reformatted = taskConfigJson("/data/logs", 
+            RECONCILE_PATTERNS, 0, "\n  ");
+    string json_changed = taskConfigJson("/data/logs", RECONCILE_PATTERNS,
+            RECONCILE_PATTERNS / 100, "");
+
+    /* first load */
+    uint64_t start = Benchmark::nowUs();
+    TaskConfDiff diff;
+    manager->reconcileTaskConfs(json, diff);
+    manager->refreshTasks(diff);
+    Benchmark::report(name, "initial",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+    Benchmark::report(name, "initial_added", diff.added.size(), "patterns");
+
+    /* config znode version unchanged */
+    zookeeper->m_log_config = json;
+    zookeeper->m_log_config_version = 1;
+    manager->m_log_config_version = 1;
+    start = Benchmark::nowUs();
+    for (int i = 0; i < RECONCILE_ROUNDS; ++i) {
+        TaskConfDiff unchanged;
+        manager->refreshTaskConfs(unchanged);
+        manager->refreshTasks(unchanged);
+    }
+    Benchmark::report(name, "unchanged_version",
+            (double)(Benchmark::nowUs() - start) / RECONCILE_ROUNDS, "us");
+
+    /* new version, same content */
+    start = Benchmark::nowUs();
+    for (int i = 0; i < RECONCILE_ROUNDS; ++i) {
+        TaskConfDiff unchanged;
+        manager->reconcileTaskConfs(json, unchanged);
+        manager->refreshTasks(unchanged);
+    }
+    Benchmark::report(name, "unchanged_content",
+            (double)(Benchmark::nowUs() - start) / RECONCILE_ROUNDS, "us");
+
+    /* same task confs, different formatting */
+    start = Benchmark::nowUs();
+    for (int i = 0; i < RECONCILE_ROUNDS; ++i) {
+        TaskConfDiff unchanged;
+        manager->m_log_config_hash = 0;
+        manager->reconcileTaskConfs(json_reformatted, unchanged);
+        manager->refreshTasks(unchanged);
+    }
+    Benchmark::report(name, "unchanged_task_confs",
+            (Benchmark::nowUs() - start) / 1000.0 / RECONCILE_ROUNDS, "ms");
+
+    /* 1% of patterns changed */
+    start = Benchmark::nowUs();
+    TaskConfDiff changed;
+    manager->reconcileTaskConfs(json_changed, changed);
+    manager->refreshTasks(changed);
+    Benchmark::report(name, "changed_1pct",
+            (Benchmark::nowUs() - start) / 1000.0, "ms");
+    Benchmark::report(name, "changed_1pct_updated",
+            changed.updated.size(), "patterns");
+
+    /* every task conf parsed and compared again */
+    start = Benchmark::nowUs();
+    for (int i = 0; i < RECONCILE_ROUNDS; ++i) {
+        TaskConfDiff full;
+        manager->m_log_config_hash = 0;
+        manager->m_task_conf_hashes.clear();
+        manager->reconcileTaskConfs(json, full);
+        manager->refreshTasks(full);
+    }
+    Benchmark::report(name, "full",
+            (Benchmark::nowUs() - start) / 1000.0 / RECONCILE_ROUNDS, "ms");
+
+    delete manager;
+}/*}}}*/
+
+/* How many log files one instance manages: Manager started with 1k,
+ * 10k and 50k tasks of plain files from an in-memory config source,
+ * producing to a mock broker. Reports time to set up all watchers,
+ * memory and fds each task takes, refreshes with nothing or 1% of
+ * tasks changed, and cpu of the process while the loop is idle, 
+ * which is mostly stat polling. Sizes of the objects behind a task
+ * are reported once, heap they point to is only in rss_per_task, and
+ * vsz_per_task is mostly the line buffer of line_max_bytes. Tasks 
+ * more than the fd limit allows are skipped. */
+BENCHMARK(ManagerScale)
+{/*{{{*/
+    const char *name = "ManagerScale";
+
+    Benchmark::report(name, "sizeof_task", sizeof(Task), "bytes");
+    Benchmark::report(name, "sizeof_tail_watcher", 
+            sizeof(TailWatcher), "bytes");
+    Benchmark::report(name, "sizeof_io_handler", 
+            sizeof(IOHandler), "bytes");
+    Benchmark::report(name, "sizeof_stat_watcher", 
+            sizeof(StatWatcher) + sizeof(uv_fs_poll_t), "bytes");
+    Benchmark::report(name, "sizeof_timer_watcher", 
+            sizeof(TimerWatcher) + sizeof(uv_timer_t), "bytes");
+
+    long fd_limit = raiseFdLimit();
+
+    MockKafkaBroker broker;
+    if (!broker.start()) {
+        fprintf(stderr, "Fail to start mock kafka broker\n");
+        return;
+    }
+
+    const char *tasks = getenv("LOGKAFKA_BENCH_SCALE_TASKS");
+    vector<string> items = explode(NULL != tasks && '\0' != *tasks? 
+            tasks: DEFAULT_SCALE_TASKS, ',');
+    for (vector<string>::const_iterator iter = items.begin();
+            iter != items.end(); ++iter) {
+        int count = atoi(iter->c_str());
+        if (count <= 0) {
+            fprintf(stderr, "Invalid number of tasks %s\n", iter->c_str());
+            continue;
+        }
+        runScale(broker, count, fd_limit);
+    }
+
+    broker.stop();
+}/*}}}*/
@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "benchmark.h"
+#include "mock_stream_server.h"
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/output_file.h"
+#include "logkafka/output_stream.h"
+#undef protected
+#undef private
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+const int OUTPUT_LINES = 2000000;
+const int OUTPUT_LINE_BYTES = 200;
+
+void removeDir(const string &dir)
+{/*{{{*/
+    string cmd = "rm -rf " + dir;
+    if (0 != system(cmd.c_str())) {
+        fprintf(stderr, "Fail to remove %s\n", dir.c_str());
+    }
+}/*}}}*/
+
+/* access log like lines, compressible as real ones */
+vector<string> makeBatch()
+{/*{{{*/
+    vector<string> lines;
+    for (unsigned long i = 0; i < DEFAULT_BATCHSIZE; ++i) {
+        string line = "10.0.0." + int2Str(i % 256) 
+            + " - - [01/Jan/2015:00:00:00 +0800] \"GET /item/" 
+            + int2Str(rand()) + " HTTP/1.1\" 200 " + int2Str(rand() % 10000)
+            + " \"-\" \"Mozilla/5.0\" ";
+        line.resize(OUTPUT_LINE_BYTES, 'x');
+        lines.push_back(line);
+    }
+    return lines;
+}/*}}}*/
+
+void runOutputFile(const char *compression_codec)
+{/*{{{*/
+    string name = string("OutputFile_") + compression_codec;
+
+    char dir[] = "/tmp/logkafka_bench.outputXXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        fprintf(stderr, "Fail to create temp dir\n");
+        return;
+    }
+
+    FileOutputConf conf;
+    conf.path = string(dir) + "/archive";
+    conf.compression_codec = compression_codec;
+    conf.segment_bytes = 0;
+    conf.segment_ms = 0;
+    OutputFile output;
+    if (!output.init(&conf)) {
+        fprintf(stderr, "Fail to init file output\n");
+        removeDir(dir);
+        return;
+    }
+
+    vector<string> batch = makeBatch();
+    int batches = OUTPUT_LINES / batch.size();
+    int failed = 0;
+    uint64_t start = Benchmark::nowUs();
+    for (int i = 0; i < batches; ++i) {
+        if (!output.output(&output, batch, 0)) ++failed;
+    }
+    double seconds = (Benchmark::nowUs() - start) / 1000000.0;
+    double lines = (double)batches * batch.size();
+
+    Benchmark::report(name.c_str(), "lines_per_s", lines / seconds, "lines/s");
+    Benchmark::report(name.c_str(), "mb_per_s", 
+            lines * (OUTPUT_LINE_BYTES + 1) / seconds / 1048576, "MB/s");
+    Benchmark::report(name.c_str(), "bytes_per_line", 
+            (double)output.m_segment_bytes / lines, "bytes");
+    Benchmark::report(name.c_str(), "failed_batches", failed, "batches");
+
+    output.close();
+    removeDir(dir);
+}/*}}}*/
+
+void countPauses(void *arg, bool full)
+{/*{{{*/
+    if (full) ++*reinterpret_cast<int *>(arg);
+}/*}}}*/
+
+void runOutputStream(const char *type)
+{/*{{{*/
+    string name = string("OutputStream_") + type;
+
+    char dir[] = "/tmp/logkafka_bench.streamXXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        fprintf(stderr, "Fail to create temp dir\n");
+        return;
+    }
+
+    MockStreamServer server;
+    bool started = (0 == strcmp(type, "unix"))? 
+        server.startUnix(string(dir) + "/sock"): server.startTcp();
+    if (!started) {
+        fprintf(stderr, "Fail to start %s server\n", type);
+        removeDir(dir);
+        return;
+    }
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+
+    StreamOutputConf conf;
+    conf.address = server.getAddress();
+    OutputStream *output = new OutputStream();
+    int pauses = 0;
+    output->setBackpressureCallback(countPauses, &pauses);
+    if (output->init(&loop, type, conf)) {
+        while (!output->isConnected()) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+
+        vector<string> batch = makeBatch();
+        int batches = OUTPUT_LINES / batch.size();
+        uint64_t start = Benchmark::nowUs();
+        for (int i = 0; i < batches; ++i) {
+            output->output(output, batch, 0);
+            uv_run(&loop, UV_RUN_NOWAIT);
+            /* as a paused tail watcher, nothing is read until drained */
+            while (output->isFull()) {
+                uv_run(&loop, UV_RUN_ONCE);
+            }
+        }
+        while (output->getPendingBytes() > 0) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        double lines = (double)batches * batch.size();
+        server.waitLines((int64_t)lines, 10000);
+        double seconds = (Benchmark::nowUs() - start) / 1000000.0;
+
+        Benchmark::report(name.c_str(), "lines_per_s", lines / seconds, 
+                "lines/s");
+        Benchmark::report(name.c_str(), "mb_per_s", 
+                lines * (OUTPUT_LINE_BYTES + 1) / seconds / 1048576, "MB/s");
+        Benchmark::report(name.c_str(), "pauses", pauses, "times");
+        Benchmark::report(name.c_str(), "lines_lost", 
+                lines - server.getLines(), "lines");
+    } else {
+        fprintf(stderr, "Fail to init %s output\n", type);
+    }
+    delete output;
+
+    uv_run(&loop, UV_RUN_DEFAULT);
+    uv_loop_close(&loop);
+    server.stop();
+    removeDir(dir);
+}/*}}}*/
+
+} // namespace
+
+/* Writing batches of DEFAULT_BATCHSIZE lines to a segment file, the 
+ * sink for archiving locally, without segment rotation. Plain segments
+ * are bounded by write(2), gzip ones by deflate. */
+BENCHMARK(OutputFileWrite)
+{/*{{{*/
+    runOutputFile("none");
+    runOutputFile("gzip");
+}/*}}}*/
+
+/* Writing batches of DEFAULT_BATCHSIZE lines to a local stand-in 
+ * server over a unix socket and over tcp, with the default limit of 
+ * bytes pending before reading would be paused. */
+BENCHMARK(OutputStreamWrite)
+{/*{{{*/
+    runOutputStream("unix");
+    runOutputStream("tcp");
+}/*}}}*/
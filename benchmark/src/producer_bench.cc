@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/metrics.h"
+#include "logkafka/producer.h"
+#include "logkafka/zookeeper.h"
+#undef protected
+#undef private
+#include "mock_kafka_broker.h"
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+const int PRODUCE_MESSAGES = 200000;
+const int PRODUCE_MESSAGE_BYTES = 200;
+/* the default queue.buffering.max.messages is 100000 */
+const long PRODUCE_MAX_QUEUED = 50000;
+
+/* delivery latencies recorded between two collections */
+int64_t deliveryP99(const MetricsValues &before, const MetricsValues &after)
+{/*{{{*/
+    const HistogramValues &b = before.histograms[HISTOGRAM_DELIVERY_US];
+    const HistogramValues &a = after.histograms[HISTOGRAM_DELIVERY_US];
+
+    HistogramValues diff;
+    for (int i = 0; i < HistogramValues::BUCKET_NUM; ++i) {
+        diff.counts[i] = a.counts[i] - b.counts[i];
+    }
+    diff.count = a.count - b.count;
+    diff.sum = a.sum - b.sum;
+
+    return diff.quantile(0.99);
+}/*}}}*/
+
+void produce(const char *name, MockKafkaBroker &broker, 
+        const string &compression_codec, long latency_ms)
+{/*{{{*/
+    Zookeeper zookeeper;
+    zookeeper.m_broker_urls = broker.getBrokerUrls();
+    zookeeper.m_broker_urls_version = 1;
+    broker.setLatency(latency_ms);
+
+    /* hex noise, so that compression has some work to do */
+    unsigned int seed = 1;
+    vector<string> batch;
+    for (unsigned int i = 0; i < DEFAULT_BATCHSIZE; ++i) {
+        string line(PRODUCE_MESSAGE_BYTES, ' ');
+        for (int j = 0; j < PRODUCE_MESSAGE_BYTES; j += 4) {
+            line[j] = "0123456789abcdef"[rand_r(&seed) % 16];
+        }
+        batch.push_back(line);
+    }
+
+    MetricsRegistry &metrics = MetricsRegistry::instance();
+    MetricsValues *before = new MetricsValues();
+    MetricsValues *after = new MetricsValues();
+    metrics.collect(*before);
+    int64_t broker_messages = broker.getMessages();
+    int64_t broker_bytes = broker.getBytes();
+
+    Producer producer;
+    if (!producer.init(zookeeper, compression_codec, 1000000, 3)) {
+        fprintf(stderr, "Fail to init producer\n");
+        delete before; delete after;
+        return;
+    }
+
+    uint64_t start = Benchmark::nowUs();
+    int rejected = 0;
+    for (int i = 0; i < PRODUCE_MESSAGES; i += batch.size()) {
+        /* wait for deliveries as the tailer would, instead of
+         * measuring QUEUE_FULL */
+        while (producer.m_queue_depth > PRODUCE_MAX_QUEUED) {
+            rd_kafka_poll(producer.m_rk, 1);
+            producer.updateQueueDepth();
+        }
+        if (!producer.send(batch, broker.getBrokerUrls(), "bench", "", 
+                    1, -1, 30000)) {
+            ++rejected;
+        }
+    }
+    producer.close();
+    double seconds = (Benchmark::nowUs() - start) / 1000000.0;
+    metrics.collect(*after);
+
+    broker_messages = broker.getMessages() - broker_messages;
+    broker_bytes = broker.getBytes() - broker_bytes;
+    Benchmark::report(name, "messages_per_s", broker_messages / seconds, 
+            "messages/s");
+    Benchmark::report(name, "mb_per_s", 
+            PRODUCE_MESSAGE_BYTES * broker_messages / seconds / 1048576, 
+            "MB/s");
+    Benchmark::report(name, "wire_bytes_per_message", 
+            broker_messages > 0? (double)broker_bytes / broker_messages: 0, 
+            "bytes");
+    Benchmark::report(name, "delivery_p99", 
+            deliveryP99(*before, *after) / 1000.0, "ms");
+    Benchmark::report(name, "rejected_batches", rejected, "batches");
+
+    delete before;
+    delete after;
+}/*}}}*/
+
+} // namespace
+
+/* Producer::send of batches of DEFAULT_BATCHSIZE lines to an in-process
+ * mock broker, until every message is acknowledged, uncompressed, with
+ * gzip (the only codec the mock inflates), and with the broker
+ * answering 5ms late. */
+BENCHMARK(ProducerMockBroker)
+{/*{{{*/
+    MockKafkaBroker broker;
+    if (!broker.start(0, 4)) {
+        fprintf(stderr, "Fail to start mock kafka broker\n");
+        return;
+    }
+
+    produce("ProducerMockBroker/none", broker, "none", 0);
+    produce("ProducerMockBroker/gzip", broker, "gzip", 0);
+    produce("ProducerMockBroker/none_rtt5ms", broker, "none", 5);
+
+    broker.stop();
+}/*}}}*/
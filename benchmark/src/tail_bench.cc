@@ -0,0 +1,594 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+#include <uv.h>
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/memory_position_entry.h"
+#include "logkafka/metrics.h"
+#include "logkafka/tail_watcher.h"
+#undef protected
+#undef private
+
+using namespace logkafka;
+using namespace benchmark;
+
+namespace {
+
+/* Defaults of the synthetic writer, overridden by environment:
+ *   LOGKAFKA_BENCH_LINE_SIZES   size:weight,... bytes per line
+ *   LOGKAFKA_BENCH_RATE         lines per second when tailing live
+ *   LOGKAFKA_BENCH_SECONDS      seconds of writing when tailing live
+ *   LOGKAFKA_BENCH_ROTATE_BYTES bytes written before rotating
+ *   LOGKAFKA_BENCH_BACKLOG_MB   size of the file read from head
+ *   LOGKAFKA_BENCH_STORM_ROTATE_BYTES bytes written before rotating 
+ *                               in rotation storms */
+const char *DEFAULT_LINE_SIZES = "120:80,600:17,4000:3";
+const long DEFAULT_RATE = 50000;
+const long DEFAULT_SECONDS = 5;
+const long DEFAULT_ROTATE_BYTES = 64L << 20;
+const long DEFAULT_STORM_ROTATE_BYTES = 1L << 20;
+const long DEFAULT_BACKLOG_MB = 256;
+
+/* lines start with the write time and sequence number */
+const size_t LINE_HEADER_BYTES = 26;
+const int64_t DRAIN_TIMEOUT_US = 10000000;
+const int64_t CATCH_UP_TIMEOUT_US = 10000000;
+
+enum RotateStyle
+{
+    ROTATE_RENAME,          /* rename to path.N, create path */
+    ROTATE_COPYTRUNCATE,    /* copy to path.N, truncate path */
+    ROTATE_DELETE,          /* delete path, create path */
+    ROTATE_TIME_FORMAT      /* write to the next path.N */
+};
+
+struct LineSize
+{
+    long bytes;
+    long weight;
+};
+
+struct WriterConf
+{
+    vector<LineSize> sizes;
+    long total_weight;
+    long rate;
+    long seconds;
+    long rotate_bytes;
+    RotateStyle rotate_style;
+};
+
+/* shared by the writer thread and the loop thread */
+struct TailBench
+{
+    string path;
+    WriterConf conf;
+    /* lines written before the writer stops, 0 for no limit */
+    int64_t max_lines;
+
+    volatile int64_t lines_written;
+    volatile int64_t bytes_written;
+    volatile int64_t rotations;
+    volatile int64_t lines_received;
+    volatile bool writer_done;
+
+    /* loop thread only */
+    int64_t bytes_received;
+    int64_t lines_out_of_order;
+    int64_t lines_duplicated;
+    int64_t next_seq;
+    vector<bool> seen;
+    Histogram latency;
+
+    uv_loop_t *loop;
+    TailWatcher *tw;
+    MemoryPositionEntry *pe;
+    /* notified every check besides stat polling */
+    bool notify;
+    int64_t files_watched;
+    int64_t writer_done_us;
+    uv_timer_t check_timer;
+};
+
+long envLong(const char *name, long default_value)
+{/*{{{*/
+    const char *value = getenv(name);
+    return (NULL != value && '\0' != *value)? atol(value): default_value;
+}/*}}}*/
+
+bool parseLineSizes(const string &str, WriterConf &conf)
+{/*{{{*/
+    conf.sizes.clear();
+    conf.total_weight = 0;
+
+    vector<string> items = explode(str, ',');
+    for (vector<string>::const_iterator iter = items.begin();
+            iter != items.end(); ++iter) {
+        LineSize ls;
+        if (2 != sscanf(iter->c_str(), "%ld:%ld", &ls.bytes, &ls.weight)
+                || ls.bytes <= (long)LINE_HEADER_BYTES || ls.weight <= 0) {
+            fprintf(stderr, "Invalid line size %s\n", iter->c_str());
+            return false;
+        }
+        conf.sizes.push_back(ls);
+        conf.total_weight += ls.weight;
+    }
+
+    return !conf.sizes.empty();
+}/*}}}*/
+
+bool initWriterConf(WriterConf &conf)
+{/*{{{*/
+    const char *sizes = getenv("LOGKAFKA_BENCH_LINE_SIZES");
+    if (!parseLineSizes(NULL != sizes? sizes: DEFAULT_LINE_SIZES, conf)) {
+        return false;
+    }
+
+    conf.rate = envLong("LOGKAFKA_BENCH_RATE", DEFAULT_RATE);
+    conf.seconds = envLong("LOGKAFKA_BENCH_SECONDS", DEFAULT_SECONDS);
+    conf.rotate_bytes = envLong("LOGKAFKA_BENCH_ROTATE_BYTES", 
+            DEFAULT_ROTATE_BYTES);
+    conf.rotate_style = ROTATE_RENAME;
+
+    return true;
+}/*}}}*/
+
+int64_t cpuUs()
+{/*{{{*/
+    /* of the calling thread, the loop thread, not the writer */
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return (int64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 
+        + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}/*}}}*/
+
+string filePath(const TailBench *bench, int64_t n)
+{/*{{{*/
+    return (ROTATE_TIME_FORMAT == bench->conf.rotate_style)? 
+        bench->path + "." + int2Str(n): bench->path;
+}/*}}}*/
+
+/* rotates the file which is written as the N-th rotation */
+void rotateFile(TailBench *bench, FILE *&file, int64_t n)
+{/*{{{*/
+    string rotated = bench->path + "." + int2Str(n);
+    switch (bench->conf.rotate_style) {
+    case ROTATE_RENAME:
+        fclose(file);
+        rename(bench->path.c_str(), rotated.c_str());
+        file = fopen(bench->path.c_str(), "a");
+        break;
+    case ROTATE_COPYTRUNCATE: {
+        /* lines which are not read before truncating are only in the 
+         * copy, wait for the tail watcher as logkafka is not to blame */
+        int64_t start_us = getMonotonicUs();
+        while (__sync_fetch_and_add(&bench->lines_received, 0) 
+                < bench->lines_written
+                && getMonotonicUs() - start_us < CATCH_UP_TIMEOUT_US) {
+            usleep(100);
+        }
+        string cmd = "cp " + bench->path + " " + rotated;
+        if (0 != system(cmd.c_str()) || 0 != ftruncate(fileno(file), 0)) {
+            fprintf(stderr, "Fail to copytruncate %s\n", bench->path.c_str());
+        }
+        break;
+    }
+    case ROTATE_DELETE:
+        fclose(file);
+        unlink(bench->path.c_str());
+        file = fopen(bench->path.c_str(), "a");
+        break;
+    case ROTATE_TIME_FORMAT:
+        fclose(file);
+        file = fopen(filePath(bench, n).c_str(), "a");
+        break;
+    }
+}/*}}}*/
+
+/* writes lines to path in the manner of a log file, rotating it every
+ * rotate_bytes */
+void writeLines(void *arg)
+{/*{{{*/
+    TailBench *bench = reinterpret_cast<TailBench *>(arg);
+    const WriterConf &conf = bench->conf;
+
+    long max_bytes = 0;
+    for (vector<LineSize>::const_iterator iter = conf.sizes.begin();
+            iter != conf.sizes.end(); ++iter) {
+        max_bytes = max(max_bytes, iter->bytes);
+    }
+    vector<char> line(max_bytes + 1, 'x');
+
+    FILE *file = fopen(filePath(bench, 0).c_str(), "a");
+    if (NULL == file) {
+        fprintf(stderr, "Fail to open %s\n", bench->path.c_str());
+        bench->writer_done = true;
+        return;
+    }
+
+    unsigned int seed = 42;
+    int64_t seq = 0;
+    int64_t file_bytes = getFsize(file);
+    int64_t start_us = getMonotonicUs();
+    int64_t end_us = start_us + (int64_t)conf.seconds * 1000000;
+
+    while (0 == bench->max_lines || seq < bench->max_lines) {
+        int64_t now_us = getMonotonicUs();
+        if (0 == bench->max_lines && now_us >= end_us) break;
+
+        /* lines due by now, written as one chunk every millisecond */
+        int64_t due = (conf.rate > 0)? 
+            (now_us - start_us) * conf.rate / 1000000 + 1: seq + 1000;
+        if (0 != bench->max_lines) due = min(due, bench->max_lines);
+        if (seq >= due) {
+            usleep(1000);
+            continue;
+        }
+
+        int64_t bytes = 0;
+        for (; seq < due; ++seq) {
+            long r = rand_r(&seed) % conf.total_weight;
+            vector<LineSize>::const_iterator iter = conf.sizes.begin();
+            while (r >= iter->weight) r -= (iter++)->weight;
+
+            long len = iter->bytes;
+            snprintf(&line[0], LINE_HEADER_BYTES + 1, "%016llx %08llx ",
+                    (unsigned long long)getMonotonicUs(), 
+                    (unsigned long long)seq);
+            line[LINE_HEADER_BYTES] = 'x';
+            line[len - 1] = '\n';
+            fwrite(&line[0], 1, len, file);
+            line[len - 1] = 'x';
+            bytes += len;
+        }
+        fflush(file);
+        file_bytes += bytes;
+        __sync_fetch_and_add(&bench->bytes_written, bytes);
+        __sync_lock_test_and_set(&bench->lines_written, seq);
+
+        if (conf.rotate_bytes > 0 && file_bytes >= conf.rotate_bytes) {
+            rotateFile(bench, file, bench->rotations + 1);
+            __sync_add_and_fetch(&bench->rotations, 1);
+            if (NULL == file) {
+                fprintf(stderr, "Fail to open %s\n", bench->path.c_str());
+                break;
+            }
+            file_bytes = 0;
+        }
+    }
+
+    if (NULL != file) fclose(file);
+    __sync_synchronize();
+    bench->writer_done = true;
+}/*}}}*/
+
+class MemoryOutput: public Output
+{
+    public:
+        explicit MemoryOutput(TailBench *bench): m_bench(bench) {};
+        virtual bool init(void *arg) { return true; };
+        virtual bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us)
+        {/*{{{*/
+            int64_t now_us = getMonotonicUs();
+            for (vector<string>::const_iterator iter = lines.begin();
+                    iter != lines.end(); ++iter) {
+                const char *s = iter->c_str();
+                char *end = NULL;
+                int64_t written_us = strtoll(s, &end, 16);
+                int64_t seq = strtoll(end, NULL, 16);
+
+                m_bench->latency.record(now_us - written_us);
+                if (seq != m_bench->next_seq) ++m_bench->lines_out_of_order;
+                m_bench->next_seq = seq + 1;
+                m_bench->bytes_received += iter->length() + 1;
+
+                if (seq >= (int64_t)m_bench->seen.size()) {
+                    m_bench->seen.resize(seq * 2 + 1024, false);
+                }
+                if (m_bench->seen[seq]) ++m_bench->lines_duplicated;
+                m_bench->seen[seq] = true;
+            }
+            __sync_add_and_fetch(&m_bench->lines_received, lines.size());
+            return true;
+        };/*}}}*/
+
+    private:
+        TailBench *m_bench;
+};
+
+bool receiveLines(void *output, vector<string> &lines, 
+        int64_t write_time_us)
+{/*{{{*/
+    Output *out = reinterpret_cast<Output *>(output);
+    return out->output(out, lines, write_time_us);
+}/*}}}*/
+
+bool onRotate(void *arg, string path_pattern, string path, 
+        PositionEntry *position_entry)
+{/*{{{*/
+    /* as Manager does, the watcher reads the new file from head and 
+     * drains the rotated one */
+    return true;
+}/*}}}*/
+
+bool setupWatcher(TailBench *bench)
+{/*{{{*/
+    bench->tw = new TailWatcher();
+    bool res = bench->tw->init(bench->loop, bench->path, 
+            filePath(bench, bench->files_watched), 
+            bench->pe, DEFAULT_STAT_SILENT_MAX_MS, true, DEFAULT_BATCHSIZE,
+            DEFAULT_LINE_MAX_BYTES, true, onRotate, bench, receiveLines, 
+            TaskConf(), new MemoryOutput(bench));
+    if (!res) {
+        fprintf(stderr, "Fail to init tail watcher of %s\n", 
+                bench->path.c_str());
+        delete bench->tw; bench->tw = NULL;
+        return false;
+    }
+
+    bench->tw->start();
+    return true;
+}/*}}}*/
+
+void checkDone(uv_timer_t *handle)
+{/*{{{*/
+    TailBench *bench = reinterpret_cast<TailBench *>(handle->data);
+
+    /* as Manager does for time formatted paths, the watcher moves on 
+     * to the next path, draining the last one */
+    while (ROTATE_TIME_FORMAT == bench->conf.rotate_style
+            && bench->files_watched < bench->rotations) {
+        bench->tw->m_unwatched = true;
+        bench->tw->stop(true);
+        delete bench->tw; bench->tw = NULL;
+        ++bench->files_watched;
+        bench->pe->update(INO_NONE, 0);
+        if (!setupWatcher(bench)) break;
+    }
+
+    if (bench->notify && NULL != bench->tw) {
+        TailWatcher::onNotify(bench->tw);
+    }
+
+    if (!bench->writer_done) return;
+
+    int64_t now_us = getMonotonicUs();
+    if (0 == bench->writer_done_us) bench->writer_done_us = now_us;
+
+    if (bench->lines_received < bench->lines_written
+            && now_us - bench->writer_done_us < DRAIN_TIMEOUT_US) {
+        return;
+    }
+
+    uv_timer_stop(&bench->check_timer);
+    uv_stop(bench->loop);
+}/*}}}*/
+
+void initBench(TailBench &bench, const string &path, 
+        const WriterConf &conf, int64_t max_lines)
+{/*{{{*/
+    bench.path = path;
+    bench.conf = conf;
+    bench.max_lines = max_lines;
+    bench.lines_written = 0;
+    bench.bytes_written = 0;
+    bench.rotations = 0;
+    bench.lines_received = 0;
+    bench.writer_done = false;
+    bench.bytes_received = 0;
+    bench.lines_out_of_order = 0;
+    bench.lines_duplicated = 0;
+    bench.next_seq = 0;
+    bench.seen.clear();
+    bench.loop = NULL;
+    bench.tw = NULL;
+    bench.pe = NULL;
+    bench.notify = false;
+    bench.files_watched = 0;
+    bench.writer_done_us = 0;
+}/*}}}*/
+
+/* tails path until the writer is done and every line is received,
+ * lines are written while tailing if with_writer */
+void runTail(const char *name, TailBench &bench, bool with_writer)
+{/*{{{*/
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+    bench.loop = &loop;
+    bench.pe = new MemoryPositionEntry();
+    bench.pe->update(0, 0);
+
+    uv_timer_init(&loop, &bench.check_timer);
+    bench.check_timer.data = &bench;
+    uv_timer_start(&bench.check_timer, checkDone, 10, 10);
+
+    uv_thread_t writer;
+    if (with_writer) {
+        uv_thread_create(&writer, writeLines, &bench);
+    }
+
+    int64_t start_us = getMonotonicUs();
+    int64_t start_cpu_us = cpuUs();
+    if (setupWatcher(&bench)) {
+        uv_run(&loop, UV_RUN_DEFAULT);
+    } else {
+        bench.writer_done = true;
+    }
+    int64_t cpu_us = cpuUs() - start_cpu_us;
+    int64_t elapsed_us = getMonotonicUs() - start_us;
+    if (with_writer) {
+        uv_thread_join(&writer);
+    }
+
+    if (NULL != bench.tw) {
+        bench.tw->stop(true);
+        delete bench.tw; bench.tw = NULL;
+    }
+    uv_close((uv_handle_t *)&bench.check_timer, NULL);
+    uv_run(&loop, UV_RUN_DEFAULT);
+    uv_loop_close(&loop);
+    delete bench.pe; bench.pe = NULL;
+
+    HistogramValues latency;
+    bench.latency.collect(latency);
+    double seconds = elapsed_us / 1000000.0;
+    double mb = bench.bytes_received / 1048576.0;
+
+    Benchmark::report(name, "lines_per_s", bench.lines_received / seconds, 
+            "lines/s");
+    Benchmark::report(name, "mb_per_s", mb / seconds, "MB/s");
+    Benchmark::report(name, "cpu_per_gb", 
+            mb > 0? cpu_us / 1000000.0 / (mb / 1024): 0, "cpu s/GB");
+    /* lines written beforehand wait for tailing to start */
+    if (with_writer) {
+        Benchmark::report(name, "latency_p50", 
+                latency.quantile(0.5) / 1000.0, "ms");
+        Benchmark::report(name, "latency_p99", 
+                latency.quantile(0.99) / 1000.0, "ms");
+    }
+    Benchmark::report(name, "rotations", bench.rotations, "files");
+    Benchmark::report(name, "lines_lost", bench.lines_written 
+            - (bench.lines_received - bench.lines_duplicated), "lines");
+    Benchmark::report(name, "lines_duplicated", 
+            bench.lines_duplicated, "lines");
+    Benchmark::report(name, "lines_out_of_order", 
+            bench.lines_out_of_order, "lines");
+}/*}}}*/
+
+void removeFiles(const string &dir)
+{/*{{{*/
+    string cmd = "rm -rf " + dir;
+    if (0 != system(cmd.c_str())) {
+        fprintf(stderr, "Fail to remove %s\n", dir.c_str());
+    }
+}/*}}}*/
+
+} // namespace
+
+/* Tailing from a synthetic writer into an in-memory output, no kafka
+ * involved. "backlog" reads a file written beforehand from its head,
+ * which shows the cost of reading and splitting lines. "live" tails 
+ * the file while lines are written at a fixed rate and rotated, its 
+ * latency from write to output is bounded by how often watchers are 
+ * notified. CPU is that of the loop thread. */
+BENCHMARK(TailThroughput)
+{/*{{{*/
+    char dir[] = "/tmp/logkafka_bench.tailXXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        fprintf(stderr, "Fail to create temp dir\n");
+        return;
+    }
+
+    WriterConf conf;
+    if (!initWriterConf(conf)) {
+        removeFiles(dir);
+        return;
+    }
+
+    long average_bytes = 0;
+    for (vector<LineSize>::const_iterator iter = conf.sizes.begin();
+            iter != conf.sizes.end(); ++iter) {
+        average_bytes += iter->bytes * iter->weight;
+    }
+    average_bytes /= conf.total_weight;
+
+    /* written before tailing starts, as fast as possible */
+    WriterConf backlog_conf = conf;
+    backlog_conf.rate = 0;
+    backlog_conf.rotate_bytes = 0;
+    int64_t backlog_lines = ((int64_t)envLong("LOGKAFKA_BENCH_BACKLOG_MB", 
+                DEFAULT_BACKLOG_MB) << 20) / average_bytes;
+
+    TailBench *backlog = new TailBench();
+    initBench(*backlog, string(dir) + "/backlog_log", backlog_conf, 
+            backlog_lines);
+    writeLines(backlog);
+    runTail("TailThroughput/backlog", *backlog, false);
+    delete backlog;
+
+    TailBench *live = new TailBench();
+    initBench(*live, string(dir) + "/live_log", conf, 0);
+    runTail("TailThroughput/live", *live, true);
+    delete live;
+
+    removeFiles(dir);
+}/*}}}*/
+
+/* Tailing while the file is rotated every LOGKAFKA_BENCH_STORM_ROTATE_BYTES
+ * in each style, at the live rate. The watcher is notified every 10ms 
+ * besides stat polling, as rotations happening twice between two 
+ * notifications can not be told apart. Lines must be neither lost nor 
+ * duplicated, copytruncate waits for the watcher to catch up before 
+ * truncating, lines not read by then are only in the copy. */
+BENCHMARK(RotationStorm)
+{/*{{{*/
+    char dir[] = "/tmp/logkafka_bench.stormXXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        fprintf(stderr, "Fail to create temp dir\n");
+        return;
+    }
+
+    WriterConf conf;
+    if (!initWriterConf(conf)) {
+        removeFiles(dir);
+        return;
+    }
+    conf.rotate_bytes = envLong("LOGKAFKA_BENCH_STORM_ROTATE_BYTES", 
+            DEFAULT_STORM_ROTATE_BYTES);
+
+    const struct {
+        RotateStyle style;
+        const char *name;
+    } styles[] = {
+        {ROTATE_RENAME, "RotationStorm/rename"},
+        {ROTATE_COPYTRUNCATE, "RotationStorm/copytruncate"},
+        {ROTATE_DELETE, "RotationStorm/delete"},
+        {ROTATE_TIME_FORMAT, "RotationStorm/time_format"},
+    };
+
+    for (size_t i = 0; i < sizeof(styles) / sizeof(styles[0]); ++i) {
+        conf.rotate_style = styles[i].style;
+        TailBench *storm = new TailBench();
+        initBench(*storm, string(dir) + "/storm_log" + int2Str(i), conf, 0);
+        storm->notify = true;
+        runTail(styles[i].name, *storm, true);
+        delete storm;
+    }
+
+    removeFiles(dir);
+}/*}}}*/
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/async_watcher.h"
+
+#include "base/loop_monitor.h"
+
+namespace base {
+
+AsyncWatcher::AsyncWatcher()
+{/*{{{*/
+    m_loop = NULL;
+    m_handle = NULL;
+    m_event_cb_func = NULL;
+    m_event_cb_func_arg = NULL;
+}/*}}}*/
+
+bool AsyncWatcher::init(uv_loop_t *loop, 
+        void *event_cb_func_arg,
+        AsyncFunc event_cb_func)
+{/*{{{*/
+    m_loop = loop;
+    m_event_cb_func_arg = event_cb_func_arg;
+    m_event_cb_func = event_cb_func;
+
+    m_handle = new uv_async_t();
+    int res = uv_async_init(m_loop, m_handle, (uv_async_cb) &cb_func);
+    if (res < 0) {
+        LERROR << "Fail to init async, " << uv_strerror(res);
+        delete m_handle; m_handle = NULL;
+        return false;
+    }
+
+    m_handle->data = this;
+
+    return true;
+}/*}}}*/
+
+void AsyncWatcher::cb_func(uv_async_t *w)
+{/*{{{*/
+    AsyncWatcher *aw = reinterpret_cast<AsyncWatcher *>(w->data);
+    if (NULL == aw->m_event_cb_func)
+        return;
+
+    int64_t begin_us = LoopMonitor::traceBegin();
+    (*aw->m_event_cb_func)(aw->m_event_cb_func_arg);
+    LoopMonitor::traceEnd(begin_us, "async", aw->m_name);
+}/*}}}*/
+
+bool AsyncWatcher::send()
+{/*{{{*/
+    if (NULL == m_handle) return false;
+
+    int res = uv_async_send(m_handle);
+    if (res < 0) {
+        LERROR << "Fail to send async, " << uv_strerror(res);
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+void AsyncWatcher::on_async_close_complete(uv_handle_t* handle)
+{/*{{{*/
+    delete (uv_async_t *)handle;
+}/*}}}*/
+
+void AsyncWatcher::close()
+{/*{{{*/
+    if (NULL == m_handle) return;
+
+    /* an open async handle keeps the loop alive */
+    uv_close((uv_handle_t *)m_handle, on_async_close_complete);
+    m_handle = NULL;
+}/*}}}*/
+
+} // namespace base
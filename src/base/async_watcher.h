@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_ASYNC_WATCHER_H_
+#define BASE_ASYNC_WATCHER_H_
+
+#include <string>
+
+#include "base/common.h"
+
+#include <uv.h>
+#include "easylogging/easylogging++.h"
+
+using namespace std;
+
+namespace base {
+
+typedef void (*AsyncFunc)(void *);
+
+/* Wakes up a loop from other threads. send() is the only function 
+ * which may be called outside the loop thread, several sends before
+ * the loop wakes up are coalesced into one callback. */
+class AsyncWatcher
+{
+    public:
+        AsyncWatcher();
+        bool init(uv_loop_t *loop, 
+                void *event_cb_func_arg,
+                AsyncFunc event_cb_func);
+        bool send();
+        void close();
+
+        /* shown when tracing slow callbacks */
+        void setName(const string &name) { m_name = name; };
+
+    private:
+        string m_name;
+        uv_loop_t *m_loop;
+        uv_async_t *m_handle;
+        AsyncFunc m_event_cb_func;
+        void *m_event_cb_func_arg;
+
+        static void cb_func(uv_async_t *w);
+        static void on_async_close_complete(uv_handle_t* handle);
+};
+
+} // namespace base
+
+#endif // BASE_ASYNC_WATCHER_H_
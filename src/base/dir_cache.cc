@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/dir_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "base/tools.h"
+
+#include "easylogging/easylogging++.h"
+
+namespace base {
+
+/* directories with time format in path come and go */
+const size_t DirCache::MAX_LISTINGS = 1024;
+
+DirCache::DirCache()
+{/*{{{*/
+    m_reads = 0;
+}/*}}}*/
+
+const vector<string> *DirCache::list(const string &dir)
+{/*{{{*/
+    struct stat st;
+    if (0 != stat(dir.c_str(), &st)) {
+        m_listings.erase(dir);
+        return NULL;
+    }
+
+    map<string, DirListing>::iterator iter = m_listings.find(dir);
+    if (iter != m_listings.end()) {
+        DirListing &listing = iter->second;
+        if (!listing.unsettled 
+                && listing.mtime == st.st_mtim.tv_sec
+                && listing.mtime_nsec == st.st_mtim.tv_nsec) {
+            return &listing.names;
+        }
+    }
+
+    if (iter == m_listings.end() && m_listings.size() >= MAX_LISTINGS) {
+        m_listings.clear();
+    }
+
+    DirListing &listing = m_listings[dir];
+    listing.mtime = st.st_mtim.tv_sec;
+    listing.mtime_nsec = st.st_mtim.tv_nsec;
+    listing.unsettled = (time(NULL) <= listing.mtime + 1);
+    if (!readDir(dir, listing)) {
+        m_listings.erase(dir);
+        return NULL;
+    }
+    ++m_reads;
+
+    return &listing.names;
+}/*}}}*/
+
+bool DirCache::exists(const string &path)
+{/*{{{*/
+    string dir, name;
+    if (!splitPath(path, dir, name)) {
+        return false;
+    }
+
+    const vector<string> *names = list(dir);
+    if (NULL == names) {
+        return false;
+    }
+
+    return binary_search(names->begin(), names->end(), name);
+}/*}}}*/
+
+void DirCache::invalidate(const string &dir)
+{/*{{{*/
+    m_listings.erase(dir);
+}/*}}}*/
+
+void DirCache::clear()
+{/*{{{*/
+    m_listings.clear();
+}/*}}}*/
+
+bool DirCache::readDir(const string &dir, DirListing &listing)
+{/*{{{*/
+    DIR *d = opendir(dir.c_str());
+    if (NULL == d) {
+        LERROR << "Fail to open dir " << dir << ", " << strerror(errno);
+        return false;
+    }
+
+    listing.names.clear();
+    struct dirent *entry = NULL;
+    while (NULL != (entry = readdir(d))) {
+        if (0 == strcmp(entry->d_name, ".") 
+                || 0 == strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        listing.names.push_back(entry->d_name);
+    }
+    closedir(d);
+
+    sort(listing.names.begin(), listing.names.end());
+
+    return true;
+}/*}}}*/
+
+} // namespace base
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_DIR_CACHE_H_
+#define BASE_DIR_CACHE_H_
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+
+using namespace std;
+
+namespace base {
+
+struct DirListing
+{
+    time_t mtime;
+    long mtime_nsec;
+
+    /* listed in the same second as the last change of the directory, 
+     * entries created later in that second do not change mtime */
+    bool unsettled;
+
+    /* sorted entry names */
+    vector<string> names;
+};
+
+/* Caches entry names of directories, a directory is read again only 
+ * when its mtime changes, i.e. entries are created, removed or renamed */
+class DirCache
+{
+    public:
+        DirCache();
+
+        /* sorted entry names of dir, NULL if it can not be read */
+        const vector<string> *list(const string &dir);
+        bool exists(const string &path);
+        void invalidate(const string &dir);
+        void clear();
+
+        unsigned long getReads() { return m_reads; };
+
+    private:
+        static bool readDir(const string &dir, DirListing &listing);
+
+    private:
+        map<string, DirListing> m_listings;
+
+        /* number of directories read, not served from cache */
+        unsigned long m_reads;
+
+        static const size_t MAX_LISTINGS;
+};
+
+} // namespace base
+
+#endif // BASE_DIR_CACHE_H_
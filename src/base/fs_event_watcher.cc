@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/fs_event_watcher.h"
+
+namespace base {
+
+FsEventWatcher::FsEventWatcher()
+{/*{{{*/
+    m_loop = NULL;
+    m_handle = NULL;
+    m_event_cb_func = NULL;
+    m_event_cb_func_arg = NULL;
+}/*}}}*/
+
+bool FsEventWatcher::init(uv_loop_t *loop,
+        string path, 
+        void *event_cb_func_arg, 
+        FsEventFunc event_cb_func)
+{/*{{{*/
+    m_loop = loop;
+    m_path = path;
+    m_event_cb_func_arg = event_cb_func_arg;
+    m_event_cb_func = event_cb_func;
+
+    m_handle = new uv_fs_event_t();
+    int res = uv_fs_event_init(m_loop, m_handle);
+    if (res < 0) {
+        LERROR << "Fail to init fs event, " << uv_strerror(res);
+        delete m_handle; m_handle = NULL;
+        return false;
+    }
+
+    m_handle->data = this;
+
+    return start();
+}/*}}}*/
+
+void FsEventWatcher::cb_func(uv_fs_event_t* handle, 
+        const char *filename, 
+        int events, 
+        int status)
+{/*{{{*/
+    FsEventWatcher *fw = reinterpret_cast<FsEventWatcher *>(handle->data);
+
+    if (NULL == fw->m_event_cb_func) {
+        LERROR << "fs event watcher callback function is NULL";
+        return;
+    }
+
+    if (status < 0) {
+        LERROR << "Fs event error on " << fw->m_path 
+               << ", " << uv_strerror(status);
+        filename = NULL;
+    }
+
+    (*fw->m_event_cb_func)(fw->m_event_cb_func_arg, filename, events);
+}/*}}}*/
+
+bool FsEventWatcher::start()
+{/*{{{*/
+    if (NULL == m_handle) return false;
+
+    int res = uv_fs_event_start(m_handle, cb_func, m_path.c_str(), 0);
+    if (res < 0) {
+        LERROR << "Fail to start fs event on " << m_path 
+               << ", " << uv_strerror(res);
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+void FsEventWatcher::stop()
+{/*{{{*/
+    if (NULL == m_handle) return;
+
+    uv_fs_event_stop(m_handle);
+}/*}}}*/
+
+void FsEventWatcher::on_fs_event_close_complete(uv_handle_t* handle)
+{/*{{{*/
+    delete (uv_fs_event_t *)handle;
+}/*}}}*/
+
+void FsEventWatcher::close()
+{/*{{{*/
+    if (NULL == m_handle) return;
+
+    uv_close((uv_handle_t *)m_handle, on_fs_event_close_complete);
+    m_handle = NULL;
+}/*}}}*/
+
+} // namespace base
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_FS_EVENT_WATCHER_H_
+#define BASE_FS_EVENT_WATCHER_H_
+
+#include <string>
+
+#include "base/common.h"
+
+#include <uv.h>
+#include "easylogging/easylogging++.h"
+
+using namespace std;
+
+namespace base {
+
+/* filename is relative to the watched directory, or NULL if the events
+ * overflowed and the directory needs to be scanned again; events is a 
+ * mask of UV_RENAME and UV_CHANGE */
+typedef void (*FsEventFunc)(void *, const char *filename, int events);
+
+/* Watches entries of a directory with uv_fs_event (inotify on linux) */
+class FsEventWatcher
+{
+    public:
+        FsEventWatcher();
+        bool init(uv_loop_t *loop, 
+                string path,
+                void *event_cb_func_arg,
+                FsEventFunc event_cb_func);
+        bool start();
+        void stop();
+        void close();
+
+    private:
+        string m_path;
+        uv_loop_t *m_loop;
+        uv_fs_event_t *m_handle;
+        FsEventFunc m_event_cb_func;
+        void *m_event_cb_func_arg;
+
+        static void cb_func(uv_fs_event_t* handle, 
+                const char *filename, 
+                int events, 
+                int status);
+        static void on_fs_event_close_complete(uv_handle_t* handle);
+};
+
+} // namespace base
+
+#endif // BASE_FS_EVENT_WATCHER_H_
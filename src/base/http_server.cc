@@ -0,0 +1,446 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/http_server.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+namespace base {
+
+const size_t HttpServer::REQUEST_MAX_BYTES = 65536;
+const int HttpServer::LISTEN_BACKLOG = 16;
+
+struct HttpConnection
+{
+    HttpServer *server;
+    uv_stream_t *handle;
+    uv_write_t write_req;
+    string request;
+    string response;
+    /* read buffer, one read at a time */
+    char buf[4096];
+};
+
+HttpServer::HttpServer()
+{/*{{{*/
+    m_loop = NULL;
+    m_handle = NULL;
+    m_handle_func = NULL;
+    m_handle_func_arg = NULL;
+}/*}}}*/
+
+HttpServer::~HttpServer()
+{/*{{{*/
+}/*}}}*/
+
+bool HttpServer::init(uv_loop_t *loop, 
+        const string &address,
+        void *handle_func_arg,
+        HttpHandleFunc handle_func)
+{/*{{{*/
+    m_loop = loop;
+    m_address = address;
+    m_handle_func_arg = handle_func_arg;
+    m_handle_func = handle_func;
+
+    int res = 0;
+    if (isUnixSocket(address)) {
+        uv_pipe_t *pipe = new uv_pipe_t();
+        uv_pipe_init(m_loop, pipe, 0);
+        m_handle = (uv_stream_t *)pipe;
+
+        /* a socket left behind by a previous run is removed, any other
+         * file is not ours to remove */
+        struct stat st;
+        if (0 == lstat(address.c_str(), &st) && !S_ISSOCK(st.st_mode)) {
+            LERROR << "Http address " << address 
+                   << " exists and is not a unix socket";
+            close();
+            return false;
+        }
+        removeSocket(address);
+        res = uv_pipe_bind(pipe, address.c_str());
+    } else {
+        uv_tcp_t *tcp = new uv_tcp_t();
+        uv_tcp_init(m_loop, tcp);
+        m_handle = (uv_stream_t *)tcp;
+
+        struct sockaddr_storage addr;
+        if (!resolveAddress(address, addr)) {
+            LERROR << "Invalid http address " << address;
+            close();
+            return false;
+        }
+        res = uv_tcp_bind(tcp, (const struct sockaddr *)&addr, 0);
+    }
+
+    m_handle->data = this;
+
+    if (res < 0) {
+        LERROR << "Fail to bind http server to " << address
+               << ", " << uv_strerror(res);
+        close();
+        return false;
+    }
+
+    res = uv_listen(m_handle, LISTEN_BACKLOG, onConnection);
+    if (res < 0) {
+        LERROR << "Fail to listen on " << address
+               << ", " << uv_strerror(res);
+        close();
+        return false;
+    }
+
+    LINFO << "Http server listening on " << address;
+
+    return true;
+}/*}}}*/
+
+void HttpServer::close()
+{/*{{{*/
+    set<HttpConnection *> connections = m_connections;
+    for (set<HttpConnection *>::iterator iter = connections.begin();
+            iter != connections.end(); ++iter) {
+        closeConnection(*iter);
+    }
+
+    if (NULL != m_handle) {
+        uv_close((uv_handle_t *)m_handle, onServerClose);
+        m_handle = NULL;
+
+        if (isUnixSocket(m_address)) {
+            removeSocket(m_address);
+        }
+    }
+}/*}}}*/
+
+bool HttpServer::isUnixSocket(const string &address)
+{/*{{{*/
+    return address.find('/') != string::npos;
+}/*}}}*/
+
+bool HttpServer::resolve(const string &address, struct addrinfo **res)
+{/*{{{*/
+    size_t colon = address.rfind(':');
+    if (string::npos == colon || colon + 1 == address.length()) {
+        return false;
+    }
+
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+    if (host.length() >= 2 && '[' == host[0] 
+            && ']' == host[host.length() - 1]) {
+        host = host.substr(1, host.length() - 2);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, res);
+    if (0 != err) {
+        LERROR << "Fail to resolve " << address << ", " << gai_strerror(err);
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+bool HttpServer::resolveAddress(const string &address, 
+        struct sockaddr_storage &addr)
+{/*{{{*/
+    struct addrinfo *res = NULL;
+    if (!resolve(address, &res)) return false;
+
+    memset(&addr, 0, sizeof(addr));
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+
+    return true;
+}/*}}}*/
+
+bool HttpServer::isLoopback(const string &address)
+{/*{{{*/
+    struct addrinfo *res = NULL;
+    if (!resolve(address, &res)) return false;
+
+    bool loopback = true;
+    for (struct addrinfo *ai = res; NULL != ai; ai = ai->ai_next) {
+        if (AF_INET == ai->ai_family) {
+            const struct sockaddr_in *sin = 
+                (const struct sockaddr_in *)ai->ai_addr;
+            /* 127.0.0.0/8 */
+            loopback = loopback 
+                && 127 == (ntohl(sin->sin_addr.s_addr) >> 24);
+        } else if (AF_INET6 == ai->ai_family) {
+            const struct sockaddr_in6 *sin6 = 
+                (const struct sockaddr_in6 *)ai->ai_addr;
+            loopback = loopback && IN6_IS_ADDR_LOOPBACK(&sin6->sin6_addr);
+        } else {
+            loopback = false;
+        }
+    }
+    freeaddrinfo(res);
+
+    return loopback;
+}/*}}}*/
+
+void HttpServer::removeSocket(const string &path)
+{/*{{{*/
+    struct stat st;
+    if (0 == lstat(path.c_str(), &st) && S_ISSOCK(st.st_mode)) {
+        unlink(path.c_str());
+    }
+}/*}}}*/
+
+void HttpServer::onServerClose(uv_handle_t *handle)
+{/*{{{*/
+    if (UV_NAMED_PIPE == handle->type) {
+        delete (uv_pipe_t *)handle;
+    } else {
+        delete (uv_tcp_t *)handle;
+    }
+}/*}}}*/
+
+void HttpServer::onConnection(uv_stream_t *server, int status)
+{/*{{{*/
+    HttpServer *hs = reinterpret_cast<HttpServer *>(server->data);
+
+    if (status < 0) {
+        LERROR << "Http connection error, " << uv_strerror(status);
+        return;
+    }
+
+    HttpConnection *conn = new HttpConnection();
+    conn->server = hs;
+    if (UV_NAMED_PIPE == server->type) {
+        uv_pipe_t *pipe = new uv_pipe_t();
+        uv_pipe_init(hs->m_loop, pipe, 0);
+        conn->handle = (uv_stream_t *)pipe;
+    } else {
+        uv_tcp_t *tcp = new uv_tcp_t();
+        uv_tcp_init(hs->m_loop, tcp);
+        conn->handle = (uv_stream_t *)tcp;
+    }
+    conn->handle->data = conn;
+    hs->m_connections.insert(conn);
+
+    if (0 != uv_accept(server, conn->handle) 
+            || 0 != uv_read_start(conn->handle, onAlloc, onRead)) {
+        hs->closeConnection(conn);
+    }
+}/*}}}*/
+
+void HttpServer::onAlloc(uv_handle_t *handle, 
+        size_t suggested_size, 
+        uv_buf_t *buf)
+{/*{{{*/
+    HttpConnection *conn = reinterpret_cast<HttpConnection *>(handle->data);
+    *buf = uv_buf_init(conn->buf, sizeof(conn->buf));
+}/*}}}*/
+
+void HttpServer::onRead(uv_stream_t *stream, 
+        ssize_t nread, 
+        const uv_buf_t *buf)
+{/*{{{*/
+    HttpConnection *conn = reinterpret_cast<HttpConnection *>(stream->data);
+    HttpServer *hs = conn->server;
+
+    if (nread < 0) {
+        hs->closeConnection(conn);
+        return;
+    }
+
+    conn->request.append(buf->base, nread);
+
+    HttpRequest request;
+    HttpResponse response;
+    bool complete = false;
+    if (conn->request.length() > REQUEST_MAX_BYTES) {
+        response.status = 413;
+    } else if (!parseRequest(conn->request, request, complete)) {
+        response.status = 400;
+    } else if (!complete) {
+        return;
+    } else if (NULL != hs->m_handle_func) {
+        (*hs->m_handle_func)(hs->m_handle_func_arg, request, response);
+    } else {
+        response.status = 404;
+    }
+
+    if (response.status >= 400 && response.body.empty()) {
+        response.body = string(statusText(response.status)) + "\n";
+    }
+
+    uv_read_stop(stream);
+
+    stringstream ss;
+    ss << "HTTP/1.0 " << response.status << " " 
+       << statusText(response.status) << "\r\n"
+       << "Content-Type: " << response.content_type << "\r\n"
+       << "Content-Length: " << response.body.length() << "\r\n"
+       << "Connection: close\r\n\r\n"
+       << response.body;
+    conn->response = ss.str();
+    hs->respond(conn);
+}/*}}}*/
+
+void HttpServer::respond(HttpConnection *conn)
+{/*{{{*/
+    uv_buf_t buf = uv_buf_init((char *)conn->response.data(), 
+            conn->response.length());
+    conn->write_req.data = conn;
+
+    int res = uv_write(&conn->write_req, conn->handle, &buf, 1, onWrite);
+    if (res < 0) {
+        LERROR << "Fail to write http response, " << uv_strerror(res);
+        closeConnection(conn);
+    }
+}/*}}}*/
+
+void HttpServer::onWrite(uv_write_t *req, int status)
+{/*{{{*/
+    HttpConnection *conn = reinterpret_cast<HttpConnection *>(req->data);
+
+    /* closed by server already, the write was cancelled */
+    if (UV_ECANCELED == status) return;
+
+    conn->server->closeConnection(conn);
+}/*}}}*/
+
+void HttpServer::closeConnection(HttpConnection *conn)
+{/*{{{*/
+    if (0 == m_connections.erase(conn)) return;
+
+    uv_close((uv_handle_t *)conn->handle, onConnectionClose);
+}/*}}}*/
+
+void HttpServer::onConnectionClose(uv_handle_t *handle)
+{/*{{{*/
+    HttpConnection *conn = reinterpret_cast<HttpConnection *>(handle->data);
+    onServerClose(handle);
+    delete conn;
+}/*}}}*/
+
+bool HttpServer::parseRequest(const string &data, 
+        HttpRequest &request, 
+        bool &complete)
+{/*{{{*/
+    complete = false;
+
+    size_t header_end = data.find("\r\n\r\n");
+    if (string::npos == header_end) return true;
+
+    size_t line_end = data.find("\r\n");
+    string line = data.substr(0, line_end);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (string::npos == sp1 || string::npos == sp2) return false;
+
+    request.method = line.substr(0, sp1);
+    string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    size_t question = target.find('?');
+    request.path = urlDecode(target.substr(0, question));
+    request.params.clear();
+    if (string::npos != question) {
+        stringstream ss(target.substr(question + 1));
+        string param;
+        while (getline(ss, param, '&')) {
+            if (param.empty()) continue;
+            size_t eq = param.find('=');
+            string key = urlDecode(param.substr(0, eq));
+            string value = (string::npos == eq)? "": 
+                urlDecode(param.substr(eq + 1));
+            request.params[key] = value;
+        }
+    }
+
+    /* headers are case insensitive, only Content-Length matters */
+    size_t content_length = 0;
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t end = data.find("\r\n", pos);
+        string header = data.substr(pos, end - pos);
+        size_t colon = header.find(':');
+        if (string::npos != colon) {
+            string name = header.substr(0, colon);
+            for (size_t i = 0; i < name.length(); ++i) {
+                name[i] = tolower(name[i]);
+            }
+            if ("content-length" == name) {
+                content_length = strtoul(header.c_str() + colon + 1, NULL, 10);
+            }
+        }
+        pos = end + 2;
+    }
+
+    size_t body_start = header_end + 4;
+    if (data.length() - body_start < content_length) return true;
+
+    request.body = data.substr(body_start, content_length);
+    complete = true;
+
+    return true;
+}/*}}}*/
+
+string HttpServer::urlDecode(const string &str)
+{/*{{{*/
+    string res;
+    res.reserve(str.length());
+    for (size_t i = 0; i < str.length(); ++i) {
+        if ('+' == str[i]) {
+            res += ' ';
+        } else if ('%' == str[i] && i + 2 < str.length() 
+                && isxdigit(str[i + 1]) && isxdigit(str[i + 2])) {
+            res += (char)strtol(str.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        } else {
+            res += str[i];
+        }
+    }
+    return res;
+}/*}}}*/
+
+const char *HttpServer::statusText(int status)
+{/*{{{*/
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Request Entity Too Large";
+        case 500: return "Internal Server Error";
+        default: return "Unknown";
+    }
+}/*}}}*/
+
+} // namespace base
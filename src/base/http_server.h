@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_HTTP_SERVER_H_
+#define BASE_HTTP_SERVER_H_
+
+#include <sys/socket.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "base/common.h"
+
+#include <uv.h>
+#include "easylogging/easylogging++.h"
+
+using namespace std;
+
+namespace base {
+
+struct HttpRequest
+{
+    string method;
+    string path;
+    /* decoded query string parameters */
+    map<string, string> params;
+    string body;
+};
+
+struct HttpResponse
+{
+    int status;
+    string content_type;
+    string body;
+
+    HttpResponse(): status(200), content_type("text/plain") {};
+};
+
+typedef void (*HttpHandleFunc)(void *, 
+        const HttpRequest &request, 
+        HttpResponse &response);
+
+struct HttpConnection;
+
+/* Minimal HTTP/1.0 server on a uv loop, one request per connection.
+ * Requests are handled in the loop thread, so handlers may touch what
+ * the loop thread owns without locks */
+class HttpServer
+{
+    public:
+        HttpServer();
+        ~HttpServer();
+
+        /* address is host:port, [host]:port for ipv6, or the path of 
+         * a unix socket */
+        bool init(uv_loop_t *loop, 
+                const string &address,
+                void *handle_func_arg,
+                HttpHandleFunc handle_func);
+        void close();
+
+        static bool isUnixSocket(const string &address);
+        /* resolves the host of host:port, the first address is taken */
+        static bool resolveAddress(const string &address, 
+                struct sockaddr_storage &addr);
+        /* true if every address the host resolves to is a loopback one */
+        static bool isLoopback(const string &address);
+        static bool parseRequest(const string &data, 
+                HttpRequest &request, 
+                bool &complete);
+        static string urlDecode(const string &str);
+        static const char *statusText(int status);
+
+    private:
+        static void onConnection(uv_stream_t *server, int status);
+        static void onAlloc(uv_handle_t *handle, 
+                size_t suggested_size, 
+                uv_buf_t *buf);
+        static void onRead(uv_stream_t *stream, 
+                ssize_t nread, 
+                const uv_buf_t *buf);
+        static void onWrite(uv_write_t *req, int status);
+        static void onConnectionClose(uv_handle_t *handle);
+        static void onServerClose(uv_handle_t *handle);
+        static bool resolve(const string &address, struct addrinfo **res);
+        /* unlinks path only if it is a unix socket */
+        static void removeSocket(const string &path);
+
+        void respond(HttpConnection *conn);
+        void closeConnection(HttpConnection *conn);
+
+    private:
+        uv_loop_t *m_loop;
+        string m_address;
+        uv_stream_t *m_handle;
+        HttpHandleFunc m_handle_func;
+        void *m_handle_func_arg;
+        set<HttpConnection *> m_connections;
+
+        static const size_t REQUEST_MAX_BYTES;
+        static const int LISTEN_BACKLOG;
+};
+
+} // namespace base
+
+#endif // BASE_HTTP_SERVER_H_
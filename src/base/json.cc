@@ -31,6 +31,9 @@ static const char* kJsonTypeNames[]
     = { "Null", "False", "True", "Object", "Array", "String", "Number" };
 const char** Json::TypeNames = kJsonTypeNames;
 
+const uint64_t Json::FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t Json::FNV_PRIME = 1099511628211ULL;
+
 void Json::getValue(const rapidjson::Value &obj, const char *name, int32_t &value)
 {/*{{{*/
     if (NULL == name) {
@@ -169,6 +172,30 @@ void Json::getValue(const rapidjson::Value &obj, const char *name, bool &value)
     }
 }/*}}}*/
 
+void Json::getValue(const rapidjson::Value &obj, const char *name, double &value)
+{/*{{{*/
+    if (NULL == name) {
+        throw JsonErr("name is NULL");
+    }
+
+    if (!obj.IsObject()) {
+        throw JsonErr("obj is not a valid json object");
+    }
+
+    Value::ConstMemberIterator itr = obj.FindMember(name);
+    if (itr != obj.MemberEnd()) {
+        const Value &v = itr->value;
+        /* integers too, e.g. 1 for 1.0 */
+        if (v.IsNumber()) {
+            value = v.GetDouble();
+        } else {
+            throw JsonErr("the value of " + string(name) + " is not number");
+        }
+    } else {
+        throw JsonErr("json object do not have name (" + string(name) + ")");
+    }
+}/*}}}*/
+
 string Json::serialize(const Value &v)
 {/*{{{*/
     StringBuffer buffer;
@@ -178,4 +205,58 @@ string Json::serialize(const Value &v)
     return string(json);
 }/*}}}*/
 
+uint64_t Json::hash(const Value &v, uint64_t seed)
+{/*{{{*/
+    unsigned char type = (unsigned char)v.GetType();
+    uint64_t h = hashBytes(&type, sizeof(type), seed);
+
+    switch (v.GetType()) {
+        case kObjectType:
+            for (Value::ConstMemberIterator itr = v.MemberBegin();
+                    itr != v.MemberEnd(); ++itr) {
+                h = hash(itr->name, h);
+                h = hash(itr->value, h);
+            }
+            break;
+        case kArrayType:
+            for (Value::ConstValueIterator itr = v.Begin();
+                    itr != v.End(); ++itr) {
+                h = hash(*itr, h);
+            }
+            break;
+        case kStringType:
+            h = hashBytes(v.GetString(), v.GetStringLength(), h);
+            break;
+        case kNumberType:
+            if (v.IsDouble()) {
+                double d = v.GetDouble();
+                h = hashBytes(&d, sizeof(d), h);
+            } else if (v.IsInt64()) {
+                int64_t i = v.GetInt64();
+                h = hashBytes(&i, sizeof(i), h);
+            } else {
+                uint64_t u = v.GetUint64();
+                h = hashBytes(&u, sizeof(u), h);
+            }
+            break;
+        default:
+            /* null, false and true are fully described by the type */
+            break;
+    }
+
+    return h;
+}/*}}}*/
+
+uint64_t Json::hashBytes(const void *data, size_t len, uint64_t seed)
+{/*{{{*/
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+
+    return h;
+}/*}}}*/
+
 } // namespace base 
@@ -23,6 +23,7 @@
 #define BASE_JSON_H_
 
 #include <cstdio>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -47,9 +48,20 @@ class Json {
     static void getValue(const rapidjson::Value &obj, const char *name, uint64_t &value);
     static void getValue(const rapidjson::Value &obj, const char *name, string &value);
     static void getValue(const rapidjson::Value &obj, const char *name, bool &value);
+    static void getValue(const rapidjson::Value &obj, const char *name, double &value);
     static string serialize(const Value &v);
 
+    /* 64-bit FNV-1a hash of the value's structure and content, so that
+     * unchanged parts of a document can be recognized without 
+     * interpreting them again */
+    static uint64_t hash(const Value &v, uint64_t seed = FNV_OFFSET_BASIS);
+    static uint64_t hashBytes(const void *data, size_t len, 
+            uint64_t seed = FNV_OFFSET_BASIS);
+
     static const char** TypeNames;
+
+    static const uint64_t FNV_OFFSET_BASIS;
+    static const uint64_t FNV_PRIME;
 };
 
 } // namespace base 
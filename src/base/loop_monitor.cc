@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/loop_monitor.h"
+
+#include "base/tools.h"
+
+namespace base {
+
+CallbackTraceFunc LoopMonitor::s_trace_func = NULL;
+int64_t LoopMonitor::s_slow_callback_us = 0;
+
+LoopMonitor::LoopMonitor()
+{/*{{{*/
+    m_loop = NULL;
+    m_handle = NULL;
+    m_interval = 0;
+    m_last_us = 0;
+    m_lag_cb_func = NULL;
+    m_lag_cb_func_arg = NULL;
+}/*}}}*/
+
+bool LoopMonitor::init(uv_loop_t *loop, 
+        long interval,
+        void *lag_cb_func_arg,
+        LoopLagFunc lag_cb_func)
+{/*{{{*/
+    m_loop = loop;
+    m_interval = interval;
+    m_lag_cb_func_arg = lag_cb_func_arg;
+    m_lag_cb_func = lag_cb_func;
+
+    m_handle = new uv_timer_t();
+    int res = uv_timer_init(m_loop, m_handle);
+    if (res < 0) {
+        LERROR << "Fail to init loop monitor timer, " << uv_strerror(res);
+        delete m_handle; m_handle = NULL;
+        return false;
+    }
+
+    m_handle->data = this;
+    m_last_us = getMonotonicUs();
+
+    res = uv_timer_start(m_handle, cb_func, m_interval, m_interval);
+    if (res < 0) {
+        LERROR << "Fail to start loop monitor timer, " << uv_strerror(res);
+        close();
+        return false;
+    }
+
+    /* the probe alone should not keep the loop running */
+    uv_unref((uv_handle_t *)m_handle);
+
+    return true;
+}/*}}}*/
+
+void LoopMonitor::cb_func(uv_timer_t *w)
+{/*{{{*/
+    LoopMonitor *lm = reinterpret_cast<LoopMonitor *>(w->data);
+
+    int64_t now_us = getMonotonicUs();
+    int64_t lag_us = now_us - lm->m_last_us - lm->m_interval * 1000;
+    lm->m_last_us = now_us;
+    if (lag_us < 0) lag_us = 0;
+
+    if (NULL != lm->m_lag_cb_func) {
+        (*lm->m_lag_cb_func)(lm->m_lag_cb_func_arg, lag_us);
+    }
+}/*}}}*/
+
+void LoopMonitor::on_timer_close_complete(uv_handle_t* handle)
+{/*{{{*/
+    delete (uv_timer_t *)handle;
+}/*}}}*/
+
+void LoopMonitor::close()
+{/*{{{*/
+    if (NULL == m_handle) return;
+
+    uv_timer_stop(m_handle);
+    uv_close((uv_handle_t *)m_handle, on_timer_close_complete);
+    m_handle = NULL;
+}/*}}}*/
+
+void LoopMonitor::setCallbackTracer(long slow_callback_ms,
+        CallbackTraceFunc func)
+{/*{{{*/
+    s_slow_callback_us = (int64_t)slow_callback_ms * 1000;
+    s_trace_func = func;
+    __sync_synchronize();
+}/*}}}*/
+
+int64_t LoopMonitor::traceBegin()
+{/*{{{*/
+    if (NULL == s_trace_func) return 0;
+
+    return getMonotonicUs();
+}/*}}}*/
+
+void LoopMonitor::traceEnd(int64_t begin_us, 
+        const char *kind, 
+        const string &name)
+{/*{{{*/
+    if (0 == begin_us || NULL == s_trace_func) return;
+
+    int64_t duration_us = getMonotonicUs() - begin_us;
+    bool slow = duration_us >= s_slow_callback_us;
+    if (slow) {
+        LWARNING << "Slow " << kind << " callback of " 
+                 << (name.empty() ? "unnamed watcher" : name)
+                 << ", " << duration_us / 1000 << " ms";
+    }
+
+    (*s_trace_func)(kind, name, duration_us, slow);
+}/*}}}*/
+
+} // namespace base
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_LOOP_MONITOR_H_
+#define BASE_LOOP_MONITOR_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "base/common.h"
+
+#include <uv.h>
+#include "easylogging/easylogging++.h"
+
+using namespace std;
+
+namespace base {
+
+typedef void (*LoopLagFunc)(void *arg, int64_t lag_us);
+
+/* called with the duration of every traced callback, from the thread
+ * running the callback */
+typedef void (*CallbackTraceFunc)(const char *kind, 
+        const string &name, 
+        int64_t duration_us, 
+        bool slow);
+
+/* All watchers of a loop share one thread, a callback which blocks
+ * delays every other one. A repeating probe timer measures how late
+ * the loop runs it, which is how long the loop was blocked, and 
+ * watchers call traceBegin()/traceEnd() around their callbacks so
+ * stalls can be attributed to them. */
+class LoopMonitor
+{
+    public:
+        LoopMonitor();
+
+        /* interval in milliseconds */
+        bool init(uv_loop_t *loop, 
+                long interval,
+                void *lag_cb_func_arg,
+                LoopLagFunc lag_cb_func);
+        void close();
+
+        /* Callbacks taking at least slow_callback_ms are logged. Set
+         * it before starting other threads running loops, tracing is
+         * skipped until a tracer is set. */
+        static void setCallbackTracer(long slow_callback_ms,
+                CallbackTraceFunc func);
+
+        /* 0 if tracing is off */
+        static int64_t traceBegin();
+        static void traceEnd(int64_t begin_us, 
+                const char *kind, 
+                const string &name);
+
+    private:
+        uv_loop_t *m_loop;
+        uv_timer_t *m_handle;
+        long m_interval;
+        int64_t m_last_us;
+        LoopLagFunc m_lag_cb_func;
+        void *m_lag_cb_func_arg;
+
+        static CallbackTraceFunc s_trace_func;
+        static int64_t s_slow_callback_us;
+
+        static void cb_func(uv_timer_t *w);
+        static void on_timer_close_complete(uv_handle_t* handle);
+};
+
+} // namespace base
+
+#endif // BASE_LOOP_MONITOR_H_
@@ -21,6 +21,8 @@
 ///////////////////////////////////////////////////////////////////////////
 #include "base/stat_watcher.h"
 
+#include "base/loop_monitor.h"
+
 namespace base {
 
 bool StatWatcher::init(uv_loop_t *loop,
@@ -64,7 +66,9 @@ void StatWatcher::cb_func(uv_fs_poll_t* handle,
         return;
     }
 
+    int64_t begin_us = LoopMonitor::traceBegin();
     (*sw->m_event_cb_func)(sw->m_event_cb_func_arg);
+    LoopMonitor::traceEnd(begin_us, "stat", sw->m_name);
 }/*}}}*/
 
 void StatWatcher::stop()
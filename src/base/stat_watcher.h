@@ -53,7 +53,12 @@ class StatWatcher
         void start();
         void stop();
         void close();
+
+        /* shown when tracing slow callbacks */
+        void setName(const string &name) { m_name = name; };
+
     private:
+        string m_name;
         string m_path;
         uv_loop_t *m_loop;
         uv_fs_poll_t *m_handle;
@@ -0,0 +1,194 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "base/time_format.h"
+
+#include <ctype.h>
+#include <string.h>
+
+namespace base {
+
+TimeFormat::TimeFormat()
+{/*{{{*/
+    m_ordered = false;
+}/*}}}*/
+
+bool TimeFormat::init(const string &format)
+{/*{{{*/
+    m_tokens.clear();
+    m_prefix = "";
+
+    for (size_t i = 0; i < format.length(); ++i) {
+        if (format[i] != '%') {
+            addLiteral(string(1, format[i]));
+            continue;
+        }
+
+        if (++i == format.length()) {
+            return false;
+        }
+
+        switch (format[i]) {
+            case 'Y': addField('Y', 4); break;
+            case 'j': addField('j', 3); break;
+            case 'y': case 'm': case 'd': 
+            case 'H': case 'M': case 'S': 
+                addField(format[i], 2); 
+                break;
+            case 'F': 
+                addField('Y', 4); addLiteral("-"); 
+                addField('m', 2); addLiteral("-"); 
+                addField('d', 2);
+                break;
+            case 'T': 
+                addField('H', 2); addLiteral(":"); 
+                addField('M', 2); addLiteral(":"); 
+                addField('S', 2);
+                break;
+            case '%': addLiteral("%"); break;
+            default: return false;
+        }
+    }
+
+    /* fixed width fields from the most significant to the least one */
+    m_ordered = true;
+    int last_rank = -1;
+    for (vector<TimeFormatToken>::const_iterator iter = m_tokens.begin();
+            iter != m_tokens.end(); ++iter) {
+        if (0 == iter->spec) continue;
+
+        int rank = getRank(iter->spec);
+        if (rank <= last_rank) {
+            m_ordered = false;
+        }
+        last_rank = rank;
+    }
+
+    if (!m_tokens.empty() && 0 == m_tokens[0].spec) {
+        m_prefix = m_tokens[0].literal;
+    }
+
+    return true;
+}/*}}}*/
+
+void TimeFormat::addField(char spec, int width)
+{/*{{{*/
+    TimeFormatToken token = {spec, width, ""};
+    m_tokens.push_back(token);
+}/*}}}*/
+
+void TimeFormat::addLiteral(const string &literal)
+{/*{{{*/
+    if (!m_tokens.empty() && 0 == m_tokens.back().spec) {
+        m_tokens.back().literal.append(literal);
+        return;
+    }
+
+    TimeFormatToken token = {0, 0, literal};
+    m_tokens.push_back(token);
+}/*}}}*/
+
+int TimeFormat::getRank(char spec)
+{/*{{{*/
+    switch (spec) {
+        case 'Y': case 'y': return 0;
+        case 'm': case 'j': return 1;
+        case 'd': return 2;
+        case 'H': return 3;
+        case 'M': return 4;
+        case 'S': return 5;
+        default: return 6;
+    }
+}/*}}}*/
+
+bool TimeFormat::parse(const string &str, time_t &t) const
+{/*{{{*/
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 70;
+    tm.tm_mday = 1;
+
+    size_t pos = 0;
+    for (vector<TimeFormatToken>::const_iterator iter = m_tokens.begin();
+            iter != m_tokens.end(); ++iter) {
+        if (0 == iter->spec) {
+            if (0 != str.compare(pos, iter->literal.length(), iter->literal)) {
+                return false;
+            }
+            pos += iter->literal.length();
+            continue;
+        }
+
+        if (pos + iter->width > str.length()) {
+            return false;
+        }
+
+        int value = 0;
+        for (int i = 0; i < iter->width; ++i) {
+            char c = str[pos++];
+            if (!isdigit(c)) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        }
+
+        switch (iter->spec) {
+            case 'Y': tm.tm_year = value - 1900; break;
+            case 'y': tm.tm_year = (value < 69)? value + 100: value; break;
+            case 'm': 
+                if (value < 1 || value > 12) return false;
+                tm.tm_mon = value - 1; 
+                break;
+            case 'd': 
+                if (value < 1 || value > 31) return false;
+                tm.tm_mday = value; 
+                break;
+            case 'j':
+                if (value < 1 || value > 366) return false;
+                tm.tm_mon = 0;
+                tm.tm_mday = value;
+                break;
+            case 'H': 
+                if (value > 23) return false;
+                tm.tm_hour = value; 
+                break;
+            case 'M': 
+                if (value > 59) return false;
+                tm.tm_min = value; 
+                break;
+            case 'S': 
+                if (value > 60) return false;
+                tm.tm_sec = value; 
+                break;
+        }
+    }
+
+    if (pos != str.length()) {
+        return false;
+    }
+
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+
+    return t != (time_t)-1;
+}/*}}}*/
+
+} // namespace base
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef BASE_TIME_FORMAT_H_
+#define BASE_TIME_FORMAT_H_
+
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+
+using namespace std;
+
+namespace base {
+
+struct TimeFormatToken
+{
+    /* conversion specifier, or 0 for literal */
+    char spec;
+    int width;
+    string literal;
+};
+
+/* Parses strings formatted by strftime with a format, e.g. the names of
+ * files created with access_log.%Y%m%d%H, back to time. Only fixed 
+ * width numeric specifiers are supported: %Y %y %m %d %j %H %M %S, 
+ * and %F %T %% */
+class TimeFormat
+{
+    public:
+        TimeFormat();
+
+        /* false if format has unsupported specifiers */
+        bool init(const string &format);
+        bool parse(const string &str, time_t &t) const;
+
+        /* if the strings matching format sort the same as their time */
+        bool isOrdered() const { return m_ordered; };
+        /* literal before the first specifier */
+        const string &getPrefix() const { return m_prefix; };
+
+    private:
+        void addField(char spec, int width);
+        void addLiteral(const string &literal);
+        static int getRank(char spec);
+
+    private:
+        vector<TimeFormatToken> m_tokens;
+        string m_prefix;
+        bool m_ordered;
+};
+
+} // namespace base
+
+#endif // BASE_TIME_FORMAT_H_
@@ -21,6 +21,8 @@
 ///////////////////////////////////////////////////////////////////////////
 #include "base/timer_watcher.h"
 
+#include "base/loop_monitor.h"
+
 namespace base {
 
 bool TimerWatcher::init(uv_loop_t *loop, 
@@ -61,7 +63,9 @@ void TimerWatcher::cb_func(uv_timer_t *w)
     if (NULL == tw->m_event_cb_func)
         return;
 
+    int64_t begin_us = LoopMonitor::traceBegin();
     (*tw->m_event_cb_func)(tw->m_event_cb_func_arg);
+    LoopMonitor::traceEnd(begin_us, "timer", tw->m_name);
 }/*}}}*/
 
 void TimerWatcher::stop()
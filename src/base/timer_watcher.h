@@ -22,11 +22,15 @@
 #ifndef BASE_TIMER_WATCHER_H_
 #define BASE_TIMER_WATCHER_H_
 
+#include <string>
+
 #include "base/common.h"
 
 #include <uv.h>
 #include "easylogging/easylogging++.h"
 
+using namespace std;
+
 namespace base {
 
 typedef void (*TimerFunc)(void *);
@@ -43,7 +47,11 @@ class TimerWatcher
         void start();
         void close();
 
+        /* shown when tracing slow callbacks */
+        void setName(const string &name) { m_name = name; };
+
     private:
+        string m_name;
         uv_loop_t *m_loop;
         uv_timer_t *m_handle;
         long m_timeout;
@@ -22,9 +22,11 @@
 #include "base/tools.h"
 
 #include <arpa/inet.h>
+#include <dirent.h>
 #include <glob.h>
 #include <libgen.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <cassert>
 #include <cerrno>
@@ -130,7 +132,8 @@ bool isAbsPath(const char* filepath)
     return filepath[1] == '/';
 }/*}}}*/
 
-set<std::string> diff_set(set<std::string> s1, set<std::string> s2)
+set<std::string> diff_set(const set<std::string> &s1, 
+        const set<std::string> &s2)
 {/*{{{*/
     set<std::string> s;
     set_difference(s1.begin(), s1.end(), 
@@ -140,7 +143,8 @@ set<std::string> diff_set(set<std::string> s1, set<std::string> s2)
     return s;
 };/*}}}*/
 
-set<std::string> intersect_set(set<std::string> s1, set<std::string> s2)
+set<std::string> intersect_set(const set<std::string> &s1, 
+        const set<std::string> &s2)
 {/*{{{*/
     set<std::string> s;
     set_intersection(s1.begin(), s1.end(), 
@@ -166,6 +170,34 @@ ino_t getInode(const char *path)
     return inode;
 };/*}}}*/
 
+bool findSiblingByInode(const string &path, ino_t inode, string &sibling)
+{/*{{{*/
+    size_t slash = path.rfind('/');
+    string dir = (string::npos == slash)? ".": 
+        (0 == slash)? "/": path.substr(0, slash);
+
+    DIR *dp = opendir(dir.c_str());
+    if (NULL == dp) return false;
+
+    bool found = false;
+    struct dirent *entry = NULL;
+    while (!found && NULL != (entry = readdir(dp))) {
+        if (entry->d_ino != inode) continue;
+
+        string candidate = (dir == "/")? dir + entry->d_name: 
+            dir + '/' + entry->d_name;
+        struct stat st;
+        if (candidate != path && 0 == stat(candidate.c_str(), &st)
+                && S_ISREG(st.st_mode) && st.st_ino == inode) {
+            sibling = candidate;
+            found = true;
+        }
+    }
+    closedir(dp);
+
+    return found;
+}/*}}}*/
+
 off_t getFsize(const char *path)
 {/*{{{*/
     struct stat buf;
@@ -204,6 +236,28 @@ off_t getFsize(FILE *fp)
     return getFsize(fileno(fp));
 };/*}}}*/
 
+int64_t getMtimeUs(FILE *fp)
+{/*{{{*/
+    struct stat buf;
+    if (NULL == fp || 0 != fstat(fileno(fp), &buf)) return 0;
+    return (int64_t)buf.st_mtim.tv_sec * 1000000 
+        + buf.st_mtim.tv_nsec / 1000;
+};/*}}}*/
+
+int64_t getNowUs()
+{/*{{{*/
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+};/*}}}*/
+
+int64_t getMonotonicUs()
+{/*{{{*/
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+};/*}}}*/
+
 string sig2str(int signum)
 {/*{{{*/
 #ifdef _GNU_SOURCE
@@ -266,6 +320,24 @@ bool globPath(const string &path_pattern, vector<string> &paths)
     return true;
 }/*}}}*/
 
+bool hasGlobMagic(const string &path)
+{/*{{{*/
+    return path.find_first_of("*?[") != string::npos;
+}/*}}}*/
+
+bool splitPath(const string &path, string &dir, string &name)
+{/*{{{*/
+    size_t pos = path.find_last_of('/');
+    if (pos == string::npos || pos == path.length() - 1) {
+        return false;
+    }
+
+    dir = (pos == 0)? "/": path.substr(0, pos);
+    name = path.substr(pos + 1);
+
+    return true;
+}/*}}}*/
+
 #ifndef _GNU_SOURCE
 int fdprintf(int fd, size_t bufmax, const char *fmt, ...)
 {/*{{{*/
@@ -23,6 +23,8 @@
 #define BASE_TOOLS_H_
 
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -59,13 +61,25 @@ struct GetKey: public std::unary_function<T_PAIR, typename T_PAIR::first_type>
     }
 };/*}}}*/
 
-extern set<std::string> diff_set(set<std::string> s1, set<std::string> s2);
-extern set<std::string> intersect_set(set<std::string> s1, set<std::string> s2);
+extern set<std::string> diff_set(const set<std::string> &s1, 
+        const set<std::string> &s2);
+extern set<std::string> intersect_set(const set<std::string> &s1, 
+        const set<std::string> &s2);
 
 extern ino_t getInode(const char *path);
+/* a regular file in the directory of path, other than path, with the 
+ * given inode, e.g. where a file was renamed to by rotation */
+extern bool findSiblingByInode(const string &path, ino_t inode, 
+        string &sibling);
 extern off_t getFsize(const char *path);
 extern off_t getFsize(int fd);
 extern off_t getFsize(FILE *fp);
+/* modification time of file in microseconds since epoch, 0 if unknown */
+extern int64_t getMtimeUs(FILE *fp);
+/* wall clock, comparable with file times */
+extern int64_t getNowUs();
+/* monotonic clock, for measuring durations */
+extern int64_t getMonotonicUs();
 extern string sig2str(int signum);
 extern long long hexstr2num(const char *buf, long long default_num);
 void strReplace(std::string& str, 
@@ -74,6 +88,8 @@ void strReplace(std::string& str,
 
 int globerr(const char *path, int eerrno);
 bool globPath(const string &path_pattern, vector<string> &paths);
+bool hasGlobMagic(const string &path);
+bool splitPath(const string &path, string &dir, string &name);
 
 #ifndef _GNU_SOURCE
 int fdprintf(int fd, size_t bufmax, const char * fmt, ...);
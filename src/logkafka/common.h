@@ -37,15 +37,41 @@
 #define DEFAULT_LINE_MAX_BYTES 1048576UL /* 1MB */
 #define DEFAULT_STAT_SILENT_MAX_MS 10000UL /* milliseconds */
 #define DEFAULT_BATCHSIZE 100U
+#define DEFAULT_BACKLOG_PARALLELISM 1
 #define DEFAULT_ZK_URLS "127.0.0.1:2181"
+#define DEFAULT_CONFIG_SOURCE "zookeeper"
+#define DEFAULT_LOG_CONFIG_PATH "log_config.json"
+#define DEFAULT_LOG_STATE_PATH "log_state.json"
+#define DEFAULT_BROKER_URLS "127.0.0.1:9092"
 #define DEFAULT_POS_PATH "logkafka.pos"
+#define DEFAULT_HTTP_ADDRESS "" /* disabled */
 #define DEFAULT_ZOOKEEPER_UPLOAD_INTERVAL 10000UL /* milliseconds */
 #define DEFAULT_REFRESH_INTERVAL 60000UL /* milliseconds */
 #define DEFAULT_MESSAGE_SEND_MAX_RETRIES 10000UL
 #define DEFAULT_RDKAFKA_POLL_TIMEOUT 100 /* milliseconds */
+#define DEFAULT_POS_COMPACT_INTERVAL 60000UL /* milliseconds */
+#define DEFAULT_CONFIG_APPLY_DELAY 100UL /* milliseconds */
+#define DEFAULT_GLOB_MAX_OPEN_FILES 64UL
+#define DEFAULT_LOOP_PROBE_INTERVAL 1000UL /* milliseconds */
+#define DEFAULT_SLOW_CALLBACK_MS 100UL
+#define DEFAULT_ZOOKEEPER_UPLOAD_COMPRESSION "none"
+#define DEFAULT_ZOOKEEPER_UPLOAD_SHARD_BYTES 524288UL /* 512KB */
+#define DEFAULT_SEGMENT_BYTES 268435456LL /* 256MB */
+#define DEFAULT_SEGMENT_MS 3600000LL /* milliseconds */
+#define DEFAULT_STREAM_MAX_PENDING_BYTES 4194304LL /* 4MB */
+#define DEFAULT_STREAM_RECONNECT_INTERVAL 1000UL /* milliseconds */
 
 #define HARD_LIMIT_LINE_MAX_BYTES 1073741824UL /* 1GB */
 #define HARD_LIMIT_ZOOKEEPER_UPLOAD_INTERVAL 60000UL /* milliseconds */
+#define HARD_LIMIT_POS_COMPACT_INTERVAL_MIN 1000UL /* milliseconds */
+#define HARD_LIMIT_CONFIG_APPLY_DELAY 10000UL /* milliseconds */
+#define HARD_LIMIT_GLOB_MAX_OPEN_FILES 4096UL
+#define HARD_LIMIT_LOOP_PROBE_INTERVAL_MIN 10UL /* milliseconds */
+#define HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES_MIN 1024UL
+#define HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES 1000000UL /* under jute.maxbuffer */
+#define HARD_LIMIT_BACKLOG_PARALLELISM 64
+#define HARD_LIMIT_OUTPUTS 16U
+#define HARD_LIMIT_STAGES 16U
 
 #define FILEPOS_END -1       /* read from file end*/
 
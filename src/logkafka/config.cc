@@ -27,6 +27,7 @@
 #include <map>
 #include <string>
 
+#include "base/http_server.h"
 #include "base/tools.h"
 #include "logkafka/tail_watcher.h"
 
@@ -41,14 +42,32 @@ Config::Config()
     cfg_opt_t opts[] =
     {
         CFG_STR("zk_urls", DEFAULT_ZK_URLS, CFGF_NONE),
+        CFG_STR("config_source", DEFAULT_CONFIG_SOURCE, CFGF_NONE),
+        CFG_STR("log_config_path", DEFAULT_LOG_CONFIG_PATH, CFGF_NONE),
+        CFG_STR("log_state_path", DEFAULT_LOG_STATE_PATH, CFGF_NONE),
+        CFG_STR("broker_urls", DEFAULT_BROKER_URLS, CFGF_NONE),
         CFG_STR("pos_path", DEFAULT_POS_PATH, CFGF_NONE),
         CFG_INT("line_max_bytes", DEFAULT_LINE_MAX_BYTES, CFGF_NONE),
         CFG_INT("stat_silent_max_ms", DEFAULT_STAT_SILENT_MAX_MS, CFGF_NONE),
         CFG_INT("zookeeper_upload_interval", DEFAULT_ZOOKEEPER_UPLOAD_INTERVAL,
                 CFGF_NONE),
+        CFG_STR("zookeeper_upload_compression", 
+                DEFAULT_ZOOKEEPER_UPLOAD_COMPRESSION, CFGF_NONE),
+        CFG_INT("zookeeper_upload_shard_bytes", 
+                DEFAULT_ZOOKEEPER_UPLOAD_SHARD_BYTES, CFGF_NONE),
         CFG_INT("refresh_interval", DEFAULT_REFRESH_INTERVAL, CFGF_NONE),
+        CFG_STR("http_address", DEFAULT_HTTP_ADDRESS, CFGF_NONE),
         CFG_INT("message_send_max_retries", DEFAULT_MESSAGE_SEND_MAX_RETRIES,
                 CFGF_NONE),
+        CFG_INT("pos_compact_interval", DEFAULT_POS_COMPACT_INTERVAL, 
+                CFGF_NONE),
+        CFG_INT("config_apply_delay", DEFAULT_CONFIG_APPLY_DELAY, 
+                CFGF_NONE),
+        CFG_INT("glob_max_open_files", DEFAULT_GLOB_MAX_OPEN_FILES, 
+                CFGF_NONE),
+        CFG_INT("loop_probe_interval", DEFAULT_LOOP_PROBE_INTERVAL, 
+                CFGF_NONE),
+        CFG_INT("slow_callback_ms", DEFAULT_SLOW_CALLBACK_MS, CFGF_NONE),
         CFG_END()
     };
 
@@ -82,17 +101,45 @@ bool Config::init(const char* filepath)
     string realdir_s(realdir);
         
     zk_urls = cfg_getstr(m_cfg, "zk_urls");
+    config_source = cfg_getstr(m_cfg, "config_source");
+    log_config_path = cfg_getstr(m_cfg, "log_config_path");
+    log_state_path = cfg_getstr(m_cfg, "log_state_path");
+    broker_urls = cfg_getstr(m_cfg, "broker_urls");
     pos_path = cfg_getstr(m_cfg, "pos_path");
     line_max_bytes = cfg_getint(m_cfg, "line_max_bytes");
     stat_silent_max_ms = cfg_getint(m_cfg, "stat_silent_max_ms");
     zookeeper_upload_interval = cfg_getint(m_cfg, "zookeeper_upload_interval");
+    zookeeper_upload_compression = cfg_getstr(m_cfg, 
+            "zookeeper_upload_compression");
+    zookeeper_upload_shard_bytes = cfg_getint(m_cfg, 
+            "zookeeper_upload_shard_bytes");
     refresh_interval = cfg_getint(m_cfg, "refresh_interval");
     message_send_max_retries = cfg_getint(m_cfg, "message_send_max_retries");
+    pos_compact_interval = cfg_getint(m_cfg, "pos_compact_interval");
+    config_apply_delay = cfg_getint(m_cfg, "config_apply_delay");
+    glob_max_open_files = cfg_getint(m_cfg, "glob_max_open_files");
+    loop_probe_interval = cfg_getint(m_cfg, "loop_probe_interval");
+    slow_callback_ms = cfg_getint(m_cfg, "slow_callback_ms");
+    http_address = cfg_getstr(m_cfg, "http_address");
 
     if (!isAbsPath(pos_path.c_str())) {
         pos_path = realdir_s + '/' + pos_path;
     }
 
+    if (config_source != "zookeeper" && config_source != "file") {
+        fprintf(stderr, "config_source %s is not valid!\n",
+                config_source.c_str());
+        return false;
+    }
+
+    if (!isAbsPath(log_config_path.c_str())) {
+        log_config_path = realdir_s + '/' + log_config_path;
+    }
+
+    if (!isAbsPath(log_state_path.c_str())) {
+        log_state_path = realdir_s + '/' + log_state_path;
+    }
+
     if (line_max_bytes > HARD_LIMIT_LINE_MAX_BYTES) {
         fprintf(stderr, "line_max_bytes %lu exceeds hard limit %lu!\n",
                 line_max_bytes, HARD_LIMIT_LINE_MAX_BYTES);
@@ -105,12 +152,67 @@ bool Config::init(const char* filepath)
         return false;
     }
 
+    if (pos_compact_interval < HARD_LIMIT_POS_COMPACT_INTERVAL_MIN) {
+        fprintf(stderr, "pos_compact_interval %lu is less than hard limit %lu!\n",
+                pos_compact_interval, HARD_LIMIT_POS_COMPACT_INTERVAL_MIN);
+        return false;
+    }
+
+    if (config_apply_delay > HARD_LIMIT_CONFIG_APPLY_DELAY) {
+        fprintf(stderr, "config_apply_delay %lu exceeds hard limit %lu!\n",
+                config_apply_delay, HARD_LIMIT_CONFIG_APPLY_DELAY);
+        return false;
+    }
+
+    if (glob_max_open_files < 1 
+            || glob_max_open_files > HARD_LIMIT_GLOB_MAX_OPEN_FILES) {
+        fprintf(stderr, "glob_max_open_files %lu is not in [1, %lu]!\n",
+                glob_max_open_files, HARD_LIMIT_GLOB_MAX_OPEN_FILES);
+        return false;
+    }
+
+    if (loop_probe_interval > 0 
+            && loop_probe_interval < HARD_LIMIT_LOOP_PROBE_INTERVAL_MIN) {
+        fprintf(stderr, "loop_probe_interval %lu is less than hard limit %lu!\n",
+                loop_probe_interval, HARD_LIMIT_LOOP_PROBE_INTERVAL_MIN);
+        return false;
+    }
+
     if (zookeeper_upload_interval > HARD_LIMIT_ZOOKEEPER_UPLOAD_INTERVAL) {
         fprintf(stderr, "zookeeper_upload_interval %lu exceeds hard limit %lu!\n",
                 zookeeper_upload_interval, HARD_LIMIT_ZOOKEEPER_UPLOAD_INTERVAL);
         return false;
     }
 
+    if (zookeeper_upload_compression != "none" 
+            && zookeeper_upload_compression != "zlib") {
+        fprintf(stderr, "zookeeper_upload_compression %s is not valid!\n",
+                zookeeper_upload_compression.c_str());
+        return false;
+    }
+
+    if (zookeeper_upload_shard_bytes < HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES_MIN
+            || zookeeper_upload_shard_bytes > HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES) {
+        fprintf(stderr, "zookeeper_upload_shard_bytes %lu is not in [%lu, %lu]!\n",
+                zookeeper_upload_shard_bytes, 
+                HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES_MIN,
+                HARD_LIMIT_ZOOKEEPER_UPLOAD_SHARD_BYTES);
+        return false;
+    }
+
+    /* control actions are not authenticated, only local clients 
+     * may connect */
+    if (HttpServer::isUnixSocket(http_address)) {
+        if (!isAbsPath(http_address.c_str())) {
+            http_address = realdir_s + '/' + http_address;
+        }
+    } else if (!http_address.empty() 
+            && !HttpServer::isLoopback(http_address)) {
+        fprintf(stderr, "http_address %s is not a loopback address "
+                "or a unix socket!\n", http_address.c_str());
+        return false;
+    }
+
     return true;
 }/*}}}*/
 
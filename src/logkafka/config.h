@@ -47,13 +47,25 @@ class Config {
 
     public:
         string zk_urls;
+        string config_source;
+        string log_config_path;
+        string log_state_path;
+        string broker_urls;
         string gdbm_path;
         string pos_path;
         unsigned long line_max_bytes;
         unsigned long zookeeper_upload_interval;
+        string zookeeper_upload_compression;
+        unsigned long zookeeper_upload_shard_bytes;
         unsigned long refresh_interval;
         unsigned long message_send_max_retries;
         unsigned long stat_silent_max_ms;
+        unsigned long pos_compact_interval;
+        unsigned long config_apply_delay;
+        unsigned long glob_max_open_files;
+        unsigned long loop_probe_interval;
+        unsigned long slow_callback_ms;
+        string http_address;
 
     private:
         Config(const Config &config);
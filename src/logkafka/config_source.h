@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_CONFIG_SOURCE_H_
+#define LOGKAFKA_CONFIG_SOURCE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+using namespace std;
+
+namespace logkafka {
+
+typedef void (*ConfigChangeFunc)(void *);
+
+/* rc is 0 if the state is written */
+typedef void (*StateCompletionFunc)(int rc, const void *data);
+
+/* Where collecting configs and broker urls come from, and collecting 
+ * state goes to */
+class ConfigSource
+{
+    public:
+        ConfigSource() {};
+        virtual ~ConfigSource() {};
+
+        /* version changes whenever the log config changes */
+        virtual string getLogConfig(int64_t *version = NULL) = 0;
+        virtual int64_t getLogConfigVersion() = 0;
+
+        /* func may be called in another thread once a new version of 
+         * log config is fetched, it must be thread safe and return 
+         * quickly */
+        virtual void setConfigChangeCallback(ConfigChangeFunc func, 
+                void *arg) = 0;
+
+        /* version changes whenever the broker list changes */
+        virtual string getBrokerUrls(int64_t *version = NULL) = 0;
+        virtual int64_t getBrokerUrlsVersion() = 0;
+
+        /* same as setConfigChangeCallback, for the broker list */
+        virtual void setBrokersChangeCallback(ConfigChangeFunc func, 
+                void *arg) = 0;
+
+        /* writes collecting state, or one of its shards if shard is not 
+         * negative. completion is called, maybe in another thread, 
+         * only if it returns true */
+        virtual bool setLogState(const char *buf, int buflen, long shard,
+                StateCompletionFunc completion, const void *data) = 0;
+        virtual bool deleteLogState(long shard, 
+                StateCompletionFunc completion, const void *data) = 0;
+
+        /* changes whenever written state is lost, it has to be written
+         * again then */
+        virtual unsigned long getClientEpoch() = 0;
+
+        virtual void close() = 0;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_CONFIG_SOURCE_H_
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/file_config_source.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "base/json.h"
+#include "base/tools.h"
+
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+FileConfigSource::FileConfigSource()
+{/*{{{*/
+    m_log_config = "{}";
+    m_log_config_version = 0;
+    m_log_config_hash = 0;
+    m_config_dir_watcher = NULL;
+    m_config_change_cb_func = NULL;
+    m_config_change_cb_func_arg = NULL;
+}/*}}}*/
+
+FileConfigSource::~FileConfigSource()
+{/*{{{*/
+    delete m_config_dir_watcher; m_config_dir_watcher = NULL;
+}/*}}}*/
+
+bool FileConfigSource::init(uv_loop_t *loop, 
+        const string &config_path, 
+        const string &state_path,
+        const string &broker_urls)
+{/*{{{*/
+    m_config_path = config_path;
+    m_state_path = state_path;
+    m_broker_urls = broker_urls;
+
+    string config_dir;
+    if (!splitPath(m_config_path, config_dir, m_config_name)) {
+        LERROR << "Fail to split log config path " << m_config_path;
+        return false;
+    }
+
+    if (!reload()) {
+        LERROR << "Fail to load log config from " << m_config_path;
+        return false;
+    }
+
+    /* watch the directory, editors often replace the file by renaming */
+    m_config_dir_watcher = new FsEventWatcher();
+    if (!m_config_dir_watcher->init(loop, config_dir, 
+                this, onConfigDirChange)) {
+        LERROR << "Fail to watch log config dir " << config_dir;
+        delete m_config_dir_watcher; m_config_dir_watcher = NULL;
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+void FileConfigSource::onConfigDirChange(void *arg, 
+        const char *filename, int events)
+{/*{{{*/
+    FileConfigSource *fcs = reinterpret_cast<FileConfigSource *>(arg);
+
+    if (NULL != filename && fcs->m_config_name != filename) {
+        return;
+    }
+
+    if (!fcs->reload()) {
+        LERROR << "Fail to reload log config from " << fcs->m_config_path;
+    }
+}/*}}}*/
+
+bool FileConfigSource::reload()
+{/*{{{*/
+    std::ifstream in(m_config_path.c_str());
+    if (!in) {
+        /* e.g. in the middle of being replaced */
+        LWARNING << "Fail to open log config " << m_config_path;
+        return true;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    string log_config = ss.str();
+
+    Document document;
+    if (document.Parse<0>(log_config.c_str()).HasParseError()) {
+        /* keep the current config until it is completely written */
+        LWARNING << "Log config " << m_config_path << " is not valid json";
+        return true;
+    }
+
+    uint64_t hash = Json::hashBytes(log_config.data(), log_config.length());
+    {
+        ScopedLock l(m_log_config_mutex);
+        if (m_log_config_version > 0 && hash == m_log_config_hash) {
+            return true;
+        }
+
+        m_log_config = log_config;
+        m_log_config_hash = hash;
+        ++m_log_config_version;
+    }
+
+    LINFO << "Load log config from " << m_config_path;
+
+    ScopedLock l(m_config_change_mutex);
+    if (NULL != m_config_change_cb_func) {
+        (*m_config_change_cb_func)(m_config_change_cb_func_arg);
+    }
+
+    return true;
+}/*}}}*/
+
+string FileConfigSource::getLogConfig(int64_t *version)
+{/*{{{*/
+    ScopedLock l(m_log_config_mutex);
+    if (NULL != version) {
+        *version = m_log_config_version;
+    }
+
+    return m_log_config;
+}/*}}}*/
+
+int64_t FileConfigSource::getLogConfigVersion()
+{/*{{{*/
+    ScopedLock l(m_log_config_mutex);
+    return m_log_config_version;
+}/*}}}*/
+
+void FileConfigSource::setConfigChangeCallback(ConfigChangeFunc func, 
+        void *arg)
+{/*{{{*/
+    ScopedLock l(m_config_change_mutex);
+    m_config_change_cb_func = func;
+    m_config_change_cb_func_arg = arg;
+}/*}}}*/
+
+string FileConfigSource::getBrokerUrls(int64_t *version)
+{/*{{{*/
+    if (NULL != version) {
+        *version = 1;
+    }
+
+    return m_broker_urls;
+}/*}}}*/
+
+int64_t FileConfigSource::getBrokerUrlsVersion()
+{/*{{{*/
+    return 1;
+}/*}}}*/
+
+bool FileConfigSource::setLogState(const char *buf, int buflen, long shard,
+        StateCompletionFunc completion, const void *data)
+{/*{{{*/
+    string path = getStatePath(shard);
+    string tmp_path = path + ".tmp";
+
+    /* readers never see a partially written state */
+    bool res = false;
+    FILE *fp = fopen(tmp_path.c_str(), "w");
+    if (NULL != fp) {
+        res = (fwrite(buf, 1, buflen, fp) == (size_t)buflen);
+        res = (0 == fclose(fp)) && res;
+        res = res && (0 == rename(tmp_path.c_str(), path.c_str()));
+    }
+
+    if (!res) {
+        LERROR << "Fail to write collecting state to " << path 
+               << ", " << strerror(errno);
+        return false;
+    }
+
+    completion(0, data);
+    return true;
+}/*}}}*/
+
+bool FileConfigSource::deleteLogState(long shard, 
+        StateCompletionFunc completion, const void *data)
+{/*{{{*/
+    string path = getStatePath(shard);
+
+    bool res = (0 == unlink(path.c_str()) || ENOENT == errno);
+    if (!res) {
+        LERROR << "Fail to delete collecting state " << path 
+               << ", " << strerror(errno);
+        return false;
+    }
+
+    completion(0, data);
+    return true;
+}/*}}}*/
+
+string FileConfigSource::getStatePath(long shard)
+{/*{{{*/
+    if (shard < 0) {
+        return m_state_path;
+    }
+
+    return m_state_path + "." + int2Str(shard);
+}/*}}}*/
+
+void FileConfigSource::close()
+{/*{{{*/
+    if (NULL != m_config_dir_watcher) {
+        m_config_dir_watcher->close();
+    }
+}/*}}}*/
+
+} // namespace logkafka
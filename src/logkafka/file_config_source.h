@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_FILE_CONFIG_SOURCE_H_
+#define LOGKAFKA_FILE_CONFIG_SOURCE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "base/fs_event_watcher.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+#include "logkafka/config_source.h"
+
+#include <uv.h>
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+/* Reads log config from a local json file in the format of the config 
+ * znode, and reloads it once the file changes. Collecting state is 
+ * written to local files, so that logkafka runs without zookeeper. */
+class FileConfigSource: public ConfigSource
+{
+    public:
+        FileConfigSource();
+        ~FileConfigSource();
+
+        bool init(uv_loop_t *loop, 
+                const string &config_path, 
+                const string &state_path,
+                const string &broker_urls);
+
+        string getLogConfig(int64_t *version = NULL);
+        int64_t getLogConfigVersion();
+
+        /* callback is called in loop thread */
+        void setConfigChangeCallback(ConfigChangeFunc func, void *arg);
+
+        /* broker urls never change */
+        string getBrokerUrls(int64_t *version = NULL);
+        int64_t getBrokerUrlsVersion();
+        void setBrokersChangeCallback(ConfigChangeFunc func, void *arg) {};
+
+        /* completion is called before returning true */
+        bool setLogState(const char *buf, int buflen, long shard,
+                StateCompletionFunc completion, const void *data);
+        bool deleteLogState(long shard, 
+                StateCompletionFunc completion, const void *data);
+        unsigned long getClientEpoch() { return 1; };
+
+        void close();
+
+    private:
+        bool reload();
+        string getStatePath(long shard);
+        static void onConfigDirChange(void *arg, 
+                const char *filename, int events);
+
+    private:
+        string m_config_path;
+        string m_config_name;
+        string m_state_path;
+        string m_broker_urls;
+
+        string m_log_config;
+        int64_t m_log_config_version;
+        uint64_t m_log_config_hash;
+
+        FsEventWatcher *m_config_dir_watcher;
+
+        ConfigChangeFunc m_config_change_cb_func;
+        void *m_config_change_cb_func_arg;
+
+        Mutex m_log_config_mutex;
+        Mutex m_config_change_mutex;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_FILE_CONFIG_SOURCE_H_
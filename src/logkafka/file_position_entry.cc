@@ -21,51 +21,54 @@
 ///////////////////////////////////////////////////////////////////////////
 #include "logkafka/file_position_entry.h"
 
+#include "logkafka/position_file.h"
+
 namespace logkafka {
 
-const size_t FilePositionEntry::POS_SIZE = 16;
-const size_t FilePositionEntry::INO_OFFSET = 17;
-const size_t FilePositionEntry::INO_SIZE = 8;
-const int FilePositionEntry::LN_OFFSET = 25;
-const int FilePositionEntry::SIZE = 26;
+FilePositionEntry::FilePositionEntry(PositionFile *position_file,
+        const PositionEntryKey &key,
+        ino_t inode,
+        off_t pos)
+{/*{{{*/
+    init(position_file, key, inode, pos);
+}/*}}}*/
 
-FilePositionEntry::FilePositionEntry(FILE *file, off_t seek)
+bool FilePositionEntry::init(PositionFile *position_file,
+        const PositionEntryKey &key,
+        ino_t inode,
+        off_t pos)
 {/*{{{*/
-    m_file = file;
-    m_seek = seek;
+    m_position_file = position_file;
+    m_key = key;
+    m_inode = inode;
+    m_pos = pos;
+
+    return true;
 }/*}}}*/
 
 bool FilePositionEntry::update(ino_t inode, off_t pos)
 {/*{{{*/
-    fseek(m_file, m_seek, SEEK_SET);
-    fprintf(m_file, "%016llx\t%08x", 
-            (unsigned long long)pos, (unsigned int)inode);
+    if (inode == m_inode && pos == m_pos) return true;
 
-    return true;
+    m_inode = inode;
+    m_pos = pos;
+
+    return m_position_file->append(m_key, m_inode, m_pos);
 }/*}}}*/
 
 bool FilePositionEntry::updatePos(off_t pos) 
 {/*{{{*/
-    fseek(m_file, m_seek, SEEK_SET);
-    fprintf(m_file, "%016llx", (unsigned long long)pos);
-
-    return true;
+    return update(m_inode, pos);
 }/*}}}*/
 
 off_t FilePositionEntry::readPos() 
 {/*{{{*/
-    fseek(m_file, m_seek, SEEK_SET);
-    char buf[16];
-    return (POS_SIZE == fread(buf, POS_SIZE, 1, m_file)) ? 
-        hexstr2num(buf, -1): -1;
+    return m_pos;
 }/*}}}*/
 
 ino_t FilePositionEntry::readInode() 
 {/*{{{*/
-    fseek(m_file, m_seek + INO_OFFSET, SEEK_SET);
-    char buf[8];
-    return (INO_SIZE == fread(buf, INO_SIZE, 1, m_file)) ? 
-        hexstr2num(buf, INO_NONE): INO_NONE;
+    return m_inode;
 }/*}}}*/
 
 } // namespace logkafka
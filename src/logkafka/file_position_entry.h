@@ -41,27 +41,34 @@ using namespace std;
 
 namespace logkafka {
 
+class PositionFile;
+
+/* Position entry backed by the position journal: the latest inode and
+ * position are kept in memory, every change is appended to the journal
+ * of the owning PositionFile. */
 class FilePositionEntry: public virtual PositionEntry 
 {
     public:
         FilePositionEntry(): PositionEntry() {};
-        FilePositionEntry(FILE *file, off_t seek);
+        FilePositionEntry(PositionFile *position_file,
+                const PositionEntryKey &key,
+                ino_t inode,
+                off_t pos);
         ~FilePositionEntry() {};
-        bool init(FILE *file, off_t seek);
+        bool init(PositionFile *position_file,
+                const PositionEntryKey &key,
+                ino_t inode,
+                off_t pos);
         bool update(ino_t inode, off_t pos);
         bool updatePos(off_t pos);
         ino_t readInode();
         off_t readPos();
 
     private:
-        FILE *m_file;
-        off_t m_seek;
-
-        static const size_t POS_SIZE;
-        static const size_t INO_OFFSET;
-        static const size_t INO_SIZE;
-        static const int LN_OFFSET;
-        static const int SIZE;
+        PositionFile *m_position_file;
+        PositionEntryKey m_key;
+        ino_t m_inode;
+        off_t m_pos;
 };
 
 } // namespace logkafka
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/filter_stage.h"
+
+#include <string.h>
+
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+LiteralMatcher::LiteralMatcher(const string &literal)
+{/*{{{*/
+    m_literal = literal;
+    m_rare = 0;
+    m_rare_offset = 0;
+
+    int rarest = 256;
+    for (size_t i = 0; i < m_literal.size(); ++i) {
+        unsigned char c = m_literal[i];
+        int frequency = byteFrequency(c);
+        if (frequency < rarest) {
+            rarest = frequency;
+            m_rare = c;
+            m_rare_offset = i;
+        }
+    }
+}/*}}}*/
+
+int LiteralMatcher::byteFrequency(unsigned char c)
+{/*{{{*/
+    /* roughly ranked by how often bytes occur in access and 
+     * application logs */
+    if (' ' == c) return 255;
+    if (c >= '0' && c <= '9') return 220;
+    if (0 != c && NULL != strchr("etaoinsr", c)) return 200;
+    if (0 != c && NULL != strchr(".:/-\"[]", c)) return 190;
+    if (0 != c && NULL != strchr("lhdcum", c)) return 180;
+    if (0 != c && NULL != strchr("_=,()+;", c)) return 150;
+    if (c >= 'a' && c <= 'z') return 120;
+    if (c >= 'A' && c <= 'Z') return 100;
+    /* other punctuation */
+    if (c > ' ' && c < 0x7f) return 60;
+    /* control and non-ascii bytes */
+    return 10;
+}/*}}}*/
+
+bool LiteralMatcher::match(const char *data, size_t len) const
+{/*{{{*/
+    size_t n = m_literal.size();
+    if (0 == n || n > len) return false;
+
+    /* the rare byte of a match can be from here to last */
+    const char *p = data + m_rare_offset;
+    const char *last = data + len - n + m_rare_offset;
+    while (p <= last) {
+        p = reinterpret_cast<const char *>(memchr(p, m_rare, last - p + 1));
+        if (NULL == p) return false;
+        /* the first byte rejects most candidates without a call */
+        const char *start = p - m_rare_offset;
+        if (start[0] == m_literal[0]
+                && 0 == memcmp(start, m_literal.data(), n)) {
+            return true;
+        }
+        ++p;
+    }
+
+    return false;
+}/*}}}*/
+
+FilterStage::~FilterStage()
+{/*{{{*/
+    for (size_t i = 0; i < m_include_regex.size(); ++i) {
+        regfree(m_include_regex[i]);
+        delete m_include_regex[i];
+    }
+
+    for (size_t i = 0; i < m_exclude_regex.size(); ++i) {
+        regfree(m_exclude_regex[i]);
+        delete m_exclude_regex[i];
+    }
+}/*}}}*/
+
+bool FilterStage::init(const StageConf &conf)
+{/*{{{*/
+    for (vector<string>::const_iterator iter = conf.include.begin();
+            iter != conf.include.end(); ++iter) {
+        m_include.push_back(LiteralMatcher(*iter));
+    }
+
+    for (vector<string>::const_iterator iter = conf.exclude.begin();
+            iter != conf.exclude.end(); ++iter) {
+        m_exclude.push_back(LiteralMatcher(*iter));
+    }
+
+    return compile(conf.include_regex, m_include_regex)
+        && compile(conf.exclude_regex, m_exclude_regex);
+}/*}}}*/
+
+bool FilterStage::compile(const vector<string> &patterns, 
+        vector<regex_t *> &regexes)
+{/*{{{*/
+    for (vector<string>::const_iterator iter = patterns.begin();
+            iter != patterns.end(); ++iter) {
+        regex_t *regex = new regex_t;
+        int res = regcomp(regex, iter->c_str(), REG_EXTENDED | REG_NOSUB);
+        if (0 != res) {
+            char error[256];
+            regerror(res, regex, error, sizeof(error));
+            LERROR << "Fail to compile regex " << *iter << ", " << error;
+            delete regex;
+            return false;
+        }
+        regexes.push_back(regex);
+    }
+
+    return true;
+}/*}}}*/
+
+bool FilterStage::matchAny(const vector<LiteralMatcher> &literals,
+        const vector<regex_t *> &regexes, const string &line)
+{/*{{{*/
+    for (vector<LiteralMatcher>::const_iterator iter = literals.begin();
+            iter != literals.end(); ++iter) {
+        if (iter->match(line.data(), line.size())) return true;
+    }
+
+    for (vector<regex_t *>::const_iterator iter = regexes.begin();
+            iter != regexes.end(); ++iter) {
+        if (0 == regexec(*iter, line.c_str(), 0, NULL, 0)) return true;
+    }
+
+    return false;
+}/*}}}*/
+
+bool FilterStage::keep(const string &line)
+{/*{{{*/
+    if ((!m_include.empty() || !m_include_regex.empty())
+            && !matchAny(m_include, m_include_regex, line)) {
+        return false;
+    }
+
+    return !matchAny(m_exclude, m_exclude_regex, line);
+}/*}}}*/
+
+} // namespace logkafka
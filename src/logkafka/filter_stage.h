@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_FILTER_STAGE_H_
+#define LOGKAFKA_FILTER_STAGE_H_
+
+#include <regex.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "logkafka/pipeline.h"
+#include "logkafka/task_conf.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* Finds a literal by scanning with memchr(3), which is vectorized in 
+ * glibc, for its rarest byte, and comparing the literal around each 
+ * hit. Log lines are mostly spaces, digits, common letters and a few
+ * separators, so an uppercase or uncommon letter of the literal seldom
+ * occurs in lines and most of them are passed over at memchr speed,
+ * even when the literal starts with a common byte, e.g. "/health". */
+class LiteralMatcher
+{
+    public:
+        LiteralMatcher(const string &literal);
+
+        bool match(const char *data, size_t len) const;
+
+    private:
+        /* higher for bytes more common in log lines */
+        static int byteFrequency(unsigned char c);
+
+    private:
+        string m_literal;
+        unsigned char m_rare;
+        size_t m_rare_offset;
+};
+
+/* Keeps lines containing any of include, if given, and not containing
+ * any of exclude. Literals are tried first, regexes only for lines no
+ * literal decided. Patterns are compiled once, when the stage is set 
+ * up. */
+class FilterStage: public Stage
+{
+    public:
+        FilterStage() {};
+        ~FilterStage();
+
+        bool init(const StageConf &conf);
+        bool keep(const string &line);
+
+    protected:
+        bool processLine(string &line) { return keep(line); };
+
+    private:
+        static bool compile(const vector<string> &patterns, 
+                vector<regex_t *> &regexes);
+        static bool matchAny(const vector<LiteralMatcher> &literals,
+                const vector<regex_t *> &regexes, const string &line);
+
+    private:
+        vector<LiteralMatcher> m_include;
+        vector<LiteralMatcher> m_exclude;
+        vector<regex_t *> m_include_regex;
+        vector<regex_t *> m_exclude_regex;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_FILTER_STAGE_H_
@@ -27,6 +27,8 @@ IOHandler::IOHandler()
 {/*{{{*/
     m_file = NULL;
     m_line = NULL;
+    m_metrics = NULL;
+    m_paused = false;
     m_last_io_time = (struct timeval){0};
 }/*}}}*/
 
@@ -41,7 +43,8 @@ bool IOHandler::init(FILE *file,
                      unsigned int max_line_at_once,
                      unsigned int line_max_bytes,
                      void *receive_func_arg,
-                     ReceiveFunc receiveLines)
+                     ReceiveFunc receiveLines,
+                     TaskMetrics *metrics)
 {/*{{{*/
     m_file = file;
     m_position_entry = position_entry;
@@ -49,6 +52,7 @@ bool IOHandler::init(FILE *file,
     m_line_max_bytes = line_max_bytes;
     m_receive_func_arg = receive_func_arg;
     m_receive_func = receiveLines;
+    m_metrics = metrics;
 
     if (NULL == (m_line = reinterpret_cast<char *>(malloc(m_line_max_bytes)))) {
         LERROR << "Fail to malloc " << m_line_max_bytes << " bytes"
@@ -67,44 +71,86 @@ bool IOHandler::init(FILE *file,
 void IOHandler::onNotify(void *arg)
 {/*{{{*/
     IOHandler *ioh = reinterpret_cast<IOHandler *>(arg);
-    ScopedLock l(ioh->m_io_handler_mutex);
+    ioh->readLines(false);
+}/*}}}*/
+
+void IOHandler::drain()
+{/*{{{*/
+    readLines(true);
+}/*}}}*/
+
+void IOHandler::readLines(bool drain)
+{/*{{{*/
+    ScopedLock l(m_io_handler_mutex);
 
-    if (NULL == ioh->m_receive_func)
+    if (NULL == m_receive_func)
         return;
 
-    if (NULL == ioh->m_file)
+    if (NULL == m_file)
+        return;
+
+    /* the output is full, lines wait in the file */
+    if (m_paused && !drain)
         return;
 
     vector<string> lines;
     bool read_more = false;
+    int64_t bytes = 0;
 
     do {
         lines.clear();
         read_more = false;
+        bytes = 0;
+        int64_t read_start = getMonotonicUs();
 
         while (true) {
             char *line = NULL;
-            pthread_mutex_lock(&(ioh->m_file_mutex).mutex());
-            if (NULL != ioh->m_file) {
-                line = fgets(ioh->m_line, ioh->m_line_max_bytes, ioh->m_file);
+            size_t len = 0;
+            pthread_mutex_lock(&m_file_mutex.mutex());
+            if (NULL != m_file) {
+                line = fgets(m_line, m_line_max_bytes, m_file);
+                /* EOF is sticky in newer glibc, clear it to read 
+                 * lines appended later */
+                if (NULL == line) clearerr(m_file);
+            }
+            if (NULL != line) {
+                len = strlen(m_line);
+                /* the writer is in the middle of the line, read it 
+                 * again once the rest is written, lines longer than 
+                 * line_max_bytes are still split */
+                if (!drain && m_line[len-1] != '\n' 
+                        && len + 1 < m_line_max_bytes) {
+                    fseek(m_file, -(long)len, SEEK_CUR);
+                    line = NULL;
+                }
             }
-            pthread_mutex_unlock(&(ioh->m_file_mutex).mutex());
+            pthread_mutex_unlock(&m_file_mutex.mutex());
 
             if (NULL != line) {
-                size_t len = strlen(ioh->m_line);
-                if (ioh->m_line[len-1] == '\n') ioh->m_line[len-1] = '\0';
-                lines.push_back(string(ioh->m_line));
+                bytes += len;
+                if (m_line[len-1] == '\n') m_line[len-1] = '\0';
+                lines.push_back(string(m_line));
             } else {
                 break;
             }
 
-            if (lines.size() >= ioh->m_max_line_at_once) {
+            if (lines.size() >= m_max_line_at_once) {
                  read_more = true;
                  break;
             }
         }
 
         if (!lines.empty()) {
+            MetricsRegistry::instance().record(HISTOGRAM_READ_US, 
+                    getMonotonicUs() - read_start);
+
+            /* the last write to the file, lines of the batch were 
+             * written no later than it */
+            int64_t write_time_us = 0;
+            pthread_mutex_lock(&m_file_mutex.mutex());
+            write_time_us = getMtimeUs(m_file);
+            pthread_mutex_unlock(&m_file_mutex.mutex());
+
             /* XXX: restart one timer here, when timeout, 
              * delete path from corresponding tail watcher.  
              * NOTE: if using just one loop for all watchers,
@@ -113,12 +159,31 @@ void IOHandler::onNotify(void *arg)
              * will timeout early than expected, when choosing
              * timeout value, you should take this into consideration.
              */
-            ioh->updateLastIOTime();
-            if ((*ioh->m_receive_func)(ioh->m_receive_func_arg, lines)) {
-                ioh->m_position_entry->updatePos(ioh->getFilePos());
+            updateLastIOTime();
+            bool sent = (*m_receive_func)(m_receive_func_arg, 
+                    lines, write_time_us);
+            if (sent) {
+                m_position_entry->updatePos(getFilePos());
+            } else {
+                /* read again from the position, lines not sent are 
+                 * never skipped */
+                pthread_mutex_lock(&m_file_mutex.mutex());
+                if (NULL != m_file) {
+                    fseek(m_file, m_position_entry->readPos(), SEEK_SET);
+                }
+                pthread_mutex_unlock(&m_file_mutex.mutex());
+                read_more = false;
+            }
+
+            /* counted once per batch, not per line */
+            if (NULL != m_metrics) {
+                m_metrics->add(METRIC_LINES_READ, lines.size());
+                m_metrics->add(METRIC_BYTES_READ, bytes);
+                m_metrics->add(sent? METRIC_BATCHES_SENT: 
+                        METRIC_PRODUCE_FAILURES, 1);
             }
         }
-    } while (read_more);
+    } while (read_more && (drain || !m_paused));
 }/*}}}*/
 
 void IOHandler::updateLastIOTime()
@@ -152,6 +217,25 @@ void IOHandler::close()
     }
 }/*}}}*/
 
+bool IOHandler::isAllSent()
+{/*{{{*/
+    off_t pos = m_position_entry->readPos();
+    long fsize = getFileSize();
+    if (pos >= fsize) return true;
+    if (fsize - pos >= (long)m_line_max_bytes) return false;
+
+    /* the rest is a single line if it has no newline */
+    size_t len = fsize - pos;
+    string rest(len, '\0');
+    ssize_t n = -1;
+    if (0 == pthread_mutex_lock(&m_file_mutex.mutex())) {
+        if (NULL != m_file) n = pread(fileno(m_file), &rest[0], len, pos);
+        pthread_mutex_unlock(&m_file_mutex.mutex());
+    }
+
+    return (ssize_t)len == n && string::npos == rest.find('\n');
+}/*}}}*/
+
 long IOHandler::getFileSize()
 {/*{{{*/
     long fsize = 0;
@@ -33,6 +33,7 @@
 #include "base/mutex.h"
 #include "base/scoped_lock.h"
 #include "base/tools.h"
+#include "logkafka/metrics.h"
 #include "logkafka/position_entry.h"
 
 #include "easylogging/easylogging++.h"
@@ -42,7 +43,8 @@ using namespace base;
 
 namespace logkafka {
 
-typedef bool (*ReceiveFunc)(void *, vector<string> &);
+/* receives lines with the time they were written */
+typedef bool (*ReceiveFunc)(void *, vector<string> &, int64_t);
 
 class IOHandler
 {
@@ -54,10 +56,19 @@ class IOHandler
                   unsigned int max_line_at_once,
                   unsigned int line_max_bytes,
                   void *receive_func_arg,
-                  ReceiveFunc receiveLines);
+                  ReceiveFunc receiveLines,
+                  TaskMetrics *metrics = NULL);
         void close();
         static void onNotify(void *arg);
+        /* reads to the end of a file which is done, including a last 
+         * line without newline */
+        void drain();
+        /* lines are not read while paused, but still drained */
+        void setPaused(bool paused) { m_paused = paused; };
         bool getLastIOTime(struct timeval &tv);
+        /* lines up to the end of the file are sent, but maybe a last 
+         * line without newline, which is only sent by drain() */
+        bool isAllSent();
         long getFileSize();
         long getFilePos();
 
@@ -66,6 +77,7 @@ class IOHandler
         PositionEntry *m_position_entry;
 
     private:
+        void readLines(bool drain);
         void updateLastIOTime();
 
     private:
@@ -73,6 +85,9 @@ class IOHandler
         unsigned int m_line_max_bytes;
         ReceiveFunc m_receive_func;
         void *m_receive_func_arg;
+        TaskMetrics *m_metrics;
+        /* set from output callbacks, even while lines are read */
+        volatile bool m_paused;
 
         char *m_line;
 
@@ -76,6 +76,7 @@ bool LogKafka::start()
     }
 
     m_upload_timer_trigger = new TimerWatcher();
+    m_upload_timer_trigger->setName("collecting state upload");
     if (!m_upload_timer_trigger->init(m_loop, 0,
             m_config->zookeeper_upload_interval,
             m_manager, &Manager::uploadCollectingState)) {
@@ -21,9 +21,11 @@
 ///////////////////////////////////////////////////////////////////////////
 #include "logkafka/manager.h"
 
+#include <string.h>
 #include <unistd.h>
 
 #include "base/json.h"
+#include "base/time_format.h"
 #include "base/tools.h"
 #include "base/scoped_lock.h"
 
@@ -42,19 +44,40 @@ Manager::Manager(const Config *config)
     m_refresh_interval = config->refresh_interval;
     m_line_max_bytes = config->line_max_bytes;
     m_stat_silent_max_ms = config->stat_silent_max_ms;
+    m_pos_compact_interval = config->pos_compact_interval;
+    m_config_apply_delay = config->config_apply_delay;
+    m_glob_max_open_files = config->glob_max_open_files;
+    m_loop_probe_interval = config->loop_probe_interval;
+    m_slow_callback_ms = config->slow_callback_ms;
 
     m_refresh_trigger = NULL;
+    m_compact_trigger = NULL;
+    m_config_change_notifier = NULL;
+    m_brokers_change_notifier = NULL;
+    m_config_apply_trigger = NULL;
+    m_config_apply_pending = false;
     m_loop = NULL;
-    m_pos_file = NULL;
     m_position_file = NULL;
-    m_zookeeper = NULL;
+    m_config_source = NULL;
+    m_http_server = NULL;
+    m_loop_monitor = NULL;
+
+    m_log_config_version = -1;
+    m_log_config_hash = 0;
+    m_tail_stats_dirty = false;
 }/*}}}*/
 
 Manager::~Manager()
 {/*{{{*/
-    delete m_zookeeper; m_zookeeper = NULL;
+    delete m_config_source; m_config_source = NULL;
     delete m_refresh_trigger; m_refresh_trigger = NULL;
+    delete m_compact_trigger; m_compact_trigger = NULL;
+    delete m_config_change_notifier; m_config_change_notifier = NULL;
+    delete m_brokers_change_notifier; m_brokers_change_notifier = NULL;
+    delete m_config_apply_trigger; m_config_apply_trigger = NULL;
     delete m_position_file; m_position_file = NULL;
+    delete m_http_server; m_http_server = NULL;
+    delete m_loop_monitor; m_loop_monitor = NULL;
 
     ScopedLock l(m_tail_watchers_mutex);
     for (TailMap::iterator iter = m_tails.begin();
@@ -62,11 +85,29 @@ Manager::~Manager()
         delete iter->second; iter->second = NULL;
     }
 
+    for (TailGroupMap::iterator iter = m_tail_groups.begin();
+            iter != m_tail_groups.end(); ++iter) {
+        delete iter->second; iter->second = NULL;
+    }
+
+    for (BacklogMap::iterator iter = m_backlog_tails.begin();
+            iter != m_backlog_tails.end(); ++iter) {
+        for (BacklogTailMap::iterator it_b = iter->second.begin();
+                it_b != iter->second.end(); ++it_b) {
+            delete it_b->second; it_b->second = NULL;
+        }
+    }
+
     for (TaskMap::iterator iter = m_tasks.begin();
             iter != m_tasks.end(); ++iter) {
         delete iter->second; iter->second = NULL;
     }
 
+    for (PipelineMap::iterator iter = m_pipelines.begin();
+            iter != m_pipelines.end(); ++iter) {
+        iter->second->release(); iter->second = NULL;
+    }
+
     OutputKafka::stopProducers();
 }/*}}}*/
 
@@ -74,8 +115,32 @@ bool Manager::init(uv_loop_t *loop)
 {/*{{{*/
     m_loop = loop;
 
+    /* before the config source starts threads running callbacks */
+    if (m_slow_callback_ms > 0) {
+        LoopMonitor::setCallbackTracer(m_slow_callback_ms, onCallbackTraced);
+    }
+
+    m_config_change_notifier = new AsyncWatcher();
+    m_config_change_notifier->setName("config change");
+    if (!m_config_change_notifier->init(m_loop, this, handleConfigChange)) {
+        LERROR << "Fail to init config change notifier";
+        delete m_config_change_notifier; m_config_change_notifier = NULL;
+        return false;
+    }
+
+    m_brokers_change_notifier = new AsyncWatcher();
+    m_brokers_change_notifier->setName("brokers change");
+    if (!m_brokers_change_notifier->init(m_loop, this, handleBrokersChange)) {
+        LERROR << "Fail to init brokers change notifier";
+        delete m_brokers_change_notifier; m_brokers_change_notifier = NULL;
+        return false;
+    }
+
     initKafkaConf();
-    initZookeeper();
+    initConfigSource();
+
+    m_state_uploader.init(m_config->zookeeper_upload_shard_bytes,
+            "zlib" == m_config->zookeeper_upload_compression);
 
     return true;
 }/*}}}*/
@@ -88,36 +153,127 @@ bool Manager::initKafkaConf()
     return true;
 }/*}}}*/
 
-bool Manager::initZookeeper()
+bool Manager::initConfigSource()
 {/*{{{*/
-    assert (NULL == m_zookeeper);
-    m_zookeeper = new Zookeeper();
+    assert (NULL == m_config_source);
+
+    if ("file" == m_config->config_source) {
+        FileConfigSource *file_config_source = new FileConfigSource();
+        m_config_source = file_config_source;
+        m_config_source->setConfigChangeCallback(onConfigChange, this);
+
+        if (!file_config_source->init(m_loop, m_config->log_config_path, 
+                    m_config->log_state_path, m_config->broker_urls)) {
+            LERROR << "Fail to init file config source, log config path " 
+                   << m_config->log_config_path;
+            delete m_config_source; m_config_source = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    Zookeeper *zookeeper = new Zookeeper();
+    m_config_source = zookeeper;
+    m_config_source->setConfigChangeCallback(onConfigChange, this);
+    m_config_source->setBrokersChangeCallback(onBrokersChange, this);
 
-    if (!m_zookeeper->init(m_config->zk_urls)) {
+    if (!zookeeper->init(m_config->zk_urls)) {
         LERROR << "Fail to init zookeeper, zk urls " << m_config->zk_urls;
-        delete m_zookeeper; m_zookeeper = NULL;
+        delete m_config_source; m_config_source = NULL;
         return false;
     }
 
     return true;
 }/*}}}*/
 
-bool Manager::refreshTaskConfs()
+void Manager::onConfigChange(void *arg)
+{/*{{{*/
+    /* may be called in zookeeper thread */
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+    manager->m_config_change_notifier->send();
+}/*}}}*/
+
+void Manager::onBrokersChange(void *arg)
+{/*{{{*/
+    /* may be called in zookeeper thread */
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+    manager->m_brokers_change_notifier->send();
+}/*}}}*/
+
+void Manager::handleBrokersChange(void *arg)
 {/*{{{*/
-    string config = m_zookeeper->getLogConfig();
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+
+    if (NULL == manager->m_config_source) return;
+
+    if (!OutputKafka::refreshBrokers(manager->m_config_source)) {
+        LERROR << "Fail to refresh brokers of producers";
+    }
+}/*}}}*/
+
+void Manager::handleConfigChange(void *arg)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+
+    /* watchers are refreshed when manager starts */
+    if (NULL == manager->m_config_apply_trigger) return;
+
+    /* changes during the delay are applied together */
+    if (!manager->m_config_apply_pending) {
+        manager->m_config_apply_pending = true;
+        manager->m_config_apply_trigger->start();
+    }
+}/*}}}*/
+
+void Manager::applyConfig(void *arg)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+    manager->m_config_apply_pending = false;
+
+    LDEBUG << "Apply changed config";
+    refreshWatchers(manager);
+}/*}}}*/
+
+bool Manager::refreshTaskConfs(TaskConfDiff &diff)
+{/*{{{*/
+    /* nothing to do if the config znode has not been modified */
+    int64_t version = m_config_source->getLogConfigVersion();
+    if (version >= 0 && version == m_log_config_version) {
+        return true;
+    }
+
+    string config = m_config_source->getLogConfig(&version);
+    if (!reconcileTaskConfs(config, diff)) {
+        return false;
+    }
 
+    m_log_config_version = version;
+
+    return true;
+}/*}}}*/
+
+bool Manager::reconcileTaskConfs(const string &config, TaskConfDiff &diff)
+{/*{{{*/
     /* minimal config length should be greater than '{}' */
-    if (config.length() <= 2) config = "{}";
+    const char *json = (config.length() <= 2) ? "{}" : config.c_str();
+
+    /* the znode may be rewritten with the same content */
+    uint64_t config_hash = Json::hashBytes(json, strlen(json));
+    if (config_hash == m_log_config_hash) {
+        return true;
+    }
 
-    /* 1. Parse a JSON text string to a document. */
+    /* 1. Parse a JSON text string to a document, in situ to save 
+     * copying every string of a large config. */
+    size_t json_len = strlen(json);
+    vector<char> buf(json, json + json_len + 1);
     Document document;
-    if (document.Parse<0>(config.c_str()).HasParseError()) {
+    if (document.ParseInsitu<0>(&buf[0]).HasParseError()) {
         LERROR << "Json parsing failed, json: " << config;
         return false;
     }
 
-    m_task_confs.clear();
-
     /* 2. Access values in document. */
     if (!document.IsObject()) {
         LERROR << "Document is not object, type: "
@@ -125,7 +281,9 @@ bool Manager::refreshTaskConfs()
         return false;
     }
 
-    /* Iterating object members */
+    /* Iterating object members, only the task confs whose json value 
+     * changed are parsed again */
+    PatternSet legal;
     for (Value::ConstMemberIterator itr = document.MemberBegin();
             itr != document.MemberEnd(); ++itr) {
         if (!itr->name.IsString()) {
@@ -133,62 +291,268 @@ bool Manager::refreshTaskConfs()
             continue;
         }
 
+        string path_pattern = (itr->name).GetString();
+        const Value &log_item = itr->value;
+        uint64_t item_hash = Json::hash(log_item);
+
+        TaskConfHashMap::iterator it_h = m_task_conf_hashes.find(path_pattern);
+        if (it_h != m_task_conf_hashes.end() && it_h->second == item_hash) {
+            legal.insert(path_pattern);
+            continue;
+        }
+
         TaskConf item;
+        if (!parseTaskConf(log_item, item) || !item.isLegal()) {
+            continue;
+        }
 
-        const Value &log_item = itr->value;
-        try {
-            Json::getValue(log_item, "valid", item.valid);
-            Json::getValue(log_item, "log_path", item.log_conf.log_path);
+        legal.insert(path_pattern);
+        m_task_conf_hashes[path_pattern] = item_hash;
+
+        TaskConfMap::iterator it_c = m_task_confs.find(path_pattern);
+        if (it_c == m_task_confs.end()) {
+            m_task_confs[path_pattern] = item;
+            diff.added.insert(path_pattern);
+        } else if (!(it_c->second == item)) {
+            it_c->second = item;
+            if (diff.added.find(path_pattern) == diff.added.end()) {
+                diff.updated.insert(path_pattern);
+            }
+        }
+    }
+
+    /* task confs which are removed or become illegal */
+    for (TaskConfMap::const_iterator it_c = m_task_confs.begin();
+            it_c != m_task_confs.end(); ++it_c) {
+        if (legal.find(it_c->first) == legal.end()) {
+            diff.deleted.insert(it_c->first);
+        }
+    }
 
-            Json::getValue(log_item, "follow_last", item.log_conf.follow_last);
-            Json::getValue(log_item, "batchsize", item.log_conf.batchsize);
+    for (PatternSet::const_iterator iter = diff.deleted.begin();
+            iter != diff.deleted.end(); ++iter) {
+        m_task_confs.erase(*iter);
+        m_task_conf_hashes.erase(*iter);
+    }
 
-            item.log_conf.read_from_head = true;
+    m_log_config_hash = config_hash;
 
-            Json::getValue(log_item, "topic", item.kafka_topic_conf.topic);
-            Json::getValue(log_item, "key", item.kafka_topic_conf.key);
-            Json::getValue(log_item, "partition", item.kafka_topic_conf.partition);
-            Json::getValue(log_item, "compression_codec", 
-                    item.kafka_topic_conf.compression_codec);
+    return true;
+}/*}}}*/
 
-            Json::getValue(log_item, "required_acks", 
-                    item.kafka_topic_conf.required_acks);
+bool Manager::parseTaskConf(const Value &log_item, TaskConf &item)
+{/*{{{*/
+    try {
+        Json::getValue(log_item, "valid", item.valid);
+        Json::getValue(log_item, "log_path", item.log_conf.log_path);
 
-            Json::getValue(log_item, "message_timeout_ms", 
-                    item.kafka_topic_conf.message_timeout_ms);
-        } catch(const JsonErr &err) {
-            LERROR << "Json error: " << err
-                   << "Json string: " << Json::serialize(log_item);
-            continue;
-        } catch(...) {
-            continue;
+        Json::getValue(log_item, "follow_last", item.log_conf.follow_last);
+        Json::getValue(log_item, "batchsize", item.log_conf.batchsize);
+
+        item.log_conf.read_from_head = true;
+
+        /* optional, configs created by older tools do not have it */
+        item.log_conf.backlog_parallelism = DEFAULT_BACKLOG_PARALLELISM;
+        if (log_item.HasMember("backlog_parallelism")) {
+            Json::getValue(log_item, "backlog_parallelism", 
+                    item.log_conf.backlog_parallelism);
         }
 
-        string path_pattern = (itr->name).GetString();
-        if (item.isLegal()) {
-            m_task_confs[path_pattern] = item;
+        /* optional, lines are sent as read without it */
+        if (log_item.HasMember("pipeline")) {
+            const Value &pipeline = log_item["pipeline"];
+            if (!pipeline.IsArray()) {
+                LERROR << "pipeline is not an array, Json string: " 
+                       << Json::serialize(log_item);
+                return false;
+            }
+
+            for (Value::ConstValueIterator iter = pipeline.Begin();
+                    iter != pipeline.End(); ++iter) {
+                StageConf stage_conf;
+                if (!iter->IsObject() || !parseStageConf(*iter, stage_conf)) {
+                    return false;
+                }
+                item.stages.push_back(stage_conf);
+            }
         }
+
+        /* several outputs are listed in outputs, a single one may be 
+         * given by fields of the task conf itself */
+        if (!log_item.HasMember("outputs")) {
+            OutputConf output_conf;
+            if (!parseOutputConf(log_item, output_conf)) return false;
+            item.outputs.push_back(output_conf);
+            return true;
+        }
+
+        const Value &outputs = log_item["outputs"];
+        if (!outputs.IsArray()) {
+            LERROR << "outputs is not an array, Json string: " 
+                   << Json::serialize(log_item);
+            return false;
+        }
+
+        for (Value::ConstValueIterator iter = outputs.Begin();
+                iter != outputs.End(); ++iter) {
+            OutputConf output_conf;
+            if (!iter->IsObject() || !parseOutputConf(*iter, output_conf)) {
+                return false;
+            }
+            item.outputs.push_back(output_conf);
+        }
+    } catch(const JsonErr &err) {
+        LERROR << "Json error: " << err
+               << "Json string: " << Json::serialize(log_item);
+        return false;
+    } catch(...) {
+        return false;
     }
 
     return true;
 }/*}}}*/
 
-bool Manager::start()
+bool Manager::parseOutputConf(const Value &item, OutputConf &conf)
 {/*{{{*/
-    if (NULL == (m_pos_file = fopen(m_pos_path.c_str(), "r+"))) {
-        LERROR << "Position file " << m_pos_path << " does not exists";
-        if (NULL == (m_pos_file = fopen(m_pos_path.c_str(), "w+"))) {
-            LERROR << "Fail to create position file " << m_pos_path;
-            return false;
+    try {
+        /* optional, lines are produced to kafka by default */
+        conf.output = "kafka";
+        if (item.HasMember("output")) {
+            Json::getValue(item, "output", conf.output);
         }
-        LINFO << "Create position file " << m_pos_path;
-    };
-    setvbuf(m_pos_file, reinterpret_cast<char *>(NULL), _IONBF, 0);
-    m_position_file = PositionFile::parse(m_pos_file);
+
+        if ("file" == conf.output) {
+            FileOutputConf &file_output_conf = conf.file_output_conf;
+            Json::getValue(item, "output_path", file_output_conf.path);
+
+            if (item.HasMember("segment_bytes")) {
+                Json::getValue(item, "segment_bytes", 
+                        file_output_conf.segment_bytes);
+            }
+
+            if (item.HasMember("segment_ms")) {
+                Json::getValue(item, "segment_ms", 
+                        file_output_conf.segment_ms);
+            }
+
+            if (item.HasMember("compression_codec")) {
+                Json::getValue(item, "compression_codec", 
+                        file_output_conf.compression_codec);
+            }
+
+            return true;
+        }
+
+        if ("unix" == conf.output || "tcp" == conf.output) {
+            StreamOutputConf &stream_output_conf = conf.stream_output_conf;
+            Json::getValue(item, "output_address", 
+                    stream_output_conf.address);
+
+            if (item.HasMember("max_pending_bytes")) {
+                Json::getValue(item, "max_pending_bytes", 
+                        stream_output_conf.max_pending_bytes);
+            }
+
+            return true;
+        }
+
+        KafkaTopicConf &kafka_topic_conf = conf.kafka_topic_conf;
+        Json::getValue(item, "topic", kafka_topic_conf.topic);
+        Json::getValue(item, "key", kafka_topic_conf.key);
+        Json::getValue(item, "partition", kafka_topic_conf.partition);
+        Json::getValue(item, "compression_codec", 
+                kafka_topic_conf.compression_codec);
+
+        Json::getValue(item, "required_acks", 
+                kafka_topic_conf.required_acks);
+
+        Json::getValue(item, "message_timeout_ms", 
+                kafka_topic_conf.message_timeout_ms);
+    } catch(const JsonErr &err) {
+        LERROR << "Json error: " << err
+               << "Json string: " << Json::serialize(item);
+        return false;
+    } catch(...) {
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+bool Manager::getStrings(const Value &item, const char *name, 
+        vector<string> &values)
+{/*{{{*/
+    /* optional, none if missing */
+    if (!item.HasMember(name)) return true;
+
+    const Value &array = item[name];
+    if (!array.IsArray()) return false;
+
+    for (Value::ConstValueIterator iter = array.Begin();
+            iter != array.End(); ++iter) {
+        if (!iter->IsString()) return false;
+        values.push_back(string(iter->GetString(), iter->GetStringLength()));
+    }
+
+    return true;
+}/*}}}*/
+
+bool Manager::parseStageConf(const Value &item, StageConf &conf)
+{/*{{{*/
+    try {
+        Json::getValue(item, "stage", conf.stage);
+
+        if ("truncate" == conf.stage) {
+            Json::getValue(item, "max_bytes", conf.max_bytes);
+        }
+
+        if ("filter" == conf.stage) {
+            if (!getStrings(item, "include", conf.include)
+                    || !getStrings(item, "exclude", conf.exclude)
+                    || !getStrings(item, "include_regex", conf.include_regex)
+                    || !getStrings(item, "exclude_regex", conf.exclude_regex)) {
+                LERROR << "Filter patterns are not arrays of strings, "
+                       << "Json string: " << Json::serialize(item);
+                return false;
+            }
+        }
+
+        if ("sample" == conf.stage) {
+            Json::getValue(item, "mode", conf.mode);
+            if ("limit" == conf.mode) {
+                Json::getValue(item, "lines_per_s", conf.lines_per_s);
+                if (item.HasMember("burst")) {
+                    Json::getValue(item, "burst", conf.burst);
+                }
+            } else {
+                Json::getValue(item, "rate", conf.rate);
+            }
+            if (item.HasMember("key_field")) {
+                Json::getValue(item, "key_field", conf.key_field);
+            }
+        }
+    } catch(const JsonErr &err) {
+        LERROR << "Json error: " << err
+               << "Json string: " << Json::serialize(item);
+        return false;
+    } catch(...) {
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+bool Manager::start()
+{/*{{{*/
+    if (NULL == (m_position_file = PositionFile::parse(m_pos_path))) {
+        LERROR << "Fail to load position file " << m_pos_path;
+        return false;
+    }
 
     refreshWatchers(this);
 
     m_refresh_trigger = new TimerWatcher();
+    m_refresh_trigger->setName("watchers refresh");
     bool res = m_refresh_trigger->init(m_loop,
                         0,
                         m_refresh_interval,
@@ -201,24 +565,160 @@ bool Manager::start()
         return false;
     }
 
+    m_compact_trigger = new TimerWatcher();
+    m_compact_trigger->setName("position file compact");
+    res = m_compact_trigger->init(m_loop,
+                        m_pos_compact_interval,
+                        m_pos_compact_interval,
+                        this,
+                        compactPositionFile);
+
+    if (!res) { 
+        LERROR << "Fail to init position file compact watcher";
+        delete m_compact_trigger; m_compact_trigger = NULL;
+        return false;
+    }
+
+    m_config_apply_trigger = new TimerWatcher();
+    m_config_apply_trigger->setName("config apply");
+    res = m_config_apply_trigger->init(m_loop,
+                        m_config_apply_delay,
+                        0,
+                        this,
+                        applyConfig);
+
+    if (!res) { 
+        LERROR << "Fail to init config apply watcher";
+        delete m_config_apply_trigger; m_config_apply_trigger = NULL;
+        return false;
+    }
+
+    /* only started by config changes */
+    m_config_apply_trigger->stop();
+
+    if (!initHttpServer()) {
+        return false;
+    }
+
+    if (!initLoopMonitor()) {
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+bool Manager::initHttpServer()
+{/*{{{*/
+    if (m_config->http_address.empty()) {
+        return true;
+    }
+
+    m_http_server = new HttpServer();
+    if (!m_http_server->init(m_loop, m_config->http_address, 
+                this, handleHttpRequest)) {
+        LERROR << "Fail to init http server on " << m_config->http_address;
+        delete m_http_server; m_http_server = NULL;
+        return false;
+    }
+
     return true;
 }/*}}}*/
 
+bool Manager::initLoopMonitor()
+{/*{{{*/
+    if (0 == m_loop_probe_interval) {
+        return true;
+    }
+
+    m_loop_monitor = new LoopMonitor();
+    if (!m_loop_monitor->init(m_loop, m_loop_probe_interval, 
+                this, onLoopLag)) {
+        LERROR << "Fail to init loop monitor";
+        delete m_loop_monitor; m_loop_monitor = NULL;
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+void Manager::onLoopLag(void *arg, int64_t lag_us)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+
+    MetricsRegistry::instance().record(HISTOGRAM_LOOP_LAG_US, lag_us);
+
+    /* the slow callback itself is logged when tracing is on */
+    if (manager->m_slow_callback_ms > 0
+            && lag_us >= (int64_t)manager->m_slow_callback_ms * 1000) {
+        LWARNING << "Loop was blocked for " << lag_us / 1000 << " ms";
+    }
+}/*}}}*/
+
+void Manager::onCallbackTraced(const char *kind, 
+        const string &name, 
+        int64_t duration_us, 
+        bool slow)
+{/*{{{*/
+    /* also called from the zookeeper thread, only touches atomics */
+    MetricsRegistry &metrics = MetricsRegistry::instance();
+    metrics.record(HISTOGRAM_CALLBACK_US, duration_us);
+    if (slow) {
+        metrics.addGlobal(METRIC_SLOW_CALLBACKS, 1);
+    }
+}/*}}}*/
+
 bool Manager::stop()
 {/*{{{*/
     if (NULL != m_refresh_trigger) {
         m_refresh_trigger->stop();
     }
 
+    if (NULL != m_compact_trigger) {
+        m_compact_trigger->stop();
+    }
+
+    if (NULL != m_config_source) {
+        m_config_source->setConfigChangeCallback(NULL, NULL);
+        m_config_source->setBrokersChangeCallback(NULL, NULL);
+    }
+
+    if (NULL != m_config_change_notifier) {
+        m_config_change_notifier->close();
+    }
+
+    if (NULL != m_brokers_change_notifier) {
+        m_brokers_change_notifier->close();
+    }
+
+    if (NULL != m_config_apply_trigger) {
+        m_config_apply_trigger->stop();
+        m_config_apply_pending = false;
+    }
+
+    if (NULL != m_http_server) {
+        m_http_server->close();
+    }
+
+    if (NULL != m_loop_monitor) {
+        m_loop_monitor->close();
+    }
+
     ScopedLock l(m_tail_watchers_mutex);
     stopWatchers(getTailsKeys(m_tails), true, false);
+    PatternSet groups;
+    for (TailGroupMap::const_iterator iter = m_tail_groups.begin();
+            iter != m_tail_groups.end(); ++iter) {
+        groups.insert(iter->first);
+    }
+    stopWatchers(groups, true, false);
+    publishTailStats();
 
-    if (NULL != m_pos_file) {
-        fclose(m_pos_file); m_pos_file = NULL;
+    if (NULL != m_position_file) {
+        m_position_file->close();
     }
 
-    if (NULL != m_zookeeper) {
-        m_zookeeper->close();
+    if (NULL != m_config_source) {
+        m_config_source->close();
     }
 
     return true;
@@ -229,97 +729,140 @@ void Manager::refreshWatchers(void *arg)
     Manager *manager = reinterpret_cast<Manager *>(arg);
     ScopedLock l(manager->m_tail_watchers_mutex);
 
-    TaskMap &tasks = manager->m_tasks;
-    TailMap &tails = manager->m_tails;
+    /* in case a broker change was signalled before producers exist */
+    handleBrokersChange(manager);
 
-    if (!manager->refreshTaskConfs()) {
+    TaskConfDiff diff;
+    if (!manager->refreshTaskConfs(diff)) {
         LERROR << "Fail to get task config";
         return;
     }
 
-    if (!manager->refreshTasks()) {
+    if (!manager->refreshTasks(diff)) {
         LERROR << "Fail to refresh tasks";
         return;
     }
-    
-    /* get added tasks */
-    set<string> added = diff_set(
-            manager->getTasksKeys(tasks), 
-            manager->getTailsKeys(tails));
-
-    /* get deleted tasks */
-    set<string> deleted = diff_set(
-            manager->getTailsKeys(tails), 
-            manager->getTasksKeys(tasks));
-
-    /* get same tasks (path_pattern same, but conf may differ) */
-    set<string> keeped = intersect_set(
-            manager->getTailsKeys(tails), 
-            manager->getTasksKeys(tasks));
-
-    manager->stopWatchers(deleted, true, true);
+
+    /* only watchers of changed tasks, tasks with time format and tasks 
+     * whose watchers failed to start need to be visited */
+    PatternSet visited(diff.added.begin(), diff.added.end());
+    visited.insert(diff.updated.begin(), diff.updated.end());
+    visited.insert(manager->m_dynamic_patterns.begin(), 
+            manager->m_dynamic_patterns.end());
+    visited.insert(manager->m_pending_patterns.begin(), 
+            manager->m_pending_patterns.end());
+
+    PatternSet added;
+    PatternSet keeped;
+    for (PatternSet::const_iterator iter = visited.begin();
+            iter != visited.end(); ++iter) {
+        if (manager->m_tasks.find(*iter) == manager->m_tasks.end()) {
+            continue;
+        }
+
+        if (manager->m_tails.find(*iter) == manager->m_tails.end()
+                && manager->m_tail_groups.find(*iter) 
+                == manager->m_tail_groups.end()) {
+            added.insert(*iter);
+        } else {
+            keeped.insert(*iter);
+        }
+    }
+
+    manager->stopWatchers(diff.deleted, true, true);
     manager->startWatchers(added);
     manager->updateWatchers(keeped);
-}/*}}}*/
 
-bool Manager::refreshTasks()
-{/*{{{*/
-    set<string> task_confs_keys = 
-        getTaskConfsKeys(m_task_confs);
+    for (PatternSet::const_iterator iter = manager->m_dynamic_patterns.begin();
+            iter != manager->m_dynamic_patterns.end(); ++iter) {
+        manager->refreshBacklogWatchers(*iter);
+    }
+
+    /* pick up new, deleted and rotated files matching wildcards */
+    for (TailGroupMap::iterator iter = manager->m_tail_groups.begin();
+            iter != manager->m_tail_groups.end(); ++iter) {
+        iter->second->refresh();
+    }
 
-    set<string> tasks_keys = 
-        getTasksKeys(m_tasks);
+    if (manager->m_tail_stats_dirty) {
+        manager->publishTailStats();
+    }
+}/*}}}*/
 
-    /* get added task confs */
-    set<string> added = diff_set(task_confs_keys, tasks_keys);
+void Manager::compactPositionFile(void *arg)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
 
-    /* get deleted task confs */
-    set<string> deleted = diff_set(tasks_keys, task_confs_keys);
+    if (NULL == manager->m_position_file) return;
 
-    /* get same task confs */
-    set<string> keeped = intersect_set(tasks_keys, task_confs_keys);
+    if (!manager->m_position_file->compact(manager->m_loop)) {
+        LERROR << "Fail to compact position file " << manager->m_pos_path;
+    }
+}/*}}}*/
 
-    deleteTasks(deleted);
-    addTasks(added);
-    updateTasks(keeped);
+bool Manager::refreshTasks(const TaskConfDiff &diff)
+{/*{{{*/
+    deleteTasks(diff.deleted);
+    addTasks(diff.added);
+    updateTasks(diff.updated);
+
+    /* paths of the other tasks only change with time format */
+    for (PatternSet::const_iterator iter = m_dynamic_patterns.begin();
+            iter != m_dynamic_patterns.end(); ++iter) {
+        if (diff.added.find(*iter) == diff.added.end()
+                && diff.updated.find(*iter) == diff.updated.end()) {
+            updateTaskPaths(*iter);
+        }
+    }
 
     return true;
 }/*}}}*/
 
-void Manager::addTasks(set<string> path_patterns)
+void Manager::addTasks(const PatternSet &path_patterns)
 {/*{{{*/
-    set<string>::const_iterator iter;
+    PatternSet::const_iterator iter;
     for (iter = path_patterns.begin(); iter != path_patterns.end(); ++iter) {
         string path_pattern = *iter;
         Task *task = new Task();
         task->conf = m_task_confs[path_pattern];
+        task->metrics = MetricsRegistry::instance().acquireTask(path_pattern);
 
         if (m_tasks.find(path_pattern) != m_tasks.end()) {
             delete m_tasks[path_pattern];
         }
         m_tasks[path_pattern] = task;
 
+        if (path_pattern.find('%') != string::npos) {
+            m_dynamic_patterns.insert(path_pattern);
+        }
+
         updateTaskPaths(path_pattern);
 
         LINFO << "Add task with path_pattern: " << path_pattern;
     }
 }/*}}}*/
 
-void Manager::deleteTasks(set<string> path_patterns)
+void Manager::deleteTasks(const PatternSet &path_patterns)
 {/*{{{*/
-    set<string>::const_iterator iter;
+    PatternSet::const_iterator iter;
     for (iter = path_patterns.begin(); iter != path_patterns.end(); ++iter) {
         string path_pattern = *iter;
         delete getTask(path_pattern);
         m_tasks.erase(path_pattern);
+        if (m_pipelines.find(path_pattern) != m_pipelines.end()) {
+            m_pipelines[path_pattern]->release();
+            m_pipelines.erase(path_pattern);
+        }
+        m_dynamic_patterns.erase(path_pattern);
+        m_pending_patterns.erase(path_pattern);
 
         LINFO << "Delete task with path_pattern: " << path_pattern;
     }
 }/*}}}*/
 
-void Manager::updateTasks(set<string> path_patterns)
+void Manager::updateTasks(const PatternSet &path_patterns)
 {/*{{{*/
-    set<string>::const_iterator iter; 
+    PatternSet::const_iterator iter; 
     for (iter = path_patterns.begin(); iter != path_patterns.end(); ++iter) {
         string path_pattern = *iter;
         m_tasks[path_pattern]->conf = m_task_confs[path_pattern];
@@ -346,18 +889,16 @@ void Manager::updateTaskPaths(const string &path_pattern)
             LDEBUG << "Add last path " << last_path << " from position file";
             task.addPath(last_path);
 
-            /* replace the time format substring in path_pattern with '*',
-             * glob all files with this pattern, add the files which are 
-             * newer than last_path and older than expanded_path */
-            vector<string> path_pattern_globed;
-            if (getPathPatternGlobed(path_pattern, path_pattern_globed)) {
-                for (vector<string>::const_iterator iter = path_pattern_globed.begin();
-                        iter != path_pattern_globed.end(); ++iter) 
+            /* add the files which are newer than last_path and older 
+             * than expanded_path */
+            vector<string> backlog_paths;
+            if (getBacklogPaths(path_pattern, last_path, expanded_path, 
+                        backlog_paths)) {
+                for (vector<string>::const_iterator iter = backlog_paths.begin();
+                        iter != backlog_paths.end(); ++iter) 
                 {
-                    if (*iter > last_path && *iter < expanded_path) {
-                        LDEBUG << "Add path " << *iter << " with glob";
-                        task.addPath(*iter);
-                    }
+                    LDEBUG << "Add backlog path " << *iter;
+                    task.addPath(*iter);
                 }
             }
         }
@@ -385,7 +926,7 @@ void Manager::updateTaskPaths(const string &path_pattern)
                     break;
                 }
             } else {
-                if (-1 == access(first_path.c_str(), R_OK)
+                if (!m_dir_cache.exists(first_path)
                         && first_path < expanded_path) {
                     task.delFirstPath();
                     LINFO << "Delete expired path " << first_path 
@@ -399,7 +940,7 @@ void Manager::updateTaskPaths(const string &path_pattern)
     } else {
         while (task.hasPath()) {
             string first_path = task.getFirstPath();
-            if (-1 == access(first_path.c_str(), R_OK)
+            if (!m_dir_cache.exists(first_path)
                     && first_path < expanded_path) {
                 task.delFirstPath();
                 LINFO << "Delete expired path " << first_path 
@@ -435,10 +976,92 @@ string Manager::expandPath(const string &path_pattern)
     return p;
 }/*}}}*/
 
-bool Manager::getPathPatternGlobed(const string &path_pattern, 
-        vector<string> &path_pattern_globed)
+bool Manager::getBacklogPaths(const string &path_pattern, 
+        const string &last_path,
+        const string &expanded_path,
+        vector<string> &paths)
 {/*{{{*/
-    string path_pattern_to_glob = path_pattern;
+    string dir, name_format, last_dir, last_name, expanded_dir, expanded_name;
+    TimeFormat format;
+
+    /* time format in directories, or not parsable */
+    if (!splitPath(path_pattern, dir, name_format) 
+            || dir.find('%') != string::npos 
+            || !format.init(name_format)
+            || !splitPath(last_path, last_dir, last_name)
+            || !splitPath(expanded_path, expanded_dir, expanded_name)) {
+        /* replace the time format substring in path_pattern with '*',
+         * and glob all files with this pattern */
+        vector<string> path_pattern_globed;
+        if (!getPathPatternGlobed(path_pattern, path_pattern_globed)) {
+            return false;
+        }
+
+        for (vector<string>::const_iterator iter = path_pattern_globed.begin();
+                iter != path_pattern_globed.end(); ++iter) {
+            if (*iter > last_path && *iter < expanded_path) {
+                paths.push_back(*iter);
+            }
+        }
+
+        return true;
+    }
+
+    const vector<string> *names = m_dir_cache.list(dir);
+    if (NULL == names) {
+        return false;
+    }
+
+    string prefix = dir + (dir == "/"? "": "/");
+    if (format.isOrdered()) {
+        /* names sort the same as their time, select the range directly */
+        vector<string>::const_iterator first = 
+            upper_bound(names->begin(), names->end(), last_name);
+        vector<string>::const_iterator last = 
+            lower_bound(first, names->end(), expanded_name);
+        for (vector<string>::const_iterator iter = first; 
+                iter != last; ++iter) {
+            time_t t;
+            if (format.parse(*iter, t)) {
+                paths.push_back(prefix + *iter);
+            }
+        }
+
+        return true;
+    }
+
+    time_t last_time, expanded_time;
+    if (!format.parse(last_name, last_time) 
+            || !format.parse(expanded_name, expanded_time)) {
+        return false;
+    }
+
+    /* only names starting with the literal prefix can match */
+    multimap<time_t, string> selected;
+    for (vector<string>::const_iterator iter = 
+            lower_bound(names->begin(), names->end(), format.getPrefix());
+            iter != names->end() 
+            && 0 == iter->compare(0, format.getPrefix().length(), 
+                format.getPrefix()); 
+            ++iter) {
+        time_t t;
+        if (format.parse(*iter, t) && t > last_time && t < expanded_time) {
+            selected.insert(make_pair(t, prefix + *iter));
+        }
+    }
+
+    for (multimap<time_t, string>::const_iterator iter = selected.begin();
+            iter != selected.end(); ++iter) {
+        paths.push_back(iter->second);
+    }
+
+    return true;
+}/*}}}*/
+
+bool Manager::getPathPatternGlobed(const string &path_pattern, 
+        vector<string> &path_pattern_globed)
+{/*{{{*/
+    string path_pattern_to_glob = path_pattern;
     while (true) {
         std::size_t start = path_pattern_to_glob.find_first_of('%', 0);
         if (start == string::npos) {
@@ -487,19 +1110,30 @@ TailWatcher* Manager::setupWatcher(
         string path_pattern, 
         string path,
         PositionEntry *position_entry,
-        bool enabled)
+        bool enabled,
+        UpdateFunc update_func,
+        void *update_func_arg)
 {/*{{{*/
     LDEBUG << "task conf" << conf.log_conf;
 
-    OutputKafka *output = new OutputKafka();
-    output->setKafkaConf(m_kafka_conf);
-    if (!output->init(m_zookeeper, conf.kafka_topic_conf.compression_codec)) {
-        LERROR << "Fail to init kafka output";
-        delete output;
-        return false;
-    };
+    /* watchers of glob groups and backlogs read files of a task at 
+     * the same time, they must not write to the same segments */
+    string source = "";
+    if (NULL == update_func) {
+        update_func = updateWatcherRotate;
+        update_func_arg = this;
+    } else {
+        source = path;
+    }
 
-    output->setKafkaTopicConf(conf.kafka_topic_conf);
+    Output *output = createOutput(conf, source);
+    if (NULL == output) {
+        return NULL;
+    }
+
+    /* stages keeping state, like sample limit, see all files of a glob
+     * group or backlog */
+    Pipeline *pipeline = getPipeline(path_pattern, conf);
 
     // init tail watcher
     TailWatcher *tail_watcher = new TailWatcher();
@@ -512,32 +1146,141 @@ TailWatcher* Manager::setupWatcher(
             conf.log_conf.batchsize,
             m_line_max_bytes,
             enabled, 
-            updateWatcherRotate, 
+            update_func, 
+            update_func_arg,
             receiveLines,
             conf,
-            output);
+            output,
+            pipeline);
 
     if (!res) {
         LERROR << "Fail to init tail watcher";
         delete tail_watcher; tail_watcher = NULL;
+    } else {
+        if (!enabled) tail_watcher->stop(false);
+        m_tail_stats_dirty = true;
     }
 
     return tail_watcher;
 }/*}}}*/
 
-void Manager::startWatchers(set<string> paths)
+Pipeline *Manager::getPipeline(const string &path_pattern, 
+        const TaskConf &conf)
+{/*{{{*/
+    if (conf.stages.empty()) return NULL;
+
+    PipelineMap::iterator iter = m_pipelines.find(path_pattern);
+    if (iter != m_pipelines.end() && iter->second->getConfs() == conf.stages) {
+        return iter->second;
+    }
+
+    /* watchers set up before a change of stages keep the old one */
+    Pipeline *pipeline = new Pipeline();
+    if (!pipeline->init(conf.stages)) {
+        LERROR << "Fail to init pipeline of " << path_pattern;
+        pipeline->release();
+        return NULL;
+    }
+
+    if (iter != m_pipelines.end()) {
+        iter->second->release();
+        iter->second = pipeline;
+    } else {
+        m_pipelines[path_pattern] = pipeline;
+    }
+
+    return pipeline;
+}/*}}}*/
+
+Output *Manager::createOutput(const TaskConf &conf, const string &source)
+{/*{{{*/
+    if (1 == conf.outputs.size()) {
+        return createOutput(conf.outputs[0], source);
+    }
+
+    /* lines read once are passed to each of the outputs */
+    OutputFanout *fanout = new OutputFanout();
+    for (vector<OutputConf>::const_iterator iter = conf.outputs.begin();
+            iter != conf.outputs.end(); ++iter) {
+        Output *output = createOutput(*iter, source);
+        if (NULL == output) {
+            delete fanout;
+            return NULL;
+        }
+        fanout->add(output);
+    }
+
+    return fanout;
+}/*}}}*/
+
+Output *Manager::createOutput(const OutputConf &conf, const string &source)
+{/*{{{*/
+    if ("file" == conf.output) {
+        OutputFile *output = new OutputFile();
+        FileOutputConf file_output_conf = conf.file_output_conf;
+        file_output_conf.source = source;
+        if (!output->init(&file_output_conf)) {
+            LERROR << "Fail to init file output, path " 
+                   << file_output_conf.path;
+            delete output;
+            return NULL;
+        }
+
+        return output;
+    }
+
+    if ("unix" == conf.output || "tcp" == conf.output) {
+        OutputStream *output = new OutputStream();
+        if (!output->init(m_loop, conf.output, conf.stream_output_conf)) {
+            LERROR << "Fail to init " << conf.output << " output, address " 
+                   << conf.stream_output_conf.address;
+            delete output;
+            return NULL;
+        }
+
+        return output;
+    }
+
+    OutputKafka *output = new OutputKafka();
+    output->setKafkaConf(m_kafka_conf);
+    if (!output->init(m_config_source, conf.kafka_topic_conf.compression_codec)) {
+        LERROR << "Fail to init kafka output";
+        delete output;
+        return NULL;
+    };
+
+    output->setKafkaTopicConf(conf.kafka_topic_conf);
+
+    return output;
+}/*}}}*/
+
+void Manager::startWatchers(const PatternSet &paths)
 {/*{{{*/
-    set<string>::iterator iter;
+    PatternSet::const_iterator iter;
 
     for (iter = paths.begin(); iter != paths.end(); ++iter) {
         string path_pattern = *iter;
-        Task *task = m_tasks[path_pattern];
+        Task *task = getTask(path_pattern);
+
+        if (NULL == task) continue;
+
+        if (!task->conf.valid) {
+            m_pending_patterns.erase(path_pattern);
+            continue;
+        }
 
-        if (!task->conf.valid) return;
+        if (m_tails.find(path_pattern) != m_tails.end()) continue;
 
-        if (m_tails.find(path_pattern) != m_tails.end()) return;
+        if (TailGroup::isGlobPattern(path_pattern)) {
+            if (startGroup(path_pattern, task)) {
+                m_pending_patterns.erase(path_pattern);
+            } else {
+                m_pending_patterns.insert(path_pattern);
+            }
+            continue;
+        }
 
-        FilePositionEntry *pe;
+        FilePositionEntry *pe = NULL;
 
         if (NULL != m_position_file) {
             PositionEntryKey pek = {path_pattern, task->getPath()};
@@ -557,15 +1300,82 @@ void Manager::startWatchers(set<string> paths)
                 enabled);
         if (NULL != tw) {
             m_tails[path_pattern] = tw;
+            m_pending_patterns.erase(path_pattern);
+        } else {
+            /* retry in next refresh */
+            m_pending_patterns.insert(path_pattern);
         }
     }
 }/*}}}*/
 
-void Manager::stopWatchers(set<string> path_patterns, 
+bool Manager::startGroup(const string &path_pattern, Task *task)
+{/*{{{*/
+    if (m_tail_groups.find(path_pattern) != m_tail_groups.end()) {
+        return true;
+    }
+
+    TailGroup *tg = new TailGroup();
+    bool res = tg->init(m_loop,
+            path_pattern,
+            m_position_file,
+            m_glob_max_open_files,
+            m_stat_silent_max_ms,
+            task->getEnabled(),
+            this,
+            setupGroupWatcher,
+            closeGroupWatcher);
+
+    if (!res) {
+        LERROR << "Fail to init tail group with path_pattern " << path_pattern;
+        delete tg;
+        return false;
+    }
+
+    tg->m_conf = task->conf;
+    m_tail_groups[path_pattern] = tg;
+
+    return true;
+}/*}}}*/
+
+TailWatcher *Manager::setupGroupWatcher(void *arg,
+        const string &path_pattern,
+        const string &path,
+        PositionEntry *position_entry,
+        UpdateFunc update_func,
+        void *update_func_arg)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+
+    Task *task = manager->getTask(path_pattern);
+    if (NULL == task) {
+        LERROR << "Task with path_pattern " << path_pattern << " not exists";
+        return NULL;
+    }
+
+    return manager->setupWatcher(task->conf, 
+            path_pattern, 
+            path, 
+            position_entry, 
+            true,
+            update_func,
+            update_func_arg);
+}/*}}}*/
+
+void Manager::closeGroupWatcher(void *arg, TailWatcher *tw, bool unwatched)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+
+    /* the position of a renamed, queued or stopped file is kept for 
+     * reopening it, only that of a deleted one is removed */
+    manager->closeWatcher(tw, true, unwatched);
+    delete tw;
+}/*}}}*/
+
+void Manager::stopWatchers(const PatternSet &path_patterns, 
         bool immediate,
         bool unwatched)
 {/*{{{*/
-    for (set<string>::iterator iter = path_patterns.begin(); 
+    for (PatternSet::const_iterator iter = path_patterns.begin(); 
             iter != path_patterns.end(); ++iter) {
         string path_pattern = *iter;
 
@@ -582,6 +1392,17 @@ void Manager::stopWatchers(set<string> path_patterns,
                 m_tails.erase(it_st);
             }
         }
+
+        if (immediate) {
+            closeBacklogWatchers(path_pattern, unwatched);
+        }
+
+        TailGroupMap::iterator it_tg = m_tail_groups.find(path_pattern);
+        if (it_tg != m_tail_groups.end() && immediate) {
+            it_tg->second->close(unwatched);
+            delete it_tg->second; it_tg->second = NULL;
+            m_tail_groups.erase(it_tg);
+        }
     }
 }/*}}}*/
 
@@ -591,6 +1412,7 @@ void Manager::closeWatcher(TailWatcher *tw,
 {/*{{{*/
     tw->stop(close_io);
     flushBuffer(tw);
+    m_tail_stats_dirty = true;
 
     PositionEntryKey pek = {tw->m_path_pattern, tw->getPath()};
     if (tw->m_unwatched && NULL != m_position_file) {
@@ -605,12 +1427,18 @@ void Manager::flushBuffer(TailWatcher *tw)
 {/*{{{*/
 }/*}}}*/
 
-void Manager::updateWatchers(set<string> path_patterns)
+void Manager::updateWatchers(const PatternSet &path_patterns)
 {/*{{{*/
-    set<string>::iterator it_s;
+    PatternSet::const_iterator it_s;
 
     for (it_s = path_patterns.begin(); it_s != path_patterns.end(); ++it_s) {
         string path_pattern = *it_s;
+
+        if (m_tail_groups.find(path_pattern) != m_tail_groups.end()) {
+            updateGroup(path_pattern);
+            continue;
+        }
+
         Task *task = m_tasks[path_pattern];
         TailWatcher *tail = m_tails[path_pattern];
 
@@ -619,7 +1447,19 @@ void Manager::updateWatchers(set<string> path_patterns)
                 LINFO << "Update tail watcher with path_pattern " << path_pattern
                       << ", change path from " << tail->getPath()
                       << " to " << task->getPath();
-                set<string> paths;
+
+                /* the next path may be read by a backlog watcher already */
+                TailWatcher *next = takeBacklogWatcher(path_pattern, 
+                        task->getPath());
+                if (NULL != next) {
+                    tail->m_unwatched = true;
+                    closeWatcher(tail, true, true);
+                    delete tail; tail = NULL;
+                    m_tails[path_pattern] = next;
+                    continue;
+                }
+
+                PatternSet paths;
                 paths.insert(path_pattern);
                 stopWatchers(paths, true, true);
                 startWatchers(paths);
@@ -629,16 +1469,28 @@ void Manager::updateWatchers(set<string> path_patterns)
         }
 
         if (task->conf.log_conf != tail->m_conf.log_conf 
-                || task->conf.kafka_topic_conf != tail->m_conf.kafka_topic_conf)
+                || task->conf.outputs != tail->m_conf.outputs
+                || task->conf.stages != tail->m_conf.stages)
         {
             closeWatcher(tail, true, false);
             PositionEntryKey pek = {path_pattern, tail->getPath()};
-            m_tails[path_pattern] = setupWatcher(
+            PositionEntry *pe = (*m_position_file)[pek];
+            delete tail; tail = NULL;
+            m_tails.erase(path_pattern);
+
+            tail = setupWatcher(
                     task->conf, 
                     path_pattern, 
                     task->getPath(), 
-                    (*m_position_file)[pek],
+                    pe,
                     task->getEnabled());
+            if (NULL == tail) {
+                m_pending_patterns.insert(path_pattern);
+            } else {
+                m_tails[path_pattern] = tail;
+            }
+
+            continue;
         }
 
         if (task->getEnabled() && !tail->getEnabled()) {
@@ -648,39 +1500,180 @@ void Manager::updateWatchers(set<string> path_patterns)
         if (!task->getEnabled() && tail->getEnabled()) {
             tail->stop(false);
         }
+
+        tail->m_conf = task->conf;
     }
 }/*}}}*/
 
-void Manager::updateWatcherRotate(Manager *manager, 
+void Manager::updateGroup(const string &path_pattern)
+{/*{{{*/
+    Task *task = m_tasks[path_pattern];
+    TailGroup *tg = m_tail_groups[path_pattern];
+
+    if (task->conf.log_conf != tg->m_conf.log_conf 
+            || task->conf.outputs != tg->m_conf.outputs
+            || task->conf.stages != tg->m_conf.stages)
+    {
+        /* positions are kept, files are reopened with the new conf */
+        PatternSet paths;
+        paths.insert(path_pattern);
+        stopWatchers(paths, true, false);
+        startWatchers(paths);
+        return;
+    }
+
+    if (task->getEnabled() && !tg->getEnabled()) {
+        tg->start();
+    }
+
+    if (!task->getEnabled() && tg->getEnabled()) {
+        tg->stop();
+    }
+
+    tg->m_conf = task->conf;
+}/*}}}*/
+
+void Manager::refreshBacklogWatchers(const string &path_pattern)
+{/*{{{*/
+    Task *task = getTask(path_pattern);
+    TailWatcher *tail = getTailWatcher(path_pattern);
+
+    BacklogMap::iterator it_bm = m_backlog_tails.find(path_pattern);
+    if (NULL == task || NULL == tail || !task->getEnabled()
+            || task->conf.log_conf.backlog_parallelism <= 1) {
+        if (it_bm != m_backlog_tails.end()) {
+            closeBacklogWatchers(path_pattern, false);
+        }
+        return;
+    }
+
+    BacklogTailMap &backlog = m_backlog_tails[path_pattern];
+    const deque<string> &paths = task->stat.paths;
+    string live_path = task->getLastPath();
+
+    /* backlog files are done when every line is sent, not when they 
+     * are silent, which a paused or slow watcher is too; the live one
+     * is kept */
+    for (BacklogTailMap::iterator iter = backlog.begin(); 
+            iter != backlog.end(); ) {
+        string path = iter->first;
+        TailWatcher *tw = iter->second;
+        bool queued = find(paths.begin(), paths.end(), path) != paths.end();
+
+        if ((queued && path == live_path) || !tw->isFullyRead()) {
+            ++iter;
+            continue;
+        }
+
+        LINFO << "Close backlog watcher of path " << path 
+              << ", path_pattern " << path_pattern;
+        tw->m_unwatched = true;
+        closeWatcher(tw, true, true);
+        delete tw;
+        backlog.erase(iter++);
+        task->delPath(path);
+    }
+
+    /* the head path is read by the main watcher */
+    int backlog_files = (tail->getPath() != live_path)? 1: 0;
+    for (size_t i = 1; i < paths.size(); ++i) {
+        string path = paths[i];
+        if (path == tail->getPath()) continue;
+
+        if (path != live_path) {
+            if (backlog_files >= task->conf.log_conf.backlog_parallelism) {
+                continue;
+            }
+            ++backlog_files;
+        }
+
+        if (backlog.find(path) != backlog.end()) continue;
+
+        PositionEntryKey pek = {path_pattern, path};
+        FilePositionEntry *pe = (*m_position_file)[pek];
+        if (pe->readInode() == INO_NONE) {
+            pe->update(getInode(path.c_str()), 0);
+        }
+
+        TailWatcher *tw = setupWatcher(task->conf, 
+                path_pattern, 
+                path, 
+                pe, 
+                true, 
+                updateBacklogRotate,
+                this);
+        if (NULL == tw) {
+            LERROR << "Fail to setup backlog watcher of path " << path
+                   << ", path_pattern " << path_pattern;
+            continue;
+        }
+
+        LINFO << "Add backlog watcher of path " << path
+              << ", path_pattern " << path_pattern;
+        backlog[path] = tw;
+        TailWatcher::onNotify(tw);
+    }
+}/*}}}*/
+
+void Manager::closeBacklogWatchers(const string &path_pattern, 
+        bool unwatched)
+{/*{{{*/
+    BacklogMap::iterator it_bm = m_backlog_tails.find(path_pattern);
+    if (it_bm == m_backlog_tails.end()) return;
+
+    BacklogTailMap &backlog = it_bm->second;
+    for (BacklogTailMap::iterator iter = backlog.begin(); 
+            iter != backlog.end(); ++iter) {
+        iter->second->m_unwatched = unwatched;
+        closeWatcher(iter->second, true, true);
+        delete iter->second; iter->second = NULL;
+    }
+
+    m_backlog_tails.erase(it_bm);
+}/*}}}*/
+
+TailWatcher *Manager::takeBacklogWatcher(const string &path_pattern, 
+        const string &path)
+{/*{{{*/
+    BacklogMap::iterator it_bm = m_backlog_tails.find(path_pattern);
+    if (it_bm == m_backlog_tails.end()) return NULL;
+
+    BacklogTailMap::iterator iter = it_bm->second.find(path);
+    if (iter == it_bm->second.end()) return NULL;
+
+    TailWatcher *tw = iter->second;
+    it_bm->second.erase(iter);
+
+    return tw;
+}/*}}}*/
+
+bool Manager::updateBacklogRotate(void *arg, 
         string path_pattern,
         string path,
         PositionEntry *position_entry)
 {/*{{{*/
+    /* files with time format in path are not rotated in place, 
+     * keep draining the opened one */
+    LINFO << "Ignore rotating of path " << path 
+          << ", path_pattern " << path_pattern;
+    return false;
+}/*}}}*/
+
+bool Manager::updateWatcherRotate(void *arg, 
+        string path_pattern,
+        string path,
+        PositionEntry *position_entry)
+{/*{{{*/
+    /* the tail watcher reads the new file from head, and drains the 
+     * rotated one until it is silent */
     LINFO << "Update watcher rotate"
-        << ", path_pattern" << path_pattern
+        << ", path_pattern " << path_pattern
         << ", path " << path;
-    ScopedLock l(manager->m_tail_watchers_mutex);
-
-    TailWatcher *tw = NULL;
-    TailMap::iterator iter 
-        = (manager->m_tails).find(path);
-    if (iter != manager->m_tails.end())
-        tw = iter->second;
-
-    if (!tw->isActive()) {
-        manager->closeWatcher(tw, true, false); 
-        delete tw; iter->second = NULL;
-        position_entry->updatePos(0); // read from head
-        manager->m_tails[path] = manager->setupWatcher(
-                tw->m_conf,
-                path_pattern, 
-                path, 
-                position_entry, 
-                manager->m_tasks[path_pattern]->getEnabled());
-    }
+    return true;
 }/*}}}*/
 
-bool Manager::receiveLines(void *output, vector<string> &lines)
+bool Manager::receiveLines(void *output, vector<string> &lines,
+        int64_t write_time_us)
 {/*{{{*/
     if (NULL == output) {
         LERROR << "output function is NULL";
@@ -693,7 +1686,7 @@ bool Manager::receiveLines(void *output, vector<string> &lines)
     }
 
     Output *out = reinterpret_cast<Output *>(output);
-    return out->output(out, lines);
+    return out->output(out, lines, write_time_us);
 }/*}}}*/
 
 void Manager::uploadCollectingState(void *arg)
@@ -705,93 +1698,348 @@ void Manager::uploadCollectingState(void *arg)
 
     Manager *manager = reinterpret_cast<Manager*>(arg);
     
-    Zookeeper *zookeeper = manager->m_zookeeper;
-    if (NULL == manager->m_zookeeper) {
-        LERROR << "zookeeper is NULL";
+    ConfigSource *config_source = manager->m_config_source;
+    if (NULL == config_source) {
+        LERROR << "config source is NULL";
         return;
     }
 
-    string info  = manager->getCollectingState();
-    LDEBUG << "Get tail watcher info json string: " << info;
+    /* files may be added to tail groups between refreshes */
+    if (manager->m_tail_stats_dirty) {
+        ScopedLock l(manager->m_tail_watchers_mutex);
+        manager->publishTailStats();
+    }
 
-    if (!zookeeper->setLogState(
-                       info.c_str(), 
-                       info.length(), 
-                       &onZookeeperSetComplete))
-    {
-        LERROR << "Fail to set collecting state " << info;
+    TailStatSnapshot *snapshot = manager->m_tail_stats.acquire();
+    if (!manager->m_state_uploader.upload(config_source, snapshot)) {
+        LERROR << "Fail to upload collecting state";
     }
+    snapshot->unref();
 }/*}}}*/
 
-string Manager::getCollectingState()
+void Manager::publishTailStats()
 {/*{{{*/
-    string filename;
-    string info;
+    TailStatSnapshot *snapshot = new TailStatSnapshot();
+
+    for (TailMap::iterator iter = m_tails.begin(); 
+            iter != m_tails.end(); ++iter) {
+        if (NULL == iter->second || "" == iter->first) continue;
+
+        TailStatEntry entry;
+        entry.path_pattern = iter->first;
+        entry.group = false;
+        entry.pending = 0;
+        entry.stats.push_back(iter->second->getStat());
+
+        BacklogMap::const_iterator it_bm = m_backlog_tails.find(iter->first);
+        if (it_bm != m_backlog_tails.end()) {
+            for (BacklogTailMap::const_iterator it_b = it_bm->second.begin();
+                    it_b != it_bm->second.end(); ++it_b) {
+                entry.stats.push_back(it_b->second->getStat());
+            }
+        }
 
+        snapshot->add(entry);
+    }
+
+    for (TailGroupMap::iterator iter = m_tail_groups.begin(); 
+            iter != m_tail_groups.end(); ++iter) {
+        TailStatEntry entry;
+        iter->second->getStats(entry);
+        snapshot->add(entry);
+    }
+
+    m_tail_stats.publish(snapshot);
+    m_tail_stats_dirty = false;
+}/*}}}*/
+
+string Manager::getCollectingState()
+{/*{{{*/
     rapidjson::StringBuffer sb;
     rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
 
-    ScopedLock l(m_tail_watchers_mutex);
+    /* no lock of watchers is needed, the snapshot is immutable and 
+     * the stats in it are atomic */
+    TailStatSnapshot *snapshot = m_tail_stats.acquire();
+    snapshot->Serialize(writer);
+    snapshot->unref();
 
-    writer.StartObject();
+    return sb.GetString();
+}/*}}}*/
 
-    for (TailMap::iterator iter = m_tails.begin(); 
-            iter != m_tails.end(); ++iter) {
-        string path_pattern = iter->first;
-        TailWatcher *tw = iter->second;
+void Manager::handleHttpRequest(void *arg, 
+        const HttpRequest &request, 
+        HttpResponse &response)
+{/*{{{*/
+    Manager *manager = reinterpret_cast<Manager *>(arg);
+    const string &path = request.path;
 
-        if (NULL == tw) continue;
+    bool is_get = ("GET" == request.method);
+    bool is_post = ("POST" == request.method);
 
-        if ("" != path_pattern) {
-            writer.String(path_pattern.c_str());
-            tw->Serialize(writer);
+    if ("/metrics" == path || "/metrics.json" == path 
+            || "/state" == path || "/watchers" == path) {
+        if (!is_get) {
+            response.status = 405;
+            return;
         }
+    } else if ("/tasks/pause" == path || "/tasks/resume" == path 
+            || "/checkpoint" == path) {
+        if (!is_post) {
+            response.status = 405;
+            return;
+        }
+    } else {
+        response.status = 404;
+        return;
     }
 
-    writer.EndObject();
+    /* reading metrics and state takes no lock of the data path */
+    if ("/metrics" == path) {
+        response.content_type = "text/plain; version=0.0.4";
+        response.body = MetricsRegistry::instance().formatPrometheus();
+    } else if ("/metrics.json" == path) {
+        rapidjson::StringBuffer sb;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+        MetricsRegistry::instance().Serialize(writer);
+        response.content_type = "application/json";
+        response.body = sb.GetString();
+    } else if ("/state" == path) {
+        response.content_type = "application/json";
+        response.body = manager->getCollectingState();
+    } else if ("/watchers" == path) {
+        response.content_type = "application/json";
+        response.body = manager->dumpWatchers();
+    } else if ("/checkpoint" == path) {
+        if (!manager->checkpoint()) {
+            response.status = 409;
+            response.body = "Position file can not be checkpointed now\n";
+            return;
+        }
+        response.body = "OK\n";
+    } else {
+        map<string, string>::const_iterator iter 
+            = request.params.find("path_pattern");
+        if (iter == request.params.end()) {
+            response.status = 400;
+            response.body = "path_pattern is required\n";
+            return;
+        }
+        if (!manager->pauseTask(iter->second, "/tasks/pause" == path)) {
+            response.status = 404;
+            response.body = "No task with path_pattern " + iter->second + "\n";
+            return;
+        }
+        response.body = "OK\n";
+    }
+}/*}}}*/
 
-    info = sb.GetString();
+bool Manager::pauseTask(const string &path_pattern, bool paused)
+{/*{{{*/
+    ScopedLock l(m_tail_watchers_mutex);
+
+    Task *task = getTask(path_pattern);
+    if (NULL == task) return false;
+
+    if (task->paused == paused) return true;
+
+    LINFO << (paused? "Pause": "Resume") << " task with path_pattern " 
+          << path_pattern;
+    task->paused = paused;
 
-    return info;
+    PatternSet paths;
+    paths.insert(path_pattern);
+    if (m_tails.find(path_pattern) != m_tails.end()
+            || m_tail_groups.find(path_pattern) != m_tail_groups.end()) {
+        updateWatchers(paths);
+    }
+    refreshBacklogWatchers(path_pattern);
+    publishTailStats();
+
+    return true;
 }/*}}}*/
 
-void Manager::onZookeeperSetComplete(int rc, const struct Stat *stat, const void *data)
+bool Manager::checkpoint()
 {/*{{{*/
-    if (NULL == data) {
-        LERROR << "Zookeeper set complete data is NULL";
-        return;
+    if (NULL == m_position_file) return false;
+
+    /* positions of all files are journaled already, compacting writes
+     * them into a fresh file in one go */
+    if (!m_position_file->compactSync()) {
+        LERROR << "Fail to checkpoint position file " << m_pos_path;
+        return false;
+    }
+
+    LINFO << "Checkpoint position file " << m_pos_path;
+    return true;
+}/*}}}*/
+
+template <typename JsonWriter>
+void Manager::serializeWatcher(JsonWriter& writer, TailWatcher *tw)
+{/*{{{*/
+    TailStat *stat = tw->getStat();
+
+    writer.StartObject();
+    writer.String("path");
+    writer.String(tw->m_path.c_str(), (SizeType)tw->m_path.length());
+    writer.String("enabled");
+    writer.Bool(tw->getEnabled());
+    writer.String("unwatched");
+    writer.Bool(tw->m_unwatched);
+    if (NULL != stat) {
+        writer.String("filepos");
+        writer.Int64(stat->getFilePos());
+        writer.String("filesize");
+        writer.Int64(stat->getFileSize());
     }
 
-    const char *path = reinterpret_cast<const char *>(data);
+    /* progress of each output, read in loop thread which writes it */
+    OutputFanout *fanout = dynamic_cast<OutputFanout *>(tw->getOutput());
+    if (NULL != fanout) {
+        writer.String("watermarks");
+        writer.StartArray();
+        for (size_t i = 0; i < fanout->size(); ++i) {
+            const OutputWatermark &watermark = fanout->getWatermark(i);
+            writer.StartObject();
+            writer.String("batches");
+            writer.Int64(watermark.batches);
+            writer.String("lines");
+            writer.Int64(watermark.lines);
+            writer.String("failures");
+            writer.Int64(watermark.failures);
+            writer.EndObject();
+        }
+        writer.EndArray();
+    }
 
-    if (0 != rc) {
-        LERROR << "Fail to set zk path " << path << ", " << zerror(rc);
+    /* lines dropped by each stage */
+    Pipeline *pipeline = tw->getPipeline();
+    if (NULL != pipeline) {
+        writer.String("pipeline");
+        writer.StartArray();
+        for (size_t i = 0; i < pipeline->size(); ++i) {
+            writer.StartObject();
+            writer.String("stage");
+            writer.String(pipeline->getName(i).c_str(), 
+                    (SizeType)pipeline->getName(i).length());
+            writer.String("dropped");
+            writer.Int64(pipeline->getDropped(i));
+            writer.EndObject();
+        }
+        writer.EndArray();
     }
+    writer.EndObject();
+}/*}}}*/
+
+string Manager::dumpWatchers()
+{/*{{{*/
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+
+    /* maps of watchers are only changed in loop thread, which is 
+     * running this */
+    writer.StartObject();
+    for (TaskMap::const_iterator iter = m_tasks.begin(); 
+            iter != m_tasks.end(); ++iter) {
+        const string &path_pattern = iter->first;
+        Task *task = iter->second;
+
+        writer.String(path_pattern.c_str(), (SizeType)path_pattern.length());
+        writer.StartObject();
+
+        writer.String("valid");
+        writer.Bool(task->conf.valid);
+        writer.String("outputs");
+        writer.StartArray();
+        for (vector<OutputConf>::const_iterator it_o = 
+                task->conf.outputs.begin(); 
+                it_o != task->conf.outputs.end(); ++it_o) {
+            writer.String(it_o->output.c_str(), 
+                    (SizeType)it_o->output.length());
+        }
+        writer.EndArray();
+        writer.String("pipeline");
+        writer.StartArray();
+        for (vector<StageConf>::const_iterator it_s = 
+                task->conf.stages.begin(); 
+                it_s != task->conf.stages.end(); ++it_s) {
+            writer.String(it_s->stage.c_str(), 
+                    (SizeType)it_s->stage.length());
+        }
+        writer.EndArray();
+        writer.String("paused");
+        writer.Bool(task->paused);
+        writer.String("pending");
+        writer.Bool(m_pending_patterns.count(path_pattern) > 0);
+
+        writer.String("paths");
+        writer.StartArray();
+        for (deque<string>::const_iterator it_p = task->stat.paths.begin();
+                it_p != task->stat.paths.end(); ++it_p) {
+            writer.String(it_p->c_str(), (SizeType)it_p->length());
+        }
+        writer.EndArray();
+
+        TailMap::const_iterator it_t = m_tails.find(path_pattern);
+        if (it_t != m_tails.end() && NULL != it_t->second) {
+            writer.String("watcher");
+            serializeWatcher(writer, it_t->second);
+        }
+
+        BacklogMap::const_iterator it_b = m_backlog_tails.find(path_pattern);
+        if (it_b != m_backlog_tails.end()) {
+            writer.String("backlog");
+            writer.StartArray();
+            for (BacklogTailMap::const_iterator it_bt = it_b->second.begin();
+                    it_bt != it_b->second.end(); ++it_bt) {
+                serializeWatcher(writer, it_bt->second);
+            }
+            writer.EndArray();
+        }
+
+        TailGroupMap::const_iterator it_g = m_tail_groups.find(path_pattern);
+        if (it_g != m_tail_groups.end()) {
+            TailStatEntry entry;
+            it_g->second->getStats(entry);
+            writer.String("group");
+            writer.StartObject();
+            writer.String("enabled");
+            writer.Bool(it_g->second->getEnabled());
+            writer.String("files");
+            writer.Uint64(entry.stats.size());
+            writer.String("pending");
+            writer.Uint64(entry.pending);
+            writer.EndObject();
+        }
+
+        writer.EndObject();
+    }
+    writer.EndObject();
 
-    free((char*)path);
+    return sb.GetString();
 }/*}}}*/
 
-set<string> Manager::getTasksKeys(const TaskMap &tasks)
+PatternSet Manager::getTasksKeys(const TaskMap &tasks)
 {/*{{{*/
-    std::set<std::string> s;
+    PatternSet s;
     std::transform(tasks.begin(), tasks.end(), 
             std::inserter(s, s.begin()), GetKey<TaskMap::value_type>());
 
     return s;
 }/*}}}*/
 
-set<string> Manager::getTailsKeys(const TailMap &tails)
+PatternSet Manager::getTailsKeys(const TailMap &tails)
 {/*{{{*/
-    std::set<std::string> s;
+    PatternSet s;
     std::transform(tails.begin(), tails.end(), 
             std::inserter(s, s.begin()), GetKey<TailMap::value_type>());
 
     return s;
 }/*}}}*/
 
-set<string> Manager::getTaskConfsKeys(const TaskConfMap &task_confs)
+PatternSet Manager::getTaskConfsKeys(const TaskConfMap &task_confs)
 {/*{{{*/
-    std::set<std::string> s;
+    PatternSet s;
     std::transform(task_confs.begin(), task_confs.end(),
             std::inserter(s, s.begin()), GetKey<TaskConfMap::value_type>());
 
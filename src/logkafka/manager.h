@@ -23,13 +23,27 @@
 #define LOGKAFKA_MANAGER_H_
 
 #include <map>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
 
+#include "base/async_watcher.h"
 #include "base/common.h"
+#include "base/dir_cache.h"
+#include "base/http_server.h"
+#include "base/loop_monitor.h"
+#include "base/json.h"
 #include "logkafka/config.h"
+#include "logkafka/config_source.h"
+#include "logkafka/file_config_source.h"
+#include "logkafka/output_fanout.h"
+#include "logkafka/output_file.h"
 #include "logkafka/output_kafka.h"
+#include "logkafka/output_stream.h"
 #include "logkafka/position_file.h"
 #include "logkafka/producer.h"
 #include "logkafka/signal_handler.h"
+#include "logkafka/state_uploader.h"
+#include "logkafka/tail_group.h"
 #include "logkafka/tail_watcher.h"
 #include "logkafka/task_conf.h"
 #include "logkafka/zookeeper.h"
@@ -43,9 +57,28 @@ namespace logkafka {
 
 class TailWatcher;
 
-typedef std::map<std::string, Task* > TaskMap;
-typedef std::map<std::string, TailWatcher*> TailMap;
-typedef std::map<std::string, TaskConf> TaskConfMap;
+typedef std::tr1::unordered_map<std::string, Task* > TaskMap;
+typedef std::tr1::unordered_map<std::string, TailWatcher*> TailMap;
+typedef std::tr1::unordered_map<std::string, TailGroup*> TailGroupMap;
+typedef std::map<std::string, TailWatcher*> BacklogTailMap;
+typedef std::tr1::unordered_map<std::string, BacklogTailMap> BacklogMap;
+typedef std::tr1::unordered_map<std::string, TaskConf> TaskConfMap;
+typedef std::tr1::unordered_map<std::string, Pipeline*> PipelineMap;
+typedef std::tr1::unordered_map<std::string, uint64_t> TaskConfHashMap;
+typedef std::tr1::unordered_set<std::string> PatternSet;
+
+/* path patterns whose task confs changed in one refresh */
+struct TaskConfDiff
+{
+    PatternSet added;
+    PatternSet deleted;
+    PatternSet updated;
+
+    bool empty() const
+    {/*{{{*/
+        return added.empty() && deleted.empty() && updated.empty();
+    }/*}}}*/
+};
 
 class Manager
 {
@@ -59,71 +92,139 @@ class Manager
         bool stop(); 
 
         static void uploadCollectingState(void *arg);
+        static void compactPositionFile(void *arg);
 
     public:
-        Zookeeper *m_zookeeper;
+        ConfigSource *m_config_source;
 
     private:
-        bool initZookeeper();
+        bool initConfigSource();
 
         /* kafka global conf relevant functions */
         bool initKafkaConf();
 
         /* task confs relevant functions */
-        bool refreshTaskConfs();
+        static void onConfigChange(void *arg);
+        static void handleConfigChange(void *arg);
+        static void applyConfig(void *arg);
+        static void onBrokersChange(void *arg);
+        static void handleBrokersChange(void *arg);
+        bool refreshTaskConfs(TaskConfDiff &diff);
+        bool reconcileTaskConfs(const string &config, TaskConfDiff &diff);
+        bool parseTaskConf(const Value &log_item, TaskConf &item);
+        bool parseOutputConf(const Value &item, OutputConf &conf);
+        bool parseStageConf(const Value &item, StageConf &conf);
+        static bool getStrings(const Value &item, const char *name, 
+                vector<string> &values);
 
         /* tasks relevant functions */
-        bool refreshTasks();
+        bool refreshTasks(const TaskConfDiff &diff);
         void updateTaskPaths(const string &path_pattern);
-        void updateTasks(set<string> path_patterns);
-        void deleteTasks(set<string> path_patterns);
-        void addTasks(set<string> path_patterns);
+        void updateTasks(const PatternSet &path_patterns);
+        void deleteTasks(const PatternSet &path_patterns);
+        void addTasks(const PatternSet &path_patterns);
 
         string expandPath(const string &path_pattern);
+        bool getBacklogPaths(const string &path_pattern, 
+                const string &last_path,
+                const string &expanded_path,
+                vector<string> &paths);
         bool getPathPatternGlobed(const string &path_pattern, 
                 vector<string> &path_pattern_globed);
         inline bool isTimeFormatConversionSpecifier(char c);
 
         /* tail watchers relevant functions */
         static void refreshWatchers(void *arg);
-        void startWatchers(set<string> added);
+        void startWatchers(const PatternSet &added);
         TailWatcher* setupWatcher(
                 TaskConf conf,
                 string path_pattern, 
                 string path,
                 PositionEntry *position_entry,
-                bool enabled = true);
-        void updateWatchers(set<string> path_patterns);
+                bool enabled = true,
+                UpdateFunc update_func = NULL,
+                void *update_func_arg = NULL);
+        /* the pipeline of the task, NULL if it has no stages */
+        Pipeline *getPipeline(const string &path_pattern, 
+                const TaskConf &conf);
+        /* source is the file read if the task reads several at once */
+        Output *createOutput(const TaskConf &conf, const string &source);
+        Output *createOutput(const OutputConf &conf, const string &source);
+        bool startGroup(const string &path_pattern, Task *task);
+        void updateWatchers(const PatternSet &path_patterns);
+        void updateGroup(const string &path_pattern);
+        void refreshBacklogWatchers(const string &path_pattern);
+        void closeBacklogWatchers(const string &path_pattern, bool unwatched);
+        TailWatcher *takeBacklogWatcher(const string &path_pattern, 
+                const string &path);
         void updateWatcher(Manager *manager,
                 string path_pattern,
                 string path, 
                 PositionEntry *position_entry);
-        void stopWatchers(set<string> removed, 
+        void stopWatchers(const PatternSet &removed, 
                 bool immediate = false,
                 bool unwatched = false);
         void closeWatcher(TailWatcher *tw, 
                 bool close_io = true, 
                 bool remove_pos_entry = false);
-        static void updateWatcherRotate(Manager *manager, 
+        static bool updateWatcherRotate(void *arg, 
                 string path_pattern,
                 string path,
                 PositionEntry *position_entry);
+        static bool updateBacklogRotate(void *arg, 
+                string path_pattern,
+                string path,
+                PositionEntry *position_entry);
+        static TailWatcher *setupGroupWatcher(void *arg,
+                const string &path_pattern,
+                const string &path,
+                PositionEntry *position_entry,
+                UpdateFunc update_func,
+                void *update_func_arg);
+        static void closeGroupWatcher(void *arg, 
+                TailWatcher *tw, 
+                bool unwatched);
         void flushBuffer(TailWatcher *tw);
-        static bool receiveLines(void *output, vector<string> &lines);
+        static bool receiveLines(void *output, vector<string> &lines,
+                int64_t write_time_us);
 
-        set<string> getTasksKeys(const TaskMap &tasks);
-        set<string> getTailsKeys(const TailMap &tails);
-        set<string> getTaskConfsKeys(const TaskConfMap &task_confs);
+        PatternSet getTasksKeys(const TaskMap &tasks);
+        PatternSet getTailsKeys(const TailMap &tails);
+        PatternSet getTaskConfsKeys(const TaskConfMap &task_confs);
         TailWatcher *getTailWatcher(string path_pattern);
         Task *getTask(string path_pattern);
 
+        void publishTailStats();
         string getCollectingState();
-        static void onZookeeperSetComplete(int rc, const struct Stat *stat, const void *data);
+
+        /* http endpoint for monitoring and control, in loop thread */
+        bool initHttpServer();
+        static void handleHttpRequest(void *arg, 
+                const HttpRequest &request, 
+                HttpResponse &response);
+        bool pauseTask(const string &path_pattern, bool paused);
+        bool checkpoint();
+        string dumpWatchers();
+        template <typename JsonWriter>
+        static void serializeWatcher(JsonWriter& writer, TailWatcher *tw);
+
+        /* loop stalls and durations of watcher callbacks */
+        bool initLoopMonitor();
+        static void onLoopLag(void *arg, int64_t lag_us);
+        static void onCallbackTraced(const char *kind, 
+                const string &name, 
+                int64_t duration_us, 
+                bool slow);
 
     private:
         unsigned long m_refresh_interval;
         unsigned long m_line_max_bytes;
         unsigned long m_stat_silent_max_ms;
+        unsigned long m_pos_compact_interval;
+        unsigned long m_config_apply_delay;
+        unsigned long m_glob_max_open_files;
+        unsigned long m_loop_probe_interval;
+        unsigned long m_slow_callback_ms;
         string m_pos_path;
         uv_loop_t *m_loop;
         const Config *m_config;
@@ -132,12 +233,52 @@ class Manager
         TaskConfMap m_task_confs;
         TaskMap m_tasks;
         TailMap m_tails;
+        /* path patterns with wildcards, tailing many files at once */
+        TailGroupMap m_tail_groups;
+        /* extra watchers of path patterns with time format, reading 
+         * backlog files and the live file in parallel */
+        BacklogMap m_backlog_tails;
+        /* pipelines shared by the watchers of each task */
+        PipelineMap m_pipelines;
+
+        /* version and hash of the last reconciled config, and hash of 
+         * every task conf in it, used to skip unchanged parts */
+        int64_t m_log_config_version;
+        uint64_t m_log_config_hash;
+        TaskConfHashMap m_task_conf_hashes;
+
+        /* listings of directories of paths with time format */
+        DirCache m_dir_cache;
+
+        /* path patterns with time format, their paths change with time */
+        PatternSet m_dynamic_patterns;
+        /* path patterns of valid tasks whose watchers failed to start */
+        PatternSet m_pending_patterns;
 
         TimerWatcher *m_refresh_trigger;
+        TimerWatcher *m_compact_trigger;
+
+        /* config changes are signalled from config source, and applied
+         * m_config_apply_delay ms later to coalesce bursts of edits */
+        AsyncWatcher *m_config_change_notifier;
+        TimerWatcher *m_config_apply_trigger;
+        bool m_config_apply_pending;
+
+        /* broker list changes are signalled from config source, and
+         * pushed to producers in loop thread */
+        AsyncWatcher *m_brokers_change_notifier;
 
-        FILE* m_pos_file;
         PositionFile *m_position_file;
 
+        /* snapshots of tail stats for collecting state, republished
+         * in loop thread after watchers are set up or closed */
+        TailStatPublisher m_tail_stats;
+        bool m_tail_stats_dirty;
+        StateUploader m_state_uploader;
+
+        HttpServer *m_http_server;
+        LoopMonitor *m_loop_monitor;
+
         Mutex m_tail_watchers_mutex;
 };
 
@@ -0,0 +1,334 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/metrics.h"
+
+#include <string.h>
+
+namespace logkafka {
+
+const MetricInfo MetricsRegistry::TASK_METRICS[TASK_METRIC_NUM] = {
+    {"lines_read", "Lines read from log files", false},
+    {"bytes_read", "Bytes read from log files", false},
+    {"batches_sent", "Batches of lines accepted by output", false},
+    {"produce_failures", "Batches of lines rejected by output", false},
+    {"bytes_behind", "Bytes between read position and end of log files", true},
+    {"lines_dropped", "Lines dropped by pipeline stages", false},
+};
+
+const MetricInfo MetricsRegistry::GLOBAL_METRICS[GLOBAL_METRIC_NUM] = {
+    {"kafka_queue_depth", "Messages waiting in librdkafka queues", true},
+    {"messages_delivered", "Messages acknowledged by kafka brokers", false},
+    {"delivery_failures", "Messages failed to be delivered to kafka", false},
+    {"slow_callbacks", "Watcher callbacks exceeding slow_callback_ms", false},
+};
+
+const MetricInfo MetricsRegistry::HISTOGRAMS[HISTOGRAM_NUM] = {
+    {"read_us", "Time of reading one batch of lines", false},
+    {"produce_us", "Time of enqueueing one batch to librdkafka", false},
+    {"delivery_us", "Time from enqueueing to kafka ack of messages", false},
+    {"end_to_end_us", "Time from writing log file to kafka ack of messages", 
+        false},
+    {"loop_lag_us", "Delay of the loop probe timer, time the loop was blocked",
+        false},
+    {"callback_us", "Time of running one watcher callback", false},
+};
+
+const double MetricsRegistry::QUANTILES[QUANTILE_NUM] = {
+    0.5, 0.9, 0.99, 0.999, 1.0
+};
+
+const char *MetricsRegistry::QUANTILE_NAMES[QUANTILE_NUM] = {
+    "p50", "p90", "p99", "p999", "max"
+};
+
+const int HistogramValues::SUB_BUCKET_BITS;
+const int HistogramValues::MAX_BITS;
+const int HistogramValues::BUCKET_NUM;
+
+HistogramValues::HistogramValues()
+{/*{{{*/
+    count = 0;
+    sum = 0;
+    memset(counts, 0, sizeof(counts));
+}/*}}}*/
+
+void HistogramValues::merge(const HistogramValues &other)
+{/*{{{*/
+    count += other.count;
+    sum += other.sum;
+    for (int i = 0; i < BUCKET_NUM; ++i) {
+        counts[i] += other.counts[i];
+    }
+}/*}}}*/
+
+int64_t HistogramValues::quantile(double q) const
+{/*{{{*/
+    if (count <= 0) return 0;
+
+    /* rank of the value, 1 based */
+    int64_t rank = (int64_t)(q * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+
+    int64_t seen = 0;
+    for (int i = 0; i < BUCKET_NUM; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return bucketUpperBound(i);
+    }
+
+    return bucketUpperBound(BUCKET_NUM - 1);
+}/*}}}*/
+
+int HistogramValues::bucketOf(int64_t value)
+{/*{{{*/
+    if (value < (1LL << SUB_BUCKET_BITS)) {
+        return value > 0? (int)value: 0;
+    }
+
+    int exp = 63 - __builtin_clzll((unsigned long long)value);
+    if (exp >= MAX_BITS) return BUCKET_NUM - 1;
+
+    int shift = exp - SUB_BUCKET_BITS;
+    int sub = (int)(value >> shift) & ((1 << SUB_BUCKET_BITS) - 1);
+    return ((shift + 1) << SUB_BUCKET_BITS) + sub;
+}/*}}}*/
+
+int64_t HistogramValues::bucketUpperBound(int bucket)
+{/*{{{*/
+    if (bucket < (1 << SUB_BUCKET_BITS)) return bucket;
+
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    int64_t sub = bucket & ((1 << SUB_BUCKET_BITS) - 1);
+    int64_t lower = ((1LL << SUB_BUCKET_BITS) + sub) << shift;
+    return lower + (1LL << shift) - 1;
+}/*}}}*/
+
+Histogram::Histogram()
+{/*{{{*/
+    m_count = 0;
+    m_sum = 0;
+    for (int i = 0; i < HistogramValues::BUCKET_NUM; ++i) {
+        m_counts[i] = 0;
+    }
+}/*}}}*/
+
+void Histogram::record(int64_t value)
+{/*{{{*/
+    if (value < 0) value = 0;
+    __sync_fetch_and_add(&m_counts[HistogramValues::bucketOf(value)], 1);
+    __sync_fetch_and_add(&m_sum, value);
+    __sync_fetch_and_add(&m_count, 1);
+}/*}}}*/
+
+void Histogram::collect(HistogramValues &values)
+{/*{{{*/
+    /* buckets are read one by one while being recorded, count is 
+     * summed from them so that quantiles stay consistent */
+    int64_t count = 0;
+    for (int i = 0; i < HistogramValues::BUCKET_NUM; ++i) {
+        int64_t n = __sync_add_and_fetch(&m_counts[i], 0);
+        values.counts[i] += n;
+        count += n;
+    }
+    values.count += count;
+    values.sum += __sync_add_and_fetch(&m_sum, 0);
+}/*}}}*/
+
+TaskMetrics::TaskMetrics(const string &path_pattern)
+    : m_path_pattern(path_pattern)
+{/*{{{*/
+    m_users = 0;
+    for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+        m_values[i] = 0;
+    }
+}/*}}}*/
+
+MetricsRegistry::MetricsRegistry()
+{/*{{{*/
+    for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+        m_retired[i] = 0;
+    }
+    for (int i = 0; i < GLOBAL_METRIC_NUM; ++i) {
+        m_globals[i] = 0;
+    }
+}/*}}}*/
+
+MetricsRegistry::~MetricsRegistry()
+{/*{{{*/
+    for (map<string, TaskMetrics *>::iterator iter = m_tasks.begin();
+            iter != m_tasks.end(); ++iter) {
+        delete iter->second;
+    }
+    m_tasks.clear();
+}/*}}}*/
+
+TaskMetrics *MetricsRegistry::acquireTask(const string &path_pattern)
+{/*{{{*/
+    ScopedLock l(m_mutex);
+
+    TaskMetrics *&metrics = m_tasks[path_pattern];
+    if (NULL == metrics) {
+        metrics = new TaskMetrics(path_pattern);
+    }
+    ++metrics->m_users;
+
+    return metrics;
+}/*}}}*/
+
+void MetricsRegistry::releaseTask(TaskMetrics *metrics)
+{/*{{{*/
+    if (NULL == metrics) return;
+
+    ScopedLock l(m_mutex);
+
+    if (--metrics->m_users > 0) return;
+
+    for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+        if (!TASK_METRICS[i].gauge) {
+            m_retired[i] += metrics->get((TaskMetricType)i);
+        }
+    }
+
+    m_tasks.erase(metrics->m_path_pattern);
+    delete metrics;
+}/*}}}*/
+
+void MetricsRegistry::collect(MetricsValues &values)
+{/*{{{*/
+    ScopedLock l(m_mutex);
+
+    for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+        values.totals[i] = m_retired[i];
+    }
+
+    values.tasks.clear();
+    values.tasks.resize(m_tasks.size());
+    size_t n = 0;
+    for (map<string, TaskMetrics *>::iterator iter = m_tasks.begin();
+            iter != m_tasks.end(); ++iter, ++n) {
+        TaskMetricsValues &task = values.tasks[n];
+        task.path_pattern = iter->first;
+        for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+            task.values[i] = iter->second->get((TaskMetricType)i);
+            values.totals[i] += task.values[i];
+        }
+    }
+
+    for (int i = 0; i < GLOBAL_METRIC_NUM; ++i) {
+        values.globals[i] = getGlobal((GlobalMetricType)i);
+    }
+
+    for (int i = 0; i < HISTOGRAM_NUM; ++i) {
+        values.histograms[i] = HistogramValues();
+        m_histograms[i].collect(values.histograms[i]);
+    }
+}/*}}}*/
+
+string MetricsRegistry::formatPrometheus()
+{/*{{{*/
+    MetricsValues values;
+    collect(values);
+
+    stringstream ss;
+
+    for (int i = 0; i < GLOBAL_METRIC_NUM; ++i) {
+        string name = string("logkafka_") + GLOBAL_METRICS[i].name;
+        if (!GLOBAL_METRICS[i].gauge) name += "_total";
+        formatFamily(ss, name, GLOBAL_METRICS[i]);
+        ss << name << " " << values.globals[i] << "\n";
+    }
+
+    /* totals include removed tasks, so they are not labeled and
+     * summing the per task families does not count twice */
+    for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+        const MetricInfo &info = TASK_METRICS[i];
+        string suffix = info.gauge? "": "_total";
+
+        string name = string("logkafka_") + info.name + suffix;
+        formatFamily(ss, name, info);
+        ss << name << " " << values.totals[i] << "\n";
+
+        name = string("logkafka_task_") + info.name + suffix;
+        formatFamily(ss, name, info);
+        for (vector<TaskMetricsValues>::const_iterator 
+                iter = values.tasks.begin(); 
+                iter != values.tasks.end(); ++iter) {
+            ss << name << "{path_pattern=\"" 
+               << escapeLabel(iter->path_pattern) << "\"} " 
+               << iter->values[i] << "\n";
+        }
+    }
+
+    /* a fixed set of power of four bounds, in seconds. They fall on
+     * bucket boundaries, so cumulative counts are exact to 1us */
+    for (int i = 0; i < HISTOGRAM_NUM; ++i) {
+        const MetricInfo &info = HISTOGRAMS[i];
+        const HistogramValues &h = values.histograms[i];
+        string name = string("logkafka_") + info.name;
+        name = name.substr(0, name.length() - 3) + "_seconds";
+
+        ss << "# HELP " << name << " " << info.help << "\n"
+           << "# TYPE " << name << " histogram\n";
+
+        int64_t cumulative = 0;
+        int bucket = 0;
+        for (int bits = 0; bits <= HistogramValues::MAX_BITS; bits += 2) {
+            int64_t bound = 1LL << bits;
+            while (bucket < HistogramValues::BUCKET_NUM 
+                    && HistogramValues::bucketUpperBound(bucket) < bound) {
+                cumulative += h.counts[bucket++];
+            }
+            ss << name << "_bucket{le=\"" << bound / 1000000.0 << "\"} " 
+               << cumulative << "\n";
+        }
+        ss << name << "_bucket{le=\"+Inf\"} " << h.count << "\n"
+           << name << "_sum " << h.sum / 1000000.0 << "\n"
+           << name << "_count " << h.count << "\n";
+    }
+
+    return ss.str();
+}/*}}}*/
+
+void MetricsRegistry::formatFamily(stringstream &ss, const string &name,
+        const MetricInfo &info)
+{/*{{{*/
+    ss << "# HELP " << name << " " << info.help << "\n"
+       << "# TYPE " << name << " " << (info.gauge? "gauge": "counter") 
+       << "\n";
+}/*}}}*/
+
+string MetricsRegistry::escapeLabel(const string &value)
+{/*{{{*/
+    string res;
+    res.reserve(value.length());
+    for (size_t i = 0; i < value.length(); ++i) {
+        switch (value[i]) {
+            case '\\': res += "\\\\"; break;
+            case '"': res += "\\\""; break;
+            case '\n': res += "\\n"; break;
+            default: res += value[i];
+        }
+    }
+    return res;
+}/*}}}*/
+
+} // namespace logkafka
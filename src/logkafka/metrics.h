@@ -0,0 +1,297 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_METRICS_H_
+#define LOGKAFKA_METRICS_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "base/json.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+#include "base/singleton.h"
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+enum TaskMetricType
+{
+    METRIC_LINES_READ = 0,
+    METRIC_BYTES_READ,
+    METRIC_BATCHES_SENT,
+    METRIC_PRODUCE_FAILURES,
+    METRIC_BYTES_BEHIND,
+    METRIC_LINES_DROPPED,
+    TASK_METRIC_NUM
+};
+
+enum GlobalMetricType
+{
+    METRIC_KAFKA_QUEUE_DEPTH = 0,
+    METRIC_MESSAGES_DELIVERED,
+    METRIC_DELIVERY_FAILURES,
+    METRIC_SLOW_CALLBACKS,
+    GLOBAL_METRIC_NUM
+};
+
+enum HistogramType
+{
+    HISTOGRAM_READ_US = 0,
+    HISTOGRAM_PRODUCE_US,
+    HISTOGRAM_DELIVERY_US,
+    HISTOGRAM_END_TO_END_US,
+    HISTOGRAM_LOOP_LAG_US,
+    HISTOGRAM_CALLBACK_US,
+    HISTOGRAM_NUM
+};
+
+/* Log bucketed counts in the manner of HdrHistogram: values below
+ * 2^SUB_BUCKET_BITS get a bucket each, above that every power of two 
+ * is split into 2^SUB_BUCKET_BITS buckets, so the bucket of a value is
+ * at most 1/2^SUB_BUCKET_BITS wider than the value. Plain values, 
+ * used for snapshots and merging */
+struct HistogramValues
+{
+    static const int SUB_BUCKET_BITS = 4;
+    static const int MAX_BITS = 40;
+    static const int BUCKET_NUM = (MAX_BITS - SUB_BUCKET_BITS + 1) 
+        << SUB_BUCKET_BITS;
+
+    int64_t count;
+    int64_t sum;
+    int64_t counts[BUCKET_NUM];
+
+    HistogramValues();
+
+    void merge(const HistogramValues &other);
+    /* upper bound of the bucket holding the q-th value, 0 if empty */
+    int64_t quantile(double q) const;
+
+    static int bucketOf(int64_t value);
+    static int64_t bucketUpperBound(int bucket);
+};
+
+/* Histogram recorded from any thread with atomic adds */
+class Histogram
+{
+    public:
+        Histogram();
+
+        void record(int64_t value);
+        /* merges current counts into values */
+        void collect(HistogramValues &values);
+
+    private:
+        volatile int64_t m_count;
+        volatile int64_t m_sum;
+        volatile int64_t m_counts[HistogramValues::BUCKET_NUM];
+};
+
+struct MetricInfo
+{
+    const char *name;
+    const char *help;
+    /* gauges go up and down, counters only go up */
+    bool gauge;
+};
+
+/* Metrics of one path pattern, shared by all its tail watchers.
+ * Values are updated with atomic adds, writers never take a lock */
+class TaskMetrics
+{
+    public:
+        explicit TaskMetrics(const string &path_pattern);
+
+        void add(TaskMetricType type, int64_t n)
+        {/*{{{*/
+            __sync_fetch_and_add(&m_values[type], n);
+        };/*}}}*/
+
+        int64_t get(TaskMetricType type)
+        {/*{{{*/
+            return __sync_add_and_fetch(&m_values[type], 0);
+        };/*}}}*/
+
+    public:
+        const string m_path_pattern;
+
+    private:
+        friend class MetricsRegistry;
+
+        /* tail watchers and tasks using it, guarded by registry */
+        int m_users;
+        volatile int64_t m_values[TASK_METRIC_NUM];
+};
+
+struct TaskMetricsValues
+{
+    string path_pattern;
+    int64_t values[TASK_METRIC_NUM];
+};
+
+/* values copied out of the registry at one time */
+struct MetricsValues
+{
+    vector<TaskMetricsValues> tasks;
+    /* every task, including removed ones for counters */
+    int64_t totals[TASK_METRIC_NUM];
+    int64_t globals[GLOBAL_METRIC_NUM];
+    HistogramValues histograms[HISTOGRAM_NUM];
+};
+
+/* Process wide registry of metrics. Tasks are acquired and released 
+ * when watchers are set up or closed, recording only touches atomic 
+ * values, and collecting copies them out under the registry lock
+ * which the data path never takes */
+class MetricsRegistry
+{
+    public:
+        MetricsRegistry();
+        ~MetricsRegistry();
+
+        static MetricsRegistry &instance()
+        {/*{{{*/
+            return Singleton<MetricsRegistry>::instance();
+        };/*}}}*/
+
+        /* never NULL, release it with releaseTask() */
+        TaskMetrics *acquireTask(const string &path_pattern);
+        /* counters of the last user are kept in the totals */
+        void releaseTask(TaskMetrics *metrics);
+
+        void addGlobal(GlobalMetricType type, int64_t n)
+        {/*{{{*/
+            __sync_fetch_and_add(&m_globals[type], n);
+        };/*}}}*/
+
+        int64_t getGlobal(GlobalMetricType type)
+        {/*{{{*/
+            return __sync_add_and_fetch(&m_globals[type], 0);
+        };/*}}}*/
+
+        /* durations and latencies in microseconds */
+        void record(HistogramType type, int64_t us)
+        {/*{{{*/
+            m_histograms[type].record(us);
+        };/*}}}*/
+
+        void collect(MetricsValues &values);
+
+        /* prometheus text exposition format */
+        string formatPrometheus();
+
+        /* serialize to json */
+        template <typename JsonWriter>
+        void Serialize(JsonWriter& writer)
+        {/*{{{*/
+            MetricsValues values;
+            collect(values);
+
+            writer.StartObject();
+
+            writer.String("global");
+            writer.StartObject();
+            for (int i = 0; i < GLOBAL_METRIC_NUM; ++i) {
+                writer.String(GLOBAL_METRICS[i].name);
+                writer.Int64(values.globals[i]);
+            }
+            serializeValues(writer, values.totals);
+            writer.EndObject();
+
+            writer.String("histograms");
+            writer.StartObject();
+            for (int i = 0; i < HISTOGRAM_NUM; ++i) {
+                const HistogramValues &h = values.histograms[i];
+                writer.String(HISTOGRAMS[i].name);
+                writer.StartObject();
+                writer.String("count");
+                writer.Int64(h.count);
+                writer.String("sum");
+                writer.Int64(h.sum);
+                for (int j = 0; j < QUANTILE_NUM; ++j) {
+                    writer.String(QUANTILE_NAMES[j]);
+                    writer.Int64(h.quantile(QUANTILES[j]));
+                }
+                writer.EndObject();
+            }
+            writer.EndObject();
+
+            writer.String("tasks");
+            writer.StartObject();
+            for (vector<TaskMetricsValues>::const_iterator 
+                    iter = values.tasks.begin(); 
+                    iter != values.tasks.end(); ++iter) {
+                writer.String(iter->path_pattern.c_str(),
+                        (rapidjson::SizeType)iter->path_pattern.length());
+                writer.StartObject();
+                serializeValues(writer, iter->values);
+                writer.EndObject();
+            }
+            writer.EndObject();
+
+            writer.EndObject();
+        };/*}}}*/
+
+    public:
+        static const MetricInfo TASK_METRICS[TASK_METRIC_NUM];
+        static const MetricInfo GLOBAL_METRICS[GLOBAL_METRIC_NUM];
+        static const MetricInfo HISTOGRAMS[HISTOGRAM_NUM];
+
+        static const int QUANTILE_NUM = 5;
+        static const double QUANTILES[QUANTILE_NUM];
+        static const char *QUANTILE_NAMES[QUANTILE_NUM];
+
+    private:
+        static void formatFamily(stringstream &ss, const string &name,
+                const MetricInfo &info);
+        static string escapeLabel(const string &value);
+
+        template <typename JsonWriter>
+        static void serializeValues(JsonWriter& writer, 
+                const int64_t *values)
+        {/*{{{*/
+            for (int i = 0; i < TASK_METRIC_NUM; ++i) {
+                writer.String(TASK_METRICS[i].name);
+                writer.Int64(values[i]);
+            }
+        };/*}}}*/
+
+    private:
+        map<string, TaskMetrics *> m_tasks;
+        /* counters of released tasks */
+        int64_t m_retired[TASK_METRIC_NUM];
+        volatile int64_t m_globals[GLOBAL_METRIC_NUM];
+        Histogram m_histograms[HISTOGRAM_NUM];
+
+        Mutex m_mutex;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_METRICS_H_
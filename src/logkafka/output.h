@@ -22,6 +22,7 @@
 #ifndef LOGKAFKA_OUTPUT_H_
 #define LOGKAFKA_OUTPUT_H_
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -36,13 +37,41 @@ using namespace std;
 
 namespace logkafka {
 
+/* called with true once an output can not take more lines for now, 
+ * and with false once it can again */
+typedef void (*BackpressureFunc)(void *, bool);
+
 class Output
 {
     public:
-        Output() {};
+        Output(): m_backpressure_func(NULL), 
+                  m_backpressure_func_arg(NULL) {};
         virtual ~Output() {};
         virtual bool init(void *arg) = 0;
-        virtual bool output(void *arg, const vector<string> &lines) = 0;
+        /* write_time_us is when the lines were written to the log 
+         * file, microseconds since epoch, 0 if unknown */
+        virtual bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us) = 0;
+
+        /* outputs which never hold lines back do not call it */
+        virtual void setBackpressureCallback(BackpressureFunc func, 
+                void *arg)
+        {/*{{{*/
+            m_backpressure_func = func;
+            m_backpressure_func_arg = arg;
+        };/*}}}*/
+
+    protected:
+        void notifyBackpressure(bool full)
+        {/*{{{*/
+            if (NULL != m_backpressure_func) {
+                (*m_backpressure_func)(m_backpressure_func_arg, full);
+            }
+        };/*}}}*/
+
+    protected:
+        BackpressureFunc m_backpressure_func;
+        void *m_backpressure_func_arg;
 };
 
 } // namespace logkafka
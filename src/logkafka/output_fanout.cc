@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/output_fanout.h"
+
+#include <algorithm>
+
+namespace logkafka {
+
+OutputFanout::~OutputFanout()
+{/*{{{*/
+    for (vector<Output *>::iterator iter = m_outputs.begin();
+            iter != m_outputs.end(); ++iter) {
+        delete *iter; *iter = NULL;
+    }
+}/*}}}*/
+
+void OutputFanout::add(Output *output)
+{/*{{{*/
+    output->setBackpressureCallback(onBackpressure, this);
+    m_outputs.push_back(output);
+    m_watermarks.push_back(OutputWatermark());
+}/*}}}*/
+
+void OutputFanout::setBackpressureCallback(BackpressureFunc func, void *arg)
+{/*{{{*/
+    Output::setBackpressureCallback(func, arg);
+    if (m_full_outputs > 0) notifyBackpressure(true);
+}/*}}}*/
+
+void OutputFanout::onBackpressure(void *arg, bool full)
+{/*{{{*/
+    OutputFanout *of = reinterpret_cast<OutputFanout *>(arg);
+
+    /* outputs call it only when they change between the two */
+    of->m_full_outputs += full? 1: -1;
+    if (full && 1 == of->m_full_outputs) {
+        of->notifyBackpressure(true);
+    } else if (!full && 0 == of->m_full_outputs) {
+        of->notifyBackpressure(false);
+    }
+}/*}}}*/
+
+bool OutputFanout::output(void *arg, const vector<string> &lines,
+        int64_t write_time_us)
+{/*{{{*/
+    OutputFanout *of = reinterpret_cast<OutputFanout *>(arg);
+
+    /* every output is tried, one failing does not hold others back */
+    bool sent = true;
+    for (size_t i = 0; i < of->m_outputs.size(); ++i) {
+        Output *output = of->m_outputs[i];
+        OutputWatermark &watermark = of->m_watermarks[i];
+
+        /* lines it took of the unsent batch are not passed again, if 
+         * the batch read again starts with them */
+        size_t taken = of->getUnsentTaken(i, lines);
+        if (taken >= lines.size()) {
+            watermark.unsent_taken = lines.size();
+            continue;
+        }
+
+        bool res = false;
+        if (0 == taken) {
+            res = output->output(output, lines, write_time_us);
+        } else {
+            vector<string> rest(lines.begin() + taken, lines.end());
+            res = output->output(output, rest, write_time_us);
+        }
+
+        if (res) {
+            ++watermark.batches;
+            watermark.lines += lines.size() - taken;
+            watermark.unsent_taken = lines.size();
+        } else {
+            ++watermark.failures;
+            watermark.unsent_taken = taken;
+            sent = false;
+        }
+    }
+
+    if (sent) {
+        of->m_unsent.clear();
+    } else {
+        of->m_unsent = lines;
+    }
+
+    return sent;
+}/*}}}*/
+
+size_t OutputFanout::getUnsentTaken(size_t i, const vector<string> &lines)
+{/*{{{*/
+    if (m_unsent.empty()) return 0;
+    size_t taken = min(m_watermarks[i].unsent_taken, lines.size());
+
+    /* filters of the pipeline may pass other lines when it is read 
+     * again, they are sent once more then */
+    if (!equal(m_unsent.begin(), m_unsent.begin() + taken, lines.begin())) {
+        return 0;
+    }
+
+    return taken;
+}/*}}}*/
+
+} // namespace logkafka
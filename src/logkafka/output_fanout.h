@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_OUTPUT_FANOUT_H_
+#define LOGKAFKA_OUTPUT_FANOUT_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "logkafka/output.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* how far one output of a fanout got */
+struct OutputWatermark
+{
+    /* batches and lines accepted */
+    int64_t batches;
+    int64_t lines;
+    /* batches it failed to take */
+    int64_t failures;
+    /* lines of the unsent batch it took already */
+    size_t unsent_taken;
+
+    OutputWatermark(): batches(0), lines(0), failures(0), 
+                       unsent_taken(0) {};
+};
+
+/* Passes every batch, read once, to each of its outputs. A batch is 
+ * sent only if all of them accept it, so that the position of the 
+ * file never goes past lines that the slowest output did not take. 
+ * The file is read again from there, and the batch after one not sent
+ * skips the lines each output took of it already. 
+ * Outputs are owned and deleted with it. */
+class OutputFanout: public virtual Output
+{
+    public:
+        OutputFanout(): Output(), m_full_outputs(0) {};
+        virtual ~OutputFanout();
+
+        bool init(void *arg) { return true; };
+        bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us);
+
+        /* full while any of its outputs is */
+        void setBackpressureCallback(BackpressureFunc func, void *arg);
+
+        void add(Output *output);
+        size_t size() { return m_outputs.size(); };
+        const OutputWatermark &getWatermark(size_t i) 
+        {/*{{{*/
+            return m_watermarks[i]; 
+        };/*}}}*/
+
+    private:
+        static void onBackpressure(void *arg, bool full);
+        /* lines of the batch the i-th output took before it was sent */
+        size_t getUnsentTaken(size_t i, const vector<string> &lines);
+
+    private:
+        vector<Output *> m_outputs;
+        vector<OutputWatermark> m_watermarks;
+        /* the last batch not taken by all outputs */
+        vector<string> m_unsent;
+        int m_full_outputs;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_OUTPUT_FANOUT_H_
@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/output_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+const size_t OutputFile::BUFFER_BYTES = 1048576UL; /* 1MB */
+
+OutputFile::OutputFile(): Output()
+{/*{{{*/
+    m_gzip = false;
+    m_fd = -1;
+    m_segment_bytes = 0;
+    m_segment_start_ms = 0;
+    m_segment_seq = 0;
+    m_zstream_inited = false;
+}/*}}}*/
+
+OutputFile::~OutputFile()
+{/*{{{*/
+    close();
+
+    if (m_zstream_inited) {
+        deflateEnd(&m_zstream);
+        m_zstream_inited = false;
+    }
+}/*}}}*/
+
+bool OutputFile::init(void *arg)
+{/*{{{*/
+    FileOutputConf *conf = reinterpret_cast<FileOutputConf *>(arg);
+    if (NULL == conf || !conf->isLegal()) {
+        LERROR << "Illegal file output conf";
+        return false;
+    }
+
+    m_conf = *conf;
+    m_gzip = ("gzip" == m_conf.compression_codec);
+
+    /* the path of the file read, as one name */
+    m_segment_prefix = m_conf.path;
+    if (!m_conf.source.empty()) {
+        string source = m_conf.source;
+        source.erase(0, source.find_first_not_of('/'));
+        replace(source.begin(), source.end(), '/', '_');
+        m_segment_prefix += "." + source;
+    }
+    m_buffer.reserve(BUFFER_BYTES);
+
+    if (m_gzip) {
+        memset(&m_zstream, 0, sizeof(m_zstream));
+        /* 16 more window bits for gzip header and trailer */
+        int ret = deflateInit2(&m_zstream, Z_DEFAULT_COMPRESSION, 
+                Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        if (Z_OK != ret) {
+            LERROR << "Fail to init gzip stream, " << zError(ret);
+            return false;
+        }
+        m_zstream_inited = true;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return rotate((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}/*}}}*/
+
+bool OutputFile::output(void *arg, const vector<string> &lines,
+        int64_t write_time_us)
+{/*{{{*/
+    OutputFile *of = reinterpret_cast<OutputFile *>(arg);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+    bool expired = of->m_conf.segment_ms > 0 
+        && now_ms - of->m_segment_start_ms >= of->m_conf.segment_ms;
+    bool full = of->m_conf.segment_bytes > 0 
+        && of->m_segment_bytes >= of->m_conf.segment_bytes;
+    if ((expired || full || -1 == of->m_fd) && !of->rotate(now_ms)) {
+        return false;
+    }
+
+    for (vector<string>::const_iterator iter = lines.begin();
+            iter != lines.end(); ++iter) {
+        of->m_buffer.append(*iter);
+        of->m_buffer.push_back('\n');
+
+        if (of->m_buffer.size() >= BUFFER_BYTES && !of->flush()) {
+            return false;
+        }
+    }
+
+    return of->flush();
+}/*}}}*/
+
+bool OutputFile::rotate(int64_t now_ms)
+{/*{{{*/
+    close();
+
+    time_t now = now_ms / 1000;
+    struct tm tm;
+    char time_str[32];
+    localtime_r(&now, &tm);
+    strftime(time_str, sizeof(time_str), "%Y%m%d%H%M%S", &tm);
+
+    /* segments started in the same second are numbered, a segment 
+     * left by a restart is appended to unless it is full */
+    int seq = (time_str == m_segment_time)? m_segment_seq + 1: 0;
+    for (; ; ++seq) {
+        string path = m_segment_prefix + "." + time_str 
+            + (seq > 0? "." + int2Str(seq): "") + (m_gzip? ".gz": "");
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (-1 == fd) {
+            LERROR << "Fail to open segment " << path 
+                   << ", " << strerror(errno);
+            return false;
+        }
+
+        off_t size = getFsize(fd);
+        if (m_conf.segment_bytes > 0 && size >= m_conf.segment_bytes) {
+            ::close(fd);
+            continue;
+        }
+
+        m_fd = fd;
+        m_segment_path = path;
+        m_segment_bytes = size;
+        m_segment_start_ms = now_ms;
+        m_segment_time = time_str;
+        m_segment_seq = seq;
+        LINFO << "Start segment " << path;
+        break;
+    }
+
+    return true;
+}/*}}}*/
+
+bool OutputFile::flush()
+{/*{{{*/
+    if (m_buffer.empty()) return true;
+
+    bool res = false;
+    if (!m_gzip) {
+        res = writeAll(m_buffer.data(), m_buffer.size());
+    } else if (compress(m_buffer, m_compressed)) {
+        res = writeAll(m_compressed.data(), m_compressed.size());
+    }
+    m_buffer.clear();
+
+    return res;
+}/*}}}*/
+
+bool OutputFile::compress(const string &in, string &out)
+{/*{{{*/
+    /* one complete gzip member for each flush */
+    deflateReset(&m_zstream);
+    out.resize(deflateBound(&m_zstream, in.size()));
+
+    m_zstream.next_in = (Bytef *)in.data();
+    m_zstream.avail_in = in.size();
+    m_zstream.next_out = (Bytef *)&out[0];
+    m_zstream.avail_out = out.size();
+
+    int ret = deflate(&m_zstream, Z_FINISH);
+    if (Z_STREAM_END != ret) {
+        LERROR << "Fail to compress lines of segment " << m_segment_path
+               << ", " << zError(ret);
+        return false;
+    }
+    out.resize(m_zstream.total_out);
+
+    return true;
+}/*}}}*/
+
+bool OutputFile::writeAll(const char *buf, size_t len)
+{/*{{{*/
+    while (len > 0) {
+        ssize_t n = write(m_fd, buf, len);
+        if (n < 0) {
+            if (EINTR == errno) continue;
+            LERROR << "Fail to write segment " << m_segment_path
+                   << ", " << strerror(errno);
+            return false;
+        }
+        buf += n;
+        len -= n;
+        m_segment_bytes += n;
+    }
+
+    return true;
+}/*}}}*/
+
+void OutputFile::close()
+{/*{{{*/
+    if (-1 != m_fd) {
+        ::close(m_fd); m_fd = -1;
+    }
+}/*}}}*/
+
+} // namespace logkafka
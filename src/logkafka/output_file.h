@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_OUTPUT_FILE_H_
+#define LOGKAFKA_OUTPUT_FILE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "base/common.h"
+#include "logkafka/output.h"
+#include "logkafka/task_conf.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* Appends lines to local segment files named path.YYYYmmddHHMMSS[.N],
+ * path.source.YYYYmmddHHMMSS[.N] if a task reads several files at once,
+ * a new segment is started once the current one reaches segment_bytes 
+ * or gets older than segment_ms. Lines of a batch are written with 
+ * one write(2) to a file opened with O_APPEND. Gzip segments end with 
+ * .gz and hold one gzip member per batch, so that a crash leaves at 
+ * most the last member partially written. */
+class OutputFile: public virtual Output
+{
+    public:
+        OutputFile();
+        virtual ~OutputFile();
+
+        /* arg is FileOutputConf */
+        bool init(void *arg);
+        bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us);
+
+        void close();
+
+        string getSegmentPath() { return m_segment_path; };
+
+    private:
+        bool rotate(int64_t now_ms);
+        bool flush();
+        bool compress(const string &in, string &out);
+        bool writeAll(const char *buf, size_t len);
+
+    private:
+        FileOutputConf m_conf;
+        bool m_gzip;
+        /* path, with the source if any */
+        string m_segment_prefix;
+        int m_fd;
+        string m_segment_path;
+        int64_t m_segment_bytes;
+        int64_t m_segment_start_ms;
+        /* start time and number of the segment in its second */
+        string m_segment_time;
+        int m_segment_seq;
+
+        string m_buffer;
+        string m_compressed;
+        z_stream m_zstream;
+        bool m_zstream_inited;
+
+        static const size_t BUFFER_BYTES;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_OUTPUT_FILE_H_
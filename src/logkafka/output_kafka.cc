@@ -26,7 +26,8 @@ namespace logkafka {
 map< string, Producer *> OutputKafka::m_producer_map;
 KafkaConf OutputKafka::m_kafka_conf;
 
-bool OutputKafka::output(void *arg, const vector<string> &lines)
+bool OutputKafka::output(void *arg, const vector<string> &lines,
+        int64_t write_time_us)
 {/*{{{*/
     OutputKafka *ok = reinterpret_cast<OutputKafka *>(arg);
     KafkaTopicConf kafka_topic_conf = ok->m_kafka_topic_conf;
@@ -38,7 +39,8 @@ bool OutputKafka::output(void *arg, const vector<string> &lines)
                 kafka_topic_conf.key, 
                 kafka_topic_conf.required_acks,
                 kafka_topic_conf.partition,
-                kafka_topic_conf.message_timeout_ms);
+                kafka_topic_conf.message_timeout_ms,
+                write_time_us);
 }/*}}}*/
 
 bool OutputKafka::init(void *arg, string compression_codec)
@@ -48,7 +50,7 @@ bool OutputKafka::init(void *arg, string compression_codec)
 
 bool OutputKafka::initProducer(void *arg, string compression_codec)
 {/*{{{*/
-    Zookeeper *zookeeper = reinterpret_cast<Zookeeper *>(arg);
+    ConfigSource *config_source = reinterpret_cast<ConfigSource *>(arg);
 
     map<string, int>::const_iterator iter 
         = Producer::cc_map.find(compression_codec);
@@ -59,7 +61,7 @@ bool OutputKafka::initProducer(void *arg, string compression_codec)
         LINFO << "Try to init producer, compression_codec is "
               << iter->first;
         Producer *producer = new Producer();
-        if (!producer->init(*zookeeper, iter->first,
+        if (!producer->init(*config_source, iter->first,
                     m_kafka_conf.message_max_bytes,
                     m_kafka_conf.message_send_max_retries))
         {
@@ -80,6 +82,25 @@ bool OutputKafka::setKafkaTopicConf(KafkaTopicConf kafka_topic_conf)
     return true;
 }/*}}}*/
 
+bool OutputKafka::refreshBrokers(void *arg)
+{/*{{{*/
+    ConfigSource *config_source = reinterpret_cast<ConfigSource *>(arg);
+
+    bool res = true;
+    map<string, Producer *>::iterator iter;
+    for (iter = m_producer_map.begin(); iter != m_producer_map.end(); ++iter) {
+        if (NULL == iter->second) continue;
+
+        if (!iter->second->refreshBrokers(*config_source)) {
+            LERROR << "Fail to refresh brokers of producer, compression_codec is "
+                   << iter->first;
+            res = false;
+        }
+    }
+
+    return res;
+}/*}}}*/
+
 bool OutputKafka::stopProducers()
 {/*{{{*/
     map<string, int>::const_iterator iter;
@@ -36,7 +36,6 @@
 #include "logkafka/task_conf.h"
 
 using namespace std;
-using namespace base;
 
 namespace logkafka {
 
@@ -54,13 +53,17 @@ class OutputKafka: public virtual Output
 
         /* NOTE: not thread-safe */
         bool init(void *arg, string compression_codec);
-        bool output(void *arg, const vector<string> &lines);
+        bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us);
         bool setKafkaTopicConf(KafkaTopicConf kafka_topic_conf);
 
         /* NOTE: not thread-safe */
         static bool initProducer(void *arg, string compression_codec);
 
         static bool stopProducers();
+
+        /* NOTE: not thread-safe */
+        static bool refreshBrokers(void *arg);
         static bool setKafkaConf(KafkaConf kafka_conf) { 
             m_kafka_conf = kafka_conf;
             return true;
@@ -0,0 +1,436 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/output_stream.h"
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/un.h>
+
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+/* writev(2) takes at most IOV_MAX buffers */
+const size_t OutputStream::MAX_WRITE_BUFS = 1024;
+
+static char NEWLINE[] = "\n";
+
+struct StreamConnection
+{
+    union {
+        uv_handle_t handle;
+        uv_stream_t stream;
+        uv_tcp_t tcp;
+        uv_pipe_t pipe;
+    } h;
+    uv_connect_t connect_req;
+    uv_write_t write_req;
+    /* NULL once the output is done with it, it is deleted when 
+     * the handle is closed */
+    OutputStream *output;
+    /* chunks of write_req, kept until it completes */
+    vector<string> writing;
+    int64_t writing_bytes;
+    /* bytes of the first chunk written before it */
+    size_t writing_skip;
+
+    StreamConnection(): output(NULL), writing_bytes(0), writing_skip(0)
+    {/*{{{*/
+        memset(&h, 0, sizeof(h));
+        memset(&connect_req, 0, sizeof(connect_req));
+        memset(&write_req, 0, sizeof(write_req));
+    }/*}}}*/
+};
+
+OutputStream::OutputStream(): Output()
+{/*{{{*/
+    m_loop = NULL;
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_conn = NULL;
+    m_connected = false;
+    m_reconnect_timer = NULL;
+    m_pending_bytes = 0;
+    m_pending_written = 0;
+    m_full = false;
+}/*}}}*/
+
+OutputStream::~OutputStream()
+{/*{{{*/
+    disconnect();
+
+    if (NULL != m_reconnect_timer) {
+        m_reconnect_timer->close();
+        delete m_reconnect_timer; m_reconnect_timer = NULL;
+    }
+}/*}}}*/
+
+bool OutputStream::init(uv_loop_t *loop, const string &type, 
+        const StreamOutputConf &conf)
+{/*{{{*/
+    m_loop = loop;
+    m_type = type;
+    m_conf = conf;
+
+    if ("unix" != m_type && "tcp" != m_type) {
+        LERROR << "Unknown stream output " << m_type;
+        return false;
+    }
+
+    if (!parseAddress()) {
+        LERROR << "Fail to parse " << m_type 
+               << " address " << m_conf.address;
+        return false;
+    }
+
+    /* a peer closing the socket fails writes with EPIPE instead of 
+     * killing the process */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* lines are queued until it is connected */
+    if (!connect()) {
+        scheduleReconnect();
+    }
+
+    return true;
+}/*}}}*/
+
+bool OutputStream::parseAddress()
+{/*{{{*/
+    if ("unix" == m_type) {
+        struct sockaddr_un sun;
+        return !m_conf.address.empty() 
+            && m_conf.address.size() < sizeof(sun.sun_path);
+    }
+
+    size_t pos = m_conf.address.rfind(':');
+    if (string::npos == pos) return false;
+
+    string host = m_conf.address.substr(0, pos);
+    int port = atoi(m_conf.address.c_str() + pos + 1);
+    if (port <= 0 || port > 65535) return false;
+
+    /* [::1]:port */
+    if (host.size() > 2 && '[' == host[0] && ']' == host[host.size() - 1]) {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    return 0 == uv_ip4_addr(host.c_str(), port, 
+                reinterpret_cast<struct sockaddr_in *>(&m_addr))
+        || 0 == uv_ip6_addr(host.c_str(), port, 
+                reinterpret_cast<struct sockaddr_in6 *>(&m_addr));
+}/*}}}*/
+
+bool OutputStream::connect()
+{/*{{{*/
+    StreamConnection *conn = new StreamConnection();
+    int res = ("unix" == m_type)? uv_pipe_init(m_loop, &conn->h.pipe, 0)
+        : uv_tcp_init(m_loop, &conn->h.tcp);
+    if (res < 0) {
+        LERROR << "Fail to init " << m_type << " handle, " 
+               << uv_strerror(res);
+        delete conn;
+        return false;
+    }
+
+    conn->output = this;
+    conn->h.handle.data = conn;
+    conn->connect_req.data = conn;
+    conn->write_req.data = conn;
+    m_conn = conn;
+
+    if ("unix" == m_type) {
+        uv_pipe_connect(&conn->connect_req, &conn->h.pipe, 
+                m_conf.address.c_str(), onConnect);
+    } else {
+        uv_tcp_nodelay(&conn->h.tcp, 1);
+        res = uv_tcp_connect(&conn->connect_req, &conn->h.tcp, 
+                reinterpret_cast<const struct sockaddr *>(&m_addr), 
+                onConnect);
+        if (res < 0) {
+            LERROR << "Fail to connect to " << m_conf.address 
+                   << ", " << uv_strerror(res);
+            disconnect();
+            return false;
+        }
+    }
+
+    return true;
+}/*}}}*/
+
+void OutputStream::disconnect()
+{/*{{{*/
+    if (NULL == m_conn) return;
+
+    StreamConnection *conn = m_conn;
+    m_conn = NULL;
+    m_connected = false;
+
+    /* not known how much of them the peer got, they are written 
+     * again after reconnecting, still counted in m_pending_bytes */
+    for (vector<string>::reverse_iterator iter = conn->writing.rbegin();
+            iter != conn->writing.rend(); ++iter) {
+        m_pending.push_front(*iter);
+    }
+
+    /* a line written in part goes to the next peer as a whole */
+    m_pending_bytes += conn->writing_skip + m_pending_written;
+    conn->writing_skip = 0;
+    m_pending_written = 0;
+
+    /* callbacks of requests in flight see it, and are called before 
+     * the one of closing */
+    conn->output = NULL;
+    uv_close(&conn->h.handle, onClose);
+}/*}}}*/
+
+void OutputStream::scheduleReconnect()
+{/*{{{*/
+    if (NULL != m_reconnect_timer) {
+        m_reconnect_timer->start();
+        return;
+    }
+
+    m_reconnect_timer = new TimerWatcher();
+    m_reconnect_timer->setName(m_type + " " + m_conf.address);
+    if (!m_reconnect_timer->init(m_loop, DEFAULT_STREAM_RECONNECT_INTERVAL,
+                0, this, onReconnect)) {
+        LERROR << "Fail to init reconnect timer";
+        delete m_reconnect_timer; m_reconnect_timer = NULL;
+    }
+}/*}}}*/
+
+void OutputStream::onReconnect(void *arg)
+{/*{{{*/
+    OutputStream *os = reinterpret_cast<OutputStream *>(arg);
+
+    if (NULL == os->m_conn && !os->connect()) {
+        os->scheduleReconnect();
+    }
+}/*}}}*/
+
+void OutputStream::onConnect(uv_connect_t *req, int status)
+{/*{{{*/
+    StreamConnection *conn = reinterpret_cast<StreamConnection *>(req->data);
+    OutputStream *os = conn->output;
+    if (NULL == os) return;
+
+    if (status >= 0) {
+        /* nothing is expected from the peer, it is read to find out 
+         * when it closes the connection */
+        status = uv_read_start(&conn->h.stream, onAlloc, onRead);
+    }
+
+    if (status < 0) {
+        LERROR << "Fail to connect to " << os->m_type << " " 
+               << os->m_conf.address << ", " << uv_strerror(status);
+        os->disconnect();
+        os->scheduleReconnect();
+        return;
+    }
+
+    LINFO << "Connected to " << os->m_type << " " << os->m_conf.address;
+    os->m_connected = true;
+    os->writePending();
+}/*}}}*/
+
+void OutputStream::onAlloc(uv_handle_t *handle, size_t suggested_size,
+        uv_buf_t *buf)
+{/*{{{*/
+    static char discarded[4096];
+    *buf = uv_buf_init(discarded, sizeof(discarded));
+}/*}}}*/
+
+void OutputStream::onRead(uv_stream_t *stream, ssize_t nread, 
+        const uv_buf_t *buf)
+{/*{{{*/
+    if (nread >= 0) return;
+
+    StreamConnection *conn = reinterpret_cast<StreamConnection *>(stream->data);
+    OutputStream *os = conn->output;
+    if (NULL == os) return;
+
+    LWARNING << "Connection to " << os->m_type << " " 
+             << os->m_conf.address << " is closed, " 
+             << uv_strerror(nread);
+    os->disconnect();
+    os->scheduleReconnect();
+}/*}}}*/
+
+void OutputStream::onClose(uv_handle_t *handle)
+{/*{{{*/
+    delete reinterpret_cast<StreamConnection *>(handle->data);
+}/*}}}*/
+
+bool OutputStream::output(void *arg, const vector<string> &lines,
+        int64_t write_time_us)
+{/*{{{*/
+    OutputStream *os = reinterpret_cast<OutputStream *>(arg);
+
+    /* the first line, and bytes of it with its newline, not written */
+    size_t line = 0;
+    size_t offset = 0;
+
+    /* lines go to the socket directly while nothing waits before them,
+     * two buffers for each, the line and its newline */
+    while (os->m_connected && os->m_pending.empty() 
+            && os->m_conn->writing.empty() && line < lines.size()) {
+        uv_buf_t bufs[MAX_WRITE_BUFS];
+        size_t nbufs = 0;
+        size_t bytes = 0;
+        for (size_t i = line; i < lines.size() && nbufs < MAX_WRITE_BUFS; 
+                ++i) {
+            bufs[nbufs++] = uv_buf_init(const_cast<char *>(lines[i].data()),
+                    lines[i].size());
+            bufs[nbufs++] = uv_buf_init(NEWLINE, 1);
+            bytes += lines[i].size() + 1;
+        }
+
+        int res = uv_try_write(&os->m_conn->h.stream, bufs, nbufs);
+        if (res < 0 && UV_EAGAIN != res) {
+            LERROR << "Fail to write to " << os->m_type << " " 
+                   << os->m_conf.address << ", " << uv_strerror(res);
+            os->disconnect();
+            os->scheduleReconnect();
+            break;
+        }
+
+        size_t written = (res > 0)? res: 0;
+        bool all = (written == bytes);
+        while (written > 0) {
+            size_t left = lines[line].size() + 1 - offset;
+            if (written < left) {
+                offset += written;
+                break;
+            }
+            written -= left;
+            offset = 0;
+            ++line;
+        }
+
+        if (!all) break;
+    }
+
+    if (line == lines.size()) return true;
+
+    /* the rest is copied, to be written once the socket is writable, 
+     * a line written in part is kept whole, in case it has to go to
+     * another peer after reconnecting */
+    size_t bytes = 0;
+    for (size_t i = line; i < lines.size(); ++i) {
+        bytes += lines[i].size() + 1;
+    }
+
+    os->m_pending.push_back(string());
+    string &chunk = os->m_pending.back();
+    chunk.reserve(bytes);
+    for (size_t i = line; i < lines.size(); ++i) {
+        chunk.append(lines[i]);
+        chunk.push_back('\n');
+    }
+    os->m_pending_bytes += bytes - offset;
+    os->m_pending_written = offset;
+
+    os->writePending();
+    os->updateFull();
+
+    return true;
+}/*}}}*/
+
+void OutputStream::writePending()
+{/*{{{*/
+    if (!m_connected || !m_conn->writing.empty() || m_pending.empty()) 
+        return;
+
+    StreamConnection *conn = m_conn;
+    conn->writing_skip = m_pending_written;
+    m_pending_written = 0;
+    while (!m_pending.empty() && conn->writing.size() < MAX_WRITE_BUFS) {
+        conn->writing.push_back(string());
+        conn->writing.back().swap(m_pending.front());
+        m_pending.pop_front();
+        conn->writing_bytes += conn->writing.back().size();
+    }
+    conn->writing_bytes -= conn->writing_skip;
+
+    /* after all are moved, growing the vector moves short strings */
+    uv_buf_t bufs[MAX_WRITE_BUFS];
+    for (size_t i = 0; i < conn->writing.size(); ++i) {
+        bufs[i] = uv_buf_init(const_cast<char *>(conn->writing[i].data()),
+                conn->writing[i].size());
+    }
+    bufs[0].base += conn->writing_skip;
+    bufs[0].len -= conn->writing_skip;
+
+    int res = uv_write(&conn->write_req, &conn->h.stream, bufs, 
+            conn->writing.size(), onWrite);
+    if (res < 0) {
+        LERROR << "Fail to write to " << m_type << " " 
+               << m_conf.address << ", " << uv_strerror(res);
+        disconnect();
+        conn->writing.clear();
+        conn->writing_bytes = 0;
+        conn->writing_skip = 0;
+        scheduleReconnect();
+    }
+}/*}}}*/
+
+void OutputStream::onWrite(uv_write_t *req, int status)
+{/*{{{*/
+    StreamConnection *conn = reinterpret_cast<StreamConnection *>(req->data);
+    OutputStream *os = conn->output;
+
+    if (NULL != os) {
+        if (status < 0) {
+            LERROR << "Fail to write to " << os->m_type << " " 
+                   << os->m_conf.address << ", " << uv_strerror(status);
+            os->disconnect();
+            os->scheduleReconnect();
+            os = NULL;
+        } else {
+            os->m_pending_bytes -= conn->writing_bytes;
+        }
+    }
+
+    conn->writing.clear();
+    conn->writing_bytes = 0;
+    conn->writing_skip = 0;
+
+    if (NULL != os) {
+        os->writePending();
+        os->updateFull();
+    }
+}/*}}}*/
+
+void OutputStream::updateFull()
+{/*{{{*/
+    if (!m_full && m_pending_bytes >= m_conf.max_pending_bytes) {
+        m_full = true;
+        notifyBackpressure(true);
+    } else if (m_full && m_pending_bytes <= m_conf.max_pending_bytes / 2) {
+        m_full = false;
+        notifyBackpressure(false);
+    }
+}/*}}}*/
+
+} // namespace logkafka
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_OUTPUT_STREAM_H_
+#define LOGKAFKA_OUTPUT_STREAM_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "base/common.h"
+#include "base/timer_watcher.h"
+#include "logkafka/output.h"
+#include "logkafka/task_conf.h"
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+struct StreamConnection;
+
+/* Writes lines, each ended with a newline, to a unix socket or a tcp 
+ * connection on the loop without blocking it. A batch goes out with 
+ * vectored writes straight from the lines, what the socket does not 
+ * take is copied and written once it is writable again. Once more 
+ * than max_pending_bytes wait, backpressure pauses reading until half
+ * of them are written. It reconnects after errors, bytes not known to 
+ * be written are written again, so a peer may get a line twice, a line
+ * written in part is written again as a whole. */
+class OutputStream: public virtual Output
+{
+    public:
+        OutputStream();
+        virtual ~OutputStream();
+
+        bool init(void *arg) { return true; };
+        /* type is unix or tcp */
+        bool init(uv_loop_t *loop, const string &type, 
+                const StreamOutputConf &conf);
+        bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us);
+
+        bool isConnected() { return m_connected; };
+        bool isFull() { return m_full; };
+        /* bytes accepted and not written to the socket yet */
+        int64_t getPendingBytes() { return m_pending_bytes; };
+
+    private:
+        bool parseAddress();
+        bool connect();
+        void disconnect();
+        void scheduleReconnect();
+        void writePending();
+        void updateFull();
+
+        static void onConnect(uv_connect_t *req, int status);
+        static void onWrite(uv_write_t *req, int status);
+        static void onRead(uv_stream_t *stream, ssize_t nread, 
+                const uv_buf_t *buf);
+        static void onAlloc(uv_handle_t *handle, size_t suggested_size,
+                uv_buf_t *buf);
+        static void onClose(uv_handle_t *handle);
+        static void onReconnect(void *arg);
+
+    private:
+        uv_loop_t *m_loop;
+        string m_type;
+        StreamOutputConf m_conf;
+        struct sockaddr_storage m_addr;
+
+        StreamConnection *m_conn;
+        bool m_connected;
+        TimerWatcher *m_reconnect_timer;
+
+        /* chunks not given to the socket yet */
+        deque<string> m_pending;
+        /* the ones being written included */
+        int64_t m_pending_bytes;
+        /* bytes of the first chunk written on this connection, it 
+         * starts with a line written in part */
+        size_t m_pending_written;
+        bool m_full;
+
+        static const size_t MAX_WRITE_BUFS;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_OUTPUT_STREAM_H_
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/pipeline.h"
+
+#include "logkafka/filter_stage.h"
+#include "logkafka/sample_stage.h"
+
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+void Stage::process(vector<string> &lines)
+{/*{{{*/
+    size_t kept = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (!processLine(lines[i])) continue;
+        if (kept != i) lines[kept].swap(lines[i]);
+        ++kept;
+    }
+
+    lines.erase(lines.begin() + kept, lines.end());
+}/*}}}*/
+
+Stage *Stage::create(const StageConf &conf)
+{/*{{{*/
+    Stage *stage = NULL;
+    if ("trim" == conf.stage) {
+        stage = new TrimStage();
+    } else if ("truncate" == conf.stage) {
+        stage = new TruncateStage();
+    } else if ("drop_empty" == conf.stage) {
+        stage = new DropEmptyStage();
+    } else if ("filter" == conf.stage) {
+        stage = new FilterStage();
+    } else if ("sample" == conf.stage) {
+        stage = new SampleStage();
+    } else {
+        LERROR << "Unknown stage " << conf.stage;
+        return NULL;
+    }
+
+    if (!stage->init(conf)) {
+        LERROR << "Fail to init stage " << conf.stage;
+        delete stage;
+        return NULL;
+    }
+
+    return stage;
+}/*}}}*/
+
+bool TrimStage::processLine(string &line)
+{/*{{{*/
+    size_t len = line.size();
+    while (len > 0) {
+        char c = line[len - 1];
+        if (' ' != c && '\t' != c && '\r' != c) break;
+        --len;
+    }
+
+    if (len < line.size()) line.resize(len);
+    return true;
+}/*}}}*/
+
+bool TruncateStage::init(const StageConf &conf)
+{/*{{{*/
+    m_max_bytes = conf.max_bytes;
+    return m_max_bytes > 0;
+}/*}}}*/
+
+bool TruncateStage::processLine(string &line)
+{/*{{{*/
+    if (line.size() > m_max_bytes) line.resize(m_max_bytes);
+    return true;
+}/*}}}*/
+
+Pipeline::~Pipeline()
+{/*{{{*/
+    for (vector<Stage *>::iterator iter = m_stages.begin();
+            iter != m_stages.end(); ++iter) {
+        delete *iter; *iter = NULL;
+    }
+}/*}}}*/
+
+bool Pipeline::init(const vector<StageConf> &confs)
+{/*{{{*/
+    m_confs = confs;
+    for (vector<StageConf>::const_iterator iter = confs.begin();
+            iter != confs.end(); ++iter) {
+        Stage *stage = Stage::create(*iter);
+        if (NULL == stage) return false;
+        m_stages.push_back(stage);
+        m_names.push_back(iter->stage);
+        m_dropped.push_back(0);
+    }
+
+    return true;
+}/*}}}*/
+
+size_t Pipeline::process(vector<string> &lines)
+{/*{{{*/
+    size_t lines_in = lines.size();
+    for (size_t i = 0; i < m_stages.size() && !lines.empty(); ++i) {
+        size_t before = lines.size();
+        m_stages[i]->process(lines);
+        m_dropped[i] += before - lines.size();
+    }
+
+    return lines_in - lines.size();
+}/*}}}*/
+
+} // namespace logkafka
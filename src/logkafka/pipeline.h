@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_PIPELINE_H_
+#define LOGKAFKA_PIPELINE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "logkafka/task_conf.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* Works on a batch of lines in place between reading and sending. 
+ * Lines are dropped by moving the kept ones forward with swap, and 
+ * edited without growing them, so that stages do not allocate memory
+ * for each line. */
+class Stage
+{
+    public:
+        Stage() {};
+        virtual ~Stage() {};
+        virtual bool init(const StageConf &conf) = 0;
+        /* lines dropped are removed from the batch */
+        virtual void process(vector<string> &lines);
+
+        /* NULL if the stage is unknown or its conf is illegal */
+        static Stage *create(const StageConf &conf);
+
+    protected:
+        /* returns false to drop the line */
+        virtual bool processLine(string &line) { return true; };
+};
+
+/* removes trailing whitespace, the \r of CRLF line endings included */
+class TrimStage: public Stage
+{
+    public:
+        bool init(const StageConf &conf) { return true; };
+
+    protected:
+        bool processLine(string &line);
+};
+
+/* cuts lines longer than max_bytes */
+class TruncateStage: public Stage
+{
+    public:
+        TruncateStage(): m_max_bytes(0) {};
+        bool init(const StageConf &conf);
+
+    protected:
+        bool processLine(string &line);
+
+    private:
+        size_t m_max_bytes;
+};
+
+class DropEmptyStage: public Stage
+{
+    public:
+        bool init(const StageConf &conf) { return true; };
+
+    protected:
+        bool processLine(string &line) { return !line.empty(); };
+};
+
+/* stages of a task, run in order. Shared by the watchers of a task, 
+ * so that stages keeping state, like sample limit, work on all lines 
+ * of the task; it is deleted once the last one releases it. */
+class Pipeline
+{
+    public:
+        Pipeline(): m_refs(1) {};
+        ~Pipeline();
+
+        bool init(const vector<StageConf> &confs);
+        Pipeline *acquire() { ++m_refs; return this; };
+        void release() { if (0 == --m_refs) delete this; };
+        const vector<StageConf> &getConfs() { return m_confs; };
+        /* returns the number of lines dropped */
+        size_t process(vector<string> &lines);
+        size_t size() { return m_stages.size(); };
+        const string &getName(size_t i) { return m_names[i]; };
+        /* lines dropped by the i-th stage so far */
+        int64_t getDropped(size_t i) { return m_dropped[i]; };
+
+    private:
+        /* only used in loop thread */
+        int m_refs;
+        vector<StageConf> m_confs;
+        vector<Stage *> m_stages;
+        vector<string> m_names;
+        vector<int64_t> m_dropped;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_PIPELINE_H_
@@ -36,6 +36,29 @@ using namespace std;
 
 namespace logkafka {
 
+struct PositionEntryKey 
+{
+    string path_pattern;
+    string path;
+
+    bool operator==(const PositionEntryKey& hs) const
+    {
+        return (path_pattern == hs.path_pattern) &&
+            (path == hs.path);
+    };
+
+    bool operator!=(const PositionEntryKey& hs) const
+    {
+        return !operator==(hs);
+    };
+
+    bool operator<(const PositionEntryKey& hs) const
+    {
+        return (path_pattern < hs.path_pattern) ||
+            (path_pattern == hs.path_pattern && path < hs.path);
+    };
+};
+
 class PositionEntry
 {
     public:
@@ -19,233 +19,476 @@
 // limitations under the License.
 //
 ///////////////////////////////////////////////////////////////////////////
-#include <cassert>
 #include "logkafka/position_file.h"
 
+#include <fcntl.h>
+
+#include <cassert>
+#include <cstdio>
+
 namespace logkafka {
 
 PositionFile *PositionFile::m_pf = NULL;
 const int64_t PositionFile::UNWATCHED_POSITION = 0xffffffffffffffff;
-
-PositionFile::PositionFile(FILE *file,
-        FilePositionEntryMap pe_map,
-        off_t last_pos)
+const unsigned long PositionFile::COMPACT_MIN_RECORDS = 10000UL;
+const unsigned long PositionFile::COMPACT_RATIO = 4UL;
+
+struct CompactWork
+{
+    uv_work_t req;
+    PositionFile *position_file;
+    string tmp_path;
+    string content;
+    unsigned long records;
+    bool ok;
+};
+
+PositionFile::PositionFile()
 {/*{{{*/
-    m_file = file;
-    m_pe_map = pe_map;
-    m_last_pos = last_pos;
+    m_file = NULL;
+    m_journal_records = 0;
+    m_compacting = false;
+    m_compact_work = NULL;
 }/*}}}*/
 
 PositionFile::~PositionFile()
 {/*{{{*/
+    close();
+
+    /* the pending compaction will find no owner and clean up itself */
+    if (NULL != m_compact_work) {
+        m_compact_work->position_file = NULL;
+        m_compact_work = NULL;
+    }
+
     for (FilePositionEntryMap::iterator iter = m_pe_map.begin();
             iter != m_pe_map.end(); ++iter) {
         delete iter->second; iter->second = NULL;
     }
 }/*}}}*/
 
-bool PositionFile::init(FILE *file,
-        FilePositionEntryMap pe_map,
-        off_t last_pos)
-{/*{{{*/
-    assert(NULL != file);
-
-    m_file = file;
-    m_pe_map = pe_map;
-    m_last_pos = last_pos;
-
-    return true;
-}/*}}}*/
-
 value_t& PositionFile::operator[](const PositionEntryKey &pek)
 {/*{{{*/
-    string path_pattern = pek.path_pattern;
-    string path = pek.path;
-
     FilePositionEntryMap::iterator iter = m_pe_map.find(pek);
-
     if (iter != m_pe_map.end()) {
         return iter->second;
     }
 
-    fseek(m_file, m_last_pos, SEEK_SET);
-    fwrite(path_pattern.c_str(), path_pattern.length(), 1, m_file);
-    fwrite("\t", 1, 1, m_file);
-
-    fwrite(path.c_str(), path.length(), 1, m_file);
-    fwrite("\t", 1, 1, m_file);
-
-    off_t seek = ftell(m_file);
-
-    string zero = "0000000000000000\t00000000\n";
-    fwrite(zero.c_str(), zero.length(), 1, m_file);
+    PositionRecordMap::const_iterator rec = m_records.find(pek);
+    if (rec != m_records.end()) {
+        return m_pe_map[pek] = new FilePositionEntry(this, pek,
+                rec->second.inode, rec->second.pos);
+    }
 
-    m_last_pos = ftell(m_file);
+    append(pek, INO_NONE, 0);
 
-    return m_pe_map[pek] = new FilePositionEntry(m_file, seek);
+    return m_pe_map[pek] = new FilePositionEntry(this, pek, INO_NONE, 0);
 }/*}}}*/
 
-PositionFile* PositionFile::parse(FILE *file)
+PositionFile* PositionFile::parse(const string &path)
 {/*{{{*/
-    compact(file);
-
-    FilePositionEntryMap pe_map;
-
-    fseek(file, 0, SEEK_SET);
-    long fsize = getFsize(file);
+    PositionFile *pf = new PositionFile();
+    pf->m_path = path;
+
+    FILE *file = fopen(path.c_str(), "r");
+    if (NULL != file) {
+        bool res = pf->replay(file);
+        fclose(file);
+        if (!res) {
+            delete pf;
+            return NULL;
+        }
+    } else if (ENOENT == errno) {
+        LINFO << "Position file " << path << " does not exists, create it";
+    } else {
+        LERROR << "Fail to open position file " << path
+               << ", " << strerror(errno);
+        delete pf;
+        return NULL;
+    }
 
-    char *buf = (char *)malloc(fsize);
-    if (NULL == buf) {
-        LERROR << "Fail to malloc " << fsize << " bytes";
+    /* start with a journal without redundant and partial records */
+    if (!pf->compactSync()) {
+        LERROR << "Fail to compact position file " << path;
+        delete pf;
         return NULL;
     }
 
-    char *line;
-    while (NULL != (line = fgets(buf, fsize, file))) {
+    PositionFile::m_pf = pf;
+
+    return PositionFile::m_pf;
+}/*}}}*/
+
+bool PositionFile::replay(FILE *file)
+{/*{{{*/
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len = 0;
+    unsigned long lineno = 0;
+
+    while ((len = getline(&line, &size, file)) != -1) {
+        ++lineno;
+
+        /* the last record may be partially written when crashing */
+        if (len == 0 || line[len - 1] != '\n') {
+            LWARNING << "Skip partial record at line " << lineno
+                     << " of position file " << m_path;
+            continue;
+        }
+
         off_t pos;
         ino_t inode;
         PositionEntryKey pek;
-
-        string line_str(line);
-        if (!PositionFile::parseLine(line_str, pek, pos, inode))
+        if (!parseLine(string(line, len), pek, pos, inode)) {
+            LWARNING << "Skip malformed record at line " << lineno
+                     << " of position file " << m_path;
             continue;
+        }
 
-        long seek = ftell(file) - strlen(line) + pek.path_pattern.length() + 1
-            + pek.path.length() + 1;
-        pe_map[pek] = new FilePositionEntry(file, seek);
+        applyRecord(pek, inode, pos);
     }
 
-    PositionFile::m_pf = new PositionFile(file, pe_map, ftell(file));
+    free(line);
 
-    free(buf);
+    if (ferror(file)) {
+        LERROR << "Fail to read position file " << m_path
+               << ", " << strerror(errno);
+        return false;
+    }
 
-    return PositionFile::m_pf;
+    LINFO << "Replay " << lineno << " records of position file " << m_path
+          << ", " << m_records.size() << " entries alive";
+
+    return true;
 }/*}}}*/
 
-bool PositionFile::parseLine(string line, 
+bool PositionFile::parseLine(const string &line, 
         PositionEntryKey &pek,
         off_t &pos,
         ino_t &inode)
 {/*{{{*/
-    string &path_pattern = pek.path_pattern;
-    string &path = pek.path;
-
-    bool is_match = true;
-    string pattern = "^([^\t]+)\t([^\t]+)\t([0-9a-fA-F]+)\t([0-9a-fA-F]+)$";
-
-    int cflags = REG_EXTENDED | REG_NEWLINE;
-    regex_t reg;
-    int res = regcomp(&reg, pattern.c_str(), cflags);
-
-    if (res == 0) {
-        regmatch_t pmatch[4];
-        const size_t nmatch = 5;
-        char *line_cstr = new char[line.length() + 1];
-        strcpy(line_cstr, line.c_str());
-        // do stuff
-        int status = regexec(&reg, line_cstr, nmatch, pmatch, 0);
-        if (status == REG_NOMATCH) {
-            is_match = false;
-            path_pattern = "";
-            path = "";
-            pos = -1;
-            inode = INO_NONE;
-        } else {
-            int i;
-            i = 1; path_pattern = line.substr(pmatch[i].rm_so, pmatch[i].rm_eo - pmatch[i].rm_so);
+    pek.path_pattern = "";
+    pek.path = "";
+    pos = -1;
+    inode = INO_NONE;
+
+    size_t end = line.length();
+    while (end > 0 && (line[end - 1] == '\n' || line[end - 1] == '\r')) {
+        --end;
+    }
 
-            i = 2; path = line.substr(pmatch[i].rm_so, pmatch[i].rm_eo - pmatch[i].rm_so);
+    size_t p1 = line.find('\t');
+    size_t p2 = (p1 == string::npos)? p1: line.find('\t', p1 + 1);
+    size_t p3 = (p2 == string::npos)? p2: line.find('\t', p2 + 1);
+    if (p3 == string::npos || p3 >= end
+            || line.find('\t', p3 + 1) < end) {
+        return false;
+    }
 
-            i = 3; string pos_str = line.substr(pmatch[i].rm_so, pmatch[i].rm_eo - pmatch[i].rm_so);
-            pos = hexstr2num(pos_str.c_str(), -1);
+    string pos_str = line.substr(p2 + 1, p3 - p2 - 1);
+    string inode_str = line.substr(p3 + 1, end - p3 - 1);
+    const char *hex = "0123456789abcdefABCDEF";
+    if (p1 == 0 || p2 == p1 + 1 
+            || pos_str.empty() || inode_str.empty()
+            || pos_str.find_first_not_of(hex) != string::npos
+            || inode_str.find_first_not_of(hex) != string::npos) {
+        return false;
+    }
 
-            i = 4; string inode_str = line.substr(pmatch[i].rm_so, pmatch[i].rm_eo - pmatch[i].rm_so);
-            inode = hexstr2num(inode_str.c_str(), 0);
-        }
+    pek.path_pattern = line.substr(0, p1);
+    pek.path = line.substr(p1 + 1, p2 - p1 - 1);
+    pos = (off_t)strtoull(pos_str.c_str(), NULL, 16);
+    inode = (ino_t)strtoull(inode_str.c_str(), NULL, 16);
 
-        delete[] line_cstr; line_cstr = NULL;
-        regfree(&reg);
-    } else {
-        is_match = false;
-        path_pattern = "";
-        path = "";
-        pos = -1;
-        inode = INO_NONE;
+    return true;
+}/*}}}*/
+
+void PositionFile::applyRecord(const PositionEntryKey &pek, 
+        ino_t inode, off_t pos)
+{/*{{{*/
+    if (UNWATCHED_POSITION == pos) {
+        m_records.erase(pek);
+        return;
     }
 
-    return is_match;
+    PositionRecord &record = m_records[pek];
+    record.inode = inode;
+    record.pos = pos;
 }/*}}}*/
 
-bool PositionFile::compact(FILE *file)
+string PositionFile::formatRecord(const PositionEntryKey &pek,
+        ino_t inode, off_t pos)
 {/*{{{*/
-    FilePositionEntryMap pe_map;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\t%016llx\t%08llx\n",
+            (unsigned long long)pos, (unsigned long long)inode);
+
+    string record;
+    record.reserve(pek.path_pattern.length() + pek.path.length() + 64);
+    record.append(pek.path_pattern);
+    record.append("\t");
+    record.append(pek.path);
+    record.append(buf);
+
+    return record;
+}/*}}}*/
 
-    fseek(file, 0, SEEK_SET);
-    long fsize = getFsize(file);
+string PositionFile::serializeRecords()
+{/*{{{*/
+    string content;
+    for (PositionRecordMap::const_iterator iter = m_records.begin();
+            iter != m_records.end(); ++iter) {
+        content.append(formatRecord(iter->first, 
+                    iter->second.inode, iter->second.pos));
+    }
 
-    char *buf = reinterpret_cast<char *>(malloc(fsize));
-    if (NULL == buf) {
-        LERROR << "Fail to malloc " << fsize << " bytes";
+    return content;
+}/*}}}*/
+
+bool PositionFile::append(const PositionEntryKey &pek, ino_t inode, off_t pos)
+{/*{{{*/
+    applyRecord(pek, inode, pos);
+
+    if (m_compacting) {
+        m_dirty_keys.insert(pek);
+    }
+
+    if (NULL == m_file) {
+        LERROR << "Position file " << m_path << " is closed";
         return false;
     }
 
-    char *line;
-    map<string, string> existent_entries;
-    while (NULL != (line = fgets(buf, fsize, file))) {
-        off_t pos;
-        ino_t inode;
-        PositionEntryKey pek;
+    /* one record, one write(2) on the unbuffered O_APPEND stream */
+    string record = formatRecord(pek, inode, pos);
+    if (1 != fwrite(record.data(), record.length(), 1, m_file)) {
+        LERROR << "Fail to append to position file " << m_path
+               << ", " << strerror(errno);
+        return false;
+    }
 
-        string line_str(line);
-        if (!PositionFile::parseLine(line_str, pek, pos, inode)) {
-            continue;
-        }
+    ++m_journal_records;
 
-        if (UNWATCHED_POSITION == pos) {
-            continue;
+    return true;
+}/*}}}*/
+
+bool PositionFile::needCompact()
+{/*{{{*/
+    return m_journal_records > COMPACT_MIN_RECORDS
+        && m_journal_records > COMPACT_RATIO * m_records.size();
+}/*}}}*/
+
+string PositionFile::tmpPath()
+{/*{{{*/
+    return m_path + ".tmp";
+}/*}}}*/
+
+bool PositionFile::writeFile(const string &path, const string &content)
+{/*{{{*/
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LERROR << "Fail to open " << path << ", " << strerror(errno);
+        return false;
+    }
+
+    const char *buf = content.data();
+    size_t left = content.length();
+    while (left > 0) {
+        ssize_t n = write(fd, buf, left);
+        if (n < 0) {
+            if (EINTR == errno) continue;
+            LERROR << "Fail to write " << path << ", " << strerror(errno);
+            ::close(fd);
+            return false;
         }
+        buf += n;
+        left -= n;
+    }
 
-        existent_entries[pek.path_pattern] 
-            = line_str.substr(pek.path_pattern.length());
+    if (0 != fsync(fd)) {
+        LERROR << "Fail to fsync " << path << ", " << strerror(errno);
+        ::close(fd);
+        return false;
     }
 
-    free(buf);
+    return 0 == ::close(fd);
+}/*}}}*/
 
-    if (ftruncate(fileno(file), 0) != 0) {
-        LERROR << "Fail to truncate file, fileno " << fileno(file);
+bool PositionFile::reopen()
+{/*{{{*/
+    FILE *file = fopen(m_path.c_str(), "a");
+    if (NULL == file) {
+        LERROR << "Fail to open position file " << m_path
+               << ", " << strerror(errno);
         return false;
     }
+    setvbuf(file, reinterpret_cast<char *>(NULL), _IONBF, 0);
 
-    fseek(file, 0, SEEK_SET);
-    for (map<string, string>::const_iterator iter = existent_entries.begin();
-            iter != existent_entries.end(); ++iter) {
-        string existent_entry = iter->first + iter->second;
-        fwrite(existent_entry.c_str(), existent_entry.length(), 1, file);
+    if (NULL != m_file) {
+        fclose(m_file);
     }
+    m_file = file;
 
     return true;
 }/*}}}*/
 
-void PositionFile::remove(const PositionEntryKey &pek)
+bool PositionFile::compactSync()
 {/*{{{*/
-    if (m_pe_map.find(pek) != m_pe_map.end()) {
-        delete m_pe_map[pek]; m_pe_map[pek] = NULL;
+    if (m_compacting) {
+        LWARNING << "Position file " << m_path << " is being compacted";
+        return false;
+    }
+
+    string tmp_path = tmpPath();
+    if (!writeFile(tmp_path, serializeRecords())) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (0 != rename(tmp_path.c_str(), m_path.c_str())) {
+        LERROR << "Fail to rename " << tmp_path << " to " << m_path
+               << ", " << strerror(errno);
+        unlink(tmp_path.c_str());
+        return false;
     }
 
-    m_pe_map.erase(pek);
+    m_journal_records = m_records.size();
+
+    return reopen();
 }/*}}}*/
 
-bool PositionFile::getPath(const string &path_pattern, string &path)
+bool PositionFile::compact(uv_loop_t *loop)
+{/*{{{*/
+    if (m_compacting || NULL == m_file || !needCompact()) {
+        return true;
+    }
+
+    CompactWork *work = new CompactWork();
+    work->req.data = work;
+    work->position_file = this;
+    work->tmp_path = tmpPath();
+    work->content = serializeRecords();
+    work->records = m_records.size();
+    work->ok = false;
+
+    int res = uv_queue_work(loop, &work->req, compactWork, afterCompactWork);
+    if (res < 0) {
+        LERROR << "Fail to queue position file compaction, " 
+               << uv_strerror(res);
+        delete work;
+        return false;
+    }
+
+    m_compacting = true;
+    m_compact_work = work;
+    m_dirty_keys.clear();
+
+    LDEBUG << "Start compacting position file " << m_path
+           << ", journal records " << m_journal_records
+           << ", entries " << work->records;
+
+    return true;
+}/*}}}*/
+
+void PositionFile::compactWork(uv_work_t *req)
 {/*{{{*/
-    for (FilePositionEntryMap::const_reverse_iterator iter = m_pe_map.rbegin();
-            iter != m_pe_map.rend(); ++iter) {
-        if (iter->first.path_pattern == path_pattern) {
-            path = iter->first.path;
-            return true;
+    /* NOTE: runs in the thread pool, touch nothing but the work */
+    CompactWork *work = reinterpret_cast<CompactWork *>(req->data);
+    work->ok = writeFile(work->tmp_path, work->content);
+}/*}}}*/
+
+void PositionFile::afterCompactWork(uv_work_t *req, int status)
+{/*{{{*/
+    CompactWork *work = reinterpret_cast<CompactWork *>(req->data);
+    PositionFile *pf = work->position_file;
+
+    if (NULL == pf || NULL == pf->m_file || 0 != status || !work->ok) {
+        LERROR << "Fail to compact position file " << work->tmp_path;
+        unlink(work->tmp_path.c_str());
+        if (NULL != pf) {
+            pf->m_compacting = false;
+            pf->m_compact_work = NULL;
+            pf->m_dirty_keys.clear();
+        }
+        delete work;
+        return;
+    }
+
+    pf->m_compacting = false;
+    pf->m_compact_work = NULL;
+
+    /* carry over the records appended after the snapshot was taken */
+    string tail;
+    for (set<PositionEntryKey>::const_iterator iter = pf->m_dirty_keys.begin();
+            iter != pf->m_dirty_keys.end(); ++iter) {
+        PositionRecordMap::const_iterator rec = pf->m_records.find(*iter);
+        if (rec != pf->m_records.end()) {
+            tail.append(formatRecord(*iter, rec->second.inode, rec->second.pos));
+        } else {
+            tail.append(formatRecord(*iter, INO_NONE, UNWATCHED_POSITION));
         }
     }
+    unsigned long tail_records = pf->m_dirty_keys.size();
+    pf->m_dirty_keys.clear();
+
+    FILE *file = fopen(work->tmp_path.c_str(), "a");
+    if (NULL == file) {
+        LERROR << "Fail to open " << work->tmp_path << ", " << strerror(errno);
+        unlink(work->tmp_path.c_str());
+        delete work;
+        return;
+    }
+    setvbuf(file, reinterpret_cast<char *>(NULL), _IONBF, 0);
+
+    if ((!tail.empty() && 1 != fwrite(tail.data(), tail.length(), 1, file))
+            || 0 != fsync(fileno(file))
+            || 0 != rename(work->tmp_path.c_str(), pf->m_path.c_str())) {
+        LERROR << "Fail to replace position file " << pf->m_path
+               << ", " << strerror(errno);
+        fclose(file);
+        unlink(work->tmp_path.c_str());
+        delete work;
+        return;
+    }
+
+    fclose(pf->m_file);
+    pf->m_file = file;
+    pf->m_journal_records = work->records + tail_records;
+
+    LINFO << "Compact position file " << pf->m_path
+          << ", records " << pf->m_journal_records;
+
+    delete work;
+}/*}}}*/
+
+void PositionFile::close()
+{/*{{{*/
+    if (NULL != m_file) {
+        fclose(m_file); m_file = NULL;
+    }
+}/*}}}*/
+
+void PositionFile::remove(const PositionEntryKey &pek)
+{/*{{{*/
+    FilePositionEntryMap::iterator iter = m_pe_map.find(pek);
+    if (iter != m_pe_map.end()) {
+        delete iter->second; iter->second = NULL;
+        m_pe_map.erase(iter);
+    }
+}/*}}}*/
+
+bool PositionFile::getPath(const string &path_pattern, string &path)
+{/*{{{*/
+    bool found = false;
+
+    PositionEntryKey first = {path_pattern, ""};
+    for (PositionRecordMap::const_iterator iter = m_records.lower_bound(first);
+            iter != m_records.end() 
+            && iter->first.path_pattern == path_pattern; ++iter) {
+        path = iter->first.path;
+        found = true;
+    }
 
-    return false;
+    return found;
 }/*}}}*/
 
 } // namespace logkafka
@@ -22,7 +22,6 @@
 #ifndef LOGKAFKA_POSITION_FILE_H_
 #define LOGKAFKA_POSITION_FILE_H_
 
-#include <regex.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -31,6 +30,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -40,65 +40,84 @@
 
 #include "easylogging/easylogging++.h"
 
+#include <uv.h>
+
 using namespace std;
 
 namespace logkafka {
 
-struct PositionEntryKey;
 typedef FilePositionEntry *value_t;
 typedef map<PositionEntryKey, FilePositionEntry *> FilePositionEntryMap;
 
-struct PositionEntryKey 
+struct PositionRecord
 {
-    string path_pattern;
-    string path;
-
-    bool operator==(const PositionEntryKey& hs) const
-    {
-        return (path_pattern == hs.path_pattern) &&
-            (path == hs.path);
-    };
-
-    bool operator!=(const PositionEntryKey& hs) const
-    {
-        return !operator==(hs);
-    };
-
-    bool operator<(const PositionEntryKey& hs) const
-    {
-        return (path_pattern < hs.path_pattern) ||
-            (path_pattern == hs.path_pattern && path < hs.path);
-    };
+    ino_t inode;
+    off_t pos;
 };
 
+typedef map<PositionEntryKey, PositionRecord> PositionRecordMap;
+
+struct CompactWork;
+
+/* The position file is an append-only journal of records
+ *
+ *     path_pattern\tpath\tpos(hex)\tinode(hex)\n
+ *
+ * the last record of a key wins when replaying, a record with 
+ * UNWATCHED_POSITION drops the key. The journal is compacted into a 
+ * new file which atomically replaces the old one, at startup 
+ * synchronously, and periodically in the uv thread pool. */
 class PositionFile
 {
     public:
-        PositionFile() {};
-        PositionFile(FILE *file, 
-                FilePositionEntryMap pe_map, 
-                off_t last_pos);
+        PositionFile();
         ~PositionFile();
-        bool init(FILE *file,
-                FilePositionEntryMap pe_map,
-                off_t last_pos);
         value_t& operator[](const PositionEntryKey &key);
         void remove(const PositionEntryKey &pek);
-        static PositionFile *parse(FILE *file);
-        static bool parseLine(string line, 
+        static PositionFile *parse(const string &path);
+        static bool parseLine(const string &line, 
                 PositionEntryKey &pek,
                 off_t &pos,
                 ino_t &inode);
-        static bool compact(FILE *file);
         bool getPath(const string &path_pattern, string &path);
 
+        bool append(const PositionEntryKey &pek, ino_t inode, off_t pos);
+        bool needCompact();
+        bool compact(uv_loop_t *loop);
+        bool compactSync();
+        void close();
+
+    private:
+        bool replay(FILE *file);
+        bool reopen();
+        void applyRecord(const PositionEntryKey &pek, ino_t inode, off_t pos);
+        static string formatRecord(const PositionEntryKey &pek, 
+                ino_t inode, off_t pos);
+        string serializeRecords();
+        string tmpPath();
+        static bool writeFile(const string &path, const string &content);
+
+        static void compactWork(uv_work_t *req);
+        static void afterCompactWork(uv_work_t *req, int status);
+
     public:
         FILE *m_file;
-        off_t m_last_pos;
+        string m_path;
         FilePositionEntryMap m_pe_map;
+        PositionRecordMap m_records;
+
+        /* number of records in the journal on disk */
+        unsigned long m_journal_records;
+
+        /* keys changed while a background compaction is running */
+        bool m_compacting;
+        CompactWork *m_compact_work;
+        set<PositionEntryKey> m_dirty_keys;
 
         static PositionFile *m_pf;
         static const int64_t UNWATCHED_POSITION;
+        static const unsigned long COMPACT_MIN_RECORDS;
+        static const unsigned long COMPACT_RATIO;
 };
 
 } // namespace logkafka
@@ -30,13 +30,13 @@
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <set>
 
 #include "base/tools.h"
 
 #include "easylogging/easylogging++.h"
 
 using namespace std;
-using namespace base;
 
 namespace logkafka {
 
@@ -47,6 +47,8 @@ Producer::Producer()
     m_compression_codec = "";
     m_conf = NULL;
     m_rk = NULL;
+    m_brokers_version = -1;
+    m_queue_depth = 0;
 }/*}}}*/
 
 Producer::~Producer()
@@ -62,7 +64,7 @@ void Producer::rdkafkaLogger(const rd_kafka_t *rk,
     LWARNING << "RDKAFKA: " << fac << ": " << rd_kafka_name(rk) << ": " << buf;
 }/*}}}*/
 
-bool Producer::init(Zookeeper& zookeeper, 
+bool Producer::init(ConfigSource& config_source, 
     const string &compression_codec,
     long long message_max_bytes,
     long long message_send_max_retries)
@@ -70,7 +72,7 @@ bool Producer::init(Zookeeper& zookeeper,
     char errstr[512];
 
     /* Get brokers */
-    m_brokers = zookeeper.getBrokerUrls();
+    m_brokers = config_source.getBrokerUrls(&m_brokers_version);
 
     /* Kafka configuration */
     m_conf = rd_kafka_conf_new();
@@ -125,13 +127,52 @@ bool Producer::init(Zookeeper& zookeeper,
     return true;
 }/*}}}*/
 
+bool Producer::refreshBrokers(ConfigSource& config_source)
+{/*{{{*/
+    if (NULL == m_rk 
+            || config_source.getBrokerUrlsVersion() == m_brokers_version) {
+        return true;
+    }
+
+    string brokers = config_source.getBrokerUrls(&m_brokers_version);
+
+    /* rdkafka can not remove brokers, those gone fail to connect
+     * and are not used for producing */
+    vector<string> known = explode(m_brokers, ',');
+    set<string> known_set(known.begin(), known.end());
+    vector<string> current = explode(brokers, ',');
+    string added;
+    for (vector<string>::const_iterator iter = current.begin();
+            iter != current.end(); ++iter) {
+        if (iter->empty() || known_set.count(*iter) > 0) continue;
+        if (!added.empty()) added.append(",");
+        added.append(*iter);
+    }
+    m_brokers = brokers;
+
+    if (added.empty()) {
+        return true;
+    }
+
+    int n = rd_kafka_brokers_add(m_rk, added.c_str());
+    LINFO << "Add brokers " << added << " to " << rd_kafka_name(m_rk)
+          << ", " << n << " valid";
+
+    return n > 0;
+}/*}}}*/
+
 void Producer::close()
 {/*{{{*/
     /* Wait for messages to be delivered */
-    while (rd_kafka_outq_len(m_rk) > 0)
+    while (NULL != m_rk && rd_kafka_outq_len(m_rk) > 0)
         rd_kafka_poll(m_rk, 100);
 
     if (NULL != m_rk) {
+        updateQueueDepth();
+        MetricsRegistry::instance().addGlobal(METRIC_KAFKA_QUEUE_DEPTH, 
+                -m_queue_depth);
+        m_queue_depth = 0;
+
         LINFO << "Destroying kafka instance: " << rd_kafka_name(m_rk);
         rd_kafka_destroy(m_rk);
         m_rk = NULL;
@@ -144,8 +185,10 @@ bool Producer::send(const vector<string> &messages,
         const string &key, 
         int required_acks,
         int partition,
-        int message_timeout_ms) 
+        int message_timeout_ms,
+        int64_t write_time_us) 
 {/*{{{*/
+    int64_t start = getMonotonicUs();
     bool ret = true;
     long r;
     rd_kafka_topic_t *rkt;
@@ -175,12 +218,14 @@ bool Producer::send(const vector<string> &messages,
     /* Create messages */
     rkmessages = (rd_kafka_message_t*)calloc(sizeof(*rkmessages), msgcnt);
     for (i = 0 ; i < msgcnt ; ++i) {
-        long *msgidp = (long *)malloc(sizeof(*msgidp));
-        *msgidp = i;
+        MessageContext *context = 
+            (MessageContext *)malloc(sizeof(*context));
+        context->enqueue_us = start;
+        context->write_time_us = write_time_us;
 
         rkmessages[i].len     = messages[i].length();
         rkmessages[i].payload = strndup(messages[i].c_str(), rkmessages[i].len);
-        rkmessages[i]._private = msgidp;
+        rkmessages[i]._private = context;
     }
 
     r = rd_kafka_produce_batch(rkt, partition, RD_KAFKA_MSG_F_FREE,
@@ -189,6 +234,8 @@ bool Producer::send(const vector<string> &messages,
     /* Scan through messages to check for errors. */
     for (i = 0 ; i < msgcnt ; ++i) {
         if (rkmessages[i].err) {
+            /* never reaches the delivery report callback */
+            free(rkmessages[i]._private);
             ++failcnt;
             if (failcnt < 100) {
                 LERROR << "Message #" << i 
@@ -212,7 +259,11 @@ bool Producer::send(const vector<string> &messages,
         ret = false;
     }
 
+    MetricsRegistry::instance().record(HISTOGRAM_PRODUCE_US, 
+            getMonotonicUs() - start);
+
     rd_kafka_poll(m_rk, 0);
+    updateQueueDepth();
 
     free(rkmessages);
     LINFO << "Partitioner: Produced "<< r << " messages, waiting for deliveries";
@@ -230,11 +281,29 @@ void Producer::msgDelivered2(rd_kafka_t *rk,
         const rd_kafka_message_t *rkmessage, 
         void *opaque) 
 {/*{{{*/
+    MetricsRegistry &metrics = MetricsRegistry::instance();
+    MessageContext *context = (MessageContext *)rkmessage->_private;
+
     bool quiet = true;
     if (rkmessage->err) {
+        free(context);
+        metrics.addGlobal(METRIC_DELIVERY_FAILURES, 1);
         LERROR << "Message delivery failed: "
             << rd_kafka_message_errstr(rkmessage);
-    } else if (!quiet) {
+        return;
+    }
+
+    metrics.addGlobal(METRIC_MESSAGES_DELIVERED, 1);
+    if (NULL != context) {
+        metrics.record(HISTOGRAM_DELIVERY_US, 
+                getMonotonicUs() - context->enqueue_us);
+        if (context->write_time_us > 0) {
+            metrics.record(HISTOGRAM_END_TO_END_US, 
+                    getNowUs() - context->write_time_us);
+        }
+        free(context);
+    }
+    if (!quiet) {
         LINFO << "Message delivered (" 
             << rkmessage->len << " bytes"
             << ", offset " << rkmessage->offset
@@ -259,6 +328,14 @@ void Producer::msgDelivered(rd_kafka_t *rk,
         LERROR << "Message delivery failed: "<< rd_kafka_err2str(err);
 }/*}}}*/
 
+void Producer::updateQueueDepth()
+{/*{{{*/
+    int64_t queue_depth = rd_kafka_outq_len(m_rk);
+    MetricsRegistry::instance().addGlobal(METRIC_KAFKA_QUEUE_DEPTH, 
+            queue_depth - m_queue_depth);
+    m_queue_depth = queue_depth;
+}/*}}}*/
+
 map<string, int> Producer::createCompressionCodecMap()
 {/*{{{*/
     map<string, int> cc_map;
@@ -29,7 +29,8 @@
 #include <string>
 #include <vector>
 
-#include "logkafka/zookeeper.h"
+#include "logkafka/config_source.h"
+#include "logkafka/metrics.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,24 +50,38 @@ class Producer
         Producer();
         ~Producer();
 
-        bool init(Zookeeper& zookeeper, 
+        bool init(ConfigSource& config_source, 
                 const string &compression_codec,
                 long long message_max_bytes,
                 long long message_send_max_retries);
         void close();
 
+        /* adds brokers which joined since the last call to rd_kafka_t */
+        bool refreshBrokers(ConfigSource& config_source);
+
         bool send(const vector<string> &messages,
                 const string &brokers, 
                 const string &topic, 
                 const string &key, 
                 int required_acks,
                 int partition,
-                int message_timeout_ms);
+                int message_timeout_ms,
+                int64_t write_time_us = 0);
 
     public:
         static const map<string, int> cc_map;
 
     private:
+        /* opaque of every message, for delivery latencies */
+        struct MessageContext
+        {
+            int64_t enqueue_us;
+            int64_t write_time_us;
+        };
+
+        /* pushes the change of queue length to the global gauge */
+        void updateQueueDepth();
+
         static map<string, int> createCompressionCodecMap();
         static void rdkafkaLogger(const rd_kafka_t *rk,
                 int level, const char *fac, const char *buf);
@@ -84,7 +99,10 @@ class Producer
         rd_kafka_conf_t *m_conf;
         rd_kafka_t *m_rk;
         string m_brokers;
+        int64_t m_brokers_version;
         string m_compression_codec;
+        /* share of this producer in kafka_queue_depth */
+        int64_t m_queue_depth;
 };
 
 } // namespace logkafka
@@ -74,6 +74,14 @@ void RotateHandler::onNotify(void *arg)
             return;
         }
 
+        /* the path may be rotated again since stat, remember the 
+         * file which is opened, or it would be taken as truncated 
+         * next time */
+        if (0 == fstat(fileno(file), &buf)) {
+            fsize = buf.st_size;
+            inode = buf.st_ino;
+        }
+
         (*rh->m_rotate_func)(rh->m_rotate_func_arg, file);
         file = NULL;
     }
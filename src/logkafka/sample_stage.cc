@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/sample_stage.h"
+
+#include <uv.h>
+
+#include "base/json.h"
+#include "easylogging/easylogging++.h"
+
+using namespace base;
+
+namespace logkafka {
+
+const uint64_t SampleStage::SCALE;
+
+bool SampleStage::init(const StageConf &conf)
+{/*{{{*/
+    if ("rate" == conf.mode) {
+        m_mode = MODE_RATE;
+    } else if ("hash" == conf.mode) {
+        m_mode = MODE_HASH;
+    } else if ("limit" == conf.mode) {
+        m_mode = MODE_LIMIT;
+    } else {
+        LERROR << "Unknown sample mode " << conf.mode;
+        return false;
+    }
+
+    if (MODE_LIMIT == m_mode) {
+        if (0 == conf.lines_per_s) {
+            LERROR << "Sample lines_per_s is 0";
+            return false;
+        }
+        m_lines_per_s = conf.lines_per_s;
+        m_burst = (0 != conf.burst)? conf.burst: conf.lines_per_s;
+        m_tokens = m_burst;
+        m_last_ns = uv_hrtime();
+        return true;
+    }
+
+    if (conf.rate <= 0 || conf.rate > 1) {
+        LERROR << "Sample rate " << conf.rate << " is not in (0, 1]";
+        return false;
+    }
+    m_threshold = (uint64_t)(conf.rate * SCALE + 0.5);
+    if (0 == m_threshold) m_threshold = 1;
+    /* the first line is kept */
+    m_credit = SCALE - m_threshold;
+    m_key_field = conf.key_field;
+
+    return true;
+}/*}}}*/
+
+void SampleStage::process(vector<string> &lines)
+{/*{{{*/
+    if (MODE_LIMIT == m_mode) m_now_ns = uv_hrtime();
+    Stage::process(lines);
+}/*}}}*/
+
+bool SampleStage::processLine(string &line)
+{/*{{{*/
+    switch (m_mode) {
+        case MODE_RATE: return keepRate();
+        case MODE_HASH: return keepHash(line);
+        case MODE_LIMIT: return keepLimit();
+    }
+
+    return true;
+}/*}}}*/
+
+bool SampleStage::keepRate()
+{/*{{{*/
+    /* integer credit, so that no rounding error builds up */
+    m_credit += m_threshold;
+    if (m_credit < SCALE) return false;
+    m_credit -= SCALE;
+    return true;
+}/*}}}*/
+
+bool SampleStage::keepHash(const string &line)
+{/*{{{*/
+    const char *key = NULL;
+    size_t len = 0;
+    getKey(line, key, len);
+    return hashKey(key, len) % SCALE < m_threshold;
+}/*}}}*/
+
+bool SampleStage::keepLimit()
+{/*{{{*/
+    if (m_now_ns > m_last_ns) {
+        m_tokens += (m_now_ns - m_last_ns) / 1e9 * m_lines_per_s;
+        if (m_tokens > m_burst) m_tokens = m_burst;
+        m_last_ns = m_now_ns;
+    }
+
+    if (m_tokens < 1) return false;
+    m_tokens -= 1;
+    return true;
+}/*}}}*/
+
+void SampleStage::getKey(const string &line, const char *&key, size_t &len)
+{/*{{{*/
+    key = line.data();
+    len = line.size();
+    if (0 == m_key_field) return;
+
+    const char *p = line.data();
+    const char *end = p + line.size();
+    for (uint32_t field = 1; p < end; ++field) {
+        while (p < end && (' ' == *p || '\t' == *p)) ++p;
+        const char *start = p;
+        while (p < end && ' ' != *p && '\t' != *p) ++p;
+        if (start == p) break;
+        if (field == m_key_field) {
+            key = start;
+            len = p - start;
+            return;
+        }
+    }
+}/*}}}*/
+
+uint64_t SampleStage::hashKey(const char *key, size_t len)
+{/*{{{*/
+    /* FNV-1a does not mix its low bits well, so finish with the 
+     * murmur3 finalizer before taking the remainder */
+    uint64_t h = Json::hashBytes(key, len);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}/*}}}*/
+
+} // namespace logkafka
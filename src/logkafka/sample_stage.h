@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_SAMPLE_STAGE_H_
+#define LOGKAFKA_SAMPLE_STAGE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "logkafka/pipeline.h"
+#include "logkafka/task_conf.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* Keeps a part of the lines, decided without randomness so that a 
+ * replay of a file keeps the same lines:
+ *
+ * rate:  keeps one line of each 1/rate, evenly spaced
+ * hash:  keeps lines whose key hashes below rate, the hash being the 
+ *        same on every host, so lines of a request id or a user are 
+ *        kept or dropped together wherever they are logged
+ * limit: a token bucket of burst lines, refilled with lines_per_s 
+ *        a second; each task has its own bucket, shared by the files
+ *        it reads at once */
+class SampleStage: public Stage
+{
+    public:
+        SampleStage(): m_mode(MODE_RATE), m_threshold(0), m_credit(0), 
+            m_key_field(0), m_lines_per_s(0), m_burst(0), m_tokens(0), 
+            m_last_ns(0), m_now_ns(0) {};
+
+        bool init(const StageConf &conf);
+        void process(vector<string> &lines);
+
+        /* the part of the hash range, of SCALE, kept by rate and hash */
+        static const uint64_t SCALE = 1000000;
+
+    protected:
+        bool processLine(string &line);
+
+    private:
+        bool keepRate();
+        bool keepHash(const string &line);
+        bool keepLimit();
+        /* the key_field-th field of line, the whole line if missing */
+        void getKey(const string &line, const char *&key, size_t &len);
+        static uint64_t hashKey(const char *key, size_t len);
+
+    private:
+        enum Mode { MODE_RATE, MODE_HASH, MODE_LIMIT };
+
+        Mode m_mode;
+        uint64_t m_threshold;
+        uint64_t m_credit;
+        uint32_t m_key_field;
+
+        double m_lines_per_s;
+        double m_burst;
+        double m_tokens;
+        uint64_t m_last_ns;
+        /* read once for each batch */
+        uint64_t m_now_ns;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_SAMPLE_STAGE_H_
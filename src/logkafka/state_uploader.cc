@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/state_uploader.h"
+
+#include <zlib.h>
+
+#include "base/json.h"
+#include "base/tools.h"
+
+#include "easylogging/easylogging++.h"
+
+using namespace base;
+
+namespace logkafka {
+
+const long StateUploader::CLIENT_ZNODE = -1;
+const unsigned long StateUploader::MAX_SHARDS = 256UL;
+
+StateUploader::StateUploader()
+{/*{{{*/
+    m_shard_max_bytes = DEFAULT_ZOOKEEPER_UPLOAD_SHARD_BYTES;
+    m_compress = false;
+    m_shard_num = 0;
+    m_client_epoch = 0;
+    m_inflight = 0;
+    m_failed = 0;
+}/*}}}*/
+
+bool StateUploader::init(unsigned long shard_max_bytes, bool compress)
+{/*{{{*/
+    m_shard_max_bytes = shard_max_bytes;
+    m_compress = compress;
+
+    return true;
+}/*}}}*/
+
+bool StateUploader::upload(ConfigSource *config_source, 
+        TailStatSnapshot *snapshot)
+{/*{{{*/
+    if (__sync_add_and_fetch(&m_inflight, 0) > 0) {
+        LDEBUG << "Last upload of collecting state is in flight, skip";
+        return true;
+    }
+
+    /* the client znode was created again, or some writes failed */
+    unsigned long client_epoch = config_source->getClientEpoch();
+    if (client_epoch != m_client_epoch 
+            || __sync_lock_test_and_set(&m_failed, 0)) {
+        m_client_epoch = client_epoch;
+        reset();
+    }
+
+    vector<StateZnode> changed;
+    vector<long> stale;
+    if (!encode(snapshot, changed, stale)) {
+        LERROR << "Fail to encode collecting state";
+        return false;
+    }
+
+    LDEBUG << "Upload collecting state, changed znodes " << changed.size()
+           << ", stale shards " << stale.size();
+
+    bool res = true;
+    for (vector<StateZnode>::const_iterator iter = changed.begin();
+            iter != changed.end(); ++iter) {
+        __sync_add_and_fetch(&m_inflight, 1);
+        if (!config_source->setLogState(iter->data.data(), iter->data.length(),
+                    iter->shard, onUploadComplete, this)) {
+            onUploadComplete(-1, this);
+            res = false;
+        }
+    }
+
+    for (vector<long>::const_iterator iter = stale.begin();
+            iter != stale.end(); ++iter) {
+        __sync_add_and_fetch(&m_inflight, 1);
+        if (!config_source->deleteLogState(*iter, onUploadComplete, this)) {
+            onUploadComplete(-1, this);
+            res = false;
+        }
+    }
+
+    return res;
+}/*}}}*/
+
+bool StateUploader::encode(TailStatSnapshot *snapshot, 
+        vector<StateZnode> &changed, vector<long> &stale)
+{/*{{{*/
+    /* members of the state object, one per path pattern */
+    vector<string> members;
+    for (vector<TailStatEntry>::const_iterator iter = 
+            snapshot->m_entries.begin(); 
+            iter != snapshot->m_entries.end(); ++iter) {
+        rapidjson::StringBuffer sb;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+        writer.StartObject();
+        TailStatSnapshot::SerializeEntry(writer, *iter);
+        writer.EndObject();
+
+        string member = sb.GetString();
+        members.push_back(member.substr(1, member.length() - 2));
+    }
+
+    string json = "{";
+    for (size_t i = 0; i < members.size(); ++i) {
+        if (i > 0) json += ",";
+        json += members[i];
+    }
+    json += "}";
+
+    size_t encoded_size = json.length();
+    if (m_compress) {
+        string compressed;
+        if (!compress(json, compressed)) {
+            return false;
+        }
+        encoded_size = compressed.length();
+    }
+
+    unsigned long shard_num = getShardNum(encoded_size);
+    if (0 == shard_num) {
+        if (!encodeZnode(CLIENT_ZNODE, json, m_compress, changed)) {
+            return false;
+        }
+    } else {
+        vector<string> shards(shard_num, "");
+        for (size_t i = 0; i < members.size(); ++i) {
+            const string &pattern = snapshot->m_entries[i].path_pattern;
+            string &shard = shards[Json::hashBytes(pattern.data(), 
+                    pattern.length()) % shard_num];
+            shard += shard.empty() ? "{": ",";
+            shard += members[i];
+        }
+
+        for (unsigned long i = 0; i < shard_num; ++i) {
+            shards[i] += shards[i].empty() ? "{}": "}";
+            if (!encodeZnode(i, shards[i], m_compress, changed)) {
+                return false;
+            }
+        }
+
+        if (!encodeZnode(CLIENT_ZNODE, 
+                    "{\"shards\":" + int2Str(shard_num) + "}", 
+                    false, changed)) {
+            return false;
+        }
+    }
+
+    for (unsigned long i = shard_num; i < m_shard_num; ++i) {
+        stale.push_back(i);
+        m_hashes.erase(i);
+    }
+    m_shard_num = shard_num;
+
+    return true;
+}/*}}}*/
+
+void StateUploader::reset()
+{/*{{{*/
+    m_hashes.clear();
+}/*}}}*/
+
+unsigned long StateUploader::getShardNum(size_t encoded_size)
+{/*{{{*/
+    /* only shrink when the state takes less than a quarter of the 
+     * shards, so that it does not flap around the limit */
+    if (m_shard_num > 0 
+            && encoded_size > m_shard_max_bytes / 4 * m_shard_num) {
+        return m_shard_num;
+    }
+
+    if (encoded_size <= m_shard_max_bytes) {
+        return 0;
+    }
+
+    /* leave room for path patterns not evenly distributed */
+    unsigned long shard_num = 2;
+    while (shard_num < MAX_SHARDS 
+            && encoded_size > m_shard_max_bytes / 2 * shard_num) {
+        shard_num *= 2;
+    }
+
+    return shard_num;
+}/*}}}*/
+
+bool StateUploader::encodeZnode(long shard, const string &json, 
+        bool compressed, vector<StateZnode> &changed)
+{/*{{{*/
+    uint64_t hash = Json::hashBytes(json.data(), json.length());
+    map<long, uint64_t>::iterator iter = m_hashes.find(shard);
+    if (iter != m_hashes.end() && iter->second == hash) {
+        return true;
+    }
+
+    StateZnode znode;
+    znode.shard = shard;
+    if (compressed) {
+        if (!compress(json, znode.data)) return false;
+    } else {
+        znode.data = json;
+    }
+
+    changed.push_back(znode);
+    m_hashes[shard] = hash;
+
+    return true;
+}/*}}}*/
+
+bool StateUploader::compress(const string &in, string &out)
+{/*{{{*/
+    uLongf len = compressBound(in.length());
+    out.resize(len);
+
+    int ret = compress2((Bytef *)&out[0], &len, 
+            (const Bytef *)in.data(), in.length(), Z_DEFAULT_COMPRESSION);
+    if (Z_OK != ret) {
+        LERROR << "Fail to compress collecting state, " << zError(ret);
+        return false;
+    }
+    out.resize(len);
+
+    return true;
+}/*}}}*/
+
+void StateUploader::onUploadComplete(int rc, const void *data)
+{/*{{{*/
+    /* may be called in zookeeper thread */
+    StateUploader *uploader = (StateUploader *)data;
+
+    if (0 != rc) {
+        __sync_lock_test_and_set(&uploader->m_failed, 1);
+    }
+    __sync_sub_and_fetch(&uploader->m_inflight, 1);
+}/*}}}*/
+
+} // namespace logkafka
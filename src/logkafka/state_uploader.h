@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_STATE_UPLOADER_H_
+#define LOGKAFKA_STATE_UPLOADER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logkafka/tail_stat.h"
+#include "logkafka/common.h"
+#include "logkafka/config_source.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* data of the client znode, or of one of its shards */
+struct StateZnode
+{
+    long shard;
+    string data;
+};
+
+/* Uploads collecting state to the config source, e.g. zookeeper. Only
+ * znodes whose content changed since the last upload are written. State larger than 
+ * shard_max_bytes is split by path pattern into shards, and the client 
+ * znode holds {"shards":N} instead. Znode data may be compressed with 
+ * zlib, which readers recognize by its first byte. */
+class StateUploader
+{
+    public:
+        StateUploader();
+
+        bool init(unsigned long shard_max_bytes, bool compress);
+
+        /* called in loop thread, skipped while writes of the last 
+         * upload are still in flight */
+        bool upload(ConfigSource *config_source, 
+                TailStatSnapshot *snapshot);
+
+        /* encodes snapshot, puts znodes changed since the last call into 
+         * changed and shards no longer used into stale */
+        bool encode(TailStatSnapshot *snapshot, 
+                vector<StateZnode> &changed, vector<long> &stale);
+
+        /* forgets what has been uploaded */
+        void reset();
+
+    private:
+        unsigned long getShardNum(size_t encoded_size);
+        bool encodeZnode(long shard, const string &json, 
+                bool compressed, vector<StateZnode> &changed);
+        static bool compress(const string &in, string &out);
+        static void onUploadComplete(int rc, const void *data);
+
+    private:
+        unsigned long m_shard_max_bytes;
+        bool m_compress;
+
+        unsigned long m_shard_num;
+        map<long, uint64_t> m_hashes;
+        unsigned long m_client_epoch;
+
+        /* may be updated in zookeeper thread */
+        volatile int m_inflight;
+        volatile int m_failed;
+
+    public:
+        static const long CLIENT_ZNODE;
+        static const unsigned long MAX_SHARDS;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_STATE_UPLOADER_H_
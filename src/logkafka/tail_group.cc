@@ -0,0 +1,435 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/tail_group.h"
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "base/tools.h"
+
+#include "easylogging/easylogging++.h"
+
+namespace logkafka {
+
+TailGroup::TailGroup()
+{/*{{{*/
+    m_loop = NULL;
+    m_position_file = NULL;
+    m_max_open_files = 0;
+    m_stat_silent_max_ms = 0;
+    m_enabled = false;
+    m_func_arg = NULL;
+    m_setup_watcher = NULL;
+    m_close_watcher = NULL;
+    m_dir_watcher = NULL;
+    m_dir_watching = false;
+}/*}}}*/
+
+TailGroup::~TailGroup()
+{/*{{{*/
+    if (NULL != m_dir_watcher) {
+        m_dir_watcher->close();
+        delete m_dir_watcher; m_dir_watcher = NULL;
+    }
+
+    for (GroupTailMap::iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        delete iter->second; iter->second = NULL;
+    }
+}/*}}}*/
+
+bool TailGroup::init(uv_loop_t *loop,
+        const string &path_pattern,
+        PositionFile *position_file,
+        unsigned long max_open_files,
+        unsigned long stat_silent_max_ms,
+        bool enabled,
+        void *func_arg,
+        SetupWatcherFunc setup_watcher,
+        CloseWatcherFunc close_watcher)
+{/*{{{*/
+    m_loop = loop;
+    m_path_pattern = path_pattern;
+    m_position_file = position_file;
+    m_max_open_files = max_open_files;
+    m_stat_silent_max_ms = stat_silent_max_ms;
+    m_enabled = enabled;
+    m_func_arg = func_arg;
+    m_setup_watcher = setup_watcher;
+    m_close_watcher = close_watcher;
+
+    if (NULL == m_position_file) {
+        LERROR << "Position file of tail group is NULL";
+        return false;
+    }
+
+    if (!splitPath(m_path_pattern, m_dir, m_name_pattern) 
+            || hasGlobMagic(m_dir)) {
+        LERROR << "Path pattern " << m_path_pattern 
+               << " can only have wildcards in its last component";
+        return false;
+    }
+
+    /* if the directory can not be watched now, e.g. it does not exist,
+     * retry and scan it again when refreshing */
+    m_dir_watcher = new FsEventWatcher();
+    m_dir_watching = m_dir_watcher->init(m_loop, m_dir, this, onDirEvent);
+
+    scan();
+
+    return true;
+}/*}}}*/
+
+bool TailGroup::isGlobPattern(const string &path_pattern)
+{/*{{{*/
+    return hasGlobMagic(path_pattern);
+}/*}}}*/
+
+bool TailGroup::matchName(const string &name)
+{/*{{{*/
+    /* hidden files are only matched by patterns starting with '.' */
+    return 0 == fnmatch(m_name_pattern.c_str(), name.c_str(), FNM_PERIOD);
+}/*}}}*/
+
+bool TailGroup::scan()
+{/*{{{*/
+    DIR *dir = opendir(m_dir.c_str());
+    if (NULL == dir) {
+        LDEBUG << "Fail to open dir " << m_dir << ", " << strerror(errno);
+        return false;
+    }
+
+    vector<string> names;
+    struct dirent *entry = NULL;
+    while (NULL != (entry = readdir(dir))) {
+        string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        if (matchName(name)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    /* older files usually have smaller names */
+    sort(names.begin(), names.end());
+    for (vector<string>::const_iterator iter = names.begin();
+            iter != names.end(); ++iter) {
+        onFile(*iter);
+    }
+
+    return true;
+}/*}}}*/
+
+void TailGroup::onDirEvent(void *arg, const char *filename, int events)
+{/*{{{*/
+    TailGroup *tg = reinterpret_cast<TailGroup *>(arg);
+
+    if (NULL == filename) {
+        tg->scan();
+        return;
+    }
+
+    if (tg->matchName(filename)) {
+        tg->onFile(filename);
+    }
+}/*}}}*/
+
+void TailGroup::onFile(const string &name)
+{/*{{{*/
+    string path = (m_dir == "/")? m_dir + name: m_dir + '/' + name;
+
+    GroupTailMap::iterator iter = m_tails.find(path);
+    if (iter == m_tails.end()) {
+        addPath(path);
+        return;
+    }
+
+    /* read appended lines right away instead of waiting for polling */
+    if (m_enabled) {
+        TailWatcher::onNotify(iter->second);
+    }
+}/*}}}*/
+
+bool TailGroup::addPath(const string &path)
+{/*{{{*/
+    if (m_tails.find(path) != m_tails.end() || isPending(path)) {
+        return true;
+    }
+
+    struct stat st;
+    if (0 != stat(path.c_str(), &st) || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    /* the file was renamed from another tailed path, e.g. rotated to a 
+     * name also matching the pattern, hand its position over */
+    TailWatcher *tw = findByInode(st.st_ino, path);
+    if (NULL != tw) {
+        string old_path = tw->getPath();
+        PositionEntryKey old_pek = {m_path_pattern, old_path};
+        struct stat old_st;
+        bool old_exists = (0 == stat(old_path.c_str(), &old_st));
+
+        LINFO << "Path " << old_path << " is renamed to " << path
+              << ", path_pattern " << m_path_pattern;
+
+        /* drain the renamed file before handing over */
+        closeWatcher(m_tails.find(old_path), false);
+        FilePositionEntry *old_pe = (*m_position_file)[old_pek];
+        off_t pos = old_pe->readPos();
+        if (!old_exists) {
+            old_pe->updatePos(PositionFile::UNWATCHED_POSITION);
+            m_position_file->remove(old_pek);
+        }
+
+        PositionEntryKey pek = {m_path_pattern, path};
+        (*m_position_file)[pek]->update(st.st_ino, pos);
+        bool res = openWatcher(path);
+
+        if (old_exists) {
+            addPath(old_path);
+        }
+
+        return res;
+    }
+
+    if (m_tails.size() >= m_max_open_files) {
+        LDEBUG << "Tail group " << m_path_pattern 
+               << " reaches max open files " << m_max_open_files
+               << ", queue path " << path;
+        pushPending(path);
+        return true;
+    }
+
+    return openWatcher(path);
+}/*}}}*/
+
+bool TailGroup::openWatcher(const string &path)
+{/*{{{*/
+    PositionEntryKey pek = {m_path_pattern, path};
+    FilePositionEntry *pe = (*m_position_file)[pek];
+    if (pe->readInode() == INO_NONE) {
+        pe->update(getInode(path.c_str()), 0);
+    }
+
+    TailWatcher *tw = (*m_setup_watcher)(m_func_arg, 
+            m_path_pattern, path, pe, onRotate, this);
+    if (NULL == tw) {
+        LERROR << "Fail to setup tail watcher for path " << path
+               << ", path_pattern " << m_path_pattern;
+        return false;
+    }
+
+    LINFO << "Add path " << path << " to tail group " << m_path_pattern;
+    m_tails[path] = tw;
+
+    /* open the file now, so that it is not taken as idle */
+    if (m_enabled) {
+        TailWatcher::onNotify(tw);
+    } else {
+        tw->stop(false);
+    }
+
+    return true;
+}/*}}}*/
+
+void TailGroup::closeWatcher(GroupTailMap::iterator iter, bool unwatched)
+{/*{{{*/
+    if (iter == m_tails.end()) return;
+
+    TailWatcher *tw = iter->second;
+    m_tails.erase(iter);
+
+    tw->m_unwatched = unwatched;
+    (*m_close_watcher)(m_func_arg, tw, unwatched);
+}/*}}}*/
+
+bool TailGroup::isPending(const string &path)
+{/*{{{*/
+    return m_pending_set.find(path) != m_pending_set.end();
+}/*}}}*/
+
+void TailGroup::pushPending(const string &path)
+{/*{{{*/
+    m_pending.push_back(path);
+    m_pending_set.insert(path);
+}/*}}}*/
+
+string TailGroup::popPending()
+{/*{{{*/
+    string path = m_pending.front();
+    m_pending.pop_front();
+    m_pending_set.erase(path);
+    return path;
+}/*}}}*/
+
+TailWatcher *TailGroup::findByInode(ino_t inode, const string &except)
+{/*{{{*/
+    for (GroupTailMap::iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        if (iter->first == except) continue;
+
+        PositionEntryKey pek = {m_path_pattern, iter->first};
+        if ((*m_position_file)[pek]->readInode() == inode) {
+            return iter->second;
+        }
+    }
+
+    return NULL;
+}/*}}}*/
+
+bool TailGroup::onRotate(void *arg, 
+        string path_pattern, 
+        string path, 
+        PositionEntry *position_entry)
+{/*{{{*/
+    /* called inside the tail watcher, the rotated file is reopened in
+     * refresh() after the old one is drained, a rotated name matching
+     * the pattern is handed over in addPath() */
+    LINFO << "Path " << path << " is rotated, path_pattern " << path_pattern;
+    return false;
+}/*}}}*/
+
+void TailGroup::refresh()
+{/*{{{*/
+    if (!m_dir_watching) {
+        m_dir_watching = m_dir_watcher->start();
+        scan();
+    }
+
+    vector<string> paths;
+    for (GroupTailMap::const_iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        paths.push_back(iter->first);
+    }
+
+    for (vector<string>::const_iterator it_p = paths.begin();
+            it_p != paths.end(); ++it_p) {
+        const string &path = *it_p;
+        GroupTailMap::iterator iter = m_tails.find(path);
+        if (iter == m_tails.end() || iter->second->isActive()) {
+            continue;
+        }
+
+        struct stat st;
+        if (0 != stat(path.c_str(), &st)) {
+            LINFO << "Remove deleted path " << path 
+                  << " from tail group " << m_path_pattern;
+            closeWatcher(iter, true);
+            continue;
+        }
+
+        PositionEntryKey pek = {m_path_pattern, path};
+        if ((*m_position_file)[pek]->readInode() != st.st_ino) {
+            LINFO << "Reopen rotated path " << path 
+                  << " in tail group " << m_path_pattern;
+            closeWatcher(iter, false);
+            openWatcher(path);
+            continue;
+        }
+
+        /* idle files give way to the queued ones */
+        if (!m_pending.empty()) {
+            closeWatcher(iter, false);
+            pushPending(path);
+        }
+    }
+
+    openPending();
+}/*}}}*/
+
+void TailGroup::openPending()
+{/*{{{*/
+    size_t n = m_pending.size();
+    while (n-- > 0 && m_tails.size() < m_max_open_files) {
+        string path = popPending();
+
+        if (0 != access(path.c_str(), R_OK)) {
+            continue;
+        }
+
+        if (!openWatcher(path)) {
+            pushPending(path);
+        }
+    }
+}/*}}}*/
+
+void TailGroup::getStats(TailStatEntry &entry)
+{/*{{{*/
+    entry.path_pattern = m_path_pattern;
+    entry.group = true;
+    entry.pending = m_pending.size();
+
+    for (GroupTailMap::const_iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        entry.stats.push_back(iter->second->getStat());
+    }
+}/*}}}*/
+
+void TailGroup::start()
+{/*{{{*/
+    m_enabled = true;
+    for (GroupTailMap::iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        iter->second->start();
+    }
+}/*}}}*/
+
+void TailGroup::stop()
+{/*{{{*/
+    m_enabled = false;
+    for (GroupTailMap::iterator iter = m_tails.begin();
+            iter != m_tails.end(); ++iter) {
+        iter->second->stop(false);
+    }
+}/*}}}*/
+
+void TailGroup::close(bool unwatched)
+{/*{{{*/
+    if (NULL != m_dir_watcher) {
+        m_dir_watcher->close();
+        delete m_dir_watcher; m_dir_watcher = NULL;
+    }
+    m_dir_watching = false;
+
+    while (!m_tails.empty()) {
+        closeWatcher(m_tails.begin(), unwatched);
+    }
+
+    if (unwatched) {
+        /* forget positions of the queued files, e.g. evicted ones */
+        for (deque<string>::const_iterator iter = m_pending.begin();
+                iter != m_pending.end(); ++iter) {
+            PositionEntryKey pek = {m_path_pattern, *iter};
+            if (0 == m_position_file->m_records.count(pek)) continue;
+            (*m_position_file)[pek]->updatePos(PositionFile::UNWATCHED_POSITION);
+            m_position_file->remove(pek);
+        }
+    }
+    m_pending.clear();
+    m_pending_set.clear();
+}/*}}}*/
+
+} // namespace logkafka
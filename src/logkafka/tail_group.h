@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_TAIL_GROUP_H_
+#define LOGKAFKA_TAIL_GROUP_H_
+
+#include <sys/types.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+#include "base/common.h"
+#include "base/fs_event_watcher.h"
+#include "logkafka/position_file.h"
+#include "logkafka/tail_watcher.h"
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+typedef TailWatcher *(*SetupWatcherFunc)(void *, 
+        const string &path_pattern, 
+        const string &path, 
+        PositionEntry *position_entry,
+        UpdateFunc update_func,
+        void *update_func_arg);
+typedef void (*CloseWatcherFunc)(void *, TailWatcher *tw, bool unwatched);
+
+typedef map<string, TailWatcher*> GroupTailMap;
+
+/* Tails all files matching a path pattern with wildcards in its last
+ * component, e.g. /var/log/app/app-*.log, concurrently. Files are 
+ * discovered by watching the directory, every file has its own position
+ * entry. At most max_open_files files are tailed at the same time, the
+ * others wait in a queue, and idle files give way to them. */
+class TailGroup
+{
+    public:
+        TailGroup();
+        ~TailGroup();
+
+        bool init(uv_loop_t *loop,
+                const string &path_pattern,
+                PositionFile *position_file,
+                unsigned long max_open_files,
+                unsigned long stat_silent_max_ms,
+                bool enabled,
+                void *func_arg,
+                SetupWatcherFunc setup_watcher,
+                CloseWatcherFunc close_watcher);
+
+        void start();
+        void stop();
+        void close(bool unwatched);
+        void refresh();
+
+        bool getEnabled() { return m_enabled; };
+        size_t getOpenFiles() { return m_tails.size(); };
+        size_t getPendingFiles() { return m_pending.size(); };
+
+        static bool isGlobPattern(const string &path_pattern);
+
+        /* stats of the tailed files, and number of queued files */
+        void getStats(TailStatEntry &entry);
+
+    public:
+        string m_path_pattern;
+        TaskConf m_conf;
+
+    private:
+        bool scan();
+        void onFile(const string &name);
+        bool matchName(const string &name);
+        bool addPath(const string &path);
+        bool openWatcher(const string &path);
+        void closeWatcher(GroupTailMap::iterator iter, bool unwatched);
+        void openPending();
+        bool isPending(const string &path);
+        void pushPending(const string &path);
+        string popPending();
+        TailWatcher *findByInode(ino_t inode, const string &except);
+
+        static void onDirEvent(void *arg, const char *filename, int events);
+        static bool onRotate(void *arg, 
+                string path_pattern, 
+                string path, 
+                PositionEntry *position_entry);
+
+    private:
+        uv_loop_t *m_loop;
+        string m_dir;
+        string m_name_pattern;
+        PositionFile *m_position_file;
+        unsigned long m_max_open_files;
+        unsigned long m_stat_silent_max_ms;
+        bool m_enabled;
+
+        void *m_func_arg;
+        SetupWatcherFunc m_setup_watcher;
+        CloseWatcherFunc m_close_watcher;
+
+        FsEventWatcher *m_dir_watcher;
+        bool m_dir_watching;
+
+        GroupTailMap m_tails;
+        /* queued in order, and looked up on each directory event */
+        deque<string> m_pending;
+        set<string> m_pending_set;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_TAIL_GROUP_H_
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "logkafka/tail_stat.h"
+
+namespace logkafka {
+
+TailStat::TailStat(const string &path_pattern, const string &path)
+    : m_path_pattern(path_pattern), m_path(path)
+{/*{{{*/
+    m_refs = 1;
+    m_filepos = -1;
+    m_filesize = 0;
+}/*}}}*/
+
+void TailStat::ref()
+{/*{{{*/
+    __sync_add_and_fetch(&m_refs, 1);
+}/*}}}*/
+
+void TailStat::unref()
+{/*{{{*/
+    if (0 == __sync_sub_and_fetch(&m_refs, 1)) {
+        delete this;
+    }
+}/*}}}*/
+
+void TailStat::update(int64_t filepos, int64_t filesize)
+{/*{{{*/
+    /* 64 bit stores are atomic on the platforms we run, the barriers 
+     * keep readers from seeing them out of order */
+    __sync_synchronize();
+    m_filepos = filepos;
+    m_filesize = filesize;
+    __sync_synchronize();
+}/*}}}*/
+
+int64_t TailStat::getFilePos()
+{/*{{{*/
+    return __sync_add_and_fetch(&m_filepos, 0);
+}/*}}}*/
+
+int64_t TailStat::getFileSize()
+{/*{{{*/
+    return __sync_add_and_fetch(&m_filesize, 0);
+}/*}}}*/
+
+TailStatSnapshot::TailStatSnapshot()
+{/*{{{*/
+    m_refs = 1;
+}/*}}}*/
+
+TailStatSnapshot::~TailStatSnapshot()
+{/*{{{*/
+    for (vector<TailStatEntry>::iterator iter = m_entries.begin();
+            iter != m_entries.end(); ++iter) {
+        for (vector<TailStat *>::iterator it_s = iter->stats.begin();
+                it_s != iter->stats.end(); ++it_s) {
+            (*it_s)->unref();
+        }
+    }
+}/*}}}*/
+
+void TailStatSnapshot::ref()
+{/*{{{*/
+    __sync_add_and_fetch(&m_refs, 1);
+}/*}}}*/
+
+void TailStatSnapshot::unref()
+{/*{{{*/
+    if (0 == __sync_sub_and_fetch(&m_refs, 1)) {
+        delete this;
+    }
+}/*}}}*/
+
+void TailStatSnapshot::add(const TailStatEntry &entry)
+{/*{{{*/
+    for (vector<TailStat *>::const_iterator iter = entry.stats.begin();
+            iter != entry.stats.end(); ++iter) {
+        (*iter)->ref();
+    }
+
+    m_entries.push_back(entry);
+}/*}}}*/
+
+TailStatPublisher::TailStatPublisher()
+{/*{{{*/
+    m_snapshot = new TailStatSnapshot();
+    m_lock = 0;
+}/*}}}*/
+
+TailStatPublisher::~TailStatPublisher()
+{/*{{{*/
+    m_snapshot->unref(); m_snapshot = NULL;
+}/*}}}*/
+
+void TailStatPublisher::publish(TailStatSnapshot *snapshot)
+{/*{{{*/
+    while (__sync_lock_test_and_set(&m_lock, 1)) {}
+    TailStatSnapshot *old = m_snapshot;
+    m_snapshot = snapshot;
+    __sync_lock_release(&m_lock);
+
+    /* readers still holding it release it later */
+    old->unref();
+}/*}}}*/
+
+TailStatSnapshot *TailStatPublisher::acquire()
+{/*{{{*/
+    while (__sync_lock_test_and_set(&m_lock, 1)) {}
+    TailStatSnapshot *snapshot = m_snapshot;
+    snapshot->ref();
+    __sync_lock_release(&m_lock);
+
+    return snapshot;
+}/*}}}*/
+
+} // namespace logkafka
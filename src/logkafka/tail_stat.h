@@ -0,0 +1,201 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_TAIL_STAT_H_
+#define LOGKAFKA_TAIL_STAT_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "base/json.h"
+
+using namespace std;
+
+namespace logkafka {
+
+/* Progress of one tailed file. Written by its tail watcher in the loop
+ * thread, read without locks by anyone holding a reference */
+class TailStat
+{
+    public:
+        TailStat(const string &path_pattern, const string &path);
+
+        void ref();
+        void unref();
+
+        void update(int64_t filepos, int64_t filesize);
+        int64_t getFilePos();
+        int64_t getFileSize();
+
+        /* serialize to json */
+        template <typename JsonWriter>
+        void Serialize(JsonWriter& writer)
+        {/*{{{*/
+            writer.StartObject();
+
+            writer.String("realpath");
+            writer.String(m_path.c_str(), (rapidjson::SizeType)m_path.length());
+            writer.String("filepos");
+            writer.Int64(getFilePos());
+            writer.String("filesize");
+            writer.Int64(getFileSize());
+
+            writer.EndObject();
+        };/*}}}*/
+
+    public:
+        const string m_path_pattern;
+        const string m_path;
+
+    private:
+        ~TailStat() {};
+
+    private:
+        volatile int m_refs;
+        volatile int64_t m_filepos;
+        volatile int64_t m_filesize;
+};
+
+struct TailStatEntry
+{
+    string path_pattern;
+
+    /* tail group of a path pattern with wildcards */
+    bool group;
+    unsigned long pending;
+
+    /* the main file first, then backlog files or files of the group */
+    vector<TailStat *> stats;
+};
+
+/* Immutable list of tail stats, shared by readers with a refcount */
+class TailStatSnapshot
+{
+    public:
+        TailStatSnapshot();
+
+        void ref();
+        void unref();
+
+        /* takes a reference of every stat */
+        void add(const TailStatEntry &entry);
+
+        /* serialize to json */
+        template <typename JsonWriter>
+        void Serialize(JsonWriter& writer)
+        {/*{{{*/
+            writer.StartObject();
+
+            for (vector<TailStatEntry>::const_iterator iter = m_entries.begin();
+                    iter != m_entries.end(); ++iter) {
+                SerializeEntry(writer, *iter);
+            }
+
+            writer.EndObject();
+        };/*}}}*/
+
+        /* serialize one entry as a member of an object */
+        template <typename JsonWriter>
+        static void SerializeEntry(JsonWriter& writer, 
+                const TailStatEntry &entry)
+        {/*{{{*/
+            writer.String(entry.path_pattern.c_str(),
+                    (rapidjson::SizeType)entry.path_pattern.length());
+
+            if (entry.group) {
+                writer.StartObject();
+                writer.String("realpath");
+                writer.String(entry.path_pattern.c_str(),
+                        (rapidjson::SizeType)entry.path_pattern.length());
+                writer.String("files");
+                serializeStats(writer, entry.stats, 0);
+                writer.String("pending");
+                writer.Uint64(entry.pending);
+                writer.EndObject();
+            } else if (entry.stats.size() == 1) {
+                entry.stats[0]->Serialize(writer);
+            } else if (entry.stats.size() > 1) {
+                /* the main file, with backlog files read in parallel */
+                TailStat *main = entry.stats[0];
+                writer.StartObject();
+                writer.String("realpath");
+                writer.String(main->m_path.c_str(),
+                        (rapidjson::SizeType)main->m_path.length());
+                writer.String("filepos");
+                writer.Int64(main->getFilePos());
+                writer.String("filesize");
+                writer.Int64(main->getFileSize());
+                writer.String("backlog");
+                serializeStats(writer, entry.stats, 1);
+                writer.EndObject();
+            }
+        };/*}}}*/
+
+    public:
+        vector<TailStatEntry> m_entries;
+
+    private:
+        ~TailStatSnapshot();
+
+        template <typename JsonWriter>
+        static void serializeStats(JsonWriter& writer, 
+                const vector<TailStat *> &stats, size_t first)
+        {/*{{{*/
+            writer.StartArray();
+            for (size_t i = first; i < stats.size(); ++i) {
+                stats[i]->Serialize(writer);
+            }
+            writer.EndArray();
+        };/*}}}*/
+
+    private:
+        volatile int m_refs;
+};
+
+/* Publishes tail stat snapshots copy-on-write. The loop thread builds
+ * a new snapshot whenever watchers change and swaps it in, readers of
+ * any thread only take a reference of the current one, so uploading 
+ * or monitoring never waits for config refresh or reading files */
+class TailStatPublisher
+{
+    public:
+        TailStatPublisher();
+        ~TailStatPublisher();
+
+        /* takes the reference of snapshot */
+        void publish(TailStatSnapshot *snapshot);
+
+        /* never NULL, unref() it after use */
+        TailStatSnapshot *acquire();
+
+    private:
+        TailStatSnapshot *m_snapshot;
+
+        /* only guards swapping and referencing the pointer */
+        volatile int m_lock;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_TAIL_STAT_H_
@@ -29,22 +29,49 @@ const unsigned long TailWatcher::STAT_WATCHER_DEFAULT_INTERVAL = 1000UL;
 TailWatcher::TailWatcher()
 {/*{{{*/
     m_receive_func = NULL;
+    m_updateWatcher = NULL;
+    m_update_func_arg = NULL;
     m_timer_trigger = NULL;
     m_stat_trigger = NULL;
     m_rotate_handler = NULL;
+    m_io_handler = NULL;
+    m_rotated_io_handler = NULL;
+    m_live_position_entry = NULL;
+    m_position_entry = NULL;
+    m_stat = NULL;
+    m_metrics = NULL;
+    m_bytes_behind = 0;
     m_output = NULL;
+    m_output_full = false;
+    m_pipeline = NULL;
 }/*}}}*/
 
 TailWatcher::~TailWatcher()
 {/*{{{*/
-    m_timer_trigger->close();
+    if (NULL != m_timer_trigger) m_timer_trigger->close();
     delete m_timer_trigger; m_timer_trigger = NULL;
-    m_stat_trigger->close();
+    if (NULL != m_stat_trigger) m_stat_trigger->close();
     delete m_stat_trigger; m_stat_trigger = NULL;
 
     delete m_io_handler; m_io_handler = NULL;
+    if (NULL != m_rotated_io_handler) m_rotated_io_handler->close();
+    delete m_rotated_io_handler; m_rotated_io_handler = NULL;
+    delete m_live_position_entry; m_live_position_entry = NULL;
     delete m_rotate_handler; m_rotate_handler = NULL;
     delete m_output; m_output = NULL;
+    if (NULL != m_pipeline) {
+        m_pipeline->release(); m_pipeline = NULL;
+    }
+
+    if (NULL != m_stat) {
+        m_stat->unref(); m_stat = NULL;
+    }
+
+    if (NULL != m_metrics) {
+        m_metrics->add(METRIC_BYTES_BEHIND, -m_bytes_behind);
+        MetricsRegistry::instance().releaseTask(m_metrics);
+        m_metrics = NULL;
+    }
 }/*}}}*/
 
 bool TailWatcher::init(uv_loop_t *loop, 
@@ -57,9 +84,11 @@ bool TailWatcher::init(uv_loop_t *loop,
         unsigned long line_max_bytes, 
         bool enabled,
         UpdateFunc updateWatcher,
+        void *update_func_arg,
         ReceiveFunc receiveLines,
         TaskConf conf,
-        Output *output)
+        Output *output,
+        Pipeline *pipeline)
 {/*{{{*/
     /* We will not close watch until stat change time expired m_stat_silent_max_ms, 
      * remove or change state_wait to infinite */
@@ -73,13 +102,37 @@ bool TailWatcher::init(uv_loop_t *loop,
     m_line_max_bytes = line_max_bytes;
     m_enabled = enabled;
     m_updateWatcher = updateWatcher;
+    m_update_func_arg = update_func_arg;
     m_receive_func = receiveLines;
     m_conf = conf;
     m_output = output; 
+    m_output_full = false;
+    if (NULL != m_output) {
+        m_output->setBackpressureCallback(onBackpressure, this);
+    }
+
+    /* no stages, no pipeline, the one of the task if given */
+    if (NULL != pipeline) {
+        m_pipeline = pipeline->acquire();
+    } else if (!conf.stages.empty()) {
+        m_pipeline = new Pipeline();
+        if (!m_pipeline->init(conf.stages)) {
+            LERROR << "Fail to init pipeline of " << path_pattern;
+            m_pipeline->release(); m_pipeline = NULL;
+            return false;
+        }
+    }
 
     m_loop = loop;
+    m_stat = new TailStat(path_pattern, path);
+    m_metrics = MetricsRegistry::instance().acquireTask(path_pattern);
+
+    /* stalls are attributed to the path pattern and the file */
+    string name = (path == path_pattern) ? path 
+        : path_pattern + " (" + path + ")";
 
     m_timer_trigger = new TimerWatcher();
+    m_timer_trigger->setName(name);
     if (!m_timer_trigger->init(m_loop, 0, TIMER_WATCHER_DEFAULT_REPEAT,
                 this, &onNotify)) {
         LERROR << "Fail to init timer watcher";
@@ -88,6 +141,7 @@ bool TailWatcher::init(uv_loop_t *loop,
     }
 
     m_stat_trigger = new StatWatcher();
+    m_stat_trigger->setName(name);
     if (!m_stat_trigger->init(m_loop, path, STAT_WATCHER_DEFAULT_INTERVAL,
                 this, &onNotify)) {
         LERROR << "Fail to init stat watcher";
@@ -115,9 +169,44 @@ void TailWatcher::onNotify(void *arg)
     if (NULL != tw->m_rotate_handler)
         tw->m_rotate_handler->onNotify((void *)tw->m_rotate_handler);
 
-    // handle io
-    if (NULL != tw->m_io_handler)
+    // lines left in the rotated file go first
+    if (NULL != tw->m_rotated_io_handler) {
+        tw->m_rotated_io_handler->onNotify(tw->m_rotated_io_handler);
+
+        struct timeval cur_tv = (struct timeval){0};
+        struct timeval last_io_time = (struct timeval){0};
+        if (0 == gettimeofday(&cur_tv, NULL)
+                && !tw->m_output_full
+                && tw->m_rotated_io_handler->isAllSent()
+                && tw->m_rotated_io_handler->getLastIOTime(last_io_time)
+                && (cur_tv.tv_sec - last_io_time.tv_sec) * 1000UL 
+                > tw->m_stat_silent_max_ms) {
+            tw->closeRotated();
+        }
+    }
+
+    // handle io, once the rotated file is sent, so that a batch not
+    // sent is read and passed again before others
+    if (NULL != tw->m_io_handler && (NULL == tw->m_rotated_io_handler
+                || tw->m_rotated_io_handler->isAllSent()))
         tw->m_io_handler->onNotify((void *)tw->m_io_handler);
+
+    tw->updateStat();
+}/*}}}*/
+
+void TailWatcher::updateStat()
+{/*{{{*/
+    ScopedLock l(m_io_handler_mutex);
+
+    if (NULL != m_io_handler && NULL != m_stat) {
+        int64_t filepos = m_io_handler->getFilePos();
+        int64_t filesize = m_io_handler->getFileSize();
+        m_stat->update(filepos, filesize);
+
+        int64_t bytes_behind = max(filesize - filepos, (int64_t)0);
+        m_metrics->add(METRIC_BYTES_BEHIND, bytes_behind - m_bytes_behind);
+        m_bytes_behind = bytes_behind;
+    }
 }/*}}}*/
 
 void TailWatcher::onRotate(void *arg, FILE *file)
@@ -126,13 +215,13 @@ void TailWatcher::onRotate(void *arg, FILE *file)
     PositionEntry *pe = tw->m_position_entry;
     unsigned int max_line_at_once = tw->m_max_line_at_once;
     unsigned int line_max_bytes = tw->m_line_max_bytes;
-    ReceiveFunc receiveLines = tw->m_receive_func;
     UpdateFunc updateWatcher = tw->m_updateWatcher;
 
     ScopedLock l(tw->m_io_handler_mutex);
 
     if (NULL == (tw->m_io_handler)) {
-        int pos = 0;
+        off_t pos = 0;
+        PositionEntry *io_pe = pe;
         if (NULL != file) {
             struct stat buf;
             fstat(fileno(file), &buf);
@@ -142,9 +231,25 @@ void TailWatcher::onRotate(void *arg, FILE *file)
             ino_t last_inode = pe->readInode();
             if (inode == last_inode) {
                 pos = pe->readPos();
+                /* truncated while not watched */
+                if (pos > fsize) {
+                    pos = 0;
+                    pe->updatePos(pos);
+                }
             } else if (inode != 0) {
                 pos = 0;
-                pe->update(inode, pos);
+                /* restarted while the file rotated before was drained,
+                 * the position entry is still with it */
+                if (NULL != tw->m_rotated_io_handler
+                        || tw->resumeRotated(last_inode, pe->readPos())) {
+                    if (NULL == tw->m_live_position_entry) {
+                        tw->m_live_position_entry = new MemoryPositionEntry();
+                    }
+                    tw->m_live_position_entry->update(inode, pos);
+                    io_pe = tw->m_live_position_entry;
+                } else {
+                    pe->update(inode, pos);
+                }
             } else {
                 pos = tw->m_read_from_head? 0: fsize;
                 pe->update(inode, pos);
@@ -153,31 +258,36 @@ void TailWatcher::onRotate(void *arg, FILE *file)
             fseek(file, pos, SEEK_SET);
 
             tw->m_io_handler = new IOHandler();
-            bool res = tw->m_io_handler->init(file, pe, max_line_at_once, 
-                    line_max_bytes, tw->m_output, receiveLines);
+            bool res = tw->m_io_handler->init(file, io_pe, max_line_at_once, 
+                    line_max_bytes, tw, onLines, 
+                    tw->m_metrics);
             if (!res) {
                 delete tw->m_io_handler; tw->m_io_handler = NULL;
                 return;
             }
+            tw->m_io_handler->setPaused(tw->m_output_full);
         }
     } else {
         if (0 != file) {
             struct stat buf;
             fstat(fileno(file), &buf);
-            off_t fsize = buf.st_size;
             ino_t inode = buf.st_ino;
 
             ino_t last_inode = pe->readInode();
             if (inode == last_inode) { // truncated
-                pe->updatePos(fsize);
+                /* read again from head, lines written since the 
+                 * truncation are before fsize */
+                pe->updatePos(0);
 
                 IOHandler *io_handler = new IOHandler();
                 bool res = io_handler->init(file, pe, max_line_at_once, 
-                        line_max_bytes, tw->m_output, receiveLines);
+                        line_max_bytes, tw, onLines, 
+                        tw->m_metrics);
                 if (!res) {
                     delete io_handler;
                     return;
                 }
+                io_handler->setPaused(tw->m_output_full);
 
                 tw->m_io_handler->close();
 
@@ -189,23 +299,147 @@ void TailWatcher::onRotate(void *arg, FILE *file)
 
                 IOHandler *io_handler = new IOHandler();
                 bool res = io_handler->init(file, pe, max_line_at_once, 
-                        line_max_bytes, tw->m_output, receiveLines);
+                        line_max_bytes, tw, onLines, 
+                        tw->m_metrics);
                 if (!res) {
                     delete io_handler;
                     return;
                 }
+                io_handler->setPaused(tw->m_output_full);
 
                 delete tw->m_io_handler;
                 tw->m_io_handler = io_handler;
+            } else if ((*updateWatcher)(tw->m_update_func_arg, 
+                        tw->m_path_pattern, tw->m_path, pe)) {
+                /* rotated more than once since, the one before is 
+                 * not written any more, the position entry is with the
+                 * current one again */
+                tw->closeRotated();
+
+                /* the position entry stays with the rotated file until 
+                 * it is drained, so that a restart goes on with it, the
+                 * new file keeps its position in memory until then */
+                MemoryPositionEntry *live = new MemoryPositionEntry();
+                live->update(inode, 0);
+                IOHandler *io_handler = new IOHandler();
+                bool res = io_handler->init(file, live, max_line_at_once, 
+                        line_max_bytes, tw, onLines, 
+                        tw->m_metrics);
+                if (!res) {
+                    delete io_handler;
+                    delete live;
+                    fclose(file);
+                    return;
+                }
+                io_handler->setPaused(tw->m_output_full);
+
+                tw->m_rotated_io_handler = tw->m_io_handler;
+                tw->m_live_position_entry = live;
+                tw->m_io_handler = io_handler;
             } else {
-                //(*updateWatcher)(tw->m_manager, tw->m_path_pattern, tw->m_path, 
-                //        swapState(&tw->m_position_entry, tw->m_io_handler));
-                (*updateWatcher)(tw->m_manager, tw->m_path_pattern, tw->m_path, tw->m_position_entry);
+                /* the new file is reopened by the callee */
+                fclose(file);
             }
         }
     }
 }/*}}}*/
 
+void TailWatcher::onBackpressure(void *arg, bool full)
+{/*{{{*/
+    TailWatcher *tw = (TailWatcher *)arg;
+
+    /* may be called while lines are sent, so it does not lock */
+    tw->m_output_full = full;
+    if (NULL != tw->m_rotated_io_handler) 
+        tw->m_rotated_io_handler->setPaused(full);
+    if (NULL != tw->m_io_handler) 
+        tw->m_io_handler->setPaused(full);
+
+    /* lines written while paused are read without waiting for 
+     * the next timer */
+    if (!full && tw->m_enabled) {
+        onNotify(tw);
+    }
+}/*}}}*/
+
+bool TailWatcher::onLines(void *arg, vector<string> &lines, 
+        int64_t write_time_us)
+{/*{{{*/
+    TailWatcher *tw = (TailWatcher *)arg;
+
+    if (NULL != tw->m_pipeline) {
+        size_t dropped = tw->m_pipeline->process(lines);
+        if (dropped > 0) {
+            tw->m_metrics->add(METRIC_LINES_DROPPED, dropped);
+        }
+
+        /* nothing left to send, the position goes past them */
+        if (lines.empty()) return true;
+    }
+
+    return (*tw->m_receive_func)(tw->m_output, lines, write_time_us);
+}/*}}}*/
+
+void TailWatcher::closeRotated()
+{/*{{{*/
+    if (NULL == m_rotated_io_handler) return;
+
+    LINFO << "Close rotated file of path " << m_path
+          << ", path_pattern " << m_path_pattern;
+    m_rotated_io_handler->drain();
+    m_rotated_io_handler->close();
+    delete m_rotated_io_handler; m_rotated_io_handler = NULL;
+
+    /* the position entry goes on with the new file */
+    if (NULL != m_live_position_entry) {
+        m_position_entry->update(m_live_position_entry->readInode(),
+                m_live_position_entry->readPos());
+        if (NULL != m_io_handler) {
+            m_io_handler->m_position_entry = m_position_entry;
+        }
+        delete m_live_position_entry; m_live_position_entry = NULL;
+    }
+}/*}}}*/
+
+bool TailWatcher::resumeRotated(ino_t inode, off_t pos)
+{/*{{{*/
+    string path;
+    if (INO_NONE == inode || !findSiblingByInode(m_path, inode, path)) {
+        return false;
+    }
+
+    /* nothing left, or not the file read before */
+    off_t fsize = getFsize(path.c_str());
+    if (fsize <= pos) return false;
+
+    if (!(*m_updateWatcher)(m_update_func_arg, m_path_pattern, m_path, 
+                m_position_entry)) {
+        return false;
+    }
+
+    FILE *file = fopen(path.c_str(), "r");
+    if (NULL == file) {
+        LERROR << "Fail to open rotated file " << path;
+        return false;
+    }
+    fseek(file, pos, SEEK_SET);
+
+    IOHandler *io_handler = new IOHandler();
+    if (!io_handler->init(file, m_position_entry, m_max_line_at_once,
+                m_line_max_bytes, this, onLines, m_metrics)) {
+        delete io_handler;
+        fclose(file);
+        return false;
+    }
+    io_handler->setPaused(m_output_full);
+
+    LINFO << "Resume rotated file " << path << " of path " << m_path
+          << " from position " << pos << ", path_pattern " << m_path_pattern;
+    m_rotated_io_handler = io_handler;
+
+    return true;
+}/*}}}*/
+
 PositionEntry *TailWatcher::swapState(PositionEntry **pep, IOHandler *io_handler)
 {/*{{{*/
     PositionEntry *pe = *pep;
@@ -221,22 +455,44 @@ PositionEntry *TailWatcher::swapState(PositionEntry **pep, IOHandler *io_handler
 
 void TailWatcher::stop(bool close_io)
 {/*{{{*/
+    m_enabled = false;
     if (NULL != m_timer_trigger) m_timer_trigger->stop();
     if (NULL != m_stat_trigger) m_stat_trigger->stop();
 
+    if (close_io) {
+        closeRotated();
+    }
+
     if (close_io && NULL != m_io_handler) {
-        m_io_handler->onNotify(this->m_io_handler);
+        /* a last line without newline is not completed any more if 
+         * the file is not watched */
+        if (m_unwatched) {
+            m_io_handler->drain();
+        } else {
+            m_io_handler->onNotify(this->m_io_handler);
+        }
+        updateStat();
         m_io_handler->close();
     }
 }/*}}}*/
 
 void TailWatcher::start()
 {/*{{{*/
+    m_enabled = true;
     if (m_timer_trigger) m_timer_trigger->start();
     if (m_stat_trigger) m_stat_trigger->start();
     onNotify(this);
 }/*}}}*/
 
+bool TailWatcher::isFullyRead()
+{/*{{{*/
+    if (m_output_full || NULL == m_io_handler) {
+        return false;
+    }
+
+    return m_io_handler->isAllSent();
+}/*}}}*/
+
 bool TailWatcher::isActive() 
 {/*{{{*/
     bool is_active = true;
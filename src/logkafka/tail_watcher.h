@@ -32,12 +32,14 @@
 #include "base/stat_watcher.h"
 #include "base/timer_watcher.h"
 #include "logkafka/io_handler.h"
-#include "logkafka/manager.h"
 #include "logkafka/memory_position_entry.h"
+#include "logkafka/metrics.h"
 #include "logkafka/output.h"
 #include "logkafka/output_kafka.h"
+#include "logkafka/pipeline.h"
 #include "logkafka/position_entry.h"
 #include "logkafka/rotate_handler.h"
+#include "logkafka/tail_stat.h"
 #include "logkafka/task_conf.h"
 
 using namespace std;
@@ -45,9 +47,9 @@ using namespace base;
 
 namespace logkafka {
 
-class Manager;
-
-typedef void (*UpdateFunc)(Manager *, string, string, PositionEntry *);
+/* called when a new file is found at the path, returns true to have 
+ * the tail watcher follow it, while the rotated one is drained */
+typedef bool (*UpdateFunc)(void *, string, string, PositionEntry *);
 
 class TailWatcher
 {
@@ -65,47 +67,48 @@ class TailWatcher
                 unsigned long line_max_bytes, 
                 bool enabled,
                 UpdateFunc updateWatcher,
+                void *update_func_arg,
                 ReceiveFunc receiveLines,
                 TaskConf conf,
-                Output *output);
+                Output *output,
+                Pipeline *pipeline = NULL);
 
         static void onNotify(void *arg);
         static void onRotate(void *arg, FILE *file);
+        /* reading is paused while the output is full */
+        static void onBackpressure(void *arg, bool full);
+        /* lines read go through the pipeline to the output */
+        static bool onLines(void *arg, vector<string> &lines, 
+                int64_t write_time_us);
         static PositionEntry * swapState(PositionEntry **pep, IOHandler *io_handler);
 
         void start();
         void stop(bool close_io);
 
         bool isActive();
+        /* done with a file which is not written any more, every line is
+         * sent and reading is not held back by a full output */
+        bool isFullyRead();
         bool getEnabled() { return m_enabled; };
         string getPath();
         static bool isStateSilentMaxMsValid(unsigned long stat_silent_max_ms);
+        void updateStat();
+        /* the file left after rotation, drained until it is silent */
+        void closeRotated();
+        /* opens the file rotated from path before a restart, found by 
+         * inode, to read it on from pos */
+        bool resumeRotated(ino_t inode, off_t pos);
+
+        /* progress for state uploading, read without locks */
+        TailStat *getStat() { return m_stat; };
+        Output *getOutput() { return m_output; };
+        Pipeline *getPipeline() { return m_pipeline; };
 
         /* serialize to json */
         template <typename JsonWriter>
         void Serialize(JsonWriter& writer)
         {/*{{{*/
-            ScopedLock l(m_io_handler_mutex);
-
-            string realpath = m_path;
-            long filepos = -1;
-            long filesize = 0;
-            if (NULL != m_io_handler) {
-                filepos = m_io_handler->getFilePos();
-                filesize = m_io_handler->getFileSize();
-            }
-
-            // This base class just write out name-value pairs, without wrapping within an object.
-            writer.StartObject();
-
-            writer.String("realpath");
-            writer.String(realpath.c_str(), (rapidjson::SizeType)realpath.length()); // Supplying length of string is faster.
-            writer.String("filepos");
-            writer.Int64(filepos);
-            writer.String("filesize");
-            writer.Int64(filesize);
-
-            writer.EndObject();
+            m_stat->Serialize(writer);
         };/*}}}*/
 
     public:
@@ -121,11 +124,20 @@ class TailWatcher
         StatWatcher *m_stat_trigger;
         RotateHandler *m_rotate_handler;
         IOHandler *m_io_handler;
+        IOHandler *m_rotated_io_handler;
+        /* position of the new file while the rotated one is drained */
+        MemoryPositionEntry *m_live_position_entry;
         PositionEntry *m_position_entry;
+        TailStat *m_stat;
+        TaskMetrics *m_metrics;
+        /* share of this file in bytes_behind of the task */
+        int64_t m_bytes_behind;
         UpdateFunc m_updateWatcher;
+        void *m_update_func_arg;
         ReceiveFunc m_receive_func;
-        Manager *m_manager;
         Output *m_output;
+        bool m_output_full;
+        Pipeline *m_pipeline;
         bool m_read_from_head;
         unsigned long m_max_line_at_once;
         unsigned long m_line_max_bytes;
@@ -22,11 +22,17 @@
 #ifndef LOGKAFKA_TASK_CONF_H_
 #define LOGKAFKA_TASK_CONF_H_
 
+#include <regex.h>
+
+#include <algorithm>
+#include <deque>
 #include <ostream>
-#include <queue>
 #include <string>
+#include <vector>
 
 #include "base/tools.h"
+#include "logkafka/common.h"
+#include "logkafka/metrics.h"
 
 #include "easylogging/easylogging++.h"
 
@@ -48,11 +54,24 @@ struct LogConf{
 
     bool read_from_head;
 
+    /* max backlog files of a path pattern with time format to be read 
+     * in parallel, besides the live file; 1 reads them one by one */
+    int backlog_parallelism;
+
+    LogConf()
+    {/*{{{*/
+        follow_last = true;
+        batchsize = DEFAULT_BATCHSIZE;
+        read_from_head = true;
+        backlog_parallelism = DEFAULT_BACKLOG_PARALLELISM;
+    }/*}}}*/
+
     bool operator==(const LogConf& hs) const
     {/*{{{*/
         return (log_path == hs.log_path) &&
             (follow_last == hs.follow_last) &&
-            (batchsize == hs.batchsize);
+            (batchsize == hs.batchsize) &&
+            (backlog_parallelism == hs.backlog_parallelism);
     };/*}}}*/
 
     bool operator!=(const LogConf& hs) const
@@ -65,20 +84,35 @@ struct LogConf{
         os << "log path: " << lc.log_path
            << "follow last" << lc.follow_last
            << "batchsize" << lc.batchsize
-           << "read from head" << lc.read_from_head;
+           << "read from head" << lc.read_from_head
+           << "backlog parallelism" << lc.backlog_parallelism;
 
         return os;
     }
 
     bool isLegal()
     {/*{{{*/
-        return isPathPatternLegal();
+        return isPathPatternLegal() && isBacklogParallelismLegal();
+    }/*}}}*/
+
+    bool isBacklogParallelismLegal()
+    {/*{{{*/
+        return backlog_parallelism >= 1 
+            && backlog_parallelism <= HARD_LIMIT_BACKLOG_PARALLELISM;
     }/*}}}*/
     
     bool isPathPatternLegal()
     {/*{{{*/
-        std::size_t found = log_path.find("*");
-        if (found != std::string::npos)
+        /* wildcards are only allowed in the last path component, 
+         * and can not be mixed with time format */
+        std::size_t found = log_path.find_first_of("*?[");
+        if (found == std::string::npos)
+            return true;
+
+        if (found < log_path.find_last_of('/'))
+            return false;
+
+        if (log_path.find('%') != std::string::npos)
             return false;
             
         return true;
@@ -132,40 +166,328 @@ struct KafkaTopicConf {
     }
 };
 
+/* local segment files lines are archived to, instead of kafka */
+struct FileOutputConf {
+    /* segments are named path[.source].YYYYmmddHHMMSS[.N][.gz] */
+    string path;
+    /* a new segment is started once it is reached, 0 is unlimited */
+    int64_t segment_bytes;
+    /* a new segment is started once it is older, 0 is unlimited */
+    int64_t segment_ms;
+    /* none or gzip */
+    string compression_codec;
+    /* the file read, set for watchers of a task reading several files
+     * at once, e.g. a glob group, so that each has segments of its own,
+     * not in the task conf */
+    string source;
+
+    FileOutputConf()
+    {/*{{{*/
+        path = "";
+        source = "";
+        segment_bytes = DEFAULT_SEGMENT_BYTES;
+        segment_ms = DEFAULT_SEGMENT_MS;
+        compression_codec = "none";
+    }/*}}}*/
+
+    bool operator==(const FileOutputConf& hs) const
+    {/*{{{*/
+        return (path == hs.path) &&
+            (segment_bytes == hs.segment_bytes) &&
+            (segment_ms == hs.segment_ms) &&
+            (compression_codec == hs.compression_codec) &&
+            (source == hs.source);
+    };/*}}}*/
+
+    bool operator!=(const FileOutputConf& hs) const
+    {/*{{{*/
+        return !operator==(hs);
+    };/*}}}*/
+
+    friend ostream& operator << (ostream& os, const FileOutputConf& foc)
+    {
+        os << "path: " << foc.path
+           << "segment bytes" << foc.segment_bytes
+           << "segment ms" << foc.segment_ms
+           << "compression codec" << foc.compression_codec;
+
+        return os;
+    }
+
+    bool isLegal()
+    {/*{{{*/
+        return !path.empty() && segment_bytes >= 0 && segment_ms >= 0
+            && ("none" == compression_codec || "gzip" == compression_codec);
+    }/*}}}*/
+};
+
+struct StreamOutputConf {
+    /* a socket path for unix, ip:port for tcp */
+    string address;
+    /* reading is paused while more bytes wait for the socket */
+    int64_t max_pending_bytes;
+
+    StreamOutputConf()
+    {/*{{{*/
+        address = "";
+        max_pending_bytes = DEFAULT_STREAM_MAX_PENDING_BYTES;
+    }/*}}}*/
+
+    bool operator==(const StreamOutputConf& hs) const
+    {/*{{{*/
+        return (address == hs.address) &&
+            (max_pending_bytes == hs.max_pending_bytes);
+    };/*}}}*/
+
+    bool operator!=(const StreamOutputConf& hs) const
+    {/*{{{*/
+        return !operator==(hs);
+    };/*}}}*/
+
+    friend ostream& operator << (ostream& os, const StreamOutputConf& soc)
+    {
+        os << "address: " << soc.address
+           << "max pending bytes" << soc.max_pending_bytes;
+
+        return os;
+    }
+
+    bool isLegal()
+    {/*{{{*/
+        return !address.empty() && max_pending_bytes > 0;
+    }/*}}}*/
+};
+
+/* one destination of lines of a task */
+struct OutputConf
+{
+    /* kafka, file, unix or tcp */
+    string output;
+
+    KafkaTopicConf kafka_topic_conf;
+    FileOutputConf file_output_conf;
+    StreamOutputConf stream_output_conf;
+
+    OutputConf(): output("kafka") {};
+
+    bool operator==(const OutputConf& hs) const
+    {/*{{{*/
+        return (output == hs.output) &&
+            (kafka_topic_conf == hs.kafka_topic_conf) &&
+            (file_output_conf == hs.file_output_conf) &&
+            (stream_output_conf == hs.stream_output_conf);
+    };/*}}}*/
+
+    bool operator!=(const OutputConf& hs) const
+    {/*{{{*/
+        return !operator==(hs);
+    };/*}}}*/
+
+    friend ostream& operator << (ostream& os, const OutputConf& oc)
+    {
+        os << "output: " << oc.output
+           << "kafka topic conf" << oc.kafka_topic_conf
+           << "file output conf" << oc.file_output_conf
+           << "stream output conf" << oc.stream_output_conf;
+
+        return os;
+    }
+
+    bool isLegal()
+    {
+        if ("file" == output) {
+            return file_output_conf.isLegal();
+        }
+
+        if ("unix" == output || "tcp" == output) {
+            return stream_output_conf.isLegal();
+        }
+
+        return "kafka" == output && kafka_topic_conf.isLegal();
+    }
+};
+
+/* one stage of the pipeline lines go through before the outputs */
+struct StageConf
+{
+    /* trim, truncate, drop_empty, filter or sample */
+    string stage;
+    /* truncate: longer lines are cut to it */
+    uint32_t max_bytes;
+    /* filter: if any include is given, only lines containing one of 
+     * them are kept, then lines containing any exclude are dropped */
+    vector<string> include;
+    vector<string> exclude;
+    /* filter: POSIX extended regexes, tried after the literals */
+    vector<string> include_regex;
+    vector<string> exclude_regex;
+    /* sample: rate keeps the given fraction of lines evenly spaced, hash
+     * keeps lines whose key hashes below the fraction, the same ones on
+     * every host, and limit keeps at most lines_per_s lines a second */
+    string mode;
+    double rate;
+    /* sample hash: 1-based whitespace separated field hashed, the whole 
+     * line if 0 or the line has fewer fields */
+    uint32_t key_field;
+    /* sample limit: burst defaults to lines_per_s */
+    uint32_t lines_per_s;
+    uint32_t burst;
+
+    StageConf(): stage(""), max_bytes(0), mode(""), rate(0), key_field(0),
+        lines_per_s(0), burst(0) {};
+
+    bool operator==(const StageConf& hs) const
+    {/*{{{*/
+        return (stage == hs.stage) &&
+            (max_bytes == hs.max_bytes) &&
+            (include == hs.include) &&
+            (exclude == hs.exclude) &&
+            (include_regex == hs.include_regex) &&
+            (exclude_regex == hs.exclude_regex) &&
+            (mode == hs.mode) &&
+            (rate == hs.rate) &&
+            (key_field == hs.key_field) &&
+            (lines_per_s == hs.lines_per_s) &&
+            (burst == hs.burst);
+    };/*}}}*/
+
+    bool operator!=(const StageConf& hs) const
+    {/*{{{*/
+        return !operator==(hs);
+    };/*}}}*/
+
+    friend ostream& operator << (ostream& os, const StageConf& sc)
+    {
+        os << "stage: " << sc.stage
+           << "max bytes" << sc.max_bytes
+           << "include" << sc.include.size()
+           << "exclude" << sc.exclude.size()
+           << "include regex" << sc.include_regex.size()
+           << "exclude regex" << sc.exclude_regex.size()
+           << "mode" << sc.mode
+           << "rate" << sc.rate
+           << "key field" << sc.key_field
+           << "lines per s" << sc.lines_per_s
+           << "burst" << sc.burst;
+
+        return os;
+    }
+
+    bool isLegal()
+    {
+        if ("truncate" == stage) {
+            return max_bytes > 0;
+        }
+
+        if ("filter" == stage) {
+            return isLegalFilter();
+        }
+
+        if ("sample" == stage) {
+            if ("rate" == mode || "hash" == mode) {
+                return rate > 0 && rate <= 1;
+            }
+            return "limit" == mode && lines_per_s > 0;
+        }
+
+        return "trim" == stage || "drop_empty" == stage;
+    }
+
+    bool isLegalFilter()
+    {
+        if (include.empty() && exclude.empty() 
+                && include_regex.empty() && exclude_regex.empty()) {
+            return false;
+        }
+
+        /* an empty literal would match every line */
+        if (find(include.begin(), include.end(), "") != include.end()
+                || find(exclude.begin(), exclude.end(), "") != exclude.end()) {
+            return false;
+        }
+
+        vector<string> regexes(include_regex);
+        regexes.insert(regexes.end(), exclude_regex.begin(), exclude_regex.end());
+        for (vector<string>::const_iterator iter = regexes.begin();
+                iter != regexes.end(); ++iter) {
+            regex_t regex;
+            if (0 != regcomp(&regex, iter->c_str(), REG_EXTENDED | REG_NOSUB)) {
+                return false;
+            }
+            regfree(&regex);
+        }
+
+        return true;
+    }
+};
+
 struct TaskConf
 {
     /* if false, the log file will not be collected */
     bool valid;
 
     LogConf log_conf;
-    KafkaTopicConf kafka_topic_conf;
+
+    /* lines are read once and sent to every output */
+    vector<OutputConf> outputs;
+
+    /* stages each batch goes through in order, before the outputs */
+    vector<StageConf> stages;
+
+    TaskConf(): valid(false) {};
 
     bool operator==(const TaskConf& hs) const
     {/*{{{*/
         return (valid == hs.valid) &&
             (log_conf == hs.log_conf) &&
-            (kafka_topic_conf == hs.kafka_topic_conf);
+            (outputs == hs.outputs) &&
+            (stages == hs.stages);
     };/*}}}*/
 
     friend ostream& operator << (ostream& os, const TaskConf& tc)
     {
         os << "valid: " << tc.valid
-           << "log conf" << tc.log_conf 
-           << "kafka topic conf" << tc.kafka_topic_conf;
+           << "log conf" << tc.log_conf;
+        for (vector<OutputConf>::const_iterator iter = tc.outputs.begin();
+                iter != tc.outputs.end(); ++iter) {
+            os << "output conf" << *iter;
+        }
+        for (vector<StageConf>::const_iterator iter = tc.stages.begin();
+                iter != tc.stages.end(); ++iter) {
+            os << "stage conf" << *iter;
+        }
 
         return os;
     }
 
     bool isLegal()
     {
-        return log_conf.isLegal() && kafka_topic_conf.isLegal();
+        if (outputs.empty() || outputs.size() > HARD_LIMIT_OUTPUTS) {
+            return false;
+        }
+
+        for (vector<OutputConf>::iterator iter = outputs.begin();
+                iter != outputs.end(); ++iter) {
+            if (!iter->isLegal()) return false;
+        }
+
+        if (stages.size() > HARD_LIMIT_STAGES) {
+            return false;
+        }
+
+        for (vector<StageConf>::iterator iter = stages.begin();
+                iter != stages.end(); ++iter) {
+            if (!iter->isLegal()) return false;
+        }
+
+        return log_conf.isLegal();
     }
 };
 
 struct TaskStat
 {
     bool first_update_paths;
-    queue<string> paths;
+    deque<string> paths;
 
     TaskStat()
     {/*{{{*/
@@ -182,19 +504,40 @@ struct Task
 {
     TaskConf conf;
     TaskStat stat;
+    /* kept while the task lives, so that metrics survive watchers 
+     * being closed and set up again */
+    TaskMetrics *metrics;
+    /* paused from the control endpoint, not kept across restarts */
+    bool paused;
+
+    Task(): metrics(NULL), paused(false) {};
+    ~Task() { MetricsRegistry::instance().releaseTask(metrics); };
+
     string getPath() { return getFirstPath(); };
     string getFirstPath() { return stat.getPath(); };
-    void delFirstPath() { stat.paths.pop(); };
+    void delFirstPath() { stat.paths.pop_front(); };
+    void delPath(const string &path)
+    { /*{{{*/
+        deque<string>::iterator iter = 
+            find(stat.paths.begin(), stat.paths.end(), path);
+        if (iter != stat.paths.end()) {
+            stat.paths.erase(iter);
+        }
+    };/*}}}*/
+    string getLastPath() 
+    { /*{{{*/
+        return !stat.paths.empty()? stat.paths.back(): "";
+    };/*}}}*/
     bool addPath(string path) 
     { /*{{{*/
         if (stat.paths.empty()) {
-            stat.paths.push(path);
+            stat.paths.push_back(path);
             LINFO << "Add path " << path;
             return true;
         } else {
             string last_path = stat.paths.back();
             if (path != last_path) {
-                stat.paths.push(path);
+                stat.paths.push_back(path);
                 LINFO << "Add path " << path;
                 return true;
             }
@@ -203,7 +546,7 @@ struct Task
         return false;
     };/*}}}*/
     bool hasPath() { return !stat.paths.empty(); };
-    bool getEnabled() { return conf.valid; };
+    bool getEnabled() { return conf.valid && !paused; };
     ino_t getInode() { return ::getInode(getPath().c_str()); };
 };
 
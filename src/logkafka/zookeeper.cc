@@ -37,6 +37,85 @@ const string Zookeeper::BROKER_IDS_PATH = "/brokers/ids";
 const unsigned long Zookeeper::REFRESH_INTERVAL_MS = 30000UL;
 const string Zookeeper::LOGKAFKA_CONFIG_PATH = "/logkafka/config/";
 const string Zookeeper::LOGKAFKA_CLIENT_PATH = "/logkafka/client/";
+const string Zookeeper::LOGKAFKA_CLIENT_SHARDS_PATH = "/logkafka/client_shards/";
+
+/* context of an asynchronous write of collecting state */
+struct LogStateContext
+{
+    zhandle_t *zhandle;
+    string path;
+    string buf;
+    bool create;
+    StateCompletionFunc completion;
+    const void *data;
+};
+
+ZnodeRefresh::ZnodeRefresh(zhandle_t *zhandle, int64_t seq,
+        RefreshApplyFunc apply_func, void *apply_func_arg)
+{/*{{{*/
+    m_zhandle = zhandle;
+    m_seq = seq;
+    m_apply_func = apply_func;
+    m_apply_func_arg = apply_func_arg;
+    m_version = -1;
+
+    m_refs = 1;
+    m_pending = 0;
+    m_failed = false;
+    m_finished = false;
+    pthread_cond_init(&m_cond, NULL);
+}/*}}}*/
+
+ZnodeRefresh::~ZnodeRefresh()
+{/*{{{*/
+    pthread_cond_destroy(&m_cond);
+}/*}}}*/
+
+void ZnodeRefresh::ref()
+{/*{{{*/
+    __sync_add_and_fetch(&m_refs, 1);
+}/*}}}*/
+
+void ZnodeRefresh::unref()
+{/*{{{*/
+    if (0 == __sync_sub_and_fetch(&m_refs, 1)) {
+        delete this;
+    }
+}/*}}}*/
+
+void ZnodeRefresh::addPending(int n)
+{/*{{{*/
+    ScopedLock l(m_mutex);
+    m_pending += n;
+}/*}}}*/
+
+void ZnodeRefresh::done(bool success)
+{/*{{{*/
+    {
+        ScopedLock l(m_mutex);
+        if (!success) m_failed = true;
+        if (--m_pending > 0) return;
+    }
+
+    /* the last read, no other completion touches it any more */
+    if (!m_failed && !m_apply_func(this)) {
+        m_failed = true;
+    }
+
+    ScopedLock l(m_mutex);
+    m_finished = true;
+    pthread_cond_broadcast(&m_cond);
+}/*}}}*/
+
+bool ZnodeRefresh::wait()
+{/*{{{*/
+    ScopedLock l(m_mutex);
+    while (!m_finished) {
+        pthread_cond_wait(&m_cond, &m_mutex.mutex());
+    }
+
+    return !m_failed;
+}/*}}}*/
 
 Zookeeper::Zookeeper()
 {/*{{{*/
@@ -47,7 +126,19 @@ Zookeeper::Zookeeper()
     m_thread = NULL;
 
     m_log_config = "{}";
+    m_log_config_version = -1;
+    m_config_change_cb_func = NULL;
+    m_config_change_cb_func_arg = NULL;
     m_broker_urls = "";
+    m_broker_urls_version = 0;
+    m_brokers_change_cb_func = NULL;
+    m_brokers_change_cb_func_arg = NULL;
+    m_client_epoch = 0;
+    m_config_watch_armed = 0;
+    m_brokers_watch_armed = 0;
+    m_refresh_seq = 0;
+    m_log_config_seq = 0;
+    m_broker_urls_seq = 0;
 }/*}}}*/
 
 Zookeeper::~Zookeeper()
@@ -73,6 +164,7 @@ bool Zookeeper::init(const string &zk_urls, long refresh_interval)
     }
 
     m_client_path = LOGKAFKA_CLIENT_PATH + m_hostname;
+    m_client_shards_path = LOGKAFKA_CLIENT_SHARDS_PATH + m_hostname;
     m_config_path = LOGKAFKA_CONFIG_PATH + m_hostname;
 
     refresh((void *)this);
@@ -90,6 +182,7 @@ bool Zookeeper::init(const string &zk_urls, long refresh_interval)
     uv_async_init(m_loop, &m_exit_handle, exitAsyncCb);
 
     m_refresh_timer_trigger = new TimerWatcher();
+    m_refresh_timer_trigger->setName("zookeeper refresh");
     if (!m_refresh_timer_trigger->init(m_loop, 0,
             refresh_interval,
             this, &refresh)) {
@@ -116,11 +209,9 @@ void Zookeeper::threadFunc(void *arg)
 
 bool Zookeeper::connect()
 {/*{{{*/
-    if (NULL != m_zhandle) {
-        LINFO << "Close invaild zookeeper connection...";
-        zookeeper_close(m_zhandle);
-        m_zhandle = NULL;
-    }
+    /* watches are lost with the session */
+    __sync_lock_test_and_set(&m_config_watch_armed, 0);
+    __sync_lock_test_and_set(&m_brokers_watch_armed, 0);
 
     LDEBUG << "Try to init zhandle";
     m_zhandle = zookeeper_init(m_zk_urls.c_str(), 
@@ -140,12 +231,18 @@ void Zookeeper::close()
     uv_stop(m_loop);
     uv_async_send(&m_exit_handle);
 
-    ScopedLock lk(m_zhandle_mutex);
-    if (NULL != m_zhandle) {
-        zookeeper_close(m_zhandle);
+    zhandle_t *zhandle = NULL;
+    {
+        ScopedLock lk(m_zhandle_mutex);
+        zhandle = m_zhandle;
         m_zhandle = NULL;
     }
 
+    /* closing waits for completions, which may take the mutex */
+    if (NULL != zhandle) {
+        zookeeper_close(zhandle);
+    }
+
     if (NULL != m_zk_log_fp) {
         fclose(m_zk_log_fp); 
         m_zk_log_fp = NULL;
@@ -173,222 +270,525 @@ void Zookeeper::refresh(void *arg)
         return;
     }
 
-    if (!zookeeper->refreshBrokerUrls()) {
-        LERROR << "Fail to refresh broker urls";
-    }
+    /* setting watches and the client znode and reading broker urls 
+     * and log config are all pipelined, so the refresh takes about 
+     * two round trips however many brokers */
+    ZnodeRefresh *watchers = zookeeper->refreshWatchers();
+    ZnodeRefresh *broker_urls = zookeeper->refreshBrokerUrls();
+    ZnodeRefresh *log_config = zookeeper->refreshLogConfig();
 
-    if (!zookeeper->refreshWatchers()) {
+    if (!watchers->wait()) {
         LERROR << "Fail to refresh zookeeper watchers";
     }
 
-    if (!zookeeper->refreshLogConfig()) {
+    if (!broker_urls->wait()) {
+        LERROR << "Fail to refresh broker urls";
+    }
+
+    if (!log_config->wait()) {
         LERROR << "Fail to refresh log config";
     }
+
+    watchers->unref();
+    broker_urls->unref();
+    log_config->unref();
 }/*}}}*/
 
 bool Zookeeper::refreshConnection()
 {/*{{{*/
-    ScopedLock l(m_zhandle_mutex);
+    zhandle_t *lost = NULL;
+    bool connected = true;
+    {
+        ScopedLock l(m_zhandle_mutex);
+
+        /* the client reconnects by itself within the session, only a 
+         * session lost for good needs a new handle */
+        int state = zoo_state(m_zhandle);
+        if (NULL != m_zhandle && ZOO_EXPIRED_SESSION_STATE != state
+                && ZOO_AUTH_FAILED_STATE != state) {
+            return true;
+        }
 
-    int res = zoo_state(m_zhandle);
-    if (NULL == m_zhandle || ZOK != res) {
+        lost = m_zhandle;
+        m_zhandle = NULL;
         if (!connect()) {
             LERROR << "Fail to reset zookeeper connection";
-            return false;
+            connected = false;
         }
     }
 
-    return true;
+    /* closing waits for completions, which may take the mutex */
+    if (NULL != lost) {
+        LINFO << "Close invaild zookeeper connection...";
+        zookeeper_close(lost);
+    }
+
+    return connected;
 }/*}}}*/
 
-bool Zookeeper::refreshWatchers()
+ZnodeRefresh *Zookeeper::refreshWatchers()
 {/*{{{*/
     ScopedLock l(m_zhandle_mutex);
 
-    /* set config change watcher */
-    if (!setWatcher(m_config_path, configChangeWatcher, (void*)this)) {
-        LERROR << "Fail to set config change watcher";
-        return false;
+    ZnodeRefresh *refresh = new ZnodeRefresh(m_zhandle, 
+            __sync_add_and_fetch(&m_refresh_seq, 1), applyWatchers, this);
+    /* held while issuing, so that it does not finish before */
+    refresh->addPending(1);
+
+    if (NULL == m_zhandle) {
+        refresh->done(false);
+        return refresh;
     }
 
-    /* set broker change watcher */
-    if (!setChildrenWatcher(BROKER_IDS_PATH, brokerChangeWatcher, (void*)this)) {
-        LERROR << "Fail to set broker change watcher";
-        return false;
+    /* set config change watcher, unless it is still set */
+    if (__sync_bool_compare_and_swap(&m_config_watch_armed, 0, 1)) {
+        ensurePathExist(m_zhandle, m_config_path);
+
+        refresh->addPending(1);
+        refresh->ref();
+        int ret = zoo_awget(m_zhandle, m_config_path.c_str(), 
+                configChangeWatcher, (void*)this, 
+                onConfigWatchComplete, refresh);
+        if (ZOK != ret) {
+            LERROR << "Fail to set config change watcher, " << zerror(ret);
+            __sync_lock_test_and_set(&m_config_watch_armed, 0);
+            refresh->done(false);
+            refresh->unref();
+        }
     }
 
-    /* create EPHEMERAL node for checking whether logkafka is alive */
-    ensurePathExist(m_client_path);    
-    /* if lost connection to zk and reconnect to it, this ephemeral node may still exist */
-    zoo_delete(m_zhandle, m_client_path.c_str(), -1);
-    if (zoo_create(m_zhandle, m_client_path.c_str(), NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 
-                ZOO_EPHEMERAL, NULL, 0) != ZOK)
-    {
-        LERROR << "Fail to create zookeeper path, " << m_client_path;
-        return false;
+    /* set broker change watcher, unless it is still set */
+    if (__sync_bool_compare_and_swap(&m_brokers_watch_armed, 0, 1)) {
+        ensurePathExist(m_zhandle, BROKER_IDS_PATH);
+
+        refresh->addPending(1);
+        refresh->ref();
+        int ret = zoo_awget_children(m_zhandle, BROKER_IDS_PATH.c_str(), 
+                brokerChangeWatcher, (void*)this, 
+                onBrokersWatchComplete, refresh);
+        if (ZOK != ret) {
+            LERROR << "Fail to set broker change watcher, " << zerror(ret);
+            __sync_lock_test_and_set(&m_brokers_watch_armed, 0);
+            refresh->done(false);
+            refresh->unref();
+        }
     }
 
-    return true;
+    /* the client znode of this session is kept, creating it again 
+     * would have all collecting state written again */
+    refresh->addPending(1);
+    refresh->ref();
+    int ret = zoo_aexists(m_zhandle, m_client_path.c_str(), 0, 
+            onClientExistsComplete, refresh);
+    if (ZOK != ret) {
+        LERROR << "Fail to check znode, " << zerror(ret) 
+               << ", path: " << m_client_path;
+        refresh->done(false);
+        refresh->unref();
+    }
+
+    refresh->done(true);
+    return refresh;
 }/*}}}*/
 
-bool Zookeeper::refreshLogConfig()
+void Zookeeper::onConfigWatchComplete(int rc, const char *value, 
+        int value_len, const struct Stat *stat, const void *data)
 {/*{{{*/
-    ScopedLock l(m_log_config_mutex);
+    ZnodeRefresh *refresh = (ZnodeRefresh *)data;
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
 
-    string log_config;
-    if (!getZnodeData(m_config_path, log_config)) {
-        LERROR << "Fail to get log config";
-        return false;
+    if (ZOK != rc) {
+        LWARNING << "set watcher failed: " << zookeeper->m_config_path
+                 << ", " << zerror(rc);
+        __sync_lock_test_and_set(&zookeeper->m_config_watch_armed, 0);
     }
 
-    m_log_config = log_config;
+    refresh->done(ZOK == rc);
+    refresh->unref();
+}/*}}}*/
 
-    return true;
+void Zookeeper::onBrokersWatchComplete(int rc, 
+        const struct String_vector *strings, const void *data)
+{/*{{{*/
+    ZnodeRefresh *refresh = (ZnodeRefresh *)data;
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
+
+    if (ZOK != rc) {
+        LWARNING << "set children watcher failed: " << BROKER_IDS_PATH
+                 << ", " << zerror(rc);
+        __sync_lock_test_and_set(&zookeeper->m_brokers_watch_armed, 0);
+    }
+
+    refresh->done(ZOK == rc);
+    refresh->unref();
 }/*}}}*/
 
-bool Zookeeper::refreshBrokerUrls()
+void Zookeeper::onClientExistsComplete(int rc, 
+        const struct Stat *stat, const void *data)
 {/*{{{*/
-    ScopedLock l(m_broker_urls_mutex);
+    ZnodeRefresh *refresh = (ZnodeRefresh *)data;
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
+    const string &path = zookeeper->m_client_path;
 
-    vector<string> ids;
-    if (!getBrokerIds(ids)) {
-        return false;
+    if (ZOK == rc && isOwnEphemeral(stat, zoo_client_id(refresh->m_zhandle))) {
+        refresh->done(true);
+        refresh->unref();
+        return;
     }
 
-    vector<string>::const_iterator iter;
-    for (iter = ids.begin(); iter != ids.end(); ++iter) {
-        string host, port;
-        string bid = *iter; 
-        if (!getBrokerIpAndPort(bid, host, port)) {
-            return false;
-        }
+    if (ZOK != rc && ZNONODE != rc) {
+        LERROR << "Fail to check znode, " << zerror(rc) << ", path: " << path;
+        refresh->done(false);
+        refresh->unref();
+        return;
+    }
 
-        if (iter != ids.begin()) {
-            m_broker_urls.append(",");
-        }
+    /* create EPHEMERAL node for checking whether logkafka is alive,
+     * requests of the session are processed in order */
+    ensurePathExist(refresh->m_zhandle, path.substr(0, path.rfind('/')));
+    if (ZOK == rc) {
+        /* if lost connection to zk and reconnect to it, the ephemeral 
+         * node of the session before may still exist */
+        zoo_adelete(refresh->m_zhandle, path.c_str(), -1, 
+                onClientDeleteComplete, NULL);
+    }
 
-        m_broker_urls.append(host);
-        m_broker_urls.append(":");
-        m_broker_urls.append(port);
+    int ret = zoo_acreate(refresh->m_zhandle, path.c_str(), NULL, 0, 
+            &ZOO_OPEN_ACL_UNSAFE, ZOO_EPHEMERAL, 
+            onClientCreateComplete, refresh);
+    if (ZOK != ret) {
+        LERROR << "Fail to create zookeeper path, " << path 
+               << ", " << zerror(ret);
+        refresh->done(false);
+        refresh->unref();
+        return;
     }
 
+    /* shards of large collecting state are EPHEMERAL children of it */
+    ensurePathExist(refresh->m_zhandle, zookeeper->m_client_shards_path);
+}/*}}}*/
+
+void Zookeeper::onClientDeleteComplete(int rc, const void *data)
+{/*{{{*/
+    if (ZOK != rc && ZNONODE != rc) {
+        LWARNING << "Fail to delete client znode, " << zerror(rc);
+    }
+}/*}}}*/
+
+void Zookeeper::onClientCreateComplete(int rc, 
+        const char *value, const void *data)
+{/*{{{*/
+    ZnodeRefresh *refresh = (ZnodeRefresh *)data;
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
+
+    if (ZOK == rc) {
+        __sync_add_and_fetch(&zookeeper->m_client_epoch, 1);
+    } else if (ZNODEEXISTS != rc) {
+        /* an existing one is created by a refresh racing with this, or
+         * is checked again on the next refresh */
+        LERROR << "Fail to create zookeeper path, " 
+               << zookeeper->m_client_path << ", " << zerror(rc);
+    }
+
+    refresh->done(ZOK == rc || ZNODEEXISTS == rc);
+    refresh->unref();
+}/*}}}*/
+
+bool Zookeeper::applyWatchers(ZnodeRefresh *refresh)
+{/*{{{*/
+    /* watches and the client znode are set by the completions */
     return true;
 }/*}}}*/
 
-string Zookeeper::getLogConfig()
+bool Zookeeper::isOwnEphemeral(const struct Stat *stat, 
+        const clientid_t *client_id)
 {/*{{{*/
-    ScopedLock l(m_log_config_mutex);
-    return m_log_config;
+    return NULL != stat && NULL != client_id 
+        && 0 != stat->ephemeralOwner
+        && stat->ephemeralOwner == client_id->client_id;
 }/*}}}*/
 
-bool Zookeeper::ensurePathExist(const string& path)
+ZnodeRefresh *Zookeeper::refreshLogConfig()
 {/*{{{*/
+    ScopedLock l(m_zhandle_mutex);
+
+    ZnodeRefresh *refresh = new ZnodeRefresh(m_zhandle, 
+            __sync_add_and_fetch(&m_refresh_seq, 1), applyLogConfig, this);
+    refresh->m_values.resize(1);
+    refresh->addPending(1);
+
     if (NULL == m_zhandle) {
-        return false;
+        refresh->done(false);
+        return refresh;
     }
 
-    if (ZOK == zoo_exists(m_zhandle, path.c_str(), 0, NULL)) {
-        return true;
+    ZnodeRead *read = new ZnodeRead();
+    read->refresh = refresh;
+    read->index = 0;
+    refresh->ref();
+
+    int ret = zoo_aget(m_zhandle, m_config_path.c_str(), 0, 
+            onLogConfigComplete, read);
+    if (ZOK != ret) {
+        LERROR << "Fail to get znode, " << zerror(ret) 
+               << ", path: " << m_config_path;
+        delete read;
+        refresh->done(false);
+        refresh->unref();
     }
 
-    size_t start_pos = 1;
-    size_t pos = 0;
-    while ((pos = path.find('/', start_pos)) != string::npos) {
-        string parent_path = path.substr(0, pos);
-        start_pos = pos+1;
-        zoo_create(m_zhandle, parent_path.c_str(), NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+    return refresh;
+}/*}}}*/
+
+void Zookeeper::onLogConfigComplete(int rc, const char *value, 
+        int value_len, const struct Stat *stat, const void *data)
+{/*{{{*/
+    ZnodeRead *read = (ZnodeRead *)data;
+    ZnodeRefresh *refresh = read->refresh;
+    delete read;
+
+    bool success = (ZOK == rc);
+    if (success) {
+        if (NULL != value && value_len > 0) {
+            refresh->m_values[0].assign(value, value_len);
+        }
+        refresh->m_version = stat->mzxid;
+    } else {
+        LERROR << "Fail to get log config, " << zerror(rc);
     }
 
-    int ret = zoo_create(m_zhandle, path.c_str(), NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
-    if (ret != ZOK && ret != ZNODEEXISTS) {
-        LERROR << "create znode failed: " << path.c_str()
-               << ", error: " << errno2String(ret);
-        return false;
+    refresh->done(success);
+    refresh->unref();
+}/*}}}*/
+
+bool Zookeeper::applyLogConfig(ZnodeRefresh *refresh)
+{/*{{{*/
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
+
+    bool changed = false;
+    {
+        ScopedLock l(zookeeper->m_log_config_mutex);
+
+        /* a newer refresh completed first */
+        if (refresh->m_seq < zookeeper->m_log_config_seq) {
+            return true;
+        }
+        zookeeper->m_log_config_seq = refresh->m_seq;
+
+        changed = (refresh->m_version != zookeeper->m_log_config_version);
+        zookeeper->m_log_config = refresh->m_values[0];
+        zookeeper->m_log_config_version = refresh->m_version;
+    }
+
+    if (changed) {
+        ScopedLock l(zookeeper->m_config_change_mutex);
+        if (NULL != zookeeper->m_config_change_cb_func) {
+            (*zookeeper->m_config_change_cb_func)(
+                    zookeeper->m_config_change_cb_func_arg);
+        }
     }
 
     return true;
 }/*}}}*/
 
-bool Zookeeper::getZnodeData(const string& path, string &data)
+void Zookeeper::setConfigChangeCallback(ConfigChangeFunc func, void *arg)
+{/*{{{*/
+    /* once it returns, the previous callback is no longer running */
+    ScopedLock l(m_config_change_mutex);
+    m_config_change_cb_func = func;
+    m_config_change_cb_func_arg = arg;
+}/*}}}*/
+
+void Zookeeper::setBrokersChangeCallback(ConfigChangeFunc func, void *arg)
+{/*{{{*/
+    /* once it returns, the previous callback is no longer running */
+    ScopedLock l(m_brokers_change_mutex);
+    m_brokers_change_cb_func = func;
+    m_brokers_change_cb_func_arg = arg;
+}/*}}}*/
+
+ZnodeRefresh *Zookeeper::refreshBrokerUrls()
 {/*{{{*/
+    ScopedLock l(m_zhandle_mutex);
+
+    ZnodeRefresh *refresh = new ZnodeRefresh(m_zhandle, 
+            __sync_add_and_fetch(&m_refresh_seq, 1), applyBrokerUrls, this);
+    refresh->addPending(1);
+
     if (NULL == m_zhandle) {
-        return false;
+        refresh->done(false);
+        return refresh;
     }
 
-    struct Stat stat;
-    int status = ZOK;
-    int len = 0;
-    bool ret = false; 
-    char *buf = NULL;
+    refresh->ref();
+    int ret = zoo_aget_children(m_zhandle, BROKER_IDS_PATH.c_str(), 0, 
+            onBrokerIdsComplete, refresh);
+    if (ZOK != ret) {
+        LERROR << "Fail to get children, " << zerror(ret)
+               << ", path: " << BROKER_IDS_PATH;
+        refresh->done(false);
+        refresh->unref();
+    }
 
-    status = zoo_exists(m_zhandle, path.c_str(), 0, &stat);
-    len = (status == ZOK) ? stat.dataLength : ZNODE_BUF_MAX_LEN;
+    return refresh;
+}/*}}}*/
 
-    buf = (char *)malloc(len + 1);
-    bzero(buf, len + 1);
-    status = zoo_get(m_zhandle, path.c_str(), 0, buf, &len, NULL);
-    if (status == ZOK) {
-        data = string(buf);
-        ret = true;
-    } else {
-        LERROR << "get znode error"
-               << ", path: " << path 
-               << ", error:%s" << errno2String(status);
+void Zookeeper::onBrokerIdsComplete(int rc, 
+        const struct String_vector *strings, const void *data)
+{/*{{{*/
+    ZnodeRefresh *refresh = (ZnodeRefresh *)data;
+
+    if (ZOK != rc || NULL == strings || 0 == strings->count) {
+        LERROR << "Fail to get broker ids, " << zerror(rc);
+        refresh->done(false);
+        refresh->unref();
+        return;
     }
-    free(buf);
 
-    return ret;
+    /* read all broker infos at once, the last completion applies them */
+    refresh->m_values.resize(strings->count);
+    refresh->addPending(strings->count);
+    for (int i = 0; i < strings->count; ++i) {
+        string path = BROKER_IDS_PATH + "/" + strings->data[i];
+
+        ZnodeRead *read = new ZnodeRead();
+        read->refresh = refresh;
+        read->index = i;
+        refresh->ref();
+
+        int ret = zoo_aget(refresh->m_zhandle, path.c_str(), 0, 
+                onBrokerInfoComplete, read);
+        if (ZOK != ret) {
+            LERROR << "Fail to get znode, " << zerror(ret) 
+                   << ", path: " << path;
+            delete read;
+            refresh->done(false);
+            refresh->unref();
+        }
+    }
+
+    /* the read of broker ids */
+    refresh->done(true);
+    refresh->unref();
 }/*}}}*/
 
-bool Zookeeper::setWatcher(const string& path, 
-        watcher_fn watcher, void *wctx)
+void Zookeeper::onBrokerInfoComplete(int rc, const char *value, 
+        int value_len, const struct Stat *stat, const void *data)
 {/*{{{*/
-    LINFO << "try to set watcher " << path.c_str();
+    ZnodeRead *read = (ZnodeRead *)data;
+    ZnodeRefresh *refresh = read->refresh;
+    size_t index = read->index;
+    delete read;
+
+    bool success = (ZOK == rc);
+    if (!success) {
+        LERROR << "Fail to get broker info, " << zerror(rc);
+    } else if (!parseBrokerInfo(value, value_len, refresh->m_values[index])) {
+        LERROR << "Fail to parse broker info";
+        success = false;
+    }
 
-    if (NULL == m_zhandle) {
-        LERROR << "zhandle is NULL";
-        return false; 
+    refresh->done(success);
+    refresh->unref();
+}/*}}}*/
+
+bool Zookeeper::applyBrokerUrls(ZnodeRefresh *refresh)
+{/*{{{*/
+    Zookeeper *zookeeper = (Zookeeper *)refresh->m_apply_func_arg;
+
+    string broker_urls;
+    for (vector<string>::const_iterator iter = refresh->m_values.begin();
+            iter != refresh->m_values.end(); ++iter) {
+        if (iter != refresh->m_values.begin()) {
+            broker_urls.append(",");
+        }
+        broker_urls.append(*iter);
     }
 
-    if (!ensurePathExist(path))
+    bool changed = false;
     {
-        LERROR << "create znode " << path;
-        return false;
+        ScopedLock l(zookeeper->m_broker_urls_mutex);
+
+        /* a newer refresh completed first */
+        if (refresh->m_seq < zookeeper->m_broker_urls_seq) {
+            return true;
+        }
+        zookeeper->m_broker_urls_seq = refresh->m_seq;
+
+        changed = (broker_urls != zookeeper->m_broker_urls);
+        if (changed) {
+            zookeeper->m_broker_urls = broker_urls;
+            ++zookeeper->m_broker_urls_version;
+            LINFO << "Broker urls changed to " << broker_urls
+                  << ", version " << zookeeper->m_broker_urls_version;
+        }
     }
-    int len = 0;
-    int ret;
-    if (ZOK != (ret = zoo_wget(m_zhandle, path.c_str(), watcher, wctx, NULL, &len, NULL)))
-    {
-        LWARNING << "set watcher failed: " << path;
-        return false;
+
+    if (changed) {
+        ScopedLock l(zookeeper->m_brokers_change_mutex);
+        if (NULL != zookeeper->m_brokers_change_cb_func) {
+            (*zookeeper->m_brokers_change_cb_func)(
+                    zookeeper->m_brokers_change_cb_func_arg);
+        }
     }
-    LINFO << "set watcher success: " << path.c_str();
+
     return true;
 }/*}}}*/
 
-bool Zookeeper::setChildrenWatcher(const string& path, 
-        watcher_fn watcher, void *wctx)
+string Zookeeper::getLogConfig(int64_t *version)
 {/*{{{*/
-    LINFO << "try to set children watcher " << path.c_str();
-
-    if (NULL == m_zhandle) {
-        return false; 
+    ScopedLock l(m_log_config_mutex);
+    if (NULL != version) {
+        *version = m_log_config_version;
     }
 
-    if (!ensurePathExist(path)) {
-        LERROR << "Create znode " << path.c_str();
+    return m_log_config;
+}/*}}}*/
+
+int64_t Zookeeper::getLogConfigVersion()
+{/*{{{*/
+    ScopedLock l(m_log_config_mutex);
+    return m_log_config_version;
+}/*}}}*/
+
+bool Zookeeper::ensurePathExist(zhandle_t *zhandle, const string& path)
+{/*{{{*/
+    if (NULL == zhandle) {
         return false;
     }
 
-    int ret = ZOK;
-    if (ZOK != (ret = zoo_wget_children(m_zhandle, path.c_str(), watcher, wctx, NULL))) {
-        LWARNING << "set children watcher failed: " << path.c_str();
-        return false;
+    /* parents first, existing ones fail with ZNODEEXISTS */
+    size_t pos = 0;
+    while (pos != string::npos) {
+        pos = path.find('/', pos + 1);
+
+        string *create_path = new string(path.substr(0, pos));
+        int ret = zoo_acreate(zhandle, create_path->c_str(), NULL, 0, 
+                &ZOO_OPEN_ACL_UNSAFE, 0, onEnsurePathComplete, create_path);
+        if (ZOK != ret) {
+            LERROR << "create znode failed: " << *create_path
+                   << ", error: " << errno2String(ret);
+            delete create_path;
+            return false;
+        }
     }
-    LINFO << "set children watcher success: " << path.c_str();
+
     return true;
 }/*}}}*/
 
+void Zookeeper::onEnsurePathComplete(int rc, 
+        const char *value, const void *data)
+{/*{{{*/
+    const string *path = (const string *)data;
+
+    if (ZOK != rc && ZNODEEXISTS != rc) {
+        LERROR << "create znode failed: " << *path
+               << ", error: " << errno2String(rc);
+    }
+
+    delete path;
+}/*}}}*/
+
 const char* Zookeeper::state2String(int state)
 {/*{{{*/
     if (state == 0)
@@ -516,10 +916,15 @@ void Zookeeper::brokerChangeWatcher(zhandle_t* zhandle, int type,
 
     Zookeeper *zookeeper = reinterpret_cast<Zookeeper *>(context);
 
-    zookeeper->refreshWatchers();
+    /* the watch fired, or is lost with the session */
+    if (type != ZOO_SESSION_EVENT || state == ZOO_EXPIRED_SESSION_STATE) {
+        __sync_lock_test_and_set(&zookeeper->m_brokers_watch_armed, 0);
+    }
 
+    /* never wait in watchers, completions run in this thread */
+    zookeeper->refreshWatchers()->unref();
     if (type != ZOO_SESSION_EVENT) { 
-        zookeeper->refreshBrokerUrls();
+        zookeeper->refreshBrokerUrls()->unref();
     }
 }/*}}}*/
 
@@ -537,48 +942,25 @@ void Zookeeper::configChangeWatcher(zhandle_t* zhandle, int type,
 
     Zookeeper *zookeeper = reinterpret_cast<Zookeeper *>(context);
 
-    zookeeper->refreshWatchers();
-
-    if (type != ZOO_SESSION_EVENT) { 
-        zookeeper->refreshLogConfig();
-    }
-}/*}}}*/
-
-bool Zookeeper::getBrokerIds(vector<string>& ids)
-{/*{{{*/
-    if (NULL == m_zhandle) {
-        return false; 
+    /* the watch fired, or is lost with the session */
+    if (type != ZOO_SESSION_EVENT || state == ZOO_EXPIRED_SESSION_STATE) {
+        __sync_lock_test_and_set(&zookeeper->m_config_watch_armed, 0);
     }
 
-    struct String_vector brokerids;
-
-    int ret = zoo_get_children(m_zhandle, BROKER_IDS_PATH.c_str(), 0, &brokerids);
-    if (ret != ZOK) {
-        LERROR << "Get children error"
-               << ", path: " << BROKER_IDS_PATH
-               << ", error: " << errno2String(ret);
-
-        return false;
-    } else {
-        ids.clear();
-        for (int i = 0; i < brokerids.count; ++i)
-        {
-            ids.push_back(brokerids.data[i]);
-        }
-        deallocate_String_vector(&brokerids);
-        return true;
+    /* never wait in watchers, completions run in this thread */
+    zookeeper->refreshWatchers()->unref();
+    if (type != ZOO_SESSION_EVENT) { 
+        zookeeper->refreshLogConfig()->unref();
     }
 }/*}}}*/
 
-bool Zookeeper::getBrokerIpAndPort(const string& brokerid, 
-        string& host, string& port)
+bool Zookeeper::parseBrokerInfo(const char *buf, int buflen, string &url)
 {/*{{{*/
-    string brokerid_info_path = BROKER_IDS_PATH + "/" + brokerid;
-    string brokerinfo;
-    if (!getZnodeData(brokerid_info_path, brokerinfo)) {
-        LERROR << "Fail to get broker info";
+    if (NULL == buf || buflen <= 0) {
+        LERROR << "Broker info is empty";
         return false;
     }
+    string brokerinfo(buf, buflen);
 
     /* 1. Parse a JSON text string to a document. */
     Document document;
@@ -594,11 +976,12 @@ bool Zookeeper::getBrokerIpAndPort(const string& brokerid,
     }
 
     try {
+        string host;
         Json::getValue(document, "host", host);
 
         int port_int;
         Json::getValue(document, "port", port_int);
-        port = int2Str(port_int);
+        url = host + ":" + int2Str(port_int);
     } catch (const JsonErr &err) {
         LERROR << "Json error: " << err;
         return false;
@@ -607,14 +990,24 @@ bool Zookeeper::getBrokerIpAndPort(const string& brokerid,
     return true;
 }/*}}}*/
 
-string Zookeeper::getBrokerUrls()
+string Zookeeper::getBrokerUrls(int64_t *version)
 {/*{{{*/
     ScopedLock l(m_broker_urls_mutex);
+    if (NULL != version) {
+        *version = m_broker_urls_version;
+    }
+
     return m_broker_urls;
 }/*}}}*/
 
-bool Zookeeper::setLogState( const char *buf, int buflen,
-        stat_completion_t completion)
+int64_t Zookeeper::getBrokerUrlsVersion()
+{/*{{{*/
+    ScopedLock l(m_broker_urls_mutex);
+    return m_broker_urls_version;
+}/*}}}*/
+
+bool Zookeeper::setLogState(const char *buf, int buflen, long shard,
+        StateCompletionFunc completion, const void *data)
 {/*{{{*/
     ScopedLock l(m_zhandle_mutex);
 
@@ -623,27 +1016,124 @@ bool Zookeeper::setLogState( const char *buf, int buflen,
         return false;
     }
 
-    int ret = ZOK;
-    const char *client_path = m_client_path.c_str();
-    char *path = strndup(client_path, strlen(client_path));
-    if (NULL == path) {
-        LERROR << "Fail to strndup path " << client_path;
-        return false;
+    LogStateContext *ctx = new LogStateContext();
+    ctx->zhandle = m_zhandle;
+    ctx->path = getLogStatePath(shard);
+    ctx->create = (shard >= 0);
+    if (ctx->create) {
+        /* kept for creating the shard if it does not exist */
+        ctx->buf.assign(buf, buflen);
     }
+    ctx->completion = completion;
+    ctx->data = data;
 
     /* NOTE: use zookeeper async set for not blocking the main loop */
-    if ((ret = zoo_aset(m_zhandle, client_path, buf, buflen,
-                    -1, completion, path)) != ZOK)
+    int ret = ZOK;
+    if ((ret = zoo_aset(m_zhandle, ctx->path.c_str(), buf, buflen,
+                    -1, onSetLogStateComplete, ctx)) != ZOK)
     {
         LERROR << "Fail to set znode, " << zerror(ret)
-               << ", path: " << path
-               << ", buf: " << buf
+               << ", path: " << ctx->path
                << ", buflen: " << buflen;
-        free(path);
+        delete ctx;
         return false;
     }
 
     return true;
 }/*}}}*/
 
+bool Zookeeper::deleteLogState(long shard, 
+        StateCompletionFunc completion, const void *data)
+{/*{{{*/
+    ScopedLock l(m_zhandle_mutex);
+
+    if (NULL == m_zhandle) {
+        LWARNING << "zhandle is NULL";
+        return false;
+    }
+
+    LogStateContext *ctx = new LogStateContext();
+    ctx->zhandle = m_zhandle;
+    ctx->path = getLogStatePath(shard);
+    ctx->create = false;
+    ctx->completion = completion;
+    ctx->data = data;
+
+    int ret = ZOK;
+    if ((ret = zoo_adelete(m_zhandle, ctx->path.c_str(), -1, 
+                    onDeleteLogStateComplete, ctx)) != ZOK)
+    {
+        LERROR << "Fail to delete znode, " << zerror(ret)
+               << ", path: " << ctx->path;
+        delete ctx;
+        return false;
+    }
+
+    return true;
+}/*}}}*/
+
+unsigned long Zookeeper::getClientEpoch()
+{/*{{{*/
+    return __sync_add_and_fetch(&m_client_epoch, 0);
+}/*}}}*/
+
+string Zookeeper::getLogStatePath(long shard)
+{/*{{{*/
+    if (shard < 0) {
+        return m_client_path;
+    }
+
+    return m_client_shards_path + "/" + int2Str(shard);
+}/*}}}*/
+
+void Zookeeper::onSetLogStateComplete(int rc, 
+        const struct Stat *stat, const void *data)
+{/*{{{*/
+    LogStateContext *ctx = (LogStateContext *)data;
+
+    if (ZNONODE == rc && ctx->create) {
+        /* zookeeper_close waits for this callback, so the handle 
+         * is still valid here */
+        ctx->create = false;
+        rc = zoo_acreate(ctx->zhandle, ctx->path.c_str(), 
+                ctx->buf.data(), ctx->buf.length(), &ZOO_OPEN_ACL_UNSAFE, 
+                ZOO_EPHEMERAL, onCreateLogStateComplete, ctx);
+        if (ZOK == rc) return;
+    }
+
+    if (ZOK != rc) {
+        LERROR << "Fail to set zk path " << ctx->path << ", " << zerror(rc);
+    }
+
+    ctx->completion(rc, ctx->data);
+    delete ctx;
+}/*}}}*/
+
+void Zookeeper::onCreateLogStateComplete(int rc, 
+        const char *value, const void *data)
+{/*{{{*/
+    LogStateContext *ctx = (LogStateContext *)data;
+
+    if (ZOK != rc) {
+        LERROR << "Fail to create zk path " << ctx->path << ", " << zerror(rc);
+    }
+
+    ctx->completion(rc, ctx->data);
+    delete ctx;
+}/*}}}*/
+
+void Zookeeper::onDeleteLogStateComplete(int rc, const void *data)
+{/*{{{*/
+    LogStateContext *ctx = (LogStateContext *)data;
+
+    if (ZNONODE == rc) {
+        rc = ZOK;
+    } else if (ZOK != rc) {
+        LERROR << "Fail to delete zk path " << ctx->path << ", " << zerror(rc);
+    }
+
+    ctx->completion(rc, ctx->data);
+    delete ctx;
+}/*}}}*/
+
 } // namespace logkafka
@@ -31,6 +31,7 @@
 #include "base/scoped_lock.h"
 #include "base/timer_watcher.h"
 #include "logkafka/common.h"
+#include "logkafka/config_source.h"
 
 #include <zookeeper/zookeeper.h>
 
@@ -41,7 +42,59 @@ using namespace base;
 
 namespace logkafka {
 
-class Zookeeper
+class ZnodeRefresh;
+typedef bool (*RefreshApplyFunc)(ZnodeRefresh *);
+
+/* Fan-in of pipelined asynchronous znode reads. Each read stores its 
+ * result into values and calls done(), the last one applies them to 
+ * the cache with apply_func in zookeeper completion thread */
+class ZnodeRefresh
+{
+    public:
+        ZnodeRefresh(zhandle_t *zhandle, int64_t seq, 
+                RefreshApplyFunc apply_func, void *apply_func_arg);
+
+        void ref();
+        void unref();
+
+        void addPending(int n);
+        void done(bool success);
+
+        /* waits until applied, must not be called in zookeeper 
+         * completion thread, i.e. in watchers */
+        bool wait();
+
+    public:
+        /* valid in completions, zookeeper_close waits for them */
+        zhandle_t *m_zhandle;
+        int64_t m_seq;
+        void *m_apply_func_arg;
+
+        vector<string> m_values;
+        int64_t m_version;
+
+    private:
+        ~ZnodeRefresh();
+
+    private:
+        RefreshApplyFunc m_apply_func;
+
+        volatile int m_refs;
+        Mutex m_mutex;
+        pthread_cond_t m_cond;
+        int m_pending;
+        bool m_failed;
+        bool m_finished;
+};
+
+/* one read of a refresh */
+struct ZnodeRead
+{
+    ZnodeRefresh *refresh;
+    size_t index;
+};
+
+class Zookeeper: public ConfigSource
 {
     public:
         Zookeeper();
@@ -50,33 +103,69 @@ class Zookeeper
         bool init(const string &zk_urls, 
                 long refresh_interval = REFRESH_INTERVAL_MS);
 
-        string getBrokerUrls();
-        string getLogConfig();
+        string getBrokerUrls(int64_t *version = NULL);
+        int64_t getBrokerUrlsVersion();
+        string getLogConfig(int64_t *version = NULL);
+        int64_t getLogConfigVersion();
+
+        /* callbacks are called in zookeeper thread */
+        void setConfigChangeCallback(ConfigChangeFunc func, void *arg);
+        void setBrokersChangeCallback(ConfigChangeFunc func, void *arg);
+
+        /* shards are EPHEMERAL znodes created when they do not exist */
+        bool setLogState(const char *buf, int buflen, long shard,
+                StateCompletionFunc completion, const void *data);
+        bool deleteLogState(long shard, 
+                StateCompletionFunc completion, const void *data);
+
+        /* changes whenever the client znode is created again */
+        unsigned long getClientEpoch();
 
-        bool setLogState(const char *buf, int buflen,
-                stat_completion_t completion);
         void close();
 
     private:
         bool connect();
         void closeLoop();
 
-        bool ensurePathExist(const string& path);
-        bool getZnodeData(const string& path, string &data);
-        bool getBrokerIds(vector<string>& ids);
-        bool getBrokerIpAndPort(const string& brokerid, 
-                string& host, string& port);
+        /* creates the path and its parents asynchronously, requests 
+         * issued later in the session see them */
+        static bool ensurePathExist(zhandle_t *zhandle, const string& path);
+        static void onEnsurePathComplete(int rc, 
+                const char *value, const void *data);
+        static bool parseBrokerInfo(const char *buf, int buflen, 
+                string &url);
 
         static void refresh(void *arg);
         bool refreshConnection();
-        bool refreshWatchers();
-        bool refreshLogConfig();
-        bool refreshBrokerUrls();
-
-        bool setWatcher(const string& path, 
-                watcher_fn watcher, void *wctx);
-        bool setChildrenWatcher(const string& path, 
-                watcher_fn watcher, void *wctx);
+        /* whether the znode is an ephemeral one of the session */
+        static bool isOwnEphemeral(const struct Stat *stat, 
+                const clientid_t *client_id);
+
+        /* read asynchronously and return at once, the returned refresh
+         * has to be unref'd, wait() on it for the result */
+        ZnodeRefresh *refreshWatchers();
+        ZnodeRefresh *refreshLogConfig();
+        ZnodeRefresh *refreshBrokerUrls();
+
+        static void onLogConfigComplete(int rc, const char *value, 
+                int value_len, const struct Stat *stat, const void *data);
+        static void onBrokerIdsComplete(int rc, 
+                const struct String_vector *strings, const void *data);
+        static void onBrokerInfoComplete(int rc, const char *value, 
+                int value_len, const struct Stat *stat, const void *data);
+        static bool applyLogConfig(ZnodeRefresh *refresh);
+        static bool applyBrokerUrls(ZnodeRefresh *refresh);
+
+        static void onConfigWatchComplete(int rc, const char *value, 
+                int value_len, const struct Stat *stat, const void *data);
+        static void onBrokersWatchComplete(int rc, 
+                const struct String_vector *strings, const void *data);
+        static void onClientExistsComplete(int rc, 
+                const struct Stat *stat, const void *data);
+        static void onClientDeleteComplete(int rc, const void *data);
+        static void onClientCreateComplete(int rc, 
+                const char *value, const void *data);
+        static bool applyWatchers(ZnodeRefresh *refresh);
 
         static void globalWatcher(zhandle_t* zhandle, int type, 
                 int state, const char* path, void* context);
@@ -89,6 +178,13 @@ class Zookeeper
         static const char* event2String(int event);
         static const char* errno2String(int errnum);
 
+        string getLogStatePath(long shard);
+        static void onSetLogStateComplete(int rc, 
+                const struct Stat *stat, const void *data);
+        static void onCreateLogStateComplete(int rc, 
+                const char *value, const void *data);
+        static void onDeleteLogStateComplete(int rc, const void *data);
+
         static void threadFunc(void *arg);
         static void exitAsyncCb(uv_async_t* handle);
 
@@ -96,9 +192,24 @@ class Zookeeper
         string m_zk_urls;
         string m_hostname;
         string m_log_config;
+        /* mzxid of the config znode, it changes on every modification 
+         * and never goes back even if the znode is recreated */
+        int64_t m_log_config_version;
         string m_broker_urls;
+        int64_t m_broker_urls_version;
+
+        /* refreshes may complete out of order, only newer ones apply */
+        volatile int64_t m_refresh_seq;
+        int64_t m_log_config_seq;
+        int64_t m_broker_urls_seq;
         string m_config_path;
         string m_client_path;
+        string m_client_shards_path;
+        volatile unsigned long m_client_epoch;
+        /* watches are armed again only after they fired or are lost 
+         * with the session */
+        volatile int m_config_watch_armed;
+        volatile int m_brokers_watch_armed;
 
         zhandle_t *m_zhandle;
         FILE* m_zk_log_fp;
@@ -107,13 +218,21 @@ class Zookeeper
         TimerWatcher *m_refresh_timer_trigger;
         uv_async_t m_exit_handle;
 
+        ConfigChangeFunc m_config_change_cb_func;
+        void *m_config_change_cb_func_arg;
+        ConfigChangeFunc m_brokers_change_cb_func;
+        void *m_brokers_change_cb_func_arg;
+
         Mutex m_zhandle_mutex;
         Mutex m_log_config_mutex;
+        Mutex m_config_change_mutex;
         Mutex m_broker_urls_mutex;
+        Mutex m_brokers_change_mutex;
 
         static const string BROKER_IDS_PATH;
         static const string LOGKAFKA_CONFIG_PATH;
         static const string LOGKAFKA_CLIENT_PATH;
+        static const string LOGKAFKA_CLIENT_SHARDS_PATH;
         static const unsigned long REFRESH_INTERVAL_MS;
 };
 
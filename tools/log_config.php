@@ -93,6 +93,15 @@ function main()
         return in_array($value, array('true', 'false'));
     });
 
+    $backlog_parallelismOpt = new Option(null, 'backlog_parallelism', Getopt::REQUIRED_ARGUMENT);
+    $backlog_parallelismOpt -> setDescription('Max backlog files of log_path with time format 
+                          to be collected in parallel, besides the live file; 
+                          1 collects them one after another');
+    $backlog_parallelismOpt -> setDefaultValue(1);
+    $backlog_parallelismOpt -> setValidation(function($value) {
+        return (is_numeric($value) && $value >= 1 && $value <= 64);
+    });
+
     $message_timeout_msOpt = new Option(null, 'message_timeout_ms', Getopt::REQUIRED_ARGUMENT);
     $message_timeout_msOpt -> setDescription('Local message timeout. This value is only enforced locally 
                           and limits the time a produced message waits for successful delivery. 
@@ -102,6 +111,54 @@ function main()
         return (is_numeric($value) && $value >= 0);
     });
 
+    $outputOpt = new Option(null, 'output', Getopt::REQUIRED_ARGUMENT);
+    $outputOpt -> setDescription('Where lines are sent: kafka, file to archive 
+                          them to local segment files, or unix and tcp to 
+                          write them to a stream socket');
+    $outputOpt -> setDefaultValue('kafka');
+    $outputOpt -> setValidation(function($value) {
+        return in_array($value, array('kafka', 'file', 'unix', 'tcp'));
+    });
+
+    $output_pathOpt = new Option(null, 'output_path', Getopt::REQUIRED_ARGUMENT);
+    $output_pathOpt -> setDescription('Path of segment files when output is file, 
+                          they are named output_path.YYYYmmddHHMMSS[.N][.gz]; 
+                          only none and gzip compression_codec are supported');
+    $output_pathOpt -> setValidation(function($value) {
+        return is_string($value) && $value != '';
+    });
+
+    $segment_bytesOpt = new Option(null, 'segment_bytes', Getopt::REQUIRED_ARGUMENT);
+    $segment_bytesOpt -> setDescription('Bytes of a segment file before a new one is started, 
+                          0 is unlimited');
+    $segment_bytesOpt -> setDefaultValue(268435456);
+    $segment_bytesOpt -> setValidation(function($value) {
+        return (is_numeric($value) && $value >= 0);
+    });
+
+    $segment_msOpt = new Option(null, 'segment_ms', Getopt::REQUIRED_ARGUMENT);
+    $segment_msOpt -> setDescription('Milliseconds a segment file is written to before 
+                          a new one is started, 0 is unlimited');
+    $segment_msOpt -> setDefaultValue(3600000);
+    $segment_msOpt -> setValidation(function($value) {
+        return (is_numeric($value) && $value >= 0);
+    });
+
+    $output_addressOpt = new Option(null, 'output_address', Getopt::REQUIRED_ARGUMENT);
+    $output_addressOpt -> setDescription('Socket path when output is unix, 
+                          ip:port when output is tcp');
+    $output_addressOpt -> setValidation(function($value) {
+        return is_string($value) && $value != '';
+    });
+
+    $max_pending_bytesOpt = new Option(null, 'max_pending_bytes', Getopt::REQUIRED_ARGUMENT);
+    $max_pending_bytesOpt -> setDescription('Bytes waiting for a unix or tcp socket 
+                          before reading the log file is paused');
+    $max_pending_bytesOpt -> setDefaultValue(4194304);
+    $max_pending_bytesOpt -> setValidation(function($value) {
+        return (is_numeric($value) && $value > 0);
+    });
+
     $validOpt = new Option(null, 'valid', Getopt::REQUIRED_ARGUMENT);
     $validOpt -> setDescription('Enable now or not');
     $validOpt -> setDefaultValue('true');
@@ -127,7 +184,14 @@ function main()
         $compression_codecOpt,
         $batchsizeOpt,
         $follow_lastOpt,
+        $backlog_parallelismOpt,
         $message_timeout_msOpt,
+        $outputOpt,
+        $output_pathOpt,
+        $segment_bytesOpt,
+        $segment_msOpt,
+        $output_addressOpt,
+        $max_pending_bytesOpt,
         $validOpt,
     ));
 
@@ -197,7 +261,12 @@ function createConfig($zkClient, $parser)
         "topic",
         );
     //CommandLineUtils::checkRequiredArgs($parser, $required);
-    CommandLineUtils::checkRequiredArgs($parser, array('hostname','log_path','topic'));
+    if ($parser['output'] == 'file')
+        CommandLineUtils::checkRequiredArgs($parser, array('hostname','log_path','output_path'));
+    else if ($parser['output'] == 'unix' || $parser['output'] == 'tcp')
+        CommandLineUtils::checkRequiredArgs($parser, array('hostname','log_path','output_address'));
+    else
+        CommandLineUtils::checkRequiredArgs($parser, array('hostname','log_path','topic'));
 
     $configs = getConfig($parser, AdminUtils::$LOG_COLLECTION_CONFIG_ITEMS);
 
@@ -322,6 +391,7 @@ class AdminUtils
 {/*{{{*/
     const LOG_COLLECT_CONFIG_PATH = "/logkafka/config";
     const LOG_COLLECT_CLIENT_PATH = "/logkafka/client";
+    const LOG_COLLECT_CLIENT_SHARDS_PATH = "/logkafka/client_shards";
 
     static $acl = array(
         array('perms' => 0x1f, 'scheme' => 'world','id' => 'anyone')
@@ -338,6 +408,13 @@ class AdminUtils
         'batchsize'   => array('type'=>'integer', 'default'=>1000),
         'message_timeout_ms'   => array('type'=>'integer', 'default'=>0),
         'follow_last' => array('type'=>'bool', 'default'=>true),
+        'backlog_parallelism' => array('type'=>'integer', 'default'=>1),
+        'output'      => array('type'=>'string', 'default'=>'kafka'),
+        'output_path' => array('type'=>'string', 'default'=>''),
+        'segment_bytes' => array('type'=>'integer', 'default'=>268435456),
+        'segment_ms'  => array('type'=>'integer', 'default'=>3600000),
+        'output_address' => array('type'=>'string', 'default'=>''),
+        'max_pending_bytes' => array('type'=>'integer', 'default'=>4194304),
         'valid'       => array('type'=>'bool', 'default'=>true),
         );
 
@@ -509,13 +586,41 @@ class AdminUtils
             $data = $zkClient->get($path);
             if ($data !== NULL)
             {
-                $state = json_decode($data, true);
+                $state = self::decodeLogCollectionState($data);
+            }
+        }
+
+        // state split into shards, see zookeeper_upload_shard_bytes
+        if (is_array($state) && array_key_exists('shards', $state))
+        {
+            $shards = $state['shards'];
+            $state = array();
+            for ($i = 0; $i < $shards; $i++)
+            {
+                $shard_path = self::LOG_COLLECT_CLIENT_SHARDS_PATH.'/'.$hostname.'/'.$i;
+                if (!$zkClient->exists($shard_path)) continue;
+                $data = $zkClient->get($shard_path);
+                if ($data === NULL) continue;
+                $shard_state = self::decodeLogCollectionState($data);
+                if (is_array($shard_state)) $state = array_merge($state, $shard_state);
             }
         }
 
         return array('errno' => 0, 'errmsg' => "", 'data' => $state);
     }/*}}}*/
 
+    static function decodeLogCollectionState($data)
+    {/*{{{*/
+        // zlib compressed, see zookeeper_upload_compression
+        if (strlen($data) > 0 && ord($data[0]) == 0x78)
+        {
+            $data = gzuncompress($data);
+            if ($data === false) return array();
+        }
+
+        return json_decode($data, true);
+    }/*}}}*/
+
     static function createPath($zkClient, $path)
     {/*{{{*/
         $dirs = explode('/', $path);
@@ -1,11 +1,14 @@
+#include "easylogging/easylogging++.h"
 #define protected public
 #define private public
+#include "base/http_server.h"
 #include "logkafka/config.h"
 #undef protected
 #undef private
 #include "gtest/gtest.h"
 #include <sys/file.h>
 
+using namespace base;
 using namespace logkafka;
 
 class ConfigTest: public ::testing::Test {
@@ -67,3 +70,42 @@ TEST_F (ConfigTest, TestReadConfString) {
 
     EXPECT_STREQ("127.0.0.1:2181", config.zk_urls.c_str());
 }
+
+TEST_F (ConfigTest, TestHttpAddress) {
+    char filename[255] = "/tmp/logkafka_test.confXXXXXX";
+    ConfigTest::createFile(filename, "http_address = \"\"  # disabled\n");
+    Config disabled;
+    EXPECT_TRUE(disabled.init(filename));
+    EXPECT_EQ("", disabled.http_address);
+    unlink(filename);
+
+    strcpy(filename, "/tmp/logkafka_test.confXXXXXX");
+    ConfigTest::createFile(filename, "http_address = run/logkafka.sock\n");
+    Config unix_socket;
+    EXPECT_TRUE(unix_socket.init(filename));
+    EXPECT_EQ("/tmp/run/logkafka.sock", unix_socket.http_address);
+    unlink(filename);
+
+    /* control actions must not be reachable from other hosts */
+    strcpy(filename, "/tmp/logkafka_test.confXXXXXX");
+    ConfigTest::createFile(filename, "http_address = 0.0.0.0:9091\n");
+    Config any;
+    EXPECT_FALSE(any.init(filename));
+    unlink(filename);
+
+    const char *loopbacks[] = {"localhost:9091", "127.0.0.2:9091", 
+        "[::1]:9091"};
+    for (size_t i = 0; i < sizeof(loopbacks) / sizeof(loopbacks[0]); ++i) {
+        strcpy(filename, "/tmp/logkafka_test.confXXXXXX");
+        ConfigTest::createFile(filename, 
+                string("http_address = \"") + loopbacks[i] + "\"\n");
+        Config loopback;
+        EXPECT_TRUE(loopback.init(filename)) << loopbacks[i];
+        unlink(filename);
+    }
+
+    /* not resolved, or not loopback once resolved */
+    EXPECT_FALSE(HttpServer::isLoopback("127.0.0.1"));
+    EXPECT_FALSE(HttpServer::isLoopback("[::]:9091"));
+    EXPECT_FALSE(HttpServer::isLoopback("127.0.0.1.example.invalid:9091"));
+}
@@ -0,0 +1,156 @@
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <uv.h>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/file_config_source.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+class FileConfigSourceTest: public ::testing::Test {
+protected:
+    FileConfigSourceTest() {
+    }
+
+    virtual ~FileConfigSourceTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.confXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        m_changes = 0;
+        m_completions = 0;
+    }
+
+    virtual void TearDown() {
+        string cmd = "rm -rf " + m_dir;
+        system(cmd.c_str());
+    }
+
+public:
+    static void writeFile(const string &path, const string &content);
+    static string readFile(const string &path);
+    static void onConfigChange(void *arg);
+    static void onComplete(int rc, const void *data);
+    static void replaceConfig(uv_timer_t *handle);
+    static void closeSource(uv_timer_t *handle);
+
+    string m_dir;
+    int m_changes;
+    int m_completions;
+    FileConfigSource *m_source;
+};
+
+void FileConfigSourceTest::writeFile(const string &path, const string &content) {
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    out << content;
+}
+
+string FileConfigSourceTest::readFile(const string &path) {
+    std::ifstream in(path.c_str());
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+void FileConfigSourceTest::onConfigChange(void *arg) {
+    FileConfigSourceTest *test = reinterpret_cast<FileConfigSourceTest *>(arg);
+    ++test->m_changes;
+}
+
+void FileConfigSourceTest::onComplete(int rc, const void *data) {
+    FileConfigSourceTest *test = (FileConfigSourceTest *)data;
+    if (0 == rc) ++test->m_completions;
+}
+
+void FileConfigSourceTest::replaceConfig(uv_timer_t *handle) {
+    FileConfigSourceTest *test = 
+        reinterpret_cast<FileConfigSourceTest *>(handle->data);
+
+    /* as editors do, write a new file and rename it over the old one */
+    writeFile(test->m_dir + "/log_config.json.new", "{\"/b\":{}}");
+    rename((test->m_dir + "/log_config.json.new").c_str(), 
+            (test->m_dir + "/log_config.json").c_str());
+}
+
+void FileConfigSourceTest::closeSource(uv_timer_t *handle) {
+    FileConfigSourceTest *test = 
+        reinterpret_cast<FileConfigSourceTest *>(handle->data);
+    test->m_source->close();
+    uv_close((uv_handle_t *)handle, NULL);
+}
+
+TEST_F (FileConfigSourceTest, ReloadOnChange) {
+    uv_loop_t *loop = uv_default_loop();
+    writeFile(m_dir + "/log_config.json", "{\"/a\":{}}");
+
+    FileConfigSource source;
+    m_source = &source;
+    source.setConfigChangeCallback(onConfigChange, this);
+    ASSERT_TRUE(source.init(loop, m_dir + "/log_config.json", 
+                m_dir + "/log_state.json", "k1:9092"));
+
+    int64_t version = 0;
+    EXPECT_EQ("{\"/a\":{}}", source.getLogConfig(&version));
+    EXPECT_EQ(1, version);
+    EXPECT_EQ(1, m_changes);
+    EXPECT_EQ("k1:9092", source.getBrokerUrls());
+
+    /* unchanged or broken content keeps the version */
+    EXPECT_TRUE(source.reload());
+    writeFile(m_dir + "/log_config.json", "{\"/a\":");
+    EXPECT_TRUE(source.reload());
+    EXPECT_EQ(1, source.getLogConfigVersion());
+
+    uv_timer_t replace_timer, close_timer;
+    uv_timer_init(loop, &replace_timer);
+    replace_timer.data = this;
+    uv_timer_start(&replace_timer, replaceConfig, 10, 0);
+    uv_timer_init(loop, &close_timer);
+    close_timer.data = this;
+    uv_timer_start(&close_timer, closeSource, 200, 0);
+    uv_run(loop, UV_RUN_DEFAULT);
+    uv_close((uv_handle_t *)&replace_timer, NULL);
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    EXPECT_EQ("{\"/b\":{}}", source.getLogConfig(&version));
+    EXPECT_EQ(2, version);
+    EXPECT_EQ(2, m_changes);
+}
+
+TEST_F (FileConfigSourceTest, WriteState) {
+    writeFile(m_dir + "/log_config.json", "{}");
+
+    FileConfigSource source;
+    ASSERT_TRUE(source.init(uv_default_loop(), m_dir + "/log_config.json", 
+                m_dir + "/log_state.json", "k1:9092"));
+
+    EXPECT_TRUE(source.setLogState("{\"/a\":1}", 8, -1, onComplete, this));
+    EXPECT_TRUE(source.setLogState("{}", 2, 0, onComplete, this));
+    EXPECT_EQ("{\"/a\":1}", readFile(m_dir + "/log_state.json"));
+    EXPECT_EQ("{}", readFile(m_dir + "/log_state.json.0"));
+
+    EXPECT_TRUE(source.deleteLogState(0, onComplete, this));
+    EXPECT_TRUE(source.deleteLogState(1, onComplete, this));
+    EXPECT_NE(0, access((m_dir + "/log_state.json.0").c_str(), F_OK));
+    EXPECT_EQ(4, m_completions);
+
+    /* no completion if it fails */
+    FileConfigSource missing;
+    missing.m_state_path = m_dir + "/none/log_state.json";
+    EXPECT_FALSE(missing.setLogState("{}", 2, -1, onComplete, this));
+    EXPECT_EQ(4, m_completions);
+
+    source.close();
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+}
@@ -0,0 +1,112 @@
+#include <string>
+#include <vector>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/filter_stage.h"
+#include "logkafka/pipeline.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+StageConf filterConf(const char *include, const char *exclude,
+        const char *include_regex = NULL, const char *exclude_regex = NULL)
+{
+    StageConf conf;
+    conf.stage = "filter";
+    if (NULL != include) conf.include.push_back(include);
+    if (NULL != exclude) conf.exclude.push_back(exclude);
+    if (NULL != include_regex) conf.include_regex.push_back(include_regex);
+    if (NULL != exclude_regex) conf.exclude_regex.push_back(exclude_regex);
+    return conf;
+}
+
+bool matches(const string &literal, const string &line)
+{
+    return LiteralMatcher(literal).match(line.data(), line.size());
+}
+
+} // namespace
+
+TEST (FilterStageTest, MatchLiteral) {
+    /* rarest byte is the uppercase one */
+    LiteralMatcher matcher("GET /health");
+    EXPECT_EQ('G', matcher.m_rare);
+    EXPECT_EQ((size_t)0, matcher.m_rare_offset);
+
+    EXPECT_TRUE(matches("GET /health", "GET /health HTTP/1.1"));
+    EXPECT_TRUE(matches("GET /health", "10.0.0.1 GET /health"));
+    EXPECT_FALSE(matches("GET /health", "GET /healt"));
+    EXPECT_FALSE(matches("GET /health", "POST /health GET /healtH"));
+    EXPECT_TRUE(matches("GET /health", "GET /x GET /health"));
+
+    /* rare byte in the middle, near both ends of the line */
+    EXPECT_TRUE(matches("a=Q;b", "a=Q;b"));
+    EXPECT_TRUE(matches("a=Q;b", "xxa=Q;b"));
+    EXPECT_FALSE(matches("a=Q;b", "=Q;bxxxx"));
+    EXPECT_FALSE(matches("a=Q;b", "xxxxa=Q;"));
+
+    EXPECT_TRUE(matches("x", "x"));
+    EXPECT_FALSE(matches("x", ""));
+    EXPECT_FALSE(matches("long literal", "long"));
+
+    /* embedded nul bytes are plain bytes */
+    EXPECT_TRUE(matches(string("b\0c", 3), string("ab\0cd", 5)));
+}
+
+TEST (FilterStageTest, IncludeExclude) {
+    vector<StageConf> confs;
+    confs.push_back(filterConf("ERROR", NULL));
+    confs.back().include.push_back("WARN");
+    confs.push_back(filterConf(NULL, "/health"));
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.init(confs));
+
+    vector<string> lines;
+    lines.push_back("INFO started");
+    lines.push_back("ERROR disk full");
+    lines.push_back("WARN GET /health slow");
+    lines.push_back("WARN queue long");
+    EXPECT_EQ((size_t)2, pipeline.process(lines));
+
+    ASSERT_EQ((size_t)2, lines.size());
+    EXPECT_EQ("ERROR disk full", lines[0]);
+    EXPECT_EQ("WARN queue long", lines[1]);
+    EXPECT_EQ(1, pipeline.getDropped(0));
+    EXPECT_EQ(1, pipeline.getDropped(1));
+    EXPECT_EQ("filter", pipeline.getName(1));
+}
+
+TEST (FilterStageTest, Regex) {
+    FilterStage filter;
+    ASSERT_TRUE(filter.init(filterConf(
+                    NULL, NULL, "\" (5[0-9][0-9]|429) ", "^#")));
+
+    EXPECT_TRUE(filter.keep("\"GET /a\" 503 12"));
+    EXPECT_TRUE(filter.keep("\"GET /a\" 429 0"));
+    EXPECT_FALSE(filter.keep("\"GET /a\" 200 12"));
+    EXPECT_FALSE(filter.keep("# \"GET /a\" 500 12"));
+
+    /* literals and regexes of one side are alternatives */
+    FilterStage both;
+    ASSERT_TRUE(both.init(filterConf("panic", NULL, "^E[0-9]+ ")));
+    EXPECT_TRUE(both.keep("kernel panic"));
+    EXPECT_TRUE(both.keep("E0412 failed"));
+    EXPECT_FALSE(both.keep("I0412 ok"));
+}
+
+TEST (FilterStageTest, RejectIllegalFilter) {
+    EXPECT_FALSE(filterConf(NULL, NULL).isLegal());
+    EXPECT_FALSE(filterConf("", NULL).isLegal());
+    EXPECT_FALSE(filterConf(NULL, NULL, "(unclosed").isLegal());
+    EXPECT_TRUE(filterConf(NULL, "debug").isLegal());
+    EXPECT_TRUE(filterConf(NULL, NULL, NULL, "^$").isLegal());
+
+    FilterStage filter;
+    EXPECT_FALSE(filter.init(filterConf(NULL, NULL, NULL, "a[")));
+}
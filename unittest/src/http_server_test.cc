@@ -0,0 +1,178 @@
+#include <unistd.h>
+
+#include <string>
+
+#include <uv.h>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "base/http_server.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+
+class HttpServerTest: public ::testing::Test {
+protected:
+    HttpServerTest() {
+    }
+
+    virtual ~HttpServerTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.httpXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        m_requests = 0;
+    }
+
+    virtual void TearDown() {
+        rmdir(m_dir.c_str());
+    }
+
+public:
+    static void handle(void *arg, const HttpRequest &request, 
+            HttpResponse &response);
+    static void onConnect(uv_connect_t *req, int status);
+    static void onWrite(uv_write_t *req, int status);
+    static void onAlloc(uv_handle_t *handle, size_t suggested_size, 
+            uv_buf_t *buf);
+    static void onRead(uv_stream_t *stream, ssize_t nread, 
+            const uv_buf_t *buf);
+
+    string m_dir;
+    int m_requests;
+    string m_request;
+    string m_response;
+    HttpServer *m_server;
+    uv_pipe_t m_client;
+    uv_connect_t m_connect_req;
+    uv_write_t m_write_req;
+    char m_buf[4096];
+};
+
+void HttpServerTest::handle(void *arg, const HttpRequest &request, 
+        HttpResponse &response) {
+    HttpServerTest *test = reinterpret_cast<HttpServerTest *>(arg);
+    ++test->m_requests;
+    if ("/echo" != request.path) {
+        response.status = 404;
+        return;
+    }
+    response.body = request.method + " " + request.params.find("a")->second 
+        + " " + request.body;
+}
+
+void HttpServerTest::onConnect(uv_connect_t *req, int status) {
+    HttpServerTest *test = reinterpret_cast<HttpServerTest *>(req->data);
+    ASSERT_EQ(0, status);
+    uv_buf_t buf = uv_buf_init((char *)test->m_request.data(), 
+            test->m_request.length());
+    test->m_write_req.data = test;
+    uv_write(&test->m_write_req, (uv_stream_t *)&test->m_client, 
+            &buf, 1, onWrite);
+}
+
+void HttpServerTest::onWrite(uv_write_t *req, int status) {
+    HttpServerTest *test = reinterpret_cast<HttpServerTest *>(req->data);
+    ASSERT_EQ(0, status);
+    uv_read_start((uv_stream_t *)&test->m_client, onAlloc, onRead);
+}
+
+void HttpServerTest::onAlloc(uv_handle_t *handle, size_t suggested_size, 
+        uv_buf_t *buf) {
+    HttpServerTest *test = reinterpret_cast<HttpServerTest *>(handle->data);
+    *buf = uv_buf_init(test->m_buf, sizeof(test->m_buf));
+}
+
+void HttpServerTest::onRead(uv_stream_t *stream, ssize_t nread, 
+        const uv_buf_t *buf) {
+    HttpServerTest *test = reinterpret_cast<HttpServerTest *>(stream->data);
+    if (nread > 0) {
+        test->m_response.append(buf->base, nread);
+        return;
+    }
+    if (nread < 0) {
+        /* the server closes the connection after responding */
+        uv_close((uv_handle_t *)stream, NULL);
+        test->m_server->close();
+    }
+}
+
+TEST_F (HttpServerTest, ParseRequest) {
+    HttpRequest request;
+    bool complete = true;
+
+    EXPECT_TRUE(HttpServer::parseRequest("GET /a HTTP/1.1\r\nHost: x\r\n", 
+                request, complete));
+    EXPECT_FALSE(complete);
+
+    EXPECT_TRUE(HttpServer::parseRequest(
+                "POST /tasks/pause?path_pattern=%2Fa%2Fb.%25Y&x HTTP/1.1\r\n"
+                "content-LENGTH: 3\r\n\r\nab", request, complete));
+    EXPECT_FALSE(complete);
+    EXPECT_TRUE(HttpServer::parseRequest(
+                "POST /tasks/pause?path_pattern=%2Fa%2Fb.%25Y&x HTTP/1.1\r\n"
+                "content-LENGTH: 3\r\n\r\nabc", request, complete));
+    EXPECT_TRUE(complete);
+    EXPECT_EQ("POST", request.method);
+    EXPECT_EQ("/tasks/pause", request.path);
+    EXPECT_EQ("/a/b.%Y", request.params["path_pattern"]);
+    EXPECT_EQ((size_t)1, request.params.count("x"));
+    EXPECT_EQ("abc", request.body);
+
+    EXPECT_FALSE(HttpServer::parseRequest("GARBAGE\r\n\r\n", 
+                request, complete));
+}
+
+TEST_F (HttpServerTest, UnixSocketRoundTrip) {
+    uv_loop_t *loop = uv_default_loop();
+    string address = m_dir + "/http.sock";
+
+    HttpServer server;
+    m_server = &server;
+    ASSERT_TRUE(server.init(loop, address, this, handle));
+    EXPECT_EQ(0, access(address.c_str(), F_OK));
+
+    m_request = "POST /echo?a=1+2 HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody";
+    uv_pipe_init(loop, &m_client, 0);
+    m_client.data = this;
+    m_connect_req.data = this;
+    uv_pipe_connect(&m_connect_req, &m_client, address.c_str(), onConnect);
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    EXPECT_EQ(1, m_requests);
+    EXPECT_EQ(0u, m_response.find("HTTP/1.0 200 OK\r\n"));
+    EXPECT_NE(string::npos, m_response.find("Content-Length: 13\r\n"));
+    EXPECT_NE(string::npos, m_response.find("\r\n\r\nPOST 1 2 body"));
+    /* the socket is removed when closed */
+    EXPECT_NE(0, access(address.c_str(), F_OK));
+}
+
+TEST_F (HttpServerTest, KeepFileAtAddress) {
+    uv_loop_t *loop = uv_default_loop();
+    string address = m_dir + "/http.sock";
+
+    /* a typo in http_address must not remove a real file */
+    FILE *fp = fopen(address.c_str(), "w");
+    ASSERT_TRUE(NULL != fp);
+    fclose(fp);
+    HttpServer server;
+    EXPECT_FALSE(server.init(loop, address, this, handle));
+    uv_run(loop, UV_RUN_DEFAULT);
+    EXPECT_EQ(0, access(address.c_str(), F_OK));
+    unlink(address.c_str());
+}
+
+TEST_F (HttpServerTest, ResolveAddress) {
+    struct sockaddr_storage addr;
+    ASSERT_TRUE(HttpServer::resolveAddress("[::1]:9091", addr));
+    EXPECT_EQ(AF_INET6, addr.ss_family);
+    ASSERT_TRUE(HttpServer::resolveAddress("127.0.0.1:9091", addr));
+    EXPECT_EQ(AF_INET, addr.ss_family);
+    EXPECT_FALSE(HttpServer::resolveAddress("127.0.0.1", addr));
+    EXPECT_FALSE(HttpServer::resolveAddress("127.0.0.1:http", addr));
+}
@@ -0,0 +1,116 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "base/loop_monitor.h"
+#include "base/timer_watcher.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+
+struct TracedCallback
+{
+    string kind;
+    string name;
+    int64_t duration_us;
+    bool slow;
+};
+
+class LoopMonitorTest: public ::testing::Test {
+protected:
+    LoopMonitorTest() {
+    }
+
+    virtual ~LoopMonitorTest() {
+    }
+
+    virtual void SetUp() {
+        s_traced.clear();
+        m_max_lag_us = 0;
+        m_blocks = 0;
+        ASSERT_EQ(0, uv_loop_init(&m_loop));
+    }
+
+    virtual void TearDown() {
+        LoopMonitor::setCallbackTracer(0, NULL);
+        uv_loop_close(&m_loop);
+    }
+
+public:
+    static void onLag(void *arg, int64_t lag_us);
+    static void block(void *arg);
+    static void onTraced(const char *kind, const string &name,
+            int64_t duration_us, bool slow);
+
+    static vector<TracedCallback> s_traced;
+
+    uv_loop_t m_loop;
+    TimerWatcher m_timer;
+    int64_t m_max_lag_us;
+    int m_blocks;
+};
+
+vector<TracedCallback> LoopMonitorTest::s_traced;
+
+void LoopMonitorTest::onLag(void *arg, int64_t lag_us) {
+    LoopMonitorTest *t = reinterpret_cast<LoopMonitorTest *>(arg);
+    if (lag_us > t->m_max_lag_us) t->m_max_lag_us = lag_us;
+}
+
+void LoopMonitorTest::block(void *arg) {
+    LoopMonitorTest *t = reinterpret_cast<LoopMonitorTest *>(arg);
+    /* first call is fast, the second one blocks the loop */
+    if (++t->m_blocks == 2) {
+        usleep(100000);
+    } else if (t->m_blocks > 4) {
+        t->m_timer.close();
+    }
+}
+
+void LoopMonitorTest::onTraced(const char *kind, const string &name,
+        int64_t duration_us, bool slow) {
+    TracedCallback tc = {kind, name, duration_us, slow};
+    s_traced.push_back(tc);
+}
+
+TEST_F (LoopMonitorTest, MeasureLag) {
+    LoopMonitor monitor;
+    ASSERT_TRUE(monitor.init(&m_loop, 20, this, onLag));
+
+    m_timer.setName("blocker");
+    ASSERT_TRUE(m_timer.init(&m_loop, 10, 30, this, block));
+
+    /* the probe timer does not keep the loop alive */
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+    monitor.close();
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+
+    EXPECT_GE(m_max_lag_us, 50000);
+    EXPECT_LT(m_max_lag_us, 1000000);
+}
+
+TEST_F (LoopMonitorTest, TraceCallbacks) {
+    /* no clock reads without tracer */
+    EXPECT_EQ(0, LoopMonitor::traceBegin());
+
+    LoopMonitor::setCallbackTracer(50, onTraced);
+    m_timer.setName("blocker");
+    ASSERT_TRUE(m_timer.init(&m_loop, 0, 5, this, block));
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+
+    ASSERT_EQ((size_t)5, s_traced.size());
+    EXPECT_EQ("timer", s_traced[1].kind);
+    EXPECT_EQ("blocker", s_traced[1].name);
+    EXPECT_FALSE(s_traced[0].slow);
+    EXPECT_LT(s_traced[0].duration_us, 50000);
+    EXPECT_TRUE(s_traced[1].slow);
+    EXPECT_GE(s_traced[1].duration_us, 100000);
+}
@@ -0,0 +1,496 @@
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/manager.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+class ManagerReconcileTest: public ::testing::Test {
+protected:
+    ManagerReconcileTest() {
+    }
+
+    virtual ~ManagerReconcileTest() {
+    }
+
+    virtual void SetUp() {
+        m_config.pos_path = "";
+        m_config.refresh_interval = DEFAULT_REFRESH_INTERVAL;
+        m_config.line_max_bytes = DEFAULT_LINE_MAX_BYTES;
+        m_config.stat_silent_max_ms = DEFAULT_STAT_SILENT_MAX_MS;
+        m_config.pos_compact_interval = DEFAULT_POS_COMPACT_INTERVAL;
+        m_config.config_apply_delay = DEFAULT_CONFIG_APPLY_DELAY;
+        m_config.glob_max_open_files = DEFAULT_GLOB_MAX_OPEN_FILES;
+        m_config.loop_probe_interval = DEFAULT_LOOP_PROBE_INTERVAL;
+        m_config.slow_callback_ms = DEFAULT_SLOW_CALLBACK_MS;
+        m_manager = new Manager(&m_config);
+    }
+
+    virtual void TearDown() {
+        delete m_manager;
+    }
+
+public:
+    static string taskConf(const string &log_path, int batchsize);
+    /* stages_json is the value of pipeline */
+    static string taskConfWithPipeline(const string &log_path, 
+            const string &stages_json);
+
+    Config m_config;
+    Manager *m_manager;
+};
+
+string ManagerReconcileTest::taskConf(const string &log_path, int batchsize) {
+    stringstream ss;
+    ss << "{\"valid\":true,\"log_path\":\"" << log_path << "\","
+       << "\"follow_last\":true,\"batchsize\":" << batchsize << ","
+       << "\"topic\":\"test\",\"key\":\"\",\"partition\":-1,"
+       << "\"compression_codec\":\"none\",\"required_acks\":1,"
+       << "\"message_timeout_ms\":0}";
+    return ss.str();
+}
+
+string ManagerReconcileTest::taskConfWithPipeline(const string &log_path, 
+        const string &stages_json) {
+    string conf = taskConf(log_path, 100);
+    return conf.substr(0, conf.length() - 1) 
+        + ",\"pipeline\":" + stages_json + "}";
+}
+
+TEST_F (ManagerReconcileTest, JsonHash) {
+    Document d1, d2, d3;
+    d1.Parse<0>("{\"a\": [1, \"x\", true], \"b\": {\"c\": null}}");
+    d2.Parse<0>("{\"a\":[1,\"x\",true],\"b\":{\"c\":null}}");
+    d3.Parse<0>("{\"a\":[1,\"x\",false],\"b\":{\"c\":null}}");
+
+    EXPECT_EQ(Json::hash(d1), Json::hash(d2));
+    EXPECT_NE(Json::hash(d1), Json::hash(d3));
+}
+
+TEST_F (ManagerReconcileTest, ReconcileChangedPatternsOnly) {
+    string config = "{\"/a\":" + taskConf("/a", 100)
+        + ",\"/b\":" + taskConf("/b", 100) + "}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, diff));
+    EXPECT_EQ((size_t)2, diff.added.size());
+    EXPECT_TRUE(diff.updated.empty());
+    EXPECT_TRUE(diff.deleted.empty());
+    EXPECT_EQ((size_t)2, m_manager->m_task_confs.size());
+
+    /* same config, even reformatted, changes nothing */
+    TaskConfDiff same;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, same));
+    EXPECT_TRUE(same.empty());
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(
+                "{ \"/a\" : " + taskConf("/a", 100)
+                + " , \"/b\" : " + taskConf("/b", 100) + " }", same));
+    EXPECT_TRUE(same.empty());
+
+    /* one pattern updated, one deleted, one added */
+    config = "{\"/a\":" + taskConf("/a", 200)
+        + ",\"/c\":" + taskConf("/c", 100) + "}";
+    TaskConfDiff changed;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, changed));
+    EXPECT_EQ((size_t)1, changed.added.count("/c"));
+    EXPECT_EQ((size_t)1, changed.updated.count("/a"));
+    EXPECT_EQ((size_t)1, changed.deleted.count("/b"));
+    EXPECT_EQ((size_t)3, changed.added.size() + changed.updated.size()
+            + changed.deleted.size());
+    EXPECT_EQ(200, m_manager->m_task_confs["/a"].log_conf.batchsize);
+    EXPECT_EQ((size_t)0, m_manager->m_task_conf_hashes.count("/b"));
+
+    /* illegal task confs are deleted */
+    config = "{\"/a\":" + taskConf("/a*/b", 200)
+        + ",\"/c\":" + taskConf("/c", 100) + "}";
+    TaskConfDiff illegal;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, illegal));
+    EXPECT_EQ((size_t)1, illegal.deleted.count("/a"));
+    EXPECT_EQ((size_t)1, illegal.deleted.size());
+
+    /* broken json keeps the current task confs */
+    TaskConfDiff broken;
+    EXPECT_FALSE(m_manager->reconcileTaskConfs("{\"/c\":", broken));
+    EXPECT_TRUE(broken.empty());
+    EXPECT_EQ((size_t)1, m_manager->m_task_confs.size());
+}
+
+TEST_F (ManagerReconcileTest, RefreshTasksWithDiff) {
+    string config = "{\"/a\":" + taskConf("/a", 100)
+        + ",\"/b\":" + taskConf("/b", 100) + "}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, diff));
+    EXPECT_TRUE(m_manager->refreshTasks(diff));
+    EXPECT_EQ((size_t)2, m_manager->m_tasks.size());
+    EXPECT_EQ("/a", m_manager->m_tasks["/a"]->getPath());
+    EXPECT_TRUE(m_manager->m_dynamic_patterns.empty());
+
+    config = "{\"/a\":" + taskConf("/a", 300) + "}";
+    TaskConfDiff changed;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, changed));
+    EXPECT_TRUE(m_manager->refreshTasks(changed));
+    EXPECT_EQ((size_t)1, m_manager->m_tasks.size());
+    EXPECT_EQ(300, m_manager->m_tasks["/a"]->conf.log_conf.batchsize);
+}
+
+TEST_F (ManagerReconcileTest, BacklogParallelism) {
+    string conf = taskConf("/a.%Y%m%d%H", 100);
+    string parallel = conf.substr(0, conf.length() - 1) 
+        + ",\"backlog_parallelism\":4}";
+    string illegal = conf.substr(0, conf.length() - 1) 
+        + ",\"backlog_parallelism\":0}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + conf 
+                + ",\"/b\":" + parallel + ",\"/c\":" + illegal + "}", diff));
+    EXPECT_EQ((size_t)2, diff.added.size());
+    EXPECT_EQ(DEFAULT_BACKLOG_PARALLELISM, 
+            m_manager->m_task_confs["/a"].log_conf.backlog_parallelism);
+    EXPECT_EQ(4, m_manager->m_task_confs["/b"].log_conf.backlog_parallelism);
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/c"));
+
+    /* finished backlog files are removed from the middle of the queue */
+    Task task;
+    task.addPath("/a.2015010100");
+    task.addPath("/a.2015010101");
+    task.addPath("/a.2015010102");
+    task.delPath("/a.2015010101");
+    EXPECT_EQ("/a.2015010100", task.getPath());
+    EXPECT_EQ("/a.2015010102", task.getLastPath());
+    EXPECT_EQ((size_t)2, task.stat.paths.size());
+}
+
+TEST_F (ManagerReconcileTest, FileOutput) {
+    string file = "{\"valid\":true,\"log_path\":\"/a\",\"follow_last\":true,"
+        "\"batchsize\":100,\"output\":\"file\","
+        "\"output_path\":\"/data/archive/a\",\"segment_bytes\":1024,"
+        "\"compression_codec\":\"gzip\"}";
+    string snappy = "{\"valid\":true,\"log_path\":\"/b\",\"follow_last\":true,"
+        "\"batchsize\":100,\"output\":\"file\","
+        "\"output_path\":\"/data/archive/b\",\"compression_codec\":\"snappy\"}";
+    string unknown = taskConf("/c", 100);
+    unknown = unknown.substr(0, unknown.length() - 1) + ",\"output\":\"hdfs\"}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + file 
+                + ",\"/b\":" + snappy + ",\"/c\":" + unknown 
+                + ",\"/d\":" + taskConf("/d", 100) + "}", diff));
+    EXPECT_EQ((size_t)2, diff.added.size());
+
+    /* no kafka fields needed */
+    ASSERT_EQ((size_t)1, m_manager->m_task_confs["/a"].outputs.size());
+    const OutputConf &conf = m_manager->m_task_confs["/a"].outputs[0];
+    EXPECT_EQ("file", conf.output);
+    EXPECT_EQ("/data/archive/a", conf.file_output_conf.path);
+    EXPECT_EQ(1024, conf.file_output_conf.segment_bytes);
+    EXPECT_EQ(DEFAULT_SEGMENT_MS, conf.file_output_conf.segment_ms);
+    EXPECT_EQ("gzip", conf.file_output_conf.compression_codec);
+    EXPECT_EQ("kafka", m_manager->m_task_confs["/d"].outputs[0].output);
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/b"));
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/c"));
+}
+
+TEST_F (ManagerReconcileTest, StreamOutput) {
+    string head = "{\"valid\":true,\"log_path\":\"/a\",\"follow_last\":true,"
+        "\"batchsize\":100,";
+    string tcp = head + "\"output\":\"tcp\","
+        "\"output_address\":\"127.0.0.1:5140\",\"max_pending_bytes\":1024}";
+    string unix_socket = head + "\"output\":\"unix\","
+        "\"output_address\":\"/run/collector.sock\"}";
+    string no_address = head + "\"output\":\"tcp\"}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + tcp 
+                + ",\"/b\":" + unix_socket + ",\"/c\":" + no_address + "}", diff));
+    EXPECT_EQ((size_t)2, diff.added.size());
+
+    const OutputConf &conf = m_manager->m_task_confs["/a"].outputs[0];
+    EXPECT_EQ("tcp", conf.output);
+    EXPECT_EQ("127.0.0.1:5140", conf.stream_output_conf.address);
+    EXPECT_EQ(1024, conf.stream_output_conf.max_pending_bytes);
+    const OutputConf &unix_conf = m_manager->m_task_confs["/b"].outputs[0];
+    EXPECT_EQ("unix", unix_conf.output);
+    EXPECT_EQ(DEFAULT_STREAM_MAX_PENDING_BYTES, 
+            unix_conf.stream_output_conf.max_pending_bytes);
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/c"));
+}
+
+TEST_F (ManagerReconcileTest, Pipeline) {
+    string stages = taskConfWithPipeline("/a", "[{\"stage\":\"trim\"},"
+        "{\"stage\":\"truncate\",\"max_bytes\":1024}]");
+    string unknown = taskConfWithPipeline("/b", "[{\"stage\":\"grep\"}]");
+    string not_array = taskConfWithPipeline("/c", "{\"stage\":\"trim\"}");
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + stages 
+                + ",\"/b\":" + unknown + ",\"/c\":" + not_array
+                + ",\"/d\":" + taskConf("/d", 100) + "}", diff));
+    EXPECT_EQ((size_t)2, diff.added.size());
+
+    const vector<StageConf> &confs = m_manager->m_task_confs["/a"].stages;
+    ASSERT_EQ((size_t)2, confs.size());
+    EXPECT_EQ("trim", confs[0].stage);
+    EXPECT_EQ("truncate", confs[1].stage);
+    EXPECT_EQ((uint32_t)1024, confs[1].max_bytes);
+    EXPECT_TRUE(m_manager->m_task_confs["/d"].stages.empty());
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/b"));
+    EXPECT_EQ((size_t)0, m_manager->m_task_confs.count("/c"));
+}
+
+TEST_F (ManagerReconcileTest, FilterStage) {
+    string filter = taskConfWithPipeline("/a", "[{\"stage\":\"filter\","
+        "\"include\":[\"ERROR\",\"WARN\"],"
+        "\"exclude_regex\":[\"/health(z)? \"]}]");
+    string not_strings = taskConfWithPipeline("/b", 
+        "[{\"stage\":\"filter\",\"include\":[\"ERROR\",1]}]");
+    string no_pattern = taskConfWithPipeline("/c", 
+        "[{\"stage\":\"filter\"}]");
+    string bad_regex = taskConfWithPipeline("/d", "[{\"stage\":\"filter\","
+        "\"include_regex\":[\"(\"]}]");
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + filter 
+                + ",\"/b\":" + not_strings + ",\"/c\":" + no_pattern
+                + ",\"/d\":" + bad_regex + "}", diff));
+    EXPECT_EQ((size_t)1, diff.added.size());
+
+    const StageConf &conf = m_manager->m_task_confs["/a"].stages[0];
+    EXPECT_EQ("filter", conf.stage);
+    ASSERT_EQ((size_t)2, conf.include.size());
+    EXPECT_EQ("WARN", conf.include[1]);
+    EXPECT_TRUE(conf.exclude.empty());
+    ASSERT_EQ((size_t)1, conf.exclude_regex.size());
+    EXPECT_EQ("/health(z)? ", conf.exclude_regex[0]);
+}
+
+TEST_F (ManagerReconcileTest, SampleStage) {
+    string hash = taskConfWithPipeline("/a", "[{\"stage\":\"sample\","
+        "\"mode\":\"hash\",\"rate\":0.01,\"key_field\":3}]");
+    string limit = taskConfWithPipeline("/b", "[{\"stage\":\"sample\","
+        "\"mode\":\"limit\",\"lines_per_s\":1000}]");
+    string all = taskConfWithPipeline("/c", "[{\"stage\":\"sample\","
+        "\"mode\":\"rate\",\"rate\":1}]");
+    string no_rate = taskConfWithPipeline("/d", 
+        "[{\"stage\":\"sample\",\"mode\":\"rate\"}]");
+    string rate_string = taskConfWithPipeline("/e", "[{\"stage\":\"sample\","
+        "\"mode\":\"rate\",\"rate\":\"1%\"}]");
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + hash 
+                + ",\"/b\":" + limit + ",\"/c\":" + all 
+                + ",\"/d\":" + no_rate + ",\"/e\":" + rate_string + "}", 
+                diff));
+    EXPECT_EQ((size_t)3, diff.added.size());
+
+    const StageConf &hash_conf = m_manager->m_task_confs["/a"].stages[0];
+    EXPECT_EQ("hash", hash_conf.mode);
+    EXPECT_DOUBLE_EQ(0.01, hash_conf.rate);
+    EXPECT_EQ((uint32_t)3, hash_conf.key_field);
+    const StageConf &limit_conf = m_manager->m_task_confs["/b"].stages[0];
+    EXPECT_EQ((uint32_t)1000, limit_conf.lines_per_s);
+    EXPECT_EQ((uint32_t)0, limit_conf.burst);
+    EXPECT_DOUBLE_EQ(1, m_manager->m_task_confs["/c"].stages[0].rate);
+
+    /* watchers of a task share one pipeline, until its stages change */
+    Pipeline *pipeline = m_manager->getPipeline("/b", 
+            m_manager->m_task_confs["/b"]);
+    ASSERT_TRUE(NULL != pipeline);
+    EXPECT_EQ(pipeline, m_manager->getPipeline("/b", 
+                m_manager->m_task_confs["/b"]));
+    EXPECT_TRUE(pipeline != m_manager->getPipeline("/b", 
+                m_manager->m_task_confs["/c"]));
+    EXPECT_TRUE(NULL == m_manager->getPipeline("/e", TaskConf()));
+}
+
+TEST_F (ManagerReconcileTest, MultipleOutputs) {
+    string kafka = "{\"topic\":\"a\",\"key\":\"\",\"partition\":-1,"
+        "\"compression_codec\":\"none\",\"required_acks\":1,"
+        "\"message_timeout_ms\":0}";
+    string file = "{\"output\":\"file\",\"output_path\":\"/data/archive/a\"}";
+    string head = "{\"valid\":true,\"log_path\":\"/a\",\"follow_last\":true,"
+        "\"batchsize\":100,\"outputs\":";
+    string fanout = head + "[" + kafka + "," + file + "]}";
+    string illegal = head + "[" + kafka + ",{\"output\":\"file\"}]}";
+    string empty = head + "[]}";
+
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + fanout 
+                + ",\"/b\":" + illegal + ",\"/c\":" + empty + "}", diff));
+    EXPECT_EQ((size_t)1, diff.added.size());
+
+    const TaskConf &conf = m_manager->m_task_confs["/a"];
+    ASSERT_EQ((size_t)2, conf.outputs.size());
+    EXPECT_EQ("kafka", conf.outputs[0].output);
+    EXPECT_EQ("a", conf.outputs[0].kafka_topic_conf.topic);
+    EXPECT_EQ("file", conf.outputs[1].output);
+    EXPECT_EQ("/data/archive/a", conf.outputs[1].file_output_conf.path);
+
+    /* a changed output is a changed task conf */
+    TaskConfDiff changed;
+    string renamed = head + "[" + kafka + "," + file.substr(0, 
+            file.length() - 2) + "2\"}]}";
+    EXPECT_TRUE(m_manager->reconcileTaskConfs("{\"/a\":" + renamed + "}", 
+                changed));
+    EXPECT_EQ((size_t)1, changed.updated.count("/a"));
+}
+
+TEST_F (ManagerReconcileTest, GetBacklogPaths) {
+    char dir[] = "/tmp/logkafka_test.backlogXXXXXX";
+    ASSERT_TRUE(NULL != mkdtemp(dir));
+    string d = dir;
+    const char *names[] = {"a.2015010100", "a.2015010101", "a.2015010102",
+        "a.2015010103", "a.2015010104", "a.2015010102.gz", "b.2015010102",
+        "c-02-01-2015", "c-01-01-2015", "c-31-12-2014"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        std::ofstream((d + "/" + names[i]).c_str());
+    }
+
+    vector<string> paths;
+    EXPECT_TRUE(m_manager->getBacklogPaths(d + "/a.%Y%m%d%H", 
+                d + "/a.2015010100", d + "/a.2015010104", paths));
+    ASSERT_EQ((size_t)3, paths.size());
+    EXPECT_EQ(d + "/a.2015010101", paths[0]);
+    EXPECT_EQ(d + "/a.2015010103", paths[2]);
+
+    /* names not sorted by time are ordered by their time */
+    paths.clear();
+    EXPECT_TRUE(m_manager->getBacklogPaths(d + "/c-%d-%m-%Y", 
+                d + "/c-30-12-2014", d + "/c-03-01-2015", paths));
+    ASSERT_EQ((size_t)3, paths.size());
+    EXPECT_EQ(d + "/c-31-12-2014", paths[0]);
+    EXPECT_EQ(d + "/c-02-01-2015", paths[2]);
+
+    string cmd = "rm -rf " + d;
+    system(cmd.c_str());
+}
+
+static void signalConfigChange(void *arg) {
+    /* a burst of config changes from another thread */
+    for (int i = 0; i < 3; ++i) {
+        Manager::onConfigChange(arg);
+    }
+}
+
+static void closeNotifier(uv_timer_t *handle) {
+    Manager *manager = reinterpret_cast<Manager *>(handle->data);
+    manager->m_config_change_notifier->close();
+    uv_close((uv_handle_t *)handle, NULL);
+}
+
+TEST_F (ManagerReconcileTest, ApplyConfigChangeOnSignal) {
+    uv_loop_t *loop = uv_default_loop();
+    m_manager->m_loop = loop;
+    Zookeeper *zookeeper = new Zookeeper();
+    zookeeper->m_log_config = "{\"/a\":" + taskConf("/a", 100) + "}";
+    zookeeper->m_log_config_version = 1;
+    m_manager->m_config_source = zookeeper;
+
+    m_manager->m_config_change_notifier = new AsyncWatcher();
+    ASSERT_TRUE(m_manager->m_config_change_notifier->init(loop, 
+                m_manager, Manager::handleConfigChange));
+    m_manager->m_config_apply_trigger = new TimerWatcher();
+    ASSERT_TRUE(m_manager->m_config_apply_trigger->init(loop, 
+                m_config.config_apply_delay, 0, 
+                m_manager, Manager::applyConfig));
+    m_manager->m_config_apply_trigger->stop();
+
+    uv_thread_t thread;
+    uv_thread_create(&thread, signalConfigChange, m_manager);
+    uv_thread_join(&thread);
+
+    /* loop time is stale after the tests run before */
+    uv_update_time(loop);
+    uv_timer_t close_timer;
+    uv_timer_init(loop, &close_timer);
+    close_timer.data = m_manager;
+    uv_timer_start(&close_timer, closeNotifier, 
+            m_config.config_apply_delay * 3, 0);
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    EXPECT_FALSE(m_manager->m_config_apply_pending);
+    EXPECT_EQ(1, m_manager->m_log_config_version);
+    EXPECT_EQ((size_t)1, m_manager->m_tasks.count("/a"));
+}
+
+TEST_F (ManagerReconcileTest, HttpControl) {
+    string config = "{\"/a\":" + taskConf("/a", 100) + "}";
+    TaskConfDiff diff;
+    EXPECT_TRUE(m_manager->reconcileTaskConfs(config, diff));
+    EXPECT_TRUE(m_manager->refreshTasks(diff));
+
+    HttpRequest request;
+    HttpResponse response;
+    request.method = "POST";
+    request.path = "/tasks/pause";
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(400, response.status);
+
+    request.params["path_pattern"] = "/a";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(200, response.status);
+    EXPECT_TRUE(m_manager->m_tasks["/a"]->paused);
+    EXPECT_FALSE(m_manager->m_tasks["/a"]->getEnabled());
+
+    request.method = "GET";
+    request.path = "/watchers";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(200, response.status);
+    Document d;
+    d.Parse<0>(response.body.c_str());
+    ASSERT_FALSE(d.HasParseError());
+    EXPECT_TRUE(d["/a"]["paused"].GetBool());
+
+    request.method = "POST";
+    request.path = "/tasks/resume";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(200, response.status);
+    EXPECT_TRUE(m_manager->m_tasks["/a"]->getEnabled());
+
+    request.params["path_pattern"] = "/none";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(404, response.status);
+
+    /* no position file is loaded */
+    request.path = "/checkpoint";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(409, response.status);
+
+    request.method = "GET";
+    request.path = "/metrics";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(200, response.status);
+    EXPECT_NE(string::npos, response.body.find(
+                "# TYPE logkafka_task_lines_read_total counter\n"
+                "logkafka_task_lines_read_total{path_pattern=\"/a\"} 0\n"));
+    EXPECT_NE(string::npos, response.body.find(
+                "logkafka_end_to_end_seconds_bucket{le=\"+Inf\"}"));
+
+    request.method = "POST";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(405, response.status);
+
+    request.path = "/none";
+    response = HttpResponse();
+    Manager::handleHttpRequest(m_manager, request, response);
+    EXPECT_EQ(404, response.status);
+}
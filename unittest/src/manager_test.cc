@@ -55,8 +55,8 @@ protected:
             EXPECT_TRUE(g_manager->init(NULL));
 
             EXPECT_NE((void*)NULL, g_manager);
-            EXPECT_NE((void*)NULL, g_manager->m_zookeeper);
-            EXPECT_NE((void*)NULL, g_manager->m_pos_file);
+            EXPECT_NE((void*)NULL, g_manager->m_config_source);
+            EXPECT_NE((void*)NULL, g_manager->m_position_file);
         }
 
         virtual ~ManagerTest() {
@@ -0,0 +1,185 @@
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/io_handler.h"
+#include "logkafka/memory_position_entry.h"
+#include "logkafka/metrics.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+static const int THREAD_NUM = 4;
+static const int ADDS_PER_THREAD = 100000;
+
+static void addLines(void *arg) {
+    TaskMetrics *metrics = reinterpret_cast<TaskMetrics *>(arg);
+    for (int i = 0; i < ADDS_PER_THREAD; ++i) {
+        metrics->add(METRIC_LINES_READ, 1);
+        MetricsRegistry::instance().addGlobal(METRIC_MESSAGES_DELIVERED, 1);
+    }
+}
+
+static bool acceptLines(void *arg, vector<string> &lines, 
+        int64_t write_time_us) {
+    return true;
+}
+
+static bool rejectLines(void *arg, vector<string> &lines, 
+        int64_t write_time_us) {
+    return false;
+}
+
+static int64_t taskValue(const MetricsValues &values, 
+        const string &path_pattern, TaskMetricType type) {
+    for (size_t i = 0; i < values.tasks.size(); ++i) {
+        if (values.tasks[i].path_pattern == path_pattern)
+            return values.tasks[i].values[type];
+    }
+    return -1;
+}
+
+TEST (MetricsTest, TaskLifetime) {
+    MetricsRegistry registry;
+
+    TaskMetrics *m1 = registry.acquireTask("/a");
+    TaskMetrics *m2 = registry.acquireTask("/a");
+    EXPECT_EQ(m1, m2);
+    m1->add(METRIC_LINES_READ, 3);
+    m1->add(METRIC_BYTES_BEHIND, 100);
+    registry.releaseTask(m2);
+
+    MetricsValues values;
+    registry.collect(values);
+    ASSERT_EQ((size_t)1, values.tasks.size());
+    EXPECT_EQ(3, taskValue(values, "/a", METRIC_LINES_READ));
+
+    /* counters of removed tasks stay in totals, gauges do not */
+    registry.releaseTask(m1);
+    TaskMetrics *m3 = registry.acquireTask("/b");
+    m3->add(METRIC_LINES_READ, 2);
+    registry.collect(values);
+    ASSERT_EQ((size_t)1, values.tasks.size());
+    EXPECT_EQ(-1, taskValue(values, "/a", METRIC_LINES_READ));
+    EXPECT_EQ(5, values.totals[METRIC_LINES_READ]);
+    EXPECT_EQ(0, values.totals[METRIC_BYTES_BEHIND]);
+    registry.releaseTask(m3);
+}
+
+TEST (MetricsTest, ConcurrentAdds) {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    TaskMetrics *metrics = registry.acquireTask("/concurrent");
+    int64_t delivered = registry.getGlobal(METRIC_MESSAGES_DELIVERED);
+
+    uv_thread_t threads[THREAD_NUM];
+    for (int i = 0; i < THREAD_NUM; ++i) {
+        uv_thread_create(&threads[i], addLines, metrics);
+    }
+    for (int i = 0; i < THREAD_NUM; ++i) {
+        uv_thread_join(&threads[i]);
+    }
+
+    EXPECT_EQ(THREAD_NUM * ADDS_PER_THREAD, metrics->get(METRIC_LINES_READ));
+    EXPECT_EQ(delivered + THREAD_NUM * ADDS_PER_THREAD, 
+            registry.getGlobal(METRIC_MESSAGES_DELIVERED));
+
+    StringBuffer buffer;
+    Writer<StringBuffer> writer(buffer);
+    registry.Serialize(writer);
+    Document d;
+    d.Parse<0>(buffer.GetString());
+    ASSERT_FALSE(d.HasParseError());
+    EXPECT_EQ(THREAD_NUM * ADDS_PER_THREAD, 
+            d["tasks"]["/concurrent"]["lines_read"].GetInt64());
+    EXPECT_TRUE(d["global"].HasMember("kafka_queue_depth"));
+    EXPECT_TRUE(d["histograms"]["end_to_end_us"].HasMember("p99"));
+
+    registry.releaseTask(metrics);
+}
+
+TEST (MetricsTest, HistogramBuckets) {
+    /* every value is at most 1/16 below the upper bound of its bucket */
+    for (int64_t v = 0; v < (1LL << 39); v = v * 5 / 4 + 1) {
+        int bucket = HistogramValues::bucketOf(v);
+        int64_t upper = HistogramValues::bucketUpperBound(bucket);
+        ASSERT_LE(v, upper);
+        ASSERT_LE(upper - v, v / 16);
+        if (bucket > 0) {
+            ASSERT_LT(HistogramValues::bucketUpperBound(bucket - 1), v);
+        }
+    }
+    EXPECT_EQ(HistogramValues::BUCKET_NUM - 1, 
+            HistogramValues::bucketOf(1LL << 50));
+    EXPECT_EQ(0, HistogramValues::bucketOf(-1));
+}
+
+TEST (MetricsTest, HistogramMerge) {
+    Histogram h1, h2;
+    for (int64_t v = 1; v <= 1000; ++v) {
+        (v % 2 ? h1: h2).record(v);
+    }
+
+    HistogramValues values;
+    h1.collect(values);
+    h2.collect(values);
+    EXPECT_EQ(1000, values.count);
+    EXPECT_EQ(500500, values.sum);
+
+    int64_t p50 = values.quantile(0.5);
+    EXPECT_GE(p50, 500);
+    EXPECT_LE(p50, 500 + 500 / 16);
+    int64_t p99 = values.quantile(0.99);
+    EXPECT_GE(p99, 990);
+    EXPECT_LE(p99, 990 + 990 / 16);
+    EXPECT_GE(values.quantile(1.0), 1000);
+
+    HistogramValues empty;
+    EXPECT_EQ(0, empty.quantile(0.99));
+    values.merge(values);
+    EXPECT_EQ(2000, values.count);
+    EXPECT_EQ(p50, values.quantile(0.5));
+}
+
+TEST (MetricsTest, CountReadLines) {
+    FILE *file = tmpfile();
+    ASSERT_TRUE(NULL != file);
+    fputs("a\nbb\nccc\n", file);
+    fflush(file);
+    rewind(file);
+
+    TaskMetrics *metrics = MetricsRegistry::instance().acquireTask("/read");
+    MetricsValues before;
+    MetricsRegistry::instance().collect(before);
+    MemoryPositionEntry pe;
+    IOHandler ioh;
+    ASSERT_TRUE(ioh.init(file, &pe, 2, 1024, NULL, acceptLines, metrics));
+    IOHandler::onNotify(&ioh);
+
+    EXPECT_EQ(3, metrics->get(METRIC_LINES_READ));
+    EXPECT_EQ(9, metrics->get(METRIC_BYTES_READ));
+    EXPECT_EQ(2, metrics->get(METRIC_BATCHES_SENT));
+    EXPECT_EQ(0, metrics->get(METRIC_PRODUCE_FAILURES));
+
+    MetricsValues after;
+    MetricsRegistry::instance().collect(after);
+    EXPECT_EQ(2, after.histograms[HISTOGRAM_READ_US].count
+            - before.histograms[HISTOGRAM_READ_US].count);
+
+    fputs("d\n", file);
+    fflush(file);
+    fseek(file, -2, SEEK_END);
+    ioh.m_receive_func = rejectLines;
+    IOHandler::onNotify(&ioh);
+    EXPECT_EQ(1, metrics->get(METRIC_PRODUCE_FAILURES));
+
+    ioh.close();
+    MetricsRegistry::instance().releaseTask(metrics);
+}
@@ -0,0 +1,620 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "mock_kafka_broker.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "base/tools.h"
+
+namespace logkafka {
+
+const int16_t MockKafkaBroker::API_PRODUCE;
+const int16_t MockKafkaBroker::API_METADATA;
+const int16_t MockKafkaBroker::API_VERSIONS;
+const int16_t MockKafkaBroker::ERR_UNSUPPORTED_VERSION;
+const size_t MockKafkaBroker::REQUEST_MAX_BYTES;
+
+namespace {
+
+/* how long setDown() and setUp() wait for the loop thread */
+const int STATE_WAIT_MS = 5000;
+
+} // namespace
+
+MockKafkaBroker::MockKafkaBroker()
+{/*{{{*/
+    m_listener = NULL;
+    m_started = false;
+    m_port = 0;
+    m_partitions = 1;
+    m_next_offset = 0;
+    m_latency_ms = 0;
+    m_want_up = false;
+    m_want_stop = false;
+    m_up = false;
+    m_messages = 0;
+    m_bytes = 0;
+    m_produce_requests = 0;
+}/*}}}*/
+
+MockKafkaBroker::~MockKafkaBroker()
+{/*{{{*/
+    stop();
+}/*}}}*/
+
+bool MockKafkaBroker::start(int port, int partitions)
+{/*{{{*/
+    m_port = port;
+    m_partitions = partitions;
+    m_want_up = true;
+    m_want_stop = false;
+
+    int res = uv_loop_init(&m_loop);
+    if (res < 0) {
+        fprintf(stderr, "Fail to init loop, %s\n", uv_strerror(res));
+        return false;
+    }
+
+    uv_async_init(&m_loop, &m_command, onCommand);
+    m_command.data = this;
+
+    if (!listen()) {
+        uv_close((uv_handle_t *)&m_command, NULL);
+        uv_run(&m_loop, UV_RUN_DEFAULT);
+        uv_loop_close(&m_loop);
+        return false;
+    }
+
+    uv_thread_create(&m_thread, threadFunc, this);
+    m_started = true;
+
+    return true;
+}/*}}}*/
+
+void MockKafkaBroker::stop()
+{/*{{{*/
+    if (!m_started) return;
+
+    m_mutex.lock();
+    m_want_stop = true;
+    m_mutex.unlock();
+
+    uv_async_send(&m_command);
+    uv_thread_join(&m_thread);
+    uv_loop_close(&m_loop);
+    m_started = false;
+}/*}}}*/
+
+string MockKafkaBroker::getBrokerUrls()
+{/*{{{*/
+    return "127.0.0.1:" + int2Str(m_port);
+}/*}}}*/
+
+void MockKafkaBroker::setLatency(long ms)
+{/*{{{*/
+    ScopedLock l(m_mutex);
+    m_latency_ms = ms;
+}/*}}}*/
+
+void MockKafkaBroker::injectErrors(const vector<int16_t> &errors)
+{/*{{{*/
+    ScopedLock l(m_mutex);
+    m_errors.insert(m_errors.end(), errors.begin(), errors.end());
+}/*}}}*/
+
+bool MockKafkaBroker::setDown()
+{/*{{{*/
+    m_mutex.lock();
+    m_want_up = false;
+    m_mutex.unlock();
+
+    uv_async_send(&m_command);
+    for (int i = 0; i < STATE_WAIT_MS && m_up; ++i) usleep(1000);
+
+    return !m_up;
+}/*}}}*/
+
+bool MockKafkaBroker::setUp()
+{/*{{{*/
+    m_mutex.lock();
+    m_want_up = true;
+    m_mutex.unlock();
+
+    uv_async_send(&m_command);
+    for (int i = 0; i < STATE_WAIT_MS && !m_up; ++i) usleep(1000);
+
+    return m_up;
+}/*}}}*/
+
+void MockKafkaBroker::threadFunc(void *arg)
+{/*{{{*/
+    MockKafkaBroker *broker = reinterpret_cast<MockKafkaBroker *>(arg);
+    uv_run(&broker->m_loop, UV_RUN_DEFAULT);
+}/*}}}*/
+
+void MockKafkaBroker::onCommand(uv_async_t *handle)
+{/*{{{*/
+    MockKafkaBroker *broker = reinterpret_cast<MockKafkaBroker *>(handle->data);
+
+    broker->m_mutex.lock();
+    bool want_up = broker->m_want_up;
+    bool want_stop = broker->m_want_stop;
+    broker->m_mutex.unlock();
+
+    if (want_stop || (!want_up && broker->m_up)) {
+        if (NULL != broker->m_listener) {
+            uv_close((uv_handle_t *)broker->m_listener, onListenerClosed);
+            broker->m_listener = NULL;
+        }
+        broker->closeConnections();
+        broker->m_up = false;
+    } else if (want_up && !broker->m_up) {
+        broker->listen();
+    }
+
+    /* the loop exits once every handle is closed */
+    if (want_stop) {
+        uv_close((uv_handle_t *)&broker->m_command, NULL);
+    }
+}/*}}}*/
+
+bool MockKafkaBroker::listen()
+{/*{{{*/
+    m_listener = new uv_tcp_t();
+    uv_tcp_init(&m_loop, m_listener);
+    m_listener->data = this;
+
+    struct sockaddr_in addr;
+    uv_ip4_addr("127.0.0.1", m_port, &addr);
+    int res = uv_tcp_bind(m_listener, (const struct sockaddr *)&addr, 0);
+    if (res >= 0) {
+        res = uv_listen((uv_stream_t *)m_listener, 128, onConnection);
+    }
+    if (res < 0) {
+        fprintf(stderr, "Fail to listen on port %d, %s\n", m_port, 
+                uv_strerror(res));
+        uv_close((uv_handle_t *)m_listener, onListenerClosed);
+        m_listener = NULL;
+        return false;
+    }
+
+    struct sockaddr_in bound;
+    int len = sizeof(bound);
+    uv_tcp_getsockname(m_listener, (struct sockaddr *)&bound, &len);
+    m_port = ntohs(bound.sin_port);
+    m_up = true;
+
+    return true;
+}/*}}}*/
+
+void MockKafkaBroker::onListenerClosed(uv_handle_t *handle)
+{/*{{{*/
+    delete (uv_tcp_t *)handle;
+}/*}}}*/
+
+void MockKafkaBroker::onConnection(uv_stream_t *server, int status)
+{/*{{{*/
+    MockKafkaBroker *broker = reinterpret_cast<MockKafkaBroker *>(server->data);
+    if (status < 0) return;
+
+    Connection *conn = new Connection();
+    conn->broker = broker;
+    conn->open_handles = 2;
+    conn->closing = false;
+    uv_tcp_init(&broker->m_loop, &conn->tcp);
+    conn->tcp.data = conn;
+    uv_timer_init(&broker->m_loop, &conn->timer);
+    conn->timer.data = conn;
+    broker->m_connections.insert(conn);
+
+    if (0 != uv_accept(server, (uv_stream_t *)&conn->tcp)) {
+        broker->closeConnection(conn);
+        return;
+    }
+
+    uv_read_start((uv_stream_t *)&conn->tcp, onAlloc, onRead);
+}/*}}}*/
+
+void MockKafkaBroker::onAlloc(uv_handle_t *handle, size_t suggested_size,
+        uv_buf_t *buf)
+{/*{{{*/
+    buf->base = (char *)malloc(suggested_size);
+    buf->len = (NULL != buf->base)? suggested_size: 0;
+}/*}}}*/
+
+void MockKafkaBroker::onRead(uv_stream_t *stream, ssize_t nread, 
+        const uv_buf_t *buf)
+{/*{{{*/
+    Connection *conn = reinterpret_cast<Connection *>(stream->data);
+    MockKafkaBroker *broker = conn->broker;
+
+    if (nread < 0) {
+        free(buf->base);
+        broker->closeConnection(conn);
+        return;
+    }
+
+    conn->input.append(buf->base, nread);
+    free(buf->base);
+
+    while (!conn->closing && conn->input.length() >= 4) {
+        Reader reader(conn->input.data(), 4);
+        int32_t size = reader.readInt32();
+        if (size < 0 || (size_t)size > REQUEST_MAX_BYTES) {
+            broker->closeConnection(conn);
+            return;
+        }
+        if (conn->input.length() < 4 + (size_t)size) break;
+
+        broker->handleRequest(conn, conn->input.substr(4, size));
+        conn->input.erase(0, 4 + size);
+    }
+}/*}}}*/
+
+void MockKafkaBroker::handleRequest(Connection *conn, const string &request)
+{/*{{{*/
+    Reader reader(request.data(), request.length());
+    int16_t api_key = reader.readInt16();
+    int16_t api_version = reader.readInt16();
+    int32_t correlation_id = reader.readInt32();
+    reader.readString(); // client id
+    if (!reader.ok()) {
+        closeConnection(conn);
+        return;
+    }
+
+    string body;
+    bool respond_now = true;
+    switch (api_key) {
+        case API_VERSIONS:
+            /* newer clients ask with newer versions first, answered
+             * in v0 which every version understands */
+            writeInt16(body, api_version > 0? ERR_UNSUPPORTED_VERSION: 0);
+            writeInt32(body, 3);
+            writeInt16(body, API_PRODUCE); 
+            writeInt16(body, 0); writeInt16(body, 0);
+            writeInt16(body, API_METADATA); 
+            writeInt16(body, 0); writeInt16(body, 0);
+            writeInt16(body, API_VERSIONS); 
+            writeInt16(body, 0); writeInt16(body, 0);
+            break;
+        case API_METADATA:
+            handleMetadata(reader, body);
+            break;
+        case API_PRODUCE:
+            handleProduce(reader, body, respond_now);
+            break;
+        default:
+            closeConnection(conn);
+            return;
+    }
+
+    if (!reader.ok()) {
+        closeConnection(conn);
+        return;
+    }
+
+    if (respond_now) {
+        respond(conn, correlation_id, body);
+    }
+}/*}}}*/
+
+void MockKafkaBroker::handleMetadata(Reader &reader, string &body)
+{/*{{{*/
+    int32_t count = reader.readInt32();
+    for (int32_t i = 0; i < count && reader.ok(); ++i) {
+        m_topics.insert(reader.readString());
+    }
+
+    writeInt32(body, 1);
+    writeInt32(body, 0);
+    writeString(body, "127.0.0.1");
+    writeInt32(body, m_port);
+
+    writeInt32(body, m_topics.size());
+    for (set<string>::const_iterator iter = m_topics.begin();
+            iter != m_topics.end(); ++iter) {
+        writeInt16(body, 0);
+        writeString(body, *iter);
+        writeInt32(body, m_partitions);
+        for (int32_t p = 0; p < m_partitions; ++p) {
+            writeInt16(body, 0);
+            writeInt32(body, p);
+            writeInt32(body, 0);  // leader
+            writeInt32(body, 1);  // replicas
+            writeInt32(body, 0);
+            writeInt32(body, 1);  // isr
+            writeInt32(body, 0);
+        }
+    }
+}/*}}}*/
+
+void MockKafkaBroker::handleProduce(Reader &reader, string &body, 
+        bool &respond)
+{/*{{{*/
+    __sync_fetch_and_add(&m_produce_requests, 1);
+
+    int16_t acks = reader.readInt16();
+    reader.readInt32(); // timeout
+    respond = (0 != acks);
+
+    int32_t topic_count = reader.readInt32();
+    writeInt32(body, topic_count);
+    for (int32_t i = 0; i < topic_count && reader.ok(); ++i) {
+        string topic = reader.readString();
+        m_topics.insert(topic);
+        writeString(body, topic);
+
+        int32_t partition_count = reader.readInt32();
+        writeInt32(body, partition_count);
+        for (int32_t j = 0; j < partition_count && reader.ok(); ++j) {
+            int32_t partition = reader.readInt32();
+            string message_set = reader.readBytes();
+
+            int16_t error = nextError();
+            int64_t offset = -1;
+            if (0 == error) {
+                int64_t n = countMessages(message_set);
+                __sync_fetch_and_add(&m_messages, n);
+                __sync_fetch_and_add(&m_bytes, (int64_t)message_set.length());
+                offset = m_next_offset;
+                m_next_offset += n;
+            }
+
+            writeInt32(body, partition);
+            writeInt16(body, error);
+            writeInt64(body, offset);
+        }
+    }
+}/*}}}*/
+
+int16_t MockKafkaBroker::nextError()
+{/*{{{*/
+    ScopedLock l(m_mutex);
+    if (m_errors.empty()) return 0;
+
+    int16_t error = m_errors.front();
+    m_errors.pop_front();
+    return error;
+}/*}}}*/
+
+void MockKafkaBroker::respond(Connection *conn, int32_t correlation_id,
+        const string &body)
+{/*{{{*/
+    m_mutex.lock();
+    long latency_ms = m_latency_ms;
+    m_mutex.unlock();
+
+    Response response;
+    response.due_us = getMonotonicUs() + latency_ms * 1000;
+    writeInt32(response.data, 4 + body.length());
+    writeInt32(response.data, correlation_id);
+    response.data.append(body);
+
+    /* queued even without latency, responses keep request order */
+    conn->responses.push_back(response);
+    flushResponses(conn);
+}/*}}}*/
+
+void MockKafkaBroker::flushResponses(Connection *conn)
+{/*{{{*/
+    int64_t now_us = getMonotonicUs();
+    while (!conn->responses.empty() 
+            && conn->responses.front().due_us <= now_us) {
+        WriteRequest *wr = new WriteRequest();
+        wr->data.swap(conn->responses.front().data);
+        wr->req.data = wr;
+        conn->responses.pop_front();
+
+        uv_buf_t buf = uv_buf_init(&wr->data[0], wr->data.length());
+        if (0 != uv_write(&wr->req, (uv_stream_t *)&conn->tcp, &buf, 1, 
+                    onWrite)) {
+            delete wr;
+        }
+    }
+
+    if (!conn->responses.empty()) {
+        int64_t wait_ms = (conn->responses.front().due_us - now_us) / 1000;
+        uv_timer_start(&conn->timer, onTimer, wait_ms + 1, 0);
+    }
+}/*}}}*/
+
+void MockKafkaBroker::onTimer(uv_timer_t *handle)
+{/*{{{*/
+    Connection *conn = reinterpret_cast<Connection *>(handle->data);
+    conn->broker->flushResponses(conn);
+}/*}}}*/
+
+void MockKafkaBroker::onWrite(uv_write_t *req, int status)
+{/*{{{*/
+    delete reinterpret_cast<WriteRequest *>(req->data);
+}/*}}}*/
+
+void MockKafkaBroker::closeConnection(Connection *conn)
+{/*{{{*/
+    if (conn->closing) return;
+
+    conn->closing = true;
+    m_connections.erase(conn);
+    uv_close((uv_handle_t *)&conn->tcp, onConnectionClosed);
+    uv_close((uv_handle_t *)&conn->timer, onConnectionClosed);
+}/*}}}*/
+
+void MockKafkaBroker::closeConnections()
+{/*{{{*/
+    set<Connection *> connections = m_connections;
+    for (set<Connection *>::iterator iter = connections.begin();
+            iter != connections.end(); ++iter) {
+        closeConnection(*iter);
+    }
+}/*}}}*/
+
+void MockKafkaBroker::onConnectionClosed(uv_handle_t *handle)
+{/*{{{*/
+    Connection *conn = reinterpret_cast<Connection *>(handle->data);
+    if (0 == --conn->open_handles) {
+        delete conn;
+    }
+}/*}}}*/
+
+int64_t MockKafkaBroker::countMessages(const string &message_set)
+{/*{{{*/
+    int64_t count = 0;
+    size_t pos = 0;
+    while (pos + 12 <= message_set.length()) {
+        Reader header(message_set.data() + pos + 8, 4);
+        int32_t size = header.readInt32();
+        /* the last message may be cut off by the client */
+        if (size < 0 || pos + 12 + size > message_set.length()) break;
+
+        Reader message(message_set.data() + pos + 12, size);
+        message.readInt32(); // crc
+        int8_t magic = message.readInt8();
+        int8_t attributes = message.readInt8();
+        if (magic >= 1) message.readInt64(); // timestamp
+        message.readBytes(); // key
+        string value = message.readBytes();
+
+        /* a gzip compressed wrapper holds a message set */
+        string inner;
+        if (1 == (attributes & 0x07) && inflateGzip(value, inner)) {
+            count += countMessages(inner);
+        } else {
+            ++count;
+        }
+
+        pos += 12 + size;
+    }
+
+    return count;
+}/*}}}*/
+
+bool MockKafkaBroker::inflateGzip(const string &in, string &out)
+{/*{{{*/
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (Z_OK != inflateInit2(&zs, 16 + MAX_WBITS)) return false;
+
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.length();
+
+    char buf[65536];
+    int res = Z_OK;
+    while (Z_OK == res) {
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = sizeof(buf);
+        res = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+
+    return Z_STREAM_END == res;
+}/*}}}*/
+
+void MockKafkaBroker::writeInt16(string &out, int16_t value)
+{/*{{{*/
+    out.push_back((char)((value >> 8) & 0xff));
+    out.push_back((char)(value & 0xff));
+}/*}}}*/
+
+void MockKafkaBroker::writeInt32(string &out, int32_t value)
+{/*{{{*/
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((char)((value >> shift) & 0xff));
+    }
+}/*}}}*/
+
+void MockKafkaBroker::writeInt64(string &out, int64_t value)
+{/*{{{*/
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back((char)((value >> shift) & 0xff));
+    }
+}/*}}}*/
+
+void MockKafkaBroker::writeString(string &out, const string &value)
+{/*{{{*/
+    writeInt16(out, value.length());
+    out.append(value);
+}/*}}}*/
+
+bool MockKafkaBroker::Reader::need(size_t n)
+{/*{{{*/
+    if (!m_ok || m_len - m_pos < n) {
+        m_ok = false;
+    }
+    return m_ok;
+}/*}}}*/
+
+int8_t MockKafkaBroker::Reader::readInt8()
+{/*{{{*/
+    if (!need(1)) return 0;
+    return (int8_t)m_data[m_pos++];
+}/*}}}*/
+
+int16_t MockKafkaBroker::Reader::readInt16()
+{/*{{{*/
+    if (!need(2)) return 0;
+    const unsigned char *p = (const unsigned char *)m_data + m_pos;
+    m_pos += 2;
+    return (int16_t)((p[0] << 8) | p[1]);
+}/*}}}*/
+
+int32_t MockKafkaBroker::Reader::readInt32()
+{/*{{{*/
+    if (!need(4)) return 0;
+    const unsigned char *p = (const unsigned char *)m_data + m_pos;
+    m_pos += 4;
+    return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) 
+            | ((uint32_t)p[2] << 8) | p[3]);
+}/*}}}*/
+
+int64_t MockKafkaBroker::Reader::readInt64()
+{/*{{{*/
+    int64_t high = (uint32_t)readInt32();
+    int64_t low = (uint32_t)readInt32();
+    return (high << 32) | low;
+}/*}}}*/
+
+string MockKafkaBroker::Reader::readString()
+{/*{{{*/
+    int16_t len = readInt16();
+    if (len <= 0 || !need(len)) return "";
+
+    string value(m_data + m_pos, len);
+    m_pos += len;
+    return value;
+}/*}}}*/
+
+string MockKafkaBroker::Reader::readBytes()
+{/*{{{*/
+    int32_t len = readInt32();
+    if (len <= 0 || !need(len)) return "";
+
+    string value(m_data + m_pos, len);
+    m_pos += len;
+    return value;
+}/*}}}*/
+
+} // namespace logkafka
@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_MOCK_KAFKA_BROKER_H_
+#define LOGKAFKA_MOCK_KAFKA_BROKER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+
+#include <uv.h>
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+/* A single kafka broker speaking just enough of the 0.8 protocol for 
+ * producers: Metadata v0, Produce v0 and ApiVersions v0 so that newer
+ * clients fall back to them. Every topic exists with the configured 
+ * number of partitions led by this broker. It runs its own loop in
+ * another thread, all functions may be called from any thread.
+ *
+ * For tests and benchmarks of Producer without a kafka cluster,
+ * scenarios are set up with setLatency(), injectErrors(), setDown() 
+ * and setUp(). */
+class MockKafkaBroker
+{
+    public:
+        MockKafkaBroker();
+        ~MockKafkaBroker();
+
+        /* listens on 127.0.0.1:port, an ephemeral port if 0 */
+        bool start(int port = 0, int partitions = 1);
+        void stop();
+
+        int getPort() { return m_port; };
+        string getBrokerUrls();
+
+        /* responses are sent ms later than requests arrive */
+        void setLatency(long ms);
+        /* the next produce requests fail with these error codes, one
+         * for each partition of a request */
+        void injectErrors(const vector<int16_t> &errors);
+        /* closes the listener and all connections, as if the broker
+         * was shut down, and listens on the same port again */
+        bool setDown();
+        bool setUp();
+
+        /* counted when acknowledged without error */
+        int64_t getMessages() { return __sync_add_and_fetch(&m_messages, 0); };
+        int64_t getBytes() { return __sync_add_and_fetch(&m_bytes, 0); };
+        int64_t getProduceRequests() 
+        { return __sync_add_and_fetch(&m_produce_requests, 0); };
+
+    public:
+        static const int16_t API_PRODUCE = 0;
+        static const int16_t API_METADATA = 3;
+        static const int16_t API_VERSIONS = 18;
+        static const int16_t ERR_UNSUPPORTED_VERSION = 35;
+        static const size_t REQUEST_MAX_BYTES = 104857600;
+
+    private:
+        struct Connection;
+
+        struct Response
+        {
+            int64_t due_us;
+            string data;
+        };
+
+        struct Connection
+        {
+            uv_tcp_t tcp;
+            uv_timer_t timer;
+            MockKafkaBroker *broker;
+            string input;
+            deque<Response> responses;
+            int open_handles;
+            bool closing;
+        };
+
+        struct WriteRequest
+        {
+            uv_write_t req;
+            string data;
+        };
+
+        /* bounds checked reading of big endian request fields */
+        class Reader
+        {
+            public:
+                Reader(const char *data, size_t len)
+                    : m_data(data), m_len(len), m_pos(0), m_ok(true) {};
+
+                int8_t readInt8();
+                int16_t readInt16();
+                int32_t readInt32();
+                int64_t readInt64();
+                string readString();
+                /* bytes with int32 length, empty if null */
+                string readBytes();
+                bool ok() { return m_ok; };
+                size_t remaining() { return m_ok? m_len - m_pos: 0; };
+
+            private:
+                bool need(size_t n);
+
+                const char *m_data;
+                size_t m_len;
+                size_t m_pos;
+                bool m_ok;
+        };
+
+        static void writeInt16(string &out, int16_t value);
+        static void writeInt32(string &out, int32_t value);
+        static void writeInt64(string &out, int64_t value);
+        static void writeString(string &out, const string &value);
+
+        static int64_t countMessages(const string &message_set);
+        static bool inflateGzip(const string &in, string &out);
+
+        bool listen();
+        void closeConnections();
+        void closeConnection(Connection *conn);
+        void handleRequest(Connection *conn, const string &request);
+        void handleMetadata(Reader &reader, string &body);
+        void handleProduce(Reader &reader, string &body, bool &respond);
+        void respond(Connection *conn, int32_t correlation_id, 
+                const string &body);
+        void flushResponses(Connection *conn);
+        int16_t nextError();
+
+        static void threadFunc(void *arg);
+        static void onCommand(uv_async_t *handle);
+        static void onConnection(uv_stream_t *server, int status);
+        static void onAlloc(uv_handle_t *handle, size_t suggested_size,
+                uv_buf_t *buf);
+        static void onRead(uv_stream_t *stream, ssize_t nread, 
+                const uv_buf_t *buf);
+        static void onWrite(uv_write_t *req, int status);
+        static void onTimer(uv_timer_t *handle);
+        static void onConnectionClosed(uv_handle_t *handle);
+        static void onListenerClosed(uv_handle_t *handle);
+
+    private:
+        uv_loop_t m_loop;
+        uv_thread_t m_thread;
+        uv_async_t m_command;
+        uv_tcp_t *m_listener;
+        set<Connection *> m_connections;
+        bool m_started;
+
+        int m_port;
+        int m_partitions;
+        set<string> m_topics;
+        int64_t m_next_offset;
+
+        /* set by callers, applied in loop thread */
+        Mutex m_mutex;
+        long m_latency_ms;
+        deque<int16_t> m_errors;
+        bool m_want_up;
+        bool m_want_stop;
+        volatile bool m_up;
+
+        volatile int64_t m_messages;
+        volatile int64_t m_bytes;
+        volatile int64_t m_produce_requests;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_MOCK_KAFKA_BROKER_H_
@@ -0,0 +1,258 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#include "mock_stream_server.h"
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "base/tools.h"
+
+namespace logkafka {
+
+namespace {
+
+/* how often the thread looks at flags set by other threads */
+const int POLL_TIMEOUT_MS = 10;
+const size_t READ_BYTES = 65536;
+
+} // namespace
+
+MockStreamServer::MockStreamServer()
+{/*{{{*/
+    m_listen_fd = -1;
+    m_started = false;
+    m_want_stop = false;
+    m_paused = false;
+    m_want_drop = false;
+    m_keep_data = false;
+    m_bytes = 0;
+    m_lines = 0;
+    m_connections = 0;
+}/*}}}*/
+
+MockStreamServer::~MockStreamServer()
+{/*{{{*/
+    stop();
+}/*}}}*/
+
+bool MockStreamServer::startUnix(const string &path)
+{/*{{{*/
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+
+    unlink(path.c_str());
+    m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listen_fd < 0 
+            || 0 != bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        stop();
+        return false;
+    }
+
+    m_unix_path = path;
+    m_address = path;
+    return start();
+}/*}}}*/
+
+bool MockStreamServer::startTcp(int port)
+{/*{{{*/
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int on = 1;
+    socklen_t len = sizeof(addr);
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0 
+            || 0 != setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, 
+                &on, sizeof(on))
+            || 0 != bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr))
+            || 0 != getsockname(m_listen_fd, (struct sockaddr *)&addr, &len)) {
+        stop();
+        return false;
+    }
+
+    m_address = "127.0.0.1:" + int2Str(ntohs(addr.sin_port));
+    return start();
+}/*}}}*/
+
+bool MockStreamServer::start()
+{/*{{{*/
+    if (0 != listen(m_listen_fd, 128)) {
+        stop();
+        return false;
+    }
+
+    m_want_stop = false;
+    if (0 != uv_thread_create(&m_thread, threadFunc, this)) {
+        stop();
+        return false;
+    }
+
+    m_started = true;
+    return true;
+}/*}}}*/
+
+void MockStreamServer::stop()
+{/*{{{*/
+    if (m_started) {
+        m_want_stop = true;
+        uv_thread_join(&m_thread);
+        m_started = false;
+    }
+
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+    }
+
+    if (!m_unix_path.empty()) {
+        unlink(m_unix_path.c_str());
+        m_unix_path = "";
+    }
+}/*}}}*/
+
+void MockStreamServer::pause()
+{/*{{{*/
+    m_paused = true;
+}/*}}}*/
+
+void MockStreamServer::resume()
+{/*{{{*/
+    m_paused = false;
+}/*}}}*/
+
+void MockStreamServer::dropConnections()
+{/*{{{*/
+    m_want_drop = true;
+    while (m_started && m_want_drop) {
+        usleep(1000);
+    }
+}/*}}}*/
+
+void MockStreamServer::setKeepData(bool keep)
+{/*{{{*/
+    m_keep_data = keep;
+}/*}}}*/
+
+string MockStreamServer::getData()
+{/*{{{*/
+    ScopedLock l(m_data_mutex);
+    return m_data;
+}/*}}}*/
+
+bool MockStreamServer::waitLines(int64_t lines, long timeout_ms)
+{/*{{{*/
+    for (long waited = 0; getLines() < lines; ++waited) {
+        if (waited >= timeout_ms) return false;
+        usleep(1000);
+    }
+
+    return true;
+}/*}}}*/
+
+void MockStreamServer::threadFunc(void *arg)
+{/*{{{*/
+    reinterpret_cast<MockStreamServer *>(arg)->run();
+}/*}}}*/
+
+void MockStreamServer::run()
+{/*{{{*/
+    vector<int> fds;
+    char *buf = new char[READ_BYTES];
+
+    while (!m_want_stop) {
+        if (m_want_drop) {
+            for (size_t i = 0; i < fds.size(); ++i) close(fds[i]);
+            fds.clear();
+            m_want_drop = false;
+        }
+
+        /* while paused only new connections are accepted */
+        vector<struct pollfd> pfds;
+        struct pollfd listen_pfd = {m_listen_fd, POLLIN, 0};
+        pfds.push_back(listen_pfd);
+        if (!m_paused) {
+            for (size_t i = 0; i < fds.size(); ++i) {
+                struct pollfd pfd = {fds[i], POLLIN, 0};
+                pfds.push_back(pfd);
+            }
+        }
+
+        if (poll(&pfds[0], pfds.size(), POLL_TIMEOUT_MS) <= 0) continue;
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept(m_listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                fds.push_back(fd);
+                __sync_add_and_fetch(&m_connections, 1);
+            }
+        }
+
+        vector<int> closed;
+        for (size_t i = 1; i < pfds.size(); ++i) {
+            if (0 == pfds[i].revents) continue;
+
+            ssize_t n = read(pfds[i].fd, buf, READ_BYTES);
+            if (n <= 0) {
+                closed.push_back(pfds[i].fd);
+                continue;
+            }
+
+            int64_t lines = 0;
+            for (const char *p = buf; 
+                    NULL != (p = (const char *)memchr(p, '\n', buf + n - p)); 
+                    ++p) {
+                ++lines;
+            }
+            __sync_add_and_fetch(&m_bytes, n);
+            __sync_add_and_fetch(&m_lines, lines);
+
+            if (m_keep_data) {
+                ScopedLock l(m_data_mutex);
+                m_data.append(buf, n);
+            }
+        }
+
+        for (size_t i = 0; i < closed.size(); ++i) {
+            close(closed[i]);
+            fds.erase(find(fds.begin(), fds.end(), closed[i]));
+        }
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) close(fds[i]);
+    delete [] buf;
+}/*}}}*/
+
+} // namespace logkafka
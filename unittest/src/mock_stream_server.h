@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// logkafka - Collect logs and send lines to Apache Kafka v0.8+
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015 Qihoo 360 Technology Co., Ltd. All rights reserved.
+//
+// Licensed under the MIT License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://opensource.org/licenses/MIT
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+#ifndef LOGKAFKA_MOCK_STREAM_SERVER_H_
+#define LOGKAFKA_MOCK_STREAM_SERVER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+
+#include <uv.h>
+
+using namespace std;
+using namespace base;
+
+namespace logkafka {
+
+/* Accepts connections on a unix socket or on 127.0.0.1 and counts the
+ * lines written to it, a stand-in for the peer of stream outputs in 
+ * tests and benchmarks. It runs in its own thread, all functions may 
+ * be called from any thread. pause() stops reading so that socket 
+ * buffers fill up, dropConnections() closes the accepted ones. */
+class MockStreamServer
+{
+    public:
+        MockStreamServer();
+        ~MockStreamServer();
+
+        bool startUnix(const string &path);
+        /* an ephemeral port if 0 */
+        bool startTcp(int port = 0);
+        void stop();
+
+        /* as the address of StreamOutputConf */
+        string getAddress() { return m_address; };
+
+        void pause();
+        void resume();
+        void dropConnections();
+        /* bytes read are kept for getData() */
+        void setKeepData(bool keep);
+
+        int64_t getBytes() { return __sync_add_and_fetch(&m_bytes, 0); };
+        int64_t getLines() { return __sync_add_and_fetch(&m_lines, 0); };
+        int64_t getConnections() 
+        { return __sync_add_and_fetch(&m_connections, 0); };
+        string getData();
+
+        /* until lines are read or timeout_ms passed */
+        bool waitLines(int64_t lines, long timeout_ms);
+
+    private:
+        bool start();
+        void run();
+        static void threadFunc(void *arg);
+
+    private:
+        int m_listen_fd;
+        string m_unix_path;
+        string m_address;
+        uv_thread_t m_thread;
+        bool m_started;
+
+        volatile bool m_want_stop;
+        volatile bool m_paused;
+        volatile bool m_want_drop;
+        volatile bool m_keep_data;
+
+        int64_t m_bytes;
+        int64_t m_lines;
+        int64_t m_connections;
+
+        Mutex m_data_mutex;
+        string m_data;
+};
+
+} // namespace logkafka
+
+#endif // LOGKAFKA_MOCK_STREAM_SERVER_H_
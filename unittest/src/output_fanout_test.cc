@@ -0,0 +1,150 @@
+#include <string>
+#include <vector>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/output_fanout.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+/* keeps lines it is given, fails when told to */
+class RecordingOutput: public Output
+{
+    public:
+        RecordingOutput(): m_fail(false) {};
+
+        bool init(void *arg) { return true; };
+        bool output(void *arg, const vector<string> &lines,
+                int64_t write_time_us)
+        {
+            RecordingOutput *ro = reinterpret_cast<RecordingOutput *>(arg);
+            if (ro->m_fail) return false;
+            ro->m_lines.insert(ro->m_lines.end(), lines.begin(), lines.end());
+            return true;
+        };
+
+        void setFull(bool full) { notifyBackpressure(full); };
+
+        bool m_fail;
+        vector<string> m_lines;
+};
+
+void recordBackpressure(void *arg, bool full)
+{
+    reinterpret_cast<vector<bool> *>(arg)->push_back(full);
+}
+
+} // namespace
+
+TEST (OutputFanoutTest, PassBatchToEveryOutput) {
+    OutputFanout fanout;
+    RecordingOutput *first = new RecordingOutput();
+    RecordingOutput *second = new RecordingOutput();
+    fanout.add(first);
+    fanout.add(second);
+    ASSERT_EQ((size_t)2, fanout.size());
+
+    vector<string> lines;
+    lines.push_back("a");
+    lines.push_back("b");
+    EXPECT_TRUE(fanout.output(&fanout, lines, 0));
+
+    EXPECT_EQ(lines, first->m_lines);
+    EXPECT_EQ(lines, second->m_lines);
+    EXPECT_EQ(1, fanout.getWatermark(0).batches);
+    EXPECT_EQ(2, fanout.getWatermark(1).lines);
+}
+
+TEST (OutputFanoutTest, NotSentUnlessAllOutputsTakeIt) {
+    OutputFanout fanout;
+    RecordingOutput *first = new RecordingOutput();
+    RecordingOutput *second = new RecordingOutput();
+    fanout.add(first);
+    fanout.add(second);
+
+    vector<string> lines(3, "line");
+    second->m_fail = true;
+    EXPECT_FALSE(fanout.output(&fanout, lines, 0));
+
+    /* the other output is not held back */
+    EXPECT_EQ((size_t)3, first->m_lines.size());
+    EXPECT_EQ(3, fanout.getWatermark(0).lines);
+    EXPECT_EQ(0, fanout.getWatermark(1).lines);
+    EXPECT_EQ(1, fanout.getWatermark(1).failures);
+
+    /* the batch read again only goes to the output which failed */
+    second->m_fail = false;
+    EXPECT_TRUE(fanout.output(&fanout, lines, 0));
+    EXPECT_EQ((size_t)3, first->m_lines.size());
+    EXPECT_EQ((size_t)3, second->m_lines.size());
+    EXPECT_EQ(1, fanout.getWatermark(0).batches);
+    EXPECT_EQ(1, fanout.getWatermark(1).batches);
+    EXPECT_EQ(0, fanout.getWatermark(0).failures);
+
+    EXPECT_TRUE(fanout.output(&fanout, lines, 0));
+    EXPECT_EQ((size_t)6, first->m_lines.size());
+    EXPECT_EQ((size_t)6, second->m_lines.size());
+}
+
+TEST (OutputFanoutTest, RetryOnlyLinesNotTaken) {
+    OutputFanout fanout;
+    RecordingOutput *first = new RecordingOutput();
+    RecordingOutput *second = new RecordingOutput();
+    fanout.add(first);
+    fanout.add(second);
+
+    vector<string> lines;
+    lines.push_back("a");
+    lines.push_back("b");
+    second->m_fail = true;
+    EXPECT_FALSE(fanout.output(&fanout, lines, 0));
+    EXPECT_FALSE(fanout.output(&fanout, lines, 0));
+    EXPECT_EQ(2, fanout.getWatermark(1).failures);
+
+    /* read again with lines written since */
+    lines.push_back("c");
+    second->m_fail = false;
+    EXPECT_TRUE(fanout.output(&fanout, lines, 0));
+    ASSERT_EQ((size_t)3, first->m_lines.size());
+    EXPECT_EQ("c", first->m_lines[2]);
+    EXPECT_EQ(lines, second->m_lines);
+    EXPECT_EQ(3, fanout.getWatermark(0).lines);
+
+    /* other lines than taken before are passed as a whole */
+    second->m_fail = true;
+    vector<string> other(1, "d");
+    EXPECT_FALSE(fanout.output(&fanout, other, 0));
+    other[0] = "e";
+    second->m_fail = false;
+    EXPECT_TRUE(fanout.output(&fanout, other, 0));
+    ASSERT_EQ((size_t)5, first->m_lines.size());
+    EXPECT_EQ("e", first->m_lines[4]);
+    EXPECT_EQ("e", second->m_lines[3]);
+}
+
+TEST (OutputFanoutTest, FullWhileAnyOutputIsFull) {
+    OutputFanout fanout;
+    RecordingOutput *first = new RecordingOutput();
+    RecordingOutput *second = new RecordingOutput();
+    fanout.add(first);
+    fanout.add(second);
+
+    vector<bool> states;
+    fanout.setBackpressureCallback(recordBackpressure, &states);
+
+    first->setFull(true);
+    second->setFull(true);
+    first->setFull(false);
+    ASSERT_EQ((size_t)1, states.size());
+    EXPECT_TRUE(states[0]);
+
+    second->setFull(false);
+    ASSERT_EQ((size_t)2, states.size());
+    EXPECT_FALSE(states[1]);
+}
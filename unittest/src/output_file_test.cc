@@ -0,0 +1,214 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/output_file.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+using namespace logkafka;
+
+class OutputFileTest: public ::testing::Test {
+protected:
+    OutputFileTest() {
+    }
+
+    virtual ~OutputFileTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.outputXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        m_conf.path = m_dir + "/archive";
+    }
+
+    virtual void TearDown() {
+        string cmd = "rm -rf " + m_dir;
+        system(cmd.c_str());
+    }
+
+public:
+    /* segment files in the order they are started */
+    vector<string> listSegments();
+    /* lines of all segments, gzipped ones are inflated */
+    string readSegments();
+
+    string m_dir;
+    FileOutputConf m_conf;
+};
+
+vector<string> OutputFileTest::listSegments() {
+    vector<string> segments;
+    DIR *dir = opendir(m_dir.c_str());
+    struct dirent *entry;
+    while (NULL != dir && NULL != (entry = readdir(dir))) {
+        if ('.' != entry->d_name[0]) {
+            segments.push_back(m_dir + "/" + entry->d_name);
+        }
+    }
+    if (NULL != dir) closedir(dir);
+
+    /* names sort by start time, then by sequence number */
+    sort(segments.begin(), segments.end());
+    return segments;
+}
+
+string OutputFileTest::readSegments() {
+    string content;
+    vector<string> segments = listSegments();
+    for (vector<string>::const_iterator iter = segments.begin();
+            iter != segments.end(); ++iter) {
+        /* gzread reads concatenated members and plain files alike */
+        gzFile file = gzopen(iter->c_str(), "rb");
+        char buf[4096];
+        int n;
+        while ((n = gzread(file, buf, sizeof(buf))) > 0) {
+            content.append(buf, n);
+        }
+        gzclose(file);
+    }
+    return content;
+}
+
+TEST_F (OutputFileTest, WriteLines) {
+    OutputFile output;
+    ASSERT_TRUE(output.init(&m_conf));
+
+    vector<string> lines;
+    lines.push_back("first");
+    lines.push_back("");
+    lines.push_back("third");
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    EXPECT_TRUE(output.output(&output, lines, 0));
+
+    ASSERT_EQ((size_t)1, listSegments().size());
+    EXPECT_EQ(0u, output.getSegmentPath().find(m_conf.path + "."));
+    EXPECT_EQ("first\n\nthird\nfirst\n\nthird\n", readSegments());
+}
+
+TEST_F (OutputFileTest, RotateBySize) {
+    m_conf.segment_bytes = 100;
+    OutputFile output;
+    ASSERT_TRUE(output.init(&m_conf));
+
+    string expected;
+    for (int i = 0; i < 20; ++i) {
+        vector<string> lines;
+        lines.push_back("line " + int2Str(i) + " of twenty");
+        EXPECT_TRUE(output.output(&output, lines, 0));
+        expected += lines[0] + "\n";
+    }
+
+    /* a segment is started once the last one reaches segment_bytes, 
+     * 6 lines of 17 or 18 bytes each */
+    EXPECT_EQ((size_t)4, listSegments().size());
+    EXPECT_EQ(expected, readSegments());
+}
+
+TEST_F (OutputFileTest, RotateByTime) {
+    m_conf.segment_ms = 50;
+    OutputFile output;
+    ASSERT_TRUE(output.init(&m_conf));
+
+    vector<string> lines(1, "line");
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    usleep(100000);
+    EXPECT_TRUE(output.output(&output, lines, 0));
+
+    EXPECT_EQ((size_t)2, listSegments().size());
+    EXPECT_EQ("line\nline\nline\n", readSegments());
+}
+
+TEST_F (OutputFileTest, AppendToSegmentLeftByRestart) {
+    vector<string> lines(1, "line");
+    string path;
+    {
+        OutputFile output;
+        ASSERT_TRUE(output.init(&m_conf));
+        EXPECT_TRUE(output.output(&output, lines, 0));
+        path = output.getSegmentPath();
+    }
+
+    /* appended to unless the restart is in another second */
+    OutputFile output;
+    ASSERT_TRUE(output.init(&m_conf));
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    if (path == output.getSegmentPath()) {
+        EXPECT_EQ((size_t)1, listSegments().size());
+    }
+    EXPECT_EQ("line\nline\n", readSegments());
+}
+
+TEST_F (OutputFileTest, Gzip) {
+    m_conf.compression_codec = "gzip";
+    OutputFile output;
+    ASSERT_TRUE(output.init(&m_conf));
+
+    string expected;
+    vector<string> lines;
+    for (int i = 0; i < 1000; ++i) {
+        lines.push_back("127.0.0.1 - - \"GET /index.html HTTP/1.1\" 200 " 
+                + int2Str(i));
+        expected += lines.back() + "\n";
+    }
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    expected += expected;
+
+    vector<string> segments = listSegments();
+    ASSERT_EQ((size_t)1, segments.size());
+    EXPECT_EQ(".gz", segments[0].substr(segments[0].length() - 3));
+    EXPECT_LT(getFsize(segments[0].c_str()), (off_t)expected.length() / 4);
+    EXPECT_EQ(expected, readSegments());
+}
+
+TEST_F (OutputFileTest, SegmentsOfEachSource) {
+    vector<string> lines(1, "line");
+    m_conf.segment_bytes = 5;
+    m_conf.source = "/var/log/a/app.log";
+    OutputFile first;
+    ASSERT_TRUE(first.init(&m_conf));
+    m_conf.source = "/var/log/b/app.log";
+    OutputFile second;
+    ASSERT_TRUE(second.init(&m_conf));
+
+    EXPECT_TRUE(first.output(&first, lines, 0));
+    EXPECT_TRUE(second.output(&second, lines, 0));
+    EXPECT_TRUE(first.output(&first, lines, 0));
+
+    /* segments are numbered for each of them */
+    vector<string> segments = listSegments();
+    ASSERT_EQ((size_t)3, segments.size());
+    EXPECT_EQ(0u, first.getSegmentPath().find(
+                m_conf.path + ".var_log_a_app.log."));
+    EXPECT_EQ(0u, second.getSegmentPath().find(
+                m_conf.path + ".var_log_b_app.log."));
+    EXPECT_EQ(5, getFsize(second.getSegmentPath().c_str()));
+}
+
+TEST_F (OutputFileTest, IllegalConf) {
+    OutputFile output;
+    FileOutputConf conf;
+    EXPECT_FALSE(output.init(&conf));
+
+    conf.path = m_dir + "/archive";
+    conf.compression_codec = "snappy";
+    EXPECT_FALSE(output.init(&conf));
+
+    conf.compression_codec = "none";
+    conf.path = m_dir + "/missing/archive";
+    EXPECT_FALSE(output.init(&conf));
+}
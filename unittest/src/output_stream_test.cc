@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#include "mock_stream_server.h"
+#define protected public
+#define private public
+#include "logkafka/output_stream.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+using namespace logkafka;
+
+namespace {
+
+typedef bool (*Condition)(OutputStream *);
+
+bool isConnected(OutputStream *os) { return os->isConnected(); }
+bool isDisconnected(OutputStream *os) { return !os->isConnected(); }
+bool isWritten(OutputStream *os) { return 0 == os->getPendingBytes(); }
+
+void recordBackpressure(void *arg, bool full)
+{
+    reinterpret_cast<vector<bool> *>(arg)->push_back(full);
+}
+
+} // namespace
+
+class OutputStreamTest: public ::testing::Test {
+protected:
+    OutputStreamTest() {
+    }
+
+    virtual ~OutputStreamTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.streamXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        ASSERT_EQ(0, uv_loop_init(&m_loop));
+    }
+
+    virtual void TearDown() {
+        m_server.stop();
+        uv_run(&m_loop, UV_RUN_DEFAULT);
+        uv_loop_close(&m_loop);
+
+        string cmd = "rm -rf " + m_dir;
+        system(cmd.c_str());
+    }
+
+public:
+    bool runUntil(Condition cond, OutputStream *os, long timeout_ms);
+
+    string m_dir;
+    uv_loop_t m_loop;
+    MockStreamServer m_server;
+};
+
+bool OutputStreamTest::runUntil(Condition cond, OutputStream *os, 
+        long timeout_ms) {
+    for (long waited = 0; !cond(os); ++waited) {
+        if (waited >= timeout_ms) return false;
+        uv_run(&m_loop, UV_RUN_NOWAIT);
+        usleep(1000);
+    }
+    return true;
+}
+
+TEST_F (OutputStreamTest, WriteLinesToUnixSocket) {
+    ASSERT_TRUE(m_server.startUnix(m_dir + "/sock"));
+    m_server.setKeepData(true);
+
+    StreamOutputConf conf;
+    conf.address = m_server.getAddress();
+    OutputStream output;
+    ASSERT_TRUE(output.init(&m_loop, "unix", conf));
+    ASSERT_TRUE(runUntil(isConnected, &output, 5000));
+
+    vector<string> lines;
+    lines.push_back("a1");
+    lines.push_back("");
+    lines.push_back("a3");
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    ASSERT_TRUE(runUntil(isWritten, &output, 5000));
+
+    ASSERT_TRUE(m_server.waitLines(3, 5000));
+    EXPECT_EQ("a1\n\na3\n", m_server.getData());
+}
+
+TEST_F (OutputStreamTest, QueueLinesUntilConnected) {
+    ASSERT_TRUE(m_server.startTcp());
+    m_server.setKeepData(true);
+
+    StreamOutputConf conf;
+    conf.address = m_server.getAddress();
+    OutputStream output;
+    ASSERT_TRUE(output.init(&m_loop, "tcp", conf));
+
+    vector<string> lines(2, "b");
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    EXPECT_FALSE(output.isConnected());
+    EXPECT_EQ(4, output.getPendingBytes());
+
+    ASSERT_TRUE(runUntil(isWritten, &output, 5000));
+    ASSERT_TRUE(m_server.waitLines(2, 5000));
+    EXPECT_EQ("b\nb\n", m_server.getData());
+}
+
+TEST_F (OutputStreamTest, RejectIllegalAddress) {
+    StreamOutputConf conf;
+    conf.address = "127.0.0.1";
+    EXPECT_FALSE(OutputStream().init(&m_loop, "tcp", conf));
+    conf.address = "127.0.0.1:0";
+    EXPECT_FALSE(OutputStream().init(&m_loop, "tcp", conf));
+    conf.address = "localhost:5140";
+    EXPECT_FALSE(OutputStream().init(&m_loop, "tcp", conf));
+    conf.address = "[::1]:5140";
+    EXPECT_TRUE(OutputStream().init(&m_loop, "tcp", conf));
+    conf.address = m_dir + "/" + string(200, 's');
+    EXPECT_FALSE(OutputStream().init(&m_loop, "unix", conf));
+}
+
+TEST_F (OutputStreamTest, PauseWhileSocketIsFull) {
+    ASSERT_TRUE(m_server.startUnix(m_dir + "/sock"));
+    m_server.pause();
+
+    StreamOutputConf conf;
+    conf.address = m_server.getAddress();
+    conf.max_pending_bytes = 65536;
+    OutputStream output;
+    ASSERT_TRUE(output.init(&m_loop, "unix", conf));
+    vector<bool> states;
+    output.setBackpressureCallback(recordBackpressure, &states);
+    ASSERT_TRUE(runUntil(isConnected, &output, 5000));
+
+    /* socket buffers fill up first */
+    vector<string> lines(100, string(999, 'x'));
+    int64_t batches = 0;
+    for (; batches < 10000 && !output.isFull(); ++batches) {
+        EXPECT_TRUE(output.output(&output, lines, 0));
+        uv_run(&m_loop, UV_RUN_NOWAIT);
+    }
+    ASSERT_TRUE(output.isFull());
+    ASSERT_EQ((size_t)1, states.size());
+    EXPECT_TRUE(states[0]);
+    EXPECT_GE(output.getPendingBytes(), conf.max_pending_bytes);
+
+    m_server.resume();
+    ASSERT_TRUE(runUntil(isWritten, &output, 10000));
+    ASSERT_EQ((size_t)2, states.size());
+    EXPECT_FALSE(states[1]);
+    ASSERT_TRUE(m_server.waitLines(batches * 100, 5000));
+    EXPECT_EQ(batches * 100 * 1000, m_server.getBytes());
+}
+
+TEST_F (OutputStreamTest, ReconnectAfterConnectionIsClosed) {
+    ASSERT_TRUE(m_server.startTcp());
+    m_server.setKeepData(true);
+
+    StreamOutputConf conf;
+    conf.address = m_server.getAddress();
+    OutputStream output;
+    ASSERT_TRUE(output.init(&m_loop, "tcp", conf));
+    ASSERT_TRUE(runUntil(isConnected, &output, 5000));
+
+    vector<string> lines(1, "c1");
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    ASSERT_TRUE(m_server.waitLines(1, 5000));
+
+    m_server.dropConnections();
+    ASSERT_TRUE(runUntil(isDisconnected, &output, 5000));
+
+    /* queued until connected again */
+    lines[0] = "c2";
+    EXPECT_TRUE(output.output(&output, lines, 0));
+    ASSERT_TRUE(runUntil(isConnected, &output, 5000));
+    ASSERT_TRUE(runUntil(isWritten, &output, 5000));
+    ASSERT_TRUE(m_server.waitLines(2, 5000));
+    EXPECT_EQ("c1\nc2\n", m_server.getData());
+    EXPECT_EQ(2, m_server.getConnections());
+}
+
+TEST_F (OutputStreamTest, WholeLineToNextPeer) {
+    ASSERT_TRUE(m_server.startUnix(m_dir + "/sock"));
+    m_server.pause();
+
+    StreamOutputConf conf;
+    conf.address = m_server.getAddress();
+    OutputStream output;
+    ASSERT_TRUE(output.init(&m_loop, "unix", conf));
+    ASSERT_TRUE(runUntil(isConnected, &output, 5000));
+
+    /* lines of odd length, the socket fills up in the middle of one */
+    vector<string> lines(100, string(996, 'x'));
+    for (int i = 0; i < 10000 && output.m_pending.empty(); ++i) {
+        EXPECT_TRUE(output.output(&output, lines, 0));
+    }
+    ASSERT_FALSE(output.m_pending.empty());
+    ASSERT_NE(0, output.getPendingBytes() % 997);
+
+    /* the peer changes, it gets the line from its start */
+    output.disconnect();
+    EXPECT_EQ(0, output.getPendingBytes() % 997);
+    EXPECT_EQ(string(996, 'x') + "\n", output.m_pending.front().substr(0, 997));
+}
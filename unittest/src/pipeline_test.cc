@@ -0,0 +1,77 @@
+#include <string>
+#include <vector>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/pipeline.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+StageConf stageConf(const string &stage, uint32_t max_bytes = 0)
+{
+    StageConf conf;
+    conf.stage = stage;
+    conf.max_bytes = max_bytes;
+    return conf;
+}
+
+} // namespace
+
+TEST (PipelineTest, RunStagesInOrder) {
+    vector<StageConf> confs;
+    confs.push_back(stageConf("trim"));
+    confs.push_back(stageConf("drop_empty"));
+    confs.push_back(stageConf("truncate", 4));
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.init(confs));
+    ASSERT_EQ((size_t)3, pipeline.size());
+
+    vector<string> lines;
+    lines.push_back("a1\r");
+    lines.push_back(" \t");
+    lines.push_back("");
+    lines.push_back("a2 with spaces  ");
+    EXPECT_EQ((size_t)2, pipeline.process(lines));
+
+    ASSERT_EQ((size_t)2, lines.size());
+    EXPECT_EQ("a1", lines[0]);
+    EXPECT_EQ("a2 w", lines[1]);
+}
+
+TEST (PipelineTest, KeepLinesInPlace) {
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.init(vector<StageConf>(1, stageConf("drop_empty"))));
+
+    /* kept lines are moved forward with their buffers, not copied */
+    vector<string> lines;
+    lines.push_back("");
+    lines.push_back(string(100, 'a'));
+    lines.push_back("");
+    lines.push_back(string(100, 'b'));
+    const char *a = lines[1].data();
+    const char *b = lines[3].data();
+    EXPECT_EQ((size_t)2, pipeline.process(lines));
+
+    ASSERT_EQ((size_t)2, lines.size());
+    EXPECT_EQ(a, lines[0].data());
+    EXPECT_EQ(b, lines[1].data());
+    EXPECT_EQ(string(100, 'b'), lines[1]);
+}
+
+TEST (PipelineTest, RejectIllegalStage) {
+    Pipeline unknown;
+    EXPECT_FALSE(unknown.init(vector<StageConf>(1, stageConf("grep"))));
+    Pipeline zero;
+    EXPECT_FALSE(zero.init(vector<StageConf>(1, stageConf("truncate"))));
+
+    EXPECT_FALSE(stageConf("truncate").isLegal());
+    EXPECT_TRUE(stageConf("truncate", 1).isLegal());
+    EXPECT_TRUE(stageConf("trim").isLegal());
+    EXPECT_FALSE(stageConf("").isLegal());
+}
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/position_file.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+class PositionFileTest: public ::testing::Test {
+protected:
+    PositionFileTest() {
+    }
+
+    virtual ~PositionFileTest() {
+    }
+
+    virtual void SetUp() {
+        char filename[] = "/tmp/logkafka_test.posXXXXXX";
+        int fd = mkstemp(filename);
+        ASSERT_NE(-1, fd);
+        close(fd);
+        m_path = filename;
+    }
+
+    virtual void TearDown() {
+        unlink(m_path.c_str());
+        unlink((m_path + ".tmp").c_str());
+    }
+
+public:
+    static void writeFile(const string &path, const string &content);
+    static string readFile(const string &path);
+    static size_t countLines(const string &content);
+
+    string m_path;
+};
+
+void PositionFileTest::writeFile(const string &path, const string &content) {
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    out << content;
+}
+
+string PositionFileTest::readFile(const string &path) {
+    std::ifstream in(path.c_str());
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+size_t PositionFileTest::countLines(const string &content) {
+    size_t n = 0;
+    for (size_t i = 0; i < content.length(); ++i) {
+        if (content[i] == '\n') ++n;
+    }
+    return n;
+}
+
+TEST_F (PositionFileTest, ParseLine) {
+    PositionEntryKey pek;
+    off_t pos;
+    ino_t inode;
+
+    EXPECT_TRUE(PositionFile::parseLine(
+                "/a/b.%Y\t/a/b.2015\t00000000000000ff\t0000001a\n",
+                pek, pos, inode));
+    EXPECT_EQ("/a/b.%Y", pek.path_pattern);
+    EXPECT_EQ("/a/b.2015", pek.path);
+    EXPECT_EQ(255, pos);
+    EXPECT_EQ((ino_t)26, inode);
+
+    EXPECT_TRUE(PositionFile::parseLine(
+                "/a\t/a\tffffffffffffffff\t00000000\n", pek, pos, inode));
+    EXPECT_EQ(PositionFile::UNWATCHED_POSITION, pos);
+
+    EXPECT_FALSE(PositionFile::parseLine("/a\t/a\t00ff\n", pek, pos, inode));
+    EXPECT_FALSE(PositionFile::parseLine("/a\t/a\t00zz\t01\n", pek, pos, inode));
+    EXPECT_FALSE(PositionFile::parseLine("\t/a\t00ff\t01\n", pek, pos, inode));
+}
+
+TEST_F (PositionFileTest, ReplayLastRecordWins) {
+    writeFile(m_path,
+            "/a\t/a\t0000000000000001\t00000001\n"
+            "/b\t/b\t0000000000000002\t00000002\n"
+            "/a\t/a\t0000000000000003\t00000001\n"
+            "/b\t/b\tffffffffffffffff\t00000002\n"
+            "/c\t/c\t00000000000000");  // partial record
+
+    PositionFile *pf = PositionFile::parse(m_path);
+    ASSERT_TRUE(NULL != pf);
+
+    EXPECT_EQ((size_t)1, pf->m_records.size());
+    PositionEntryKey pek = {"/a", "/a"};
+    EXPECT_EQ(3, (*pf)[pek]->readPos());
+    EXPECT_EQ((ino_t)1, (*pf)[pek]->readInode());
+
+    /* the journal is compacted when loading */
+    EXPECT_EQ((size_t)1, countLines(readFile(m_path)));
+
+    delete pf;
+}
+
+TEST_F (PositionFileTest, AppendAndReload) {
+    PositionFile *pf = PositionFile::parse(m_path);
+    ASSERT_TRUE(NULL != pf);
+
+    PositionEntryKey pek = {"/a.%Y", "/a.2015"};
+    for (off_t pos = 1; pos <= 100; ++pos) {
+        (*pf)[pek]->update(7, pos);
+    }
+    PositionEntryKey pek_unwatched = {"/a.%Y", "/a.2014"};
+    (*pf)[pek_unwatched]->update(8, 10);
+    (*pf)[pek_unwatched]->updatePos(PositionFile::UNWATCHED_POSITION);
+    pf->remove(pek_unwatched);
+
+    /* one zero record when created, then one record per update */
+    EXPECT_EQ((size_t)104, countLines(readFile(m_path)));
+    delete pf;
+
+    pf = PositionFile::parse(m_path);
+    ASSERT_TRUE(NULL != pf);
+    EXPECT_EQ((size_t)1, countLines(readFile(m_path)));
+    EXPECT_EQ(100, (*pf)[pek]->readPos());
+
+    string path;
+    EXPECT_TRUE(pf->getPath("/a.%Y", path));
+    EXPECT_EQ("/a.2015", path);
+    EXPECT_FALSE(pf->getPath("/b", path));
+
+    delete pf;
+}
+
+TEST_F (PositionFileTest, BackgroundCompaction) {
+    PositionFile *pf = PositionFile::parse(m_path);
+    ASSERT_TRUE(NULL != pf);
+
+    PositionEntryKey pek = {"/a", "/a"};
+    PositionEntryKey pek_other = {"/b", "/b"};
+    unsigned long n = PositionFile::COMPACT_MIN_RECORDS + 1;
+    for (off_t pos = 1; pos <= (off_t)n; ++pos) {
+        (*pf)[pek]->update(7, pos);
+    }
+    EXPECT_TRUE(pf->needCompact());
+
+    uv_loop_t *loop = uv_default_loop();
+    EXPECT_TRUE(pf->compact(loop));
+    EXPECT_TRUE(pf->m_compacting);
+
+    /* records appended during the compaction must survive it */
+    (*pf)[pek]->updatePos(n + 1);
+    (*pf)[pek_other]->update(9, 42);
+
+    uv_run(loop, UV_RUN_DEFAULT);
+    EXPECT_FALSE(pf->m_compacting);
+    EXPECT_FALSE(pf->needCompact());
+    EXPECT_LT(countLines(readFile(m_path)), (size_t)10);
+
+    (*pf)[pek]->updatePos(n + 2);
+    delete pf;
+
+    pf = PositionFile::parse(m_path);
+    ASSERT_TRUE(NULL != pf);
+    EXPECT_EQ((off_t)(n + 2), (*pf)[pek]->readPos());
+    EXPECT_EQ(42, (*pf)[pek_other]->readPos());
+    EXPECT_EQ((ino_t)9, (*pf)[pek_other]->readInode());
+    delete pf;
+}
@@ -0,0 +1,189 @@
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/producer.h"
+#include "logkafka/zookeeper.h"
+#undef protected
+#undef private
+#include "mock_kafka_broker.h"
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+TEST (ProducerTest, RefreshBrokers) {
+    Zookeeper zookeeper;
+    zookeeper.m_broker_urls = "127.0.0.1:19092";
+    zookeeper.m_broker_urls_version = 1;
+
+    Producer producer;
+    ASSERT_TRUE(producer.init(zookeeper, "none", 1000000, 0));
+    EXPECT_EQ(1, producer.m_brokers_version);
+
+    /* unchanged version does nothing */
+    EXPECT_TRUE(producer.refreshBrokers(zookeeper));
+    EXPECT_EQ("127.0.0.1:19092", producer.m_brokers);
+
+    /* only brokers which joined are added */
+    zookeeper.m_broker_urls = "127.0.0.1:19092,127.0.0.1:19093";
+    zookeeper.m_broker_urls_version = 2;
+    EXPECT_TRUE(producer.refreshBrokers(zookeeper));
+    EXPECT_EQ(2, producer.m_brokers_version);
+    EXPECT_EQ(zookeeper.m_broker_urls, producer.m_brokers);
+
+    /* brokers gone are dropped from the list */
+    zookeeper.m_broker_urls = "127.0.0.1:19093";
+    zookeeper.m_broker_urls_version = 3;
+    EXPECT_TRUE(producer.refreshBrokers(zookeeper));
+    EXPECT_EQ("127.0.0.1:19093", producer.m_brokers);
+
+    producer.close();
+}
+
+class ProducerMockTest: public ::testing::Test {
+protected:
+    ProducerMockTest() {
+    }
+
+    virtual ~ProducerMockTest() {
+    }
+
+    virtual void SetUp() {
+        ASSERT_TRUE(m_broker.start());
+        m_zookeeper.m_broker_urls = m_broker.getBrokerUrls();
+        m_zookeeper.m_broker_urls_version = 1;
+
+        MetricsRegistry &metrics = MetricsRegistry::instance();
+        m_delivered = metrics.getGlobal(METRIC_MESSAGES_DELIVERED);
+        m_failed = metrics.getGlobal(METRIC_DELIVERY_FAILURES);
+    }
+
+    virtual void TearDown() {
+        m_broker.stop();
+    }
+
+public:
+    bool send(Producer &producer, int n) {
+        vector<string> lines;
+        for (int i = 0; i < n; ++i) {
+            lines.push_back("line " + int2Str(i));
+        }
+        return producer.send(lines, m_broker.getBrokerUrls(), "test", "", 
+                1, -1, 30000);
+    }
+
+    int64_t delivered() {
+        return MetricsRegistry::instance().getGlobal(
+                METRIC_MESSAGES_DELIVERED) - m_delivered;
+    }
+
+    int64_t failed() {
+        return MetricsRegistry::instance().getGlobal(
+                METRIC_DELIVERY_FAILURES) - m_failed;
+    }
+
+    MockKafkaBroker m_broker;
+    Zookeeper m_zookeeper;
+    int64_t m_delivered;
+    int64_t m_failed;
+};
+
+TEST_F (ProducerMockTest, Deliver) {
+    Producer producer;
+    ASSERT_TRUE(producer.init(m_zookeeper, "none", 1000000, 3));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(send(producer, 100));
+    }
+    producer.close();
+
+    EXPECT_EQ(1000, delivered());
+    EXPECT_EQ(0, failed());
+    EXPECT_EQ(1000, m_broker.getMessages());
+
+    /* messages inside compressed wrappers are counted too */
+    Producer gzip_producer;
+    ASSERT_TRUE(gzip_producer.init(m_zookeeper, "gzip", 1000000, 3));
+    EXPECT_TRUE(send(gzip_producer, 100));
+    gzip_producer.close();
+    EXPECT_EQ(1100, delivered());
+    EXPECT_EQ(1100, m_broker.getMessages());
+}
+
+TEST_F (ProducerMockTest, InjectedErrors) {
+    Producer producer;
+    ASSERT_TRUE(producer.init(m_zookeeper, "none", 1000000, 3));
+
+    /* retried */
+    vector<int16_t> retriable(2, RD_KAFKA_RESP_ERR_NOT_LEADER_FOR_PARTITION);
+    m_broker.injectErrors(retriable);
+    EXPECT_TRUE(send(producer, 10));
+    producer.close();
+    EXPECT_EQ(10, delivered());
+    EXPECT_EQ(0, failed());
+
+    /* not retried, reported by delivery reports */
+    Producer fatal_producer;
+    ASSERT_TRUE(fatal_producer.init(m_zookeeper, "none", 1000000, 3));
+    m_broker.injectErrors(vector<int16_t>(1, 
+                RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE));
+    EXPECT_TRUE(send(fatal_producer, 10));
+    fatal_producer.close();
+    EXPECT_EQ(10, delivered());
+    EXPECT_EQ(10, failed());
+    EXPECT_EQ(10, m_broker.getMessages());
+}
+
+TEST_F (ProducerMockTest, Latency) {
+    Producer producer;
+    ASSERT_TRUE(producer.init(m_zookeeper, "none", 1000000, 3));
+    m_broker.setLatency(300);
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    EXPECT_TRUE(send(producer, 10));
+    producer.close();
+    gettimeofday(&end, NULL);
+
+    EXPECT_EQ(10, delivered());
+    EXPECT_GE((end.tv_sec - start.tv_sec) * 1000 
+            + (end.tv_usec - start.tv_usec) / 1000, 300);
+}
+
+TEST_F (ProducerMockTest, BrokerRestart) {
+    Producer producer;
+    ASSERT_TRUE(producer.init(m_zookeeper, "none", 1000000, 3));
+    EXPECT_TRUE(send(producer, 10));
+
+    /* messages wait in the queue until the broker is back */
+    ASSERT_TRUE(m_broker.setDown());
+    EXPECT_TRUE(send(producer, 100));
+    usleep(500000);
+    EXPECT_EQ(0, failed());
+    ASSERT_TRUE(m_broker.setUp());
+    producer.close();
+
+    EXPECT_EQ(110, delivered());
+    EXPECT_EQ(0, failed());
+    EXPECT_EQ(110, m_broker.getMessages());
+}
+
+TEST_F (ProducerMockTest, QueueFull) {
+    Producer producer;
+    ASSERT_TRUE(producer.init(m_zookeeper, "none", 1000000, 3));
+    ASSERT_TRUE(m_broker.setDown());
+
+    /* beyond queue.buffering.max.messages, the rest is rejected */
+    EXPECT_FALSE(send(producer, 100100));
+    int64_t queued = producer.m_queue_depth;
+    EXPECT_LT(queued, 100100);
+
+    ASSERT_TRUE(m_broker.setUp());
+    producer.close();
+    EXPECT_EQ(queued, delivered());
+    EXPECT_EQ(queued, m_broker.getMessages());
+}
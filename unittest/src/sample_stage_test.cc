@@ -0,0 +1,149 @@
+#include <string>
+#include <vector>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/pipeline.h"
+#include "logkafka/sample_stage.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+StageConf sampleConf(const string &mode, double rate, 
+        uint32_t key_field = 0)
+{
+    StageConf conf;
+    conf.stage = "sample";
+    conf.mode = mode;
+    conf.rate = rate;
+    conf.key_field = key_field;
+    return conf;
+}
+
+vector<string> makeLines(int n)
+{
+    vector<string> lines;
+    for (int i = 0; i < n; ++i) {
+        lines.push_back("2015-01-01 req-" + int2Str(i % 50) + " line " 
+                + int2Str(i));
+    }
+    return lines;
+}
+
+} // namespace
+
+TEST (SampleStageTest, Rate) {
+    Pipeline pipeline;
+    ASSERT_TRUE(pipeline.init(vector<StageConf>(1, sampleConf("rate", 0.01))));
+
+    /* the first line of each hundred, across batches */
+    vector<string> first = makeLines(150);
+    vector<string> second = makeLines(150);
+    EXPECT_EQ((size_t)148, pipeline.process(first));
+    EXPECT_EQ((size_t)149, pipeline.process(second));
+    ASSERT_EQ((size_t)2, first.size());
+    EXPECT_EQ("2015-01-01 req-0 line 0", first[0]);
+    EXPECT_EQ("2015-01-01 req-0 line 100", first[1]);
+    ASSERT_EQ((size_t)1, second.size());
+    EXPECT_EQ("2015-01-01 req-0 line 50", second[0]);
+
+    Pipeline all;
+    ASSERT_TRUE(all.init(vector<StageConf>(1, sampleConf("rate", 1))));
+    vector<string> lines = makeLines(10);
+    EXPECT_EQ((size_t)0, all.process(lines));
+}
+
+TEST (SampleStageTest, HashOfKey) {
+    SampleStage stage;
+    ASSERT_TRUE(stage.init(sampleConf("hash", 0.2, 2)));
+
+    /* the same keys are kept by another instance, e.g. on another host */
+    SampleStage other;
+    ASSERT_TRUE(other.init(sampleConf("hash", 0.2, 2)));
+
+    vector<string> lines = makeLines(5000);
+    int kept = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        bool keep = stage.processLine(lines[i]);
+        EXPECT_EQ(keep, other.processLine(lines[i]));
+        /* all lines of a key go together */
+        EXPECT_EQ(keep, stage.processLine(lines[i % 50]));
+        if (keep) ++kept;
+    }
+    EXPECT_GT(kept, 0);
+    EXPECT_LT(kept, 5000);
+
+    /* whole lines are about the fraction of the rate */
+    SampleStage whole;
+    ASSERT_TRUE(whole.init(sampleConf("hash", 0.2)));
+    kept = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (whole.processLine(lines[i])) ++kept;
+    }
+    EXPECT_GT(kept, 800);
+    EXPECT_LT(kept, 1200);
+
+    const char *key = NULL;
+    size_t len = 0;
+    string line = "  a\tbc  d";
+    stage.getKey(line, key, len);
+    EXPECT_EQ("bc", string(key, len));
+    string short_line = "a";
+    stage.getKey(short_line, key, len);
+    EXPECT_EQ("a", string(key, len));
+}
+
+TEST (SampleStageTest, Limit) {
+    StageConf conf = sampleConf("limit", 0);
+    conf.lines_per_s = 100;
+    conf.burst = 10;
+    SampleStage stage;
+    ASSERT_TRUE(stage.init(conf));
+
+    string line = "a";
+    uint64_t start = stage.m_last_ns;
+    stage.m_now_ns = start;
+    int kept = 0;
+    for (int i = 0; i < 50; ++i) {
+        if (stage.processLine(line)) ++kept;
+    }
+    EXPECT_EQ(10, kept);
+
+    /* 100ms later the bucket has 10 more lines */
+    stage.m_now_ns = start + 100000000ULL;
+    kept = 0;
+    for (int i = 0; i < 50; ++i) {
+        if (stage.processLine(line)) ++kept;
+    }
+    EXPECT_EQ(10, kept);
+
+    /* never more than burst after a pause */
+    stage.m_now_ns = start + 60000000000ULL;
+    kept = 0;
+    for (int i = 0; i < 50; ++i) {
+        if (stage.processLine(line)) ++kept;
+    }
+    EXPECT_EQ(10, kept);
+}
+
+TEST (SampleStageTest, RejectIllegalSample) {
+    EXPECT_FALSE(sampleConf("rate", 0).isLegal());
+    EXPECT_FALSE(sampleConf("rate", 1.5).isLegal());
+    EXPECT_TRUE(sampleConf("rate", 1).isLegal());
+    EXPECT_TRUE(sampleConf("hash", 0.001, 3).isLegal());
+    EXPECT_FALSE(sampleConf("random", 0.5).isLegal());
+    EXPECT_FALSE(sampleConf("limit", 0.5).isLegal());
+
+    StageConf limit = sampleConf("limit", 0);
+    limit.lines_per_s = 1;
+    EXPECT_TRUE(limit.isLegal());
+
+    SampleStage stage;
+    EXPECT_FALSE(stage.init(sampleConf("rate", 0)));
+}
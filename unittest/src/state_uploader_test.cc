@@ -0,0 +1,220 @@
+#include <zlib.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/state_uploader.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+using namespace logkafka;
+
+namespace {
+
+/* counts writes of collecting state, which complete at once */
+class FakeConfigSource: public ConfigSource
+{
+    public:
+        FakeConfigSource(): m_client_epoch(1), m_writes(0), m_deletes(0) {};
+
+        string getLogConfig(int64_t *version) { return "{}"; };
+        int64_t getLogConfigVersion() { return 0; };
+        void setConfigChangeCallback(ConfigChangeFunc func, void *arg) {};
+        string getBrokerUrls(int64_t *version) { return ""; };
+        int64_t getBrokerUrlsVersion() { return 0; };
+        void setBrokersChangeCallback(ConfigChangeFunc func, void *arg) {};
+
+        bool setLogState(const char *buf, int buflen, long shard,
+                StateCompletionFunc completion, const void *data)
+        {
+            ++m_writes;
+            completion(0, data);
+            return true;
+        };
+        bool deleteLogState(long shard, 
+                StateCompletionFunc completion, const void *data)
+        {
+            ++m_deletes;
+            completion(0, data);
+            return true;
+        };
+
+        unsigned long getClientEpoch() { return m_client_epoch; };
+        void close() {};
+
+        unsigned long m_client_epoch;
+        int m_writes;
+        int m_deletes;
+};
+
+} // namespace
+
+class StateUploaderTest: public ::testing::Test {
+protected:
+    StateUploaderTest() {
+    }
+
+    virtual ~StateUploaderTest() {
+    }
+
+    virtual void SetUp() {
+        m_snapshot = new TailStatSnapshot();
+        for (int i = 0; i < 100; ++i) {
+            stringstream ss;
+            ss << "/data/logs/app" << i << "/access_log";
+            TailStat *stat = new TailStat(ss.str(), ss.str());
+            stat->update(i, i * 2);
+            m_stats.push_back(stat);
+
+            TailStatEntry entry;
+            entry.path_pattern = ss.str();
+            entry.group = false;
+            entry.pending = 0;
+            entry.stats.push_back(stat);
+            m_snapshot->add(entry);
+            stat->unref();
+        }
+    }
+
+    virtual void TearDown() {
+        m_snapshot->unref();
+    }
+
+public:
+    static string uncompress(const string &data);
+
+    TailStatSnapshot *m_snapshot;
+    vector<TailStat *> m_stats;
+};
+
+string StateUploaderTest::uncompress(const string &data) {
+    string out(1 << 20, '\0');
+    uLongf len = out.length();
+    if (Z_OK != ::uncompress((Bytef *)&out[0], &len, 
+                (const Bytef *)data.data(), data.length())) {
+        return "";
+    }
+    out.resize(len);
+    return out;
+}
+
+TEST_F (StateUploaderTest, SkipUnchanged) {
+    StateUploader uploader;
+    uploader.init(DEFAULT_ZOOKEEPER_UPLOAD_SHARD_BYTES, false);
+
+    vector<StateZnode> changed;
+    vector<long> stale;
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    ASSERT_EQ((size_t)1, changed.size());
+    EXPECT_EQ(StateUploader::CLIENT_ZNODE, changed[0].shard);
+
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    m_snapshot->Serialize(writer);
+    EXPECT_EQ(sb.GetString(), changed[0].data);
+
+    changed.clear();
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    EXPECT_TRUE(changed.empty());
+    EXPECT_TRUE(stale.empty());
+
+    /* uploaded again after progress, or after reset */
+    m_stats[0]->update(1, 2);
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    EXPECT_EQ((size_t)1, changed.size());
+    changed.clear();
+    uploader.reset();
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    EXPECT_EQ((size_t)1, changed.size());
+}
+
+TEST_F (StateUploaderTest, ShardsAndCompression) {
+    StateUploader uploader;
+    uploader.init(1024, false);
+
+    vector<StateZnode> changed;
+    vector<long> stale;
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    unsigned long shard_num = uploader.m_shard_num;
+    EXPECT_GE(shard_num, (unsigned long)8);
+    ASSERT_EQ(shard_num + 1, changed.size());
+
+    Document d;
+    size_t patterns = 0;
+    for (size_t i = 0; i < changed.size(); ++i) {
+        if (StateUploader::CLIENT_ZNODE == changed[i].shard) {
+            EXPECT_EQ("{\"shards\":" + int2Str(shard_num) + "}", 
+                    changed[i].data);
+            continue;
+        }
+        EXPECT_LE(changed[i].data.length(), (size_t)1024);
+        EXPECT_FALSE(d.Parse<0>(changed[i].data.c_str()).HasParseError());
+        patterns += d.MemberCount();
+    }
+    EXPECT_EQ((size_t)100, patterns);
+
+    /* progress of one file rewrites one shard only */
+    changed.clear();
+    m_stats[42]->update(100, 200);
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    ASSERT_EQ((size_t)1, changed.size());
+    EXPECT_NE(StateUploader::CLIENT_ZNODE, changed[0].shard);
+
+    /* compressed state fits in the client znode, shards are deleted */
+    uploader.init(1024, true);
+    uploader.m_shard_num = 0;
+    changed.clear();
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    EXPECT_TRUE(stale.empty());
+
+    uploader.m_shard_num = shard_num;
+    uploader.m_hashes.clear();
+    changed.clear();
+    uploader.init(1 << 19, true);
+    EXPECT_TRUE(uploader.encode(m_snapshot, changed, stale));
+    EXPECT_EQ(shard_num, stale.size());
+    ASSERT_EQ((size_t)1, changed.size());
+    EXPECT_EQ(0x78, (unsigned char)changed[0].data[0]);
+
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    m_snapshot->Serialize(writer);
+    EXPECT_EQ(sb.GetString(), uncompress(changed[0].data));
+}
+
+TEST_F (StateUploaderTest, UploadOnlyProgress) {
+    StateUploader uploader;
+    uploader.init(1024, false);
+    FakeConfigSource config_source;
+
+    /* the client znode and every shard at first */
+    EXPECT_TRUE(uploader.upload(&config_source, m_snapshot));
+    int shard_num = (int)uploader.m_shard_num;
+    EXPECT_EQ(shard_num + 1, config_source.m_writes);
+
+    /* refreshes keeping the client znode write nothing */
+    config_source.m_writes = 0;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(uploader.upload(&config_source, m_snapshot));
+    }
+    EXPECT_EQ(0, config_source.m_writes);
+
+    m_stats[42]->update(100, 200);
+    EXPECT_TRUE(uploader.upload(&config_source, m_snapshot));
+    EXPECT_EQ(1, config_source.m_writes);
+
+    /* a new session lost all of it, it is written once */
+    config_source.m_writes = 0;
+    ++config_source.m_client_epoch;
+    EXPECT_TRUE(uploader.upload(&config_source, m_snapshot));
+    EXPECT_TRUE(uploader.upload(&config_source, m_snapshot));
+    EXPECT_EQ(shard_num + 1, config_source.m_writes);
+    EXPECT_EQ(0, config_source.m_deletes);
+}
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/manager.h"
+#include "logkafka/tail_group.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+class LinesOutput: public Output {
+public:
+    LinesOutput(vector<string> *lines): m_lines(lines) {}
+    virtual bool init(void *arg) { return true; }
+    virtual bool output(void *arg, const vector<string> &lines,
+            int64_t write_time_us) {
+        m_lines->insert(m_lines->end(), lines.begin(), lines.end());
+        return true;
+    }
+
+    vector<string> *m_lines;
+};
+
+class TailGroupTest: public ::testing::Test {
+protected:
+    TailGroupTest() {
+    }
+
+    virtual ~TailGroupTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.globXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        m_pf = PositionFile::parse(m_dir + "/pos");
+        ASSERT_TRUE(NULL != m_pf);
+        m_loop = uv_default_loop();
+        m_group = new TailGroup();
+        m_manager = NULL;
+    }
+
+    virtual void TearDown() {
+        m_group->close(true);
+        uv_run(m_loop, UV_RUN_DEFAULT);
+        delete m_group;
+        delete m_pf;
+
+        string cmd = "rm -rf " + m_dir;
+        system(cmd.c_str());
+    }
+
+public:
+    static TailWatcher *setupWatcher(void *arg,
+            const string &path_pattern,
+            const string &path,
+            PositionEntry *position_entry,
+            UpdateFunc update_func,
+            void *update_func_arg);
+    static void closeWatcher(void *arg, TailWatcher *tw, bool unwatched);
+    static bool receiveLines(void *output, vector<string> &lines,
+            int64_t write_time_us);
+    static void stopLoop(uv_timer_t *handle);
+
+    bool initGroup(const string &name_pattern, unsigned long max_open_files);
+    void writeFile(const string &name, const string &content);
+    void setIdle(const string &name);
+    void runLoop(uint64_t ms);
+
+    string m_dir;
+    uv_loop_t *m_loop;
+    PositionFile *m_pf;
+    TailGroup *m_group;
+    /* closes watchers as the manager does, if set */
+    Manager *m_manager;
+    vector<string> m_lines;
+};
+
+TailWatcher *TailGroupTest::setupWatcher(void *arg,
+        const string &path_pattern,
+        const string &path,
+        PositionEntry *position_entry,
+        UpdateFunc update_func,
+        void *update_func_arg) {
+    TailGroupTest *test = reinterpret_cast<TailGroupTest *>(arg);
+    TailWatcher *tw = new TailWatcher();
+    bool res = tw->init(test->m_loop, path_pattern, path, position_entry,
+            DEFAULT_STAT_SILENT_MAX_MS, true, DEFAULT_BATCHSIZE,
+            DEFAULT_LINE_MAX_BYTES, true, update_func, update_func_arg,
+            receiveLines, TaskConf(), new LinesOutput(&test->m_lines));
+    if (!res) {
+        delete tw;
+        return NULL;
+    }
+    return tw;
+}
+
+void TailGroupTest::closeWatcher(void *arg, TailWatcher *tw, bool unwatched) {
+    TailGroupTest *test = reinterpret_cast<TailGroupTest *>(arg);
+    if (NULL != test->m_manager) {
+        Manager::closeGroupWatcher(test->m_manager, tw, unwatched);
+        return;
+    }
+    tw->stop(true);
+    delete tw;
+}
+
+bool TailGroupTest::receiveLines(void *output, vector<string> &lines,
+        int64_t write_time_us) {
+    Output *out = reinterpret_cast<Output *>(output);
+    return out->output(out, lines, write_time_us);
+}
+
+void TailGroupTest::stopLoop(uv_timer_t *handle) {
+    uv_close((uv_handle_t *)handle, NULL);
+    uv_stop(handle->loop);
+}
+
+bool TailGroupTest::initGroup(const string &name_pattern, 
+        unsigned long max_open_files) {
+    return m_group->init(m_loop, m_dir + "/" + name_pattern, m_pf,
+            max_open_files, DEFAULT_STAT_SILENT_MAX_MS, true, this,
+            setupWatcher, closeWatcher);
+}
+
+void TailGroupTest::writeFile(const string &name, const string &content) {
+    std::ofstream out((m_dir + "/" + name).c_str(), std::ios::app);
+    out << content;
+}
+
+void TailGroupTest::setIdle(const string &name) {
+    TailWatcher *tw = m_group->m_tails[m_dir + "/" + name];
+    tw->m_io_handler->m_last_io_time.tv_sec -= 100;
+}
+
+void TailGroupTest::runLoop(uint64_t ms) {
+    uv_timer_t timer;
+    uv_timer_init(m_loop, &timer);
+    uv_timer_start(&timer, stopLoop, ms, 0);
+    uv_run(m_loop, UV_RUN_DEFAULT);
+    uv_run(m_loop, UV_RUN_NOWAIT);
+}
+
+TEST_F (TailGroupTest, GlobPatternLegal) {
+    LogConf conf;
+    conf.log_path = "/var/log/app-*.log";
+    EXPECT_TRUE(conf.isPathPatternLegal());
+    conf.log_path = "/var/log/*/app.log";
+    EXPECT_FALSE(conf.isPathPatternLegal());
+    conf.log_path = "/var/log/app-*.log.%Y%m%d";
+    EXPECT_FALSE(conf.isPathPatternLegal());
+
+    EXPECT_TRUE(TailGroup::isGlobPattern("/var/log/app-?.log"));
+    EXPECT_FALSE(TailGroup::isGlobPattern("/var/log/app.log.%Y%m%d"));
+}
+
+TEST_F (TailGroupTest, DiscoverMatchingFiles) {
+    writeFile("a.log", "a1\n");
+    writeFile("b.log", "b1\n");
+    writeFile("c.txt", "c1\n");
+    writeFile(".d.log", "d1\n");
+
+    ASSERT_TRUE(initGroup("*.log", 8));
+    EXPECT_EQ((size_t)2, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)2, m_lines.size());
+
+    /* new files are picked up from directory events */
+    writeFile("e.log", "e1\ne2\n");
+    runLoop(200);
+    EXPECT_EQ((size_t)3, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)1, m_group->m_tails.count(m_dir + "/e.log"));
+
+    /* appended lines of all files are read */
+    writeFile("a.log", "a2\n");
+    writeFile("b.log", "b2\n");
+    runLoop(200);
+    EXPECT_EQ((size_t)6, m_lines.size());
+
+    /* deleted files are closed once drained */
+    unlink((m_dir + "/a.log").c_str());
+    setIdle("a.log");
+    m_group->refresh();
+    EXPECT_EQ((size_t)2, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)0, m_group->m_tails.count(m_dir + "/a.log"));
+}
+
+TEST_F (TailGroupTest, MaxOpenFiles) {
+    writeFile("a.log", "a1\n");
+    writeFile("b.log", "b1\n");
+    writeFile("c.log", "c1\n");
+
+    ASSERT_TRUE(initGroup("*.log", 2));
+    EXPECT_EQ((size_t)2, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)1, m_group->getPendingFiles());
+    EXPECT_EQ((size_t)0, m_group->m_tails.count(m_dir + "/c.log"));
+
+    /* idle files give way to queued ones, and keep their positions */
+    setIdle("a.log");
+    m_group->refresh();
+    EXPECT_EQ((size_t)2, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)1, m_group->getPendingFiles());
+    EXPECT_EQ((size_t)1, m_group->m_tails.count(m_dir + "/c.log"));
+    EXPECT_EQ((size_t)3, m_lines.size());
+
+    PositionEntryKey pek = {m_group->m_path_pattern, m_dir + "/a.log"};
+    EXPECT_EQ(3, (*m_pf)[pek]->readPos());
+}
+
+TEST_F (TailGroupTest, RenamedFileKeepsPosition) {
+    writeFile("a.log", "a1\n");
+
+    ASSERT_TRUE(initGroup("*.log*", 8));
+    EXPECT_EQ((size_t)1, m_lines.size());
+
+    /* rotated to a name also matching the pattern */
+    writeFile("a.log", "a2\n");
+    rename((m_dir + "/a.log").c_str(), (m_dir + "/a.log.1").c_str());
+    writeFile("a.log", "n1\n");
+    runLoop(200);
+
+    EXPECT_EQ((size_t)2, m_group->getOpenFiles());
+    EXPECT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_EQ("n1", m_lines[2]);
+}
+
+TEST_F (TailGroupTest, ManagerKeepsPositionOfClosedFile) {
+    Config config;
+    Manager manager(&config);
+    manager.m_position_file = m_pf;
+    m_manager = &manager;
+
+    writeFile("a.log", "a1\n");
+    writeFile("b.log", "b1\n");
+    writeFile("c.log", "c1\n");
+    ASSERT_TRUE(initGroup("*.log", 2));
+    ASSERT_EQ((size_t)1, m_group->getPendingFiles());
+
+    /* an idle file queued for another one is not forgotten */
+    setIdle("a.log");
+    m_group->refresh();
+    PositionEntryKey pek = {m_group->m_path_pattern, m_dir + "/a.log"};
+    ASSERT_EQ((size_t)1, m_pf->m_pe_map.count(pek));
+    EXPECT_EQ(3, (*m_pf)[pek]->readPos());
+
+    /* a deleted one is */
+    unlink((m_dir + "/b.log").c_str());
+    setIdle("b.log");
+    m_group->refresh();
+    PositionEntryKey deleted = {m_group->m_path_pattern, m_dir + "/b.log"};
+    EXPECT_EQ((size_t)0, m_pf->m_pe_map.count(deleted));
+
+    m_group->close(true);
+    manager.m_position_file = NULL;
+    m_manager = NULL;
+}
@@ -0,0 +1,127 @@
+#include <string>
+
+#include <uv.h>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/tail_stat.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+const int READ_ROUNDS = 10000;
+
+struct ReaderArg
+{
+    TailStatPublisher *publisher;
+    int mismatches;
+};
+
+string serialize(TailStatSnapshot *snapshot)
+{
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    snapshot->Serialize(writer);
+    return sb.GetString();
+}
+
+void readSnapshots(void *arg)
+{
+    ReaderArg *ra = reinterpret_cast<ReaderArg *>(arg);
+    for (int i = 0; i < READ_ROUNDS; ++i) {
+        TailStatSnapshot *snapshot = ra->publisher->acquire();
+        for (size_t j = 0; j < snapshot->m_entries.size(); ++j) {
+            TailStat *stat = snapshot->m_entries[j].stats[0];
+            if (stat->getFilePos() > stat->getFileSize()) {
+                ++ra->mismatches;
+            }
+        }
+        serialize(snapshot);
+        snapshot->unref();
+    }
+}
+
+}
+
+TEST (TailStatTest, SnapshotSerialize) {
+    TailStat *main = new TailStat("/a.%Y", "/a.2015");
+    TailStat *backlog = new TailStat("/a.%Y", "/a.2014");
+    TailStat *file = new TailStat("/b/*.log", "/b/x.log");
+    main->update(10, 20);
+    backlog->update(30, 40);
+    file->update(5, 5);
+
+    TailStatSnapshot *snapshot = new TailStatSnapshot();
+    TailStatEntry entry;
+    entry.path_pattern = "/a.%Y";
+    entry.group = false;
+    entry.pending = 0;
+    entry.stats.push_back(main);
+    entry.stats.push_back(backlog);
+    snapshot->add(entry);
+
+    TailStatEntry group;
+    group.path_pattern = "/b/*.log";
+    group.group = true;
+    group.pending = 2;
+    group.stats.push_back(file);
+    snapshot->add(group);
+
+    EXPECT_EQ(2, main->m_refs);
+    EXPECT_EQ("{\"/a.%Y\":{\"realpath\":\"/a.2015\",\"filepos\":10,"
+            "\"filesize\":20,\"backlog\":[{\"realpath\":\"/a.2014\","
+            "\"filepos\":30,\"filesize\":40}]},"
+            "\"/b/*.log\":{\"realpath\":\"/b/*.log\",\"files\":["
+            "{\"realpath\":\"/b/x.log\",\"filepos\":5,\"filesize\":5}],"
+            "\"pending\":2}}", serialize(snapshot));
+
+    /* stats outlive their watchers while a snapshot holds them */
+    main->unref();
+    backlog->unref();
+    file->unref();
+    EXPECT_EQ(1, main->m_refs);
+    main->update(20, 20);
+    EXPECT_EQ(20, snapshot->m_entries[0].stats[0]->getFilePos());
+
+    snapshot->unref();
+}
+
+TEST (TailStatTest, PublishWhileReading) {
+    TailStatPublisher publisher;
+    TailStatSnapshot *empty = publisher.acquire();
+    EXPECT_EQ("{}", serialize(empty));
+    empty->unref();
+
+    ReaderArg ra = {&publisher, 0};
+    uv_thread_t thread;
+    uv_thread_create(&thread, readSnapshots, &ra);
+
+    TailStat *stat = new TailStat("/a", "/a");
+    for (int i = 0; i < READ_ROUNDS; ++i) {
+        stat->update(i, i);
+        if (i % 10 == 0) {
+            TailStatSnapshot *snapshot = new TailStatSnapshot();
+            TailStatEntry entry;
+            entry.path_pattern = "/a";
+            entry.group = false;
+            entry.pending = 0;
+            entry.stats.push_back(stat);
+            snapshot->add(entry);
+            publisher.publish(snapshot);
+        }
+    }
+
+    uv_thread_join(&thread);
+    EXPECT_EQ(0, ra.mismatches);
+
+    /* the publisher holds the last snapshot */
+    stat->unref();
+    TailStatSnapshot *last = publisher.acquire();
+    EXPECT_EQ(READ_ROUNDS - 1, last->m_entries[0].stats[0]->getFilePos());
+    last->unref();
+}
@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/memory_position_entry.h"
+#include "logkafka/tail_watcher.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace logkafka;
+
+namespace {
+
+enum RotateStyle
+{
+    ROTATE_RENAME,          /* rename to path.N, create path */
+    ROTATE_COPYTRUNCATE,    /* copy to path.N, truncate path */
+    ROTATE_DELETE,          /* delete path, create path */
+    ROTATE_TIME_FORMAT      /* write to the next path.N */
+};
+
+const int64_t STRESS_LINES = 200000;
+const int64_t STRESS_LINES_PER_FILE = 5000;
+const int64_t STRESS_LINES_PER_WRITE = 100;
+const int64_t STRESS_TIMEOUT_US = 20000000;
+/* far below what a sanitized build does on a loaded box */
+const int64_t STRESS_LINES_PER_S_MIN = 20000;
+
+/* shared by the writer thread and the loop thread */
+struct RotationStress
+{
+    string path;
+    RotateStyle style;
+
+    volatile int64_t lines_written;
+    volatile int64_t lines_received;
+    volatile int64_t rotations;
+    volatile int64_t rotations_followed;
+    volatile int files;
+    volatile bool writer_done;
+
+    /* loop thread only */
+    vector<int> seen;
+    int64_t lines_corrupt;
+};
+
+/* lines of different lengths, so that writes end in the middle of lines */
+string stressLine(int64_t seq)
+{
+    return "seq " + int2Str(seq) + " " + string(seq % 13 * 20, 'x');
+}
+
+int64_t atomicRead(volatile int64_t *value)
+{
+    return __sync_fetch_and_add(value, 0);
+}
+
+/* waits for the tail watcher. Rotations must be noticed one by one, a 
+ * file created and rotated away again before the watcher is notified 
+ * is never opened, so rotations faster than notifications are not 
+ * supported. A file rotated again before it is drained is. */
+void waitFor(volatile int64_t *value, int64_t expected)
+{
+    int64_t start = getMonotonicUs();
+    while (atomicRead(value) < expected
+            && getMonotonicUs() - start < STRESS_TIMEOUT_US) {
+        usleep(100);
+    }
+}
+
+void rotate(RotationStress *rs, FILE *&file)
+{
+    string rotated = rs->path + "." + int2Str(rs->files + 1);
+    switch (rs->style) {
+    case ROTATE_RENAME:
+        fclose(file);
+        rename(rs->path.c_str(), rotated.c_str());
+        file = fopen(rs->path.c_str(), "a");
+        break;
+    case ROTATE_COPYTRUNCATE:
+        /* lines not read before truncating are only in the copy */
+        waitFor(&rs->lines_received, rs->lines_written);
+        system(("cp " + rs->path + " " + rotated).c_str());
+        ftruncate(fileno(file), 0);
+        break;
+    case ROTATE_DELETE:
+        fclose(file);
+        unlink(rs->path.c_str());
+        file = fopen(rs->path.c_str(), "a");
+        break;
+    case ROTATE_TIME_FORMAT:
+        fclose(file);
+        file = fopen(rotated.c_str(), "a");
+        break;
+    }
+    __sync_add_and_fetch(&rs->files, 1);
+}
+
+void writeLines(void *arg)
+{
+    RotationStress *rs = reinterpret_cast<RotationStress *>(arg);
+    string path = (ROTATE_TIME_FORMAT == rs->style)? rs->path + ".0": rs->path;
+    FILE *file = fopen(path.c_str(), "a");
+
+    int64_t file_lines = 0;
+    for (int64_t seq = 0; seq < STRESS_LINES && NULL != file; ) {
+        for (int64_t i = 0; i < STRESS_LINES_PER_WRITE 
+                && seq < STRESS_LINES; ++i, ++seq, ++file_lines) {
+            fprintf(file, "%s\n", stressLine(seq).c_str());
+        }
+        fflush(file);
+        __sync_lock_test_and_set(&rs->lines_written, seq);
+
+        if (file_lines >= STRESS_LINES_PER_FILE && seq < STRESS_LINES) {
+            rotate(rs, file);
+            file_lines = 0;
+            int64_t rotations = __sync_add_and_fetch(&rs->rotations, 1);
+            if (ROTATE_RENAME == rs->style || ROTATE_DELETE == rs->style) {
+                /* noticed, but the rotated file may not be drained */
+                waitFor(&rs->rotations_followed, rotations);
+            } else if (ROTATE_COPYTRUNCATE == rs->style) {
+                /* the file must not grow to its old size before the
+                 * truncation is noticed */
+                fprintf(file, "%s\n", stressLine(seq++).c_str());
+                fflush(file);
+                ++file_lines;
+                __sync_lock_test_and_set(&rs->lines_written, seq);
+                waitFor(&rs->lines_received, seq);
+            }
+        }
+    }
+
+    if (NULL != file) fclose(file);
+    __sync_synchronize();
+    rs->writer_done = true;
+}
+
+class SequenceOutput: public Output
+{
+public:
+    SequenceOutput(vector<string> *lines, RotationStress *rs)
+        : m_lines(lines), m_rs(rs), m_full_after(0), m_failures(0) {}
+    virtual bool init(void *arg) { return true; }
+    virtual bool output(void *arg, const vector<string> &lines,
+            int64_t write_time_us) {
+        if (m_failures > 0) {
+            --m_failures;
+            return false;
+        }
+
+        if (NULL == m_rs) {
+            m_lines->insert(m_lines->end(), lines.begin(), lines.end());
+            if (m_full_after > 0 && m_lines->size() >= m_full_after) {
+                notifyBackpressure(true);
+            }
+            return true;
+        }
+
+        for (vector<string>::const_iterator iter = lines.begin();
+                iter != lines.end(); ++iter) {
+            long long seq = -1;
+            if (1 != sscanf(iter->c_str(), "seq %lld", &seq)
+                    || seq < 0 || seq >= STRESS_LINES
+                    || *iter != stressLine(seq)) {
+                ++m_rs->lines_corrupt;
+                continue;
+            }
+            ++m_rs->seen[seq];
+        }
+        __sync_add_and_fetch(&m_rs->lines_received, lines.size());
+        return true;
+    }
+
+    vector<string> *m_lines;
+    RotationStress *m_rs;
+    /* full once it holds that many lines, never if 0 */
+    size_t m_full_after;
+    /* batches it fails to take */
+    int m_failures;
+};
+
+} // namespace
+
+class TailWatcherTest: public ::testing::Test {
+protected:
+    TailWatcherTest() {
+    }
+
+    virtual ~TailWatcherTest() {
+    }
+
+    virtual void SetUp() {
+        char dir[] = "/tmp/logkafka_test.tailXXXXXX";
+        ASSERT_TRUE(NULL != mkdtemp(dir));
+        m_dir = dir;
+        m_path = m_dir + "/app.log";
+        ASSERT_EQ(0, uv_loop_init(&m_loop));
+        m_pe = new MemoryPositionEntry();
+        m_pe->update(INO_NONE, 0);
+        m_follow = true;
+        m_rotations = 0;
+        m_rs = NULL;
+        m_tw = NULL;
+    }
+
+    virtual void TearDown() {
+        closeWatcher();
+        uv_run(&m_loop, UV_RUN_DEFAULT);
+        uv_loop_close(&m_loop);
+        delete m_pe;
+
+        string cmd = "rm -rf " + m_dir;
+        system(cmd.c_str());
+    }
+
+public:
+    static bool onRotate(void *arg, string path_pattern, string path,
+            PositionEntry *position_entry);
+    static bool receiveLines(void *output, vector<string> &lines,
+            int64_t write_time_us);
+    static void notifyStress(uv_timer_t *handle);
+
+    bool initWatcher(const string &path);
+    void closeWatcher();
+    void writeFile(const string &path, const string &content);
+    void runStress(RotateStyle style);
+
+    string m_dir;
+    string m_path;
+    uv_loop_t m_loop;
+    MemoryPositionEntry *m_pe;
+    TailWatcher *m_tw;
+    TaskConf m_conf;
+    vector<string> m_lines;
+    bool m_follow;
+    int m_rotations;
+    RotationStress *m_rs;
+    int m_watched_file;
+    int64_t m_stress_start_us;
+};
+
+bool TailWatcherTest::onRotate(void *arg, string path_pattern, string path,
+        PositionEntry *position_entry) {
+    TailWatcherTest *t = reinterpret_cast<TailWatcherTest *>(arg);
+    ++t->m_rotations;
+    if (NULL != t->m_rs) {
+        __sync_add_and_fetch(&t->m_rs->rotations_followed, 1);
+    }
+    return t->m_follow;
+}
+
+bool TailWatcherTest::receiveLines(void *output, vector<string> &lines,
+        int64_t write_time_us) {
+    Output *out = reinterpret_cast<Output *>(output);
+    return out->output(out, lines, write_time_us);
+}
+
+bool TailWatcherTest::initWatcher(const string &path) {
+    m_tw = new TailWatcher();
+    bool res = m_tw->init(&m_loop, m_path, path, m_pe,
+            DEFAULT_STAT_SILENT_MAX_MS, true, DEFAULT_BATCHSIZE,
+            DEFAULT_LINE_MAX_BYTES, true, onRotate, this, receiveLines,
+            m_conf, new SequenceOutput(&m_lines, m_rs));
+    if (!res) {
+        delete m_tw; m_tw = NULL;
+    }
+    return res;
+}
+
+void TailWatcherTest::closeWatcher() {
+    if (NULL == m_tw) return;
+    m_tw->m_unwatched = true;
+    m_tw->stop(true);
+    delete m_tw; m_tw = NULL;
+}
+
+void TailWatcherTest::writeFile(const string &path, const string &content) {
+    std::ofstream out(path.c_str(), std::ios::app);
+    out << content;
+}
+
+void TailWatcherTest::notifyStress(uv_timer_t *handle) {
+    TailWatcherTest *t = reinterpret_cast<TailWatcherTest *>(handle->data);
+    RotationStress *rs = t->m_rs;
+    bool writer_done = rs->writer_done;
+
+    /* as Manager does for time formatted paths, the watcher moves on
+     * to the next path, draining the last one */
+    if (ROTATE_TIME_FORMAT == rs->style) {
+        while (t->m_watched_file < rs->files) {
+            t->closeWatcher();
+            ++t->m_watched_file;
+            t->m_pe->update(INO_NONE, 0);
+            t->initWatcher(rs->path + "." + int2Str(t->m_watched_file));
+            TailWatcher::onNotify(t->m_tw);
+        }
+    }
+
+    TailWatcher::onNotify(t->m_tw);
+
+    if ((writer_done && rs->lines_received >= rs->lines_written)
+            || getMonotonicUs() - t->m_stress_start_us > STRESS_TIMEOUT_US) {
+        uv_close((uv_handle_t *)handle, NULL);
+        uv_stop(handle->loop);
+    }
+}
+
+void TailWatcherTest::runStress(RotateStyle style) {
+    RotationStress *rs = new RotationStress();
+    rs->path = m_path;
+    rs->style = style;
+    rs->lines_written = 0;
+    rs->lines_received = 0;
+    rs->rotations = 0;
+    rs->rotations_followed = 0;
+    rs->files = 0;
+    rs->writer_done = false;
+    rs->seen.assign(STRESS_LINES, 0);
+    rs->lines_corrupt = 0;
+    m_rs = rs;
+    m_watched_file = 0;
+
+    string path = (ROTATE_TIME_FORMAT == style)? m_path + ".0": m_path;
+    writeFile(path, "");
+    ASSERT_TRUE(initWatcher(path));
+    m_tw->start();
+
+    /* watchers are notified far more often than by stat polling */
+    uv_timer_t timer;
+    uv_timer_init(&m_loop, &timer);
+    timer.data = this;
+    uv_timer_start(&timer, notifyStress, 1, 1);
+
+    uv_thread_t writer;
+    m_stress_start_us = getMonotonicUs();
+    uv_thread_create(&writer, writeLines, rs);
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+    uv_run(&m_loop, UV_RUN_NOWAIT);
+    uv_thread_join(&writer);
+    double seconds = (getMonotonicUs() - m_stress_start_us) / 1000000.0;
+
+    int64_t lost = 0, duplicated = 0;
+    for (int64_t seq = 0; seq < STRESS_LINES; ++seq) {
+        if (0 == rs->seen[seq]) ++lost;
+        if (rs->seen[seq] > 1) duplicated += rs->seen[seq] - 1;
+    }
+
+    int64_t lines_per_s = (int64_t)(STRESS_LINES / seconds);
+    RecordProperty("lines_per_s", (int)lines_per_s);
+    EXPECT_GE(lines_per_s, STRESS_LINES_PER_S_MIN);
+    EXPECT_GE(rs->rotations, STRESS_LINES / STRESS_LINES_PER_FILE - 2);
+    EXPECT_EQ(0, lost);
+    EXPECT_EQ(0, duplicated);
+    EXPECT_EQ(0, rs->lines_corrupt);
+
+    closeWatcher();
+    m_rs = NULL;
+    delete rs;
+}
+
+TEST_F (TailWatcherTest, FollowRenamedFile) {
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+
+    /* lines written before and after rotating the active file */
+    writeFile(m_path, "a2\n");
+    rename(m_path.c_str(), (m_path + ".1").c_str());
+    writeFile(m_path, "b1\n");
+    TailWatcher::onNotify(m_tw);
+    writeFile(m_path + ".1", "a3\n");
+    writeFile(m_path, "b2\n");
+    TailWatcher::onNotify(m_tw);
+
+    EXPECT_EQ(1, m_rotations);
+    ASSERT_EQ((size_t)5, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_EQ("b1", m_lines[2]);
+    EXPECT_EQ("a3", m_lines[3]);
+    EXPECT_EQ("b2", m_lines[4]);
+
+    /* the position entry stays with the rotated file until it is 
+     * closed once it is silent */
+    EXPECT_EQ(getInode((m_path + ".1").c_str()), m_pe->readInode());
+    EXPECT_EQ(9, m_pe->readPos());
+    EXPECT_TRUE(NULL != m_tw->m_rotated_io_handler);
+    m_tw->m_rotated_io_handler->m_last_io_time.tv_sec -= 100;
+    TailWatcher::onNotify(m_tw);
+    EXPECT_TRUE(NULL == m_tw->m_rotated_io_handler);
+    EXPECT_EQ(getInode(m_path.c_str()), m_pe->readInode());
+    EXPECT_EQ(6, m_pe->readPos());
+
+    writeFile(m_path, "b3\n");
+    TailWatcher::onNotify(m_tw);
+    EXPECT_EQ(9, m_pe->readPos());
+}
+
+TEST_F (TailWatcherTest, RestartWhileDrainingRotated) {
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+
+    /* rotated while the output is full */
+    m_tw->getOutput()->notifyBackpressure(true);
+    writeFile(m_path, "a2\na3\n");
+    rename(m_path.c_str(), (m_path + ".1").c_str());
+    writeFile(m_path, "b1\n");
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+    EXPECT_EQ(getInode((m_path + ".1").c_str()), m_pe->readInode());
+    EXPECT_EQ(3, m_pe->readPos());
+
+    /* restarted without stopping */
+    delete m_tw; m_tw = NULL;
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+
+    ASSERT_EQ((size_t)4, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_EQ("a3", m_lines[2]);
+    EXPECT_EQ("b1", m_lines[3]);
+    EXPECT_EQ(getInode((m_path + ".1").c_str()), m_pe->readInode());
+    EXPECT_EQ(9, m_pe->readPos());
+
+    ASSERT_TRUE(NULL != m_tw->m_rotated_io_handler);
+    m_tw->m_rotated_io_handler->m_last_io_time.tv_sec -= 100;
+    TailWatcher::onNotify(m_tw);
+    EXPECT_TRUE(NULL == m_tw->m_rotated_io_handler);
+    EXPECT_EQ(getInode(m_path.c_str()), m_pe->readInode());
+    EXPECT_EQ(3, m_pe->readPos());
+}
+
+TEST_F (TailWatcherTest, RotateAgainBeforeDrained) {
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+
+    /* rotated twice while the output is full, nothing is read */
+    m_tw->getOutput()->notifyBackpressure(true);
+    writeFile(m_path, "a2\n");
+    rename(m_path.c_str(), (m_path + ".1").c_str());
+    writeFile(m_path, "b1\n");
+    TailWatcher::onNotify(m_tw);
+    writeFile(m_path, "b2\n");
+    rename(m_path.c_str(), (m_path + ".2").c_str());
+    writeFile(m_path, "c1\n");
+    TailWatcher::onNotify(m_tw);
+    EXPECT_EQ(2, m_rotations);
+
+    /* the first one is drained as the second is noticed */
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+
+    m_tw->getOutput()->notifyBackpressure(false);
+    ASSERT_EQ((size_t)5, m_lines.size());
+    EXPECT_EQ("b1", m_lines[2]);
+    EXPECT_EQ("b2", m_lines[3]);
+    EXPECT_EQ("c1", m_lines[4]);
+}
+
+TEST_F (TailWatcherTest, SkipRotatedFileReadBeforeRestart) {
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    closeWatcher();
+
+    /* rotated while stopped, after it was read */
+    rename(m_path.c_str(), (m_path + ".1").c_str());
+    writeFile(m_path, "b1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ("b1", m_lines[1]);
+    EXPECT_TRUE(NULL == m_tw->m_rotated_io_handler);
+    EXPECT_EQ(getInode(m_path.c_str()), m_pe->readInode());
+}
+
+TEST_F (TailWatcherTest, FollowRecreatedFile) {
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+
+    writeFile(m_path, "a2\n");
+    unlink(m_path.c_str());
+    TailWatcher::onNotify(m_tw);
+    writeFile(m_path, "b1\n");
+    TailWatcher::onNotify(m_tw);
+
+    EXPECT_EQ(1, m_rotations);
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_EQ("b1", m_lines[2]);
+}
+
+TEST_F (TailWatcherTest, KeepRenamedFileIfNotFollowed) {
+    m_follow = false;
+    writeFile(m_path, "a1\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+
+    rename(m_path.c_str(), (m_path + ".1").c_str());
+    writeFile(m_path, "b1\n");
+    writeFile(m_path + ".1", "a2\n");
+    TailWatcher::onNotify(m_tw);
+
+    EXPECT_EQ(1, m_rotations);
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_TRUE(NULL == m_tw->m_rotated_io_handler);
+}
+
+TEST_F (TailWatcherTest, ReadTruncatedFileFromHead) {
+    writeFile(m_path, "a1\na2\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)2, m_lines.size());
+
+    /* copytruncate, and lines written before the truncation is noticed */
+    truncate(m_path.c_str(), 0);
+    writeFile(m_path, "b1\n");
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("b1", m_lines[2]);
+    EXPECT_EQ(3, m_pe->readPos());
+    EXPECT_EQ(0, m_rotations);
+
+    /* truncated while not watched */
+    closeWatcher();
+    m_lines.clear();
+    truncate(m_path.c_str(), 0);
+    writeFile(m_path, "c1\n");
+    m_pe->updatePos(100);
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+    EXPECT_EQ("c1", m_lines[0]);
+}
+
+TEST_F (TailWatcherTest, HoldLineInTheMiddleOfWriting) {
+    writeFile(m_path, "a1\na");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)1, m_lines.size());
+    EXPECT_EQ(3, m_pe->readPos());
+
+    writeFile(m_path, "2\nb");
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+
+    /* the last line is not completed any more once unwatched */
+    closeWatcher();
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("b", m_lines[2]);
+}
+
+TEST_F (TailWatcherTest, PauseWhileOutputIsFull) {
+    writeFile(m_path, "a1\na2\na3\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    m_tw->m_max_line_at_once = 1;
+    SequenceOutput *output = (SequenceOutput *)m_tw->getOutput();
+    output->m_full_after = 2;
+
+    /* stops after the batch which filled it up */
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ(6, m_pe->readPos());
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)2, m_lines.size());
+
+    /* lines left are read as soon as it is drained */
+    output->m_full_after = 0;
+    output->notifyBackpressure(false);
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("a3", m_lines[2]);
+    EXPECT_EQ(9, m_pe->readPos());
+}
+
+TEST_F (TailWatcherTest, ReadAgainLinesNotSent) {
+    writeFile(m_path, "a1\na2\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    SequenceOutput *output = (SequenceOutput *)m_tw->getOutput();
+    output->m_failures = 2;
+
+    TailWatcher::onNotify(m_tw);
+    EXPECT_TRUE(m_lines.empty());
+    EXPECT_EQ(0, m_pe->readPos());
+    EXPECT_FALSE(m_tw->isFullyRead());
+
+    /* lines accepted later are not skipped */
+    writeFile(m_path, "a3\n");
+    TailWatcher::onNotify(m_tw);
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_EQ("a1", m_lines[0]);
+    EXPECT_EQ("a3", m_lines[2]);
+    EXPECT_EQ(9, m_pe->readPos());
+    EXPECT_EQ(2, m_tw->m_metrics->get(METRIC_PRODUCE_FAILURES));
+}
+
+TEST_F (TailWatcherTest, FullyReadOnlyWhenSent) {
+    writeFile(m_path, "a1\na2\na3\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    m_tw->m_max_line_at_once = 1;
+    SequenceOutput *output = (SequenceOutput *)m_tw->getOutput();
+    output->m_full_after = 2;
+
+    /* a paused watcher is silent, but not done */
+    TailWatcher::onNotify(m_tw);
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_FALSE(m_tw->isFullyRead());
+
+    output->m_full_after = 0;
+    output->notifyBackpressure(false);
+    ASSERT_EQ((size_t)3, m_lines.size());
+    EXPECT_TRUE(m_tw->isFullyRead());
+
+    /* a last line without newline is left to drain() */
+    writeFile(m_path, "a4");
+    TailWatcher::onNotify(m_tw);
+    EXPECT_TRUE(m_tw->isFullyRead());
+    writeFile(m_path, "\na5");
+    EXPECT_FALSE(m_tw->isFullyRead());
+}
+
+TEST_F (TailWatcherTest, RunPipelineBeforeOutput) {
+    StageConf stage_conf;
+    stage_conf.stage = "drop_empty";
+    m_conf.stages.push_back(stage_conf);
+    writeFile(m_path, "a1\n\na2\n");
+    ASSERT_TRUE(initWatcher(m_path));
+    TailWatcher::onNotify(m_tw);
+
+    ASSERT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ("a2", m_lines[1]);
+    EXPECT_EQ(1, m_tw->m_metrics->get(METRIC_LINES_DROPPED));
+
+    /* a batch dropped as a whole is not read again */
+    writeFile(m_path, "\n\n");
+    TailWatcher::onNotify(m_tw);
+    EXPECT_EQ((size_t)2, m_lines.size());
+    EXPECT_EQ(9, m_pe->readPos());
+    EXPECT_EQ(3, m_tw->m_metrics->get(METRIC_LINES_DROPPED));
+}
+
+TEST_F (TailWatcherTest, StressRenameCreate) {
+    runStress(ROTATE_RENAME);
+}
+
+TEST_F (TailWatcherTest, StressCopyTruncate) {
+    runStress(ROTATE_COPYTRUNCATE);
+}
+
+TEST_F (TailWatcherTest, StressDeleteCreate) {
+    runStress(ROTATE_DELETE);
+}
+
+TEST_F (TailWatcherTest, StressTimeFormatRollover) {
+    runStress(ROTATE_TIME_FORMAT);
+}
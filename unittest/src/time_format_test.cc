@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "base/dir_cache.h"
+#include "base/time_format.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+
+class TimeFormatTest: public ::testing::Test {
+protected:
+    TimeFormatTest() {
+    }
+
+    virtual ~TimeFormatTest() {
+    }
+
+    virtual void SetUp() {
+    }
+
+    virtual void TearDown() {
+    }
+
+public:
+    static time_t localTime(int year, int mon, int mday, int hour);
+};
+
+time_t TimeFormatTest::localTime(int year, int mon, int mday, int hour) {
+    struct tm tm = {0};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = mon - 1;
+    tm.tm_mday = mday;
+    tm.tm_hour = hour;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+TEST_F (TimeFormatTest, Parse) {
+    TimeFormat format;
+    ASSERT_TRUE(format.init("access_log.%Y%m%d%H"));
+    EXPECT_TRUE(format.isOrdered());
+    EXPECT_EQ("access_log.", format.getPrefix());
+
+    time_t t;
+    EXPECT_TRUE(format.parse("access_log.2015070809", t));
+    EXPECT_EQ(localTime(2015, 7, 8, 9), t);
+    EXPECT_FALSE(format.parse("access_log.201507080", t));
+    EXPECT_FALSE(format.parse("access_log.2015070809.gz", t));
+    EXPECT_FALSE(format.parse("access_log.2015130809", t));
+    EXPECT_FALSE(format.parse("error_log.2015070809", t));
+
+    ASSERT_TRUE(format.init("app-%d-%m-%Y_%H.log"));
+    EXPECT_FALSE(format.isOrdered());
+    EXPECT_TRUE(format.parse("app-08-07-2015_09.log", t));
+    EXPECT_EQ(localTime(2015, 7, 8, 9), t);
+
+    ASSERT_TRUE(format.init("app.%F.log"));
+    EXPECT_TRUE(format.parse("app.2015-07-08.log", t));
+    EXPECT_EQ(localTime(2015, 7, 8, 0), t);
+
+    EXPECT_FALSE(format.init("app.%b.log"));
+}
+
+TEST_F (TimeFormatTest, DirCache) {
+    char dir[] = "/tmp/logkafka_test.dirXXXXXX";
+    ASSERT_TRUE(NULL != mkdtemp(dir));
+    string d = dir;
+    std::ofstream((d + "/b").c_str());
+    std::ofstream((d + "/a").c_str());
+
+    DirCache cache;
+    const vector<string> *names = cache.list(d);
+    ASSERT_TRUE(NULL != names);
+    ASSERT_EQ((size_t)2, names->size());
+    EXPECT_EQ("a", (*names)[0]);
+    EXPECT_TRUE(cache.exists(d + "/b"));
+    EXPECT_FALSE(cache.exists(d + "/c"));
+
+    /* served from cache once the directory settles */
+    cache.m_listings[d].unsettled = false;
+    unsigned long reads = cache.getReads();
+    cache.list(d);
+    EXPECT_EQ(reads, cache.getReads());
+
+    /* read again when the directory changes */
+    cache.m_listings[d].mtime -= 10;
+    std::ofstream((d + "/c").c_str());
+    EXPECT_TRUE(cache.exists(d + "/c"));
+    EXPECT_EQ(reads + 1, cache.getReads());
+
+    string cmd = "rm -rf " + d;
+    system(cmd.c_str());
+    EXPECT_TRUE(NULL == cache.list(d));
+}
@@ -0,0 +1,177 @@
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "base/tools.h"
+#include "easylogging/easylogging++.h"
+#define protected public
+#define private public
+#include "logkafka/zookeeper.h"
+#undef protected
+#undef private
+#include "gtest/gtest.h"
+
+using namespace base;
+using namespace logkafka;
+
+namespace {
+
+const int BROKER_NUM = 64;
+
+struct BrokerReads
+{
+    ZnodeRefresh *refresh;
+    int begin;
+    int end;
+};
+
+void completeBrokerReads(void *arg)
+{
+    BrokerReads *reads = reinterpret_cast<BrokerReads *>(arg);
+    for (int i = reads->begin; i < reads->end; ++i) {
+        string info = "{\"host\":\"broker" + int2Str(i) + "\",\"port\":9092}";
+        ZnodeRead *read = new ZnodeRead();
+        read->refresh = reads->refresh;
+        read->index = i;
+        Zookeeper::onBrokerInfoComplete(ZOK, info.data(), info.length(), 
+                NULL, read);
+    }
+}
+
+}
+
+TEST (ZookeeperTest, ParseBrokerInfo) {
+    string url;
+    string info = "{\"jmx_port\":-1,\"host\":\"k1\",\"version\":1,\"port\":9092}";
+    EXPECT_TRUE(Zookeeper::parseBrokerInfo(info.data(), info.length(), url));
+    EXPECT_EQ("k1:9092", url);
+
+    EXPECT_FALSE(Zookeeper::parseBrokerInfo(NULL, -1, url));
+    EXPECT_FALSE(Zookeeper::parseBrokerInfo("{\"host\":", 8, url));
+}
+
+TEST (ZookeeperTest, BrokerReadsFanIn) {
+    Zookeeper zookeeper;
+    zookeeper.m_broker_urls = "stale:9092";
+
+    ZnodeRefresh *refresh = new ZnodeRefresh(NULL, 2, 
+            Zookeeper::applyBrokerUrls, &zookeeper);
+    refresh->m_values.resize(BROKER_NUM);
+    refresh->addPending(BROKER_NUM);
+
+    /* completions of pipelined reads arrive from other threads */
+    uv_thread_t threads[2];
+    BrokerReads reads[2] = {{refresh, 0, BROKER_NUM / 2}, 
+        {refresh, BROKER_NUM / 2, BROKER_NUM}};
+    for (int i = 0; i < BROKER_NUM; ++i) {
+        refresh->ref();
+    }
+    for (int i = 0; i < 2; ++i) {
+        uv_thread_create(&threads[i], completeBrokerReads, &reads[i]);
+    }
+
+    EXPECT_TRUE(refresh->wait());
+    for (int i = 0; i < 2; ++i) {
+        uv_thread_join(&threads[i]);
+    }
+
+    string urls = zookeeper.getBrokerUrls();
+    EXPECT_EQ(0U, urls.find("broker0:9092,broker1:9092,"));
+    EXPECT_EQ(string::npos, urls.find("stale"));
+    EXPECT_EQ(2, zookeeper.m_broker_urls_seq);
+    EXPECT_EQ(1, zookeeper.getBrokerUrlsVersion());
+
+    /* an older refresh completing later is dropped */
+    ZnodeRefresh *older = new ZnodeRefresh(NULL, 1, 
+            Zookeeper::applyBrokerUrls, &zookeeper);
+    older->m_values.push_back("old:9092");
+    older->addPending(1);
+    older->done(true);
+    EXPECT_TRUE(older->wait());
+    EXPECT_EQ(urls, zookeeper.getBrokerUrls());
+
+    /* the same brokers again keep the version */
+    ZnodeRefresh *same = new ZnodeRefresh(NULL, 3, 
+            Zookeeper::applyBrokerUrls, &zookeeper);
+    same->m_values = refresh->m_values;
+    same->addPending(1);
+    same->done(true);
+    EXPECT_TRUE(same->wait());
+    EXPECT_EQ(1, zookeeper.getBrokerUrlsVersion());
+    same->unref();
+
+    older->unref();
+    refresh->unref();
+}
+
+TEST (ZookeeperTest, KeepOwnClientZnode) {
+    clientid_t client_id;
+    memset(&client_id, 0, sizeof(client_id));
+    client_id.client_id = 0x1234;
+    struct Stat stat;
+    memset(&stat, 0, sizeof(stat));
+
+    /* a persistent znode, or one left by the session before */
+    EXPECT_FALSE(Zookeeper::isOwnEphemeral(&stat, &client_id));
+    stat.ephemeralOwner = 0x1233;
+    EXPECT_FALSE(Zookeeper::isOwnEphemeral(&stat, &client_id));
+
+    stat.ephemeralOwner = 0x1234;
+    EXPECT_TRUE(Zookeeper::isOwnEphemeral(&stat, &client_id));
+    EXPECT_FALSE(Zookeeper::isOwnEphemeral(&stat, NULL));
+}
+
+TEST (ZookeeperTest, WatchesArmedOnce) {
+    Zookeeper zookeeper;
+    zookeeper.m_config_watch_armed = 1;
+    zookeeper.m_brokers_watch_armed = 1;
+
+    /* session events of a live session keep the watches */
+    Zookeeper::configChangeWatcher(NULL, ZOO_SESSION_EVENT, 
+            ZOO_CONNECTED_STATE, "", &zookeeper);
+    Zookeeper::brokerChangeWatcher(NULL, ZOO_SESSION_EVENT, 
+            ZOO_CONNECTING_STATE, "", &zookeeper);
+    EXPECT_EQ(1, zookeeper.m_config_watch_armed);
+    EXPECT_EQ(1, zookeeper.m_brokers_watch_armed);
+
+    /* a fired watch is armed again, all of them if the session is lost */
+    Zookeeper::configChangeWatcher(NULL, ZOO_CHANGED_EVENT, 
+            ZOO_CONNECTED_STATE, "", &zookeeper);
+    EXPECT_EQ(0, zookeeper.m_config_watch_armed);
+    EXPECT_EQ(1, zookeeper.m_brokers_watch_armed);
+    Zookeeper::brokerChangeWatcher(NULL, ZOO_SESSION_EVENT, 
+            ZOO_EXPIRED_SESSION_STATE, "", &zookeeper);
+    EXPECT_EQ(0, zookeeper.m_brokers_watch_armed);
+
+    /* a failed watch is armed on the next refresh */
+    zookeeper.m_config_watch_armed = 1;
+    ZnodeRefresh *refresh = new ZnodeRefresh(NULL, 1, 
+            Zookeeper::applyWatchers, &zookeeper);
+    refresh->addPending(1);
+    refresh->ref();
+    Zookeeper::onConfigWatchComplete(ZCONNECTIONLOSS, NULL, 0, NULL, refresh);
+    EXPECT_FALSE(refresh->wait());
+    EXPECT_EQ(0, zookeeper.m_config_watch_armed);
+    refresh->unref();
+}
+
+TEST (ZookeeperTest, ClientEpoch) {
+    Zookeeper zookeeper;
+    unsigned long epoch = zookeeper.getClientEpoch();
+
+    /* a client znode created by a racing refresh is no new one */
+    for (int i = 0; i < 2; ++i) {
+        ZnodeRefresh *refresh = new ZnodeRefresh(NULL, 1, 
+                Zookeeper::applyWatchers, &zookeeper);
+        refresh->addPending(1);
+        refresh->ref();
+        Zookeeper::onClientCreateComplete(0 == i ? ZOK : ZNODEEXISTS, 
+                NULL, refresh);
+        EXPECT_TRUE(refresh->wait());
+        refresh->unref();
+    }
+    EXPECT_EQ(epoch + 1, zookeeper.getClientEpoch());
+}